@@ -0,0 +1,40 @@
+#!/bin/bash -ex
+
+function cleanup() {
+    rbd snap purge foo || :
+    rbd rm foo || :
+    rbd snap purge foo.copy || :
+    rbd rm foo.copy || :
+    rm -f foo.diff foo.out
+}
+
+cleanup
+
+rbd create foo --size 1000
+rbd bench-write foo --io-size 4096 --io-threads 5 --io-total 4096000
+
+rbd create foo.copy --size 1000
+rbd export-diff foo - | rbd import-diff - foo.copy
+
+rbd snap create foo --snap=two
+rbd bench-write foo --io-size 4096 --io-threads 5 --io-total 4096000
+rbd snap create foo --snap=three
+rbd snap create foo.copy --snap=two
+
+rbd export-diff foo@three --from-snap two foo.diff
+rbd import-diff foo.diff foo.copy
+rbd snap ls foo.copy | grep three
+
+# the copy now matches the original at each snapshot
+rbd export foo@two foo.out
+rbd export foo.copy@two - | cmp - foo.out
+rm foo.out
+rbd export foo@three foo.out
+rbd export foo.copy@three - | cmp - foo.out
+
+# a diff cannot be applied twice
+! rbd import-diff foo.diff foo.copy
+
+cleanup
+
+echo OK
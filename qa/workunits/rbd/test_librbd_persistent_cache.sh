@@ -0,0 +1,12 @@
+#!/bin/sh -ex
+
+# run the librbd tests with every writable image open going through a
+# persistent cache log.  the excluded tests look at objects on the OSDs
+# right after writing, or open the same image twice.
+dir=`mktemp -d`
+trap "rm -rf $dir" EXIT
+
+CEPH_ARGS="$CEPH_ARGS --rbd-persistent-cache=true --rbd-persistent-cache-path=$dir --rbd-persistent-cache-size=67108864" \
+    test_librbd --gtest_filter=-LibRBD.ObjectMapPP:LibRBD.ObjectMapClonePP:LibRBD.DiscardPP
+
+exit 0
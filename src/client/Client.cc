@@ -5209,6 +5209,26 @@ Fh *Client::_create_fh(Inode *in, int flags, int cmode)
   f->inode = in;
   f->inode->get();
 
+  // readahead
+  const md_config_t *conf = cct->_conf;
+  uint64_t period = (uint64_t)in->layout.fl_stripe_count *
+    (uint64_t)in->layout.fl_object_size;
+  uint64_t max_readahead = 0;
+  if (conf->client_readahead_max_bytes)
+    max_readahead = conf->client_readahead_max_bytes;
+  if (conf->client_readahead_max_periods) {
+    uint64_t max_periods = conf->client_readahead_max_periods * period;
+    if (!max_readahead || max_periods < max_readahead)
+      max_readahead = max_periods;
+  }
+  vector<uint64_t> alignments;
+  alignments.push_back(period);
+  alignments.push_back(in->layout.fl_stripe_unit);
+  f->readahead.set_trigger_requests(1);
+  f->readahead.set_min_readahead_size(conf->client_readahead_min);
+  f->readahead.set_max_readahead_size(max_readahead);
+  f->readahead.set_alignments(alignments);
+
   ldout(cct, 10) << "_create_fh " << in->ino << " mode " << cmode << dendl;
 
   if (in->snapid != CEPH_NOSNAP) {
@@ -5431,19 +5451,6 @@ int Client::_read(Fh *f, int64_t offset, uint64_t size, bufferlist *bl)
     unlock_fh_pos(f);
   }
 
-  // adjust readahead state
-  if (f->last_pos != offset) {
-    f->nr_consec_read = f->consec_read_bytes = 0;
-  } else {
-    f->nr_consec_read++;
-  }
-  f->consec_read_bytes += bl->length();
-  ldout(cct, 10) << "readahead nr_consec_read " << f->nr_consec_read
-	   << " for " << f->consec_read_bytes << " bytes" 
-	   << " .. last_pos " << f->last_pos << " .. offset " << offset
-	   << dendl;
-  f->last_pos = offset+bl->length();
-
   // done!
   put_cap_ref(in, CEPH_CAP_FILE_RD);
   return r;
@@ -5451,71 +5458,20 @@ int Client::_read(Fh *f, int64_t offset, uint64_t size, bufferlist *bl)
 
 int Client::_read_async(Fh *f, uint64_t off, uint64_t len, bufferlist *bl)
 {
-  const md_config_t *conf = cct->_conf;
   Inode *in = f->inode;
-  bool readahead = true;
 
   ldout(cct, 10) << "_read_async " << *in << " " << off << "~" << len << dendl;
 
   // trim read based on file size?
   if (off >= in->size)
     return 0;
-  if (off + len > in->size) {
-    len = in->size - off;    
-    readahead = false;
-  }
+  if (off + len > in->size)
+    len = in->size - off;
 
   // we will populate the cache here
   if (in->cap_refs[CEPH_CAP_FILE_CACHE] == 0)
     in->get_cap_ref(CEPH_CAP_FILE_CACHE);
   
-  ldout(cct, 10) << "readahead=" << readahead << " nr_consec=" << f->nr_consec_read
-	   << " max_byes=" << conf->client_readahead_max_bytes
-	   << " max_periods=" << conf->client_readahead_max_periods << dendl;
-
-  // readahead?
-  if (readahead &&
-      f->nr_consec_read &&
-      (conf->client_readahead_max_bytes ||
-       conf->client_readahead_max_periods)) {
-    loff_t l = f->consec_read_bytes * 2;
-    if (conf->client_readahead_min)
-      l = MAX(l, conf->client_readahead_min);
-    if (conf->client_readahead_max_bytes)
-      l = MIN(l, conf->client_readahead_max_bytes);
-    loff_t p = in->layout.fl_stripe_count * in->layout.fl_object_size;
-    if (conf->client_readahead_max_periods)
-      l = MIN(l, conf->client_readahead_max_periods * p);
-
-    if (l >= 2*p)
-      // align large readahead with period
-      l -= (off+l) % p;
-    else {
-      // align readahead with stripe unit if we cross su boundary
-      int su = in->layout.fl_stripe_unit;
-      if ((off+l)/su != off/su) l -= (off+l) % su;
-    }
-    
-    // don't read past end of file
-    if (off+l > in->size)
-      l = in->size - off;
-    
-    loff_t min = MIN((loff_t)len, l/2);
-
-    ldout(cct, 20) << "readahead " << f->nr_consec_read << " reads " 
-	     << f->consec_read_bytes << " bytes ... readahead " << off << "~" << l
-	     << " min " << min
-	     << " (caller wants " << off << "~" << len << ")" << dendl;
-    if (l > (loff_t)len) {
-      if (objectcacher->file_is_cached(&in->oset, &in->layout, in->snapid, off, min))
-	ldout(cct, 20) << "readahead already have min" << dendl;
-      else {
-	objectcacher->file_read(&in->oset, &in->layout, in->snapid, off, l, NULL, 0, 0);
-	ldout(cct, 20) << "readahead initiated" << dendl;
-      }
-    }
-  }
-  
   // read (and possibly block)
   int r, rvalue = 0;
   Mutex flock("Client::_read_async flock");
@@ -5524,6 +5480,17 @@ int Client::_read_async(Fh *f, uint64_t off, uint64_t len, bufferlist *bl)
   Context *onfinish = new C_SafeCond(&flock, &cond, &done, &rvalue);
   r = objectcacher->file_read(&in->oset, &in->layout, in->snapid,
                               off, len, bl, 0, onfinish);
+
+  // readahead?  (no buffer and no completion: this only warms the cache)
+  pair<uint64_t, uint64_t> readahead_extent = f->readahead.update(off, len, in->size);
+  if (readahead_extent.second > 0) {
+    ldout(cct, 20) << "readahead " << readahead_extent.first << "~" << readahead_extent.second
+		   << " (caller wants " << off << "~" << len << ")" << dendl;
+    objectcacher->file_read(&in->oset, &in->layout, in->snapid,
+			    readahead_extent.first, readahead_extent.second,
+			    NULL, 0, 0);
+  }
+
   if (r == 0) {
     client_lock.Unlock();
     flock.Lock();
@@ -80,6 +80,9 @@ cls_method_handle_t h_snapshot_add;
 cls_method_handle_t h_snapshot_remove;
 cls_method_handle_t h_get_all_features;
 cls_method_handle_t h_copyup;
+cls_method_handle_t h_object_map_load;
+cls_method_handle_t h_object_map_resize;
+cls_method_handle_t h_object_map_update;
 cls_method_handle_t h_get_id;
 cls_method_handle_t h_set_id;
 cls_method_handle_t h_dir_get_id;
@@ -1372,6 +1375,183 @@ int copyup(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
 }
 
 
+/******************** rbd_object_map object methods **********************/
+
+/*
+ * The object map is stored as the object's data: the number of
+ * objects it covers (__le64), followed by one bit per object, set if
+ * the object may exist.  Bit n lives in byte n / 8 of the bitmap.
+ */
+static const unsigned OBJECT_MAP_HEADER_LEN = sizeof(uint64_t);
+
+static int object_map_read(cls_method_context_t hctx, uint64_t *num_objs,
+			   bufferlist *bits)
+{
+  uint64_t size;
+  int r = cls_cxx_stat(hctx, &size, NULL);
+  if (r < 0)
+    return r;
+  if (size < OBJECT_MAP_HEADER_LEN)
+    return -EIO;
+
+  bufferlist bl;
+  r = cls_cxx_read(hctx, 0, size, &bl);
+  if (r < 0) {
+    CLS_ERR("object_map_read: error reading object map: %d", r);
+    return r;
+  }
+
+  try {
+    bufferlist::iterator iter = bl.begin();
+    ::decode(*num_objs, iter);
+    iter.copy(bl.length() - OBJECT_MAP_HEADER_LEN, *bits);
+  } catch (const buffer::error &err) {
+    return -EIO;
+  }
+  if (bits->length() < (*num_objs + 7) / 8) {
+    CLS_ERR("object_map_read: map of %llu objects is only %u bytes",
+	    (unsigned long long)*num_objs, bits->length());
+    return -EIO;
+  }
+  return 0;
+}
+
+/**
+ * Input:
+ * @param none
+ *
+ * Output:
+ * @param num_objs number of objects covered by the map (uint64_t)
+ * @param bits the bitmap (bufferlist)
+ * @returns 0 on success, negative error code on failure
+ */
+int object_map_load(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  uint64_t num_objs;
+  bufferlist bits;
+  int r = object_map_read(hctx, &num_objs, &bits);
+  if (r < 0)
+    return r;
+
+  ::encode(num_objs, *out);
+  ::encode(bits, *out);
+  return 0;
+}
+
+/**
+ * Create the object map, or change the number of objects it covers.
+ * Objects added by growing the map are marked nonexistent.
+ *
+ * Input:
+ * @param num_objs number of objects to cover (uint64_t)
+ *
+ * Output:
+ * @returns 0 on success, negative error code on failure
+ */
+int object_map_resize(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  uint64_t num_objs;
+  try {
+    bufferlist::iterator iter = in->begin();
+    ::decode(num_objs, iter);
+  } catch (const buffer::error &err) {
+    return -EINVAL;
+  }
+
+  uint64_t old_num_objs = 0;
+  bufferlist old_bits;
+  int r = object_map_read(hctx, &old_num_objs, &old_bits);
+  if (r < 0 && r != -ENOENT)
+    return r;
+
+  CLS_LOG(20, "object_map_resize %llu -> %llu",
+	  (unsigned long long)old_num_objs, (unsigned long long)num_objs);
+
+  uint64_t len = (num_objs + 7) / 8;
+  bufferptr bits(len);
+  bits.zero();
+  if (len && old_bits.length())
+    old_bits.copy(0, MIN(len, (uint64_t)old_bits.length()), bits.c_str());
+
+  // clear anything past the end so that a later grow starts clean
+  if (num_objs % 8)
+    bits[len - 1] &= (1 << (num_objs % 8)) - 1;
+
+  bufferlist bl;
+  ::encode(num_objs, bl);
+  bl.append(bits);
+  return cls_cxx_write_full(hctx, &bl);
+}
+
+/**
+ * Set the state of objects [start, end) in the object map.  Objects
+ * past the end of the map are ignored.
+ *
+ * Input:
+ * @param start first object to update (uint64_t)
+ * @param end one past the last object to update (uint64_t)
+ * @param exists whether the objects may exist (bool)
+ *
+ * Output:
+ * @returns 0 on success, negative error code on failure
+ */
+int object_map_update(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  uint64_t start, end;
+  bool exists;
+  try {
+    bufferlist::iterator iter = in->begin();
+    ::decode(start, iter);
+    ::decode(end, iter);
+    ::decode(exists, iter);
+  } catch (const buffer::error &err) {
+    return -EINVAL;
+  }
+
+  bufferlist headerbl;
+  int r = cls_cxx_read(hctx, 0, OBJECT_MAP_HEADER_LEN, &headerbl);
+  if (r < 0)
+    return r;
+  if (headerbl.length() < OBJECT_MAP_HEADER_LEN)
+    return -ENOENT;
+
+  uint64_t num_objs;
+  bufferlist::iterator iter = headerbl.begin();
+  ::decode(num_objs, iter);
+
+  end = MIN(end, num_objs);
+  if (start >= end)
+    return 0;
+
+  CLS_LOG(20, "object_map_update [%llu, %llu) exists=%d",
+	  (unsigned long long)start, (unsigned long long)end, (int)exists);
+
+  // only read and rewrite the bytes that cover the range
+  uint64_t first_byte = start / 8;
+  uint64_t last_byte = (end - 1) / 8;
+  uint64_t len = last_byte - first_byte + 1;
+  bufferlist bl;
+  r = cls_cxx_read(hctx, OBJECT_MAP_HEADER_LEN + first_byte, len, &bl);
+  if (r < 0)
+    return r;
+  if (bl.length() != len)
+    return -EIO;
+
+  bufferptr bits(bl.c_str(), len);
+  for (uint64_t i = start; i < end; ++i) {
+    char mask = 1 << (i % 8);
+    if (exists)
+      bits[i / 8 - first_byte] |= mask;
+    else
+      bits[i / 8 - first_byte] &= ~mask;
+  }
+
+  bufferlist outbl;
+  outbl.append(bits);
+  return cls_cxx_write(hctx, OBJECT_MAP_HEADER_LEN + first_byte, len, &outbl);
+}
+
+
 /************************ rbd_id object methods **************************/
 
 /**
@@ -2087,6 +2267,17 @@ void __cls_init()
 			  CLS_METHOD_RD,
 			  get_children, &h_get_children);
 
+  /* methods for the rbd_object_map.$image_id objects */
+  cls_register_cxx_method(h_class, "object_map_load",
+			  CLS_METHOD_RD,
+			  object_map_load, &h_object_map_load);
+  cls_register_cxx_method(h_class, "object_map_resize",
+			  CLS_METHOD_RD | CLS_METHOD_WR,
+			  object_map_resize, &h_object_map_resize);
+  cls_register_cxx_method(h_class, "object_map_update",
+			  CLS_METHOD_RD | CLS_METHOD_WR,
+			  object_map_update, &h_object_map_update);
+
   /* methods for the rbd_id.$image_name objects */
   cls_register_cxx_method(h_class, "get_id",
 			  CLS_METHOD_RD,
@@ -631,5 +631,60 @@ namespace librbd {
       ::encode(id, in);
       return ioctx->exec(oid, "rbd", "dir_rename_image", in, out);
     }
+
+    int object_map_load(librados::IoCtx *ioctx, const std::string &oid,
+			std::vector<bool> *object_map)
+    {
+      bufferlist in, out;
+      int r = ioctx->exec(oid, "rbd", "object_map_load", in, out);
+      if (r < 0)
+	return r;
+
+      uint64_t num_objs;
+      bufferlist bits;
+      try {
+	bufferlist::iterator iter = out.begin();
+	::decode(num_objs, iter);
+	::decode(bits, iter);
+      } catch (const buffer::error &err) {
+	return -EBADMSG;
+      }
+      if (bits.length() < (num_objs + 7) / 8)
+	return -EBADMSG;
+
+      const char *p = bits.c_str();
+      object_map->resize(num_objs);
+      for (uint64_t i = 0; i < num_objs; ++i)
+	(*object_map)[i] = p[i / 8] & (1 << (i % 8));
+      return 0;
+    }
+
+    int object_map_resize(librados::IoCtx *ioctx, const std::string &oid,
+			  uint64_t num_objs)
+    {
+      bufferlist in, out;
+      ::encode(num_objs, in);
+      return ioctx->exec(oid, "rbd", "object_map_resize", in, out);
+    }
+
+    int object_map_update(librados::IoCtx *ioctx, const std::string &oid,
+			  uint64_t start, uint64_t end, bool exists)
+    {
+      bufferlist in, out;
+      ::encode(start, in);
+      ::encode(end, in);
+      ::encode(exists, in);
+      return ioctx->exec(oid, "rbd", "object_map_update", in, out);
+    }
+
+    void object_map_update(librados::ObjectWriteOperation *op,
+			   uint64_t start, uint64_t end, bool exists)
+    {
+      bufferlist in;
+      ::encode(start, in);
+      ::encode(end, in);
+      ::encode(exists, in);
+      op->exec("rbd", "object_map_update", in);
+    }
   } // namespace cls_client
 } // namespace librbd
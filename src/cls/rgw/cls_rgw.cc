@@ -42,6 +42,33 @@ static uint64_t get_rounded_size(uint64_t size)
   return (size + ROUND_BLOCK_SIZE - 1) & ~(ROUND_BLOCK_SIZE - 1);
 }
 
+/*
+ * Appended to a common prefix, gives a key that sorts after all the keys
+ * starting with it.  Object names are utf-8, which never has a 0xff byte.
+ */
+#define LIST_PREFIX_END "\xff"
+
+/* keys read at a time after seeking past a common prefix */
+#define LIST_SEEK_CHUNK 8
+
+/*
+ * If the key has the delimiter in it past the listed prefix, get the
+ * common prefix it is listed under.
+ */
+static bool list_common_prefix(const string& key, const string& filter_prefix,
+                               const string& delimiter, string *prefix)
+{
+  if (delimiter.empty() || key.compare(0, filter_prefix.size(), filter_prefix) != 0)
+    return false;
+
+  size_t pos = key.find(delimiter, filter_prefix.size());
+  if (pos == string::npos)
+    return false;
+
+  *prefix = key.substr(0, pos + delimiter.size());
+  return true;
+}
+
 int rgw_bucket_list(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
 {
   bufferlist::iterator iter = in->begin();
@@ -68,33 +95,64 @@ int rgw_bucket_list(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
     return -EINVAL;
   }
 
-  bufferlist bl;
+  string start_key = op.start_obj;
+  string prefix;
 
-  map<string, bufferlist> keys;
-  rc = cls_cxx_map_get_vals(hctx, op.start_obj, op.filter_prefix, op.num_entries + 1, &keys);
-  if (rc < 0)
-    return rc;
+  /* a marker within a common prefix means the prefix was listed already */
+  if (list_common_prefix(op.start_obj, op.filter_prefix, op.delimiter, &prefix))
+    start_key = prefix + LIST_PREFIX_END;
 
   std::map<string, struct rgw_bucket_dir_entry>& m = new_dir.m;
-  std::map<string, bufferlist>::iterator kiter = keys.begin();
-  uint32_t i;
+  uint32_t count = 0;
+  uint64_t chunk = (uint64_t)op.num_entries + 1;
 
-  for (i = 0; i < op.num_entries && kiter != keys.end(); ++i, ++kiter) {
-    struct rgw_bucket_dir_entry entry;
-    bufferlist& entrybl = kiter->second;
-    bufferlist::iterator eiter = entrybl.begin();
-    try {
-      ::decode(entry, eiter);
-    } catch (buffer::error& err) {
-      CLS_LOG(1, "ERROR: rgw_bucket_list(): failed to decode entry, key=%s\n", kiter->first.c_str());
-      return -EINVAL;
+  do {
+    map<string, bufferlist> keys;
+    uint64_t max = min((uint64_t)op.num_entries - count + 1, chunk);
+    rc = cls_cxx_map_get_vals(hctx, start_key, op.filter_prefix, max, &keys);
+    if (rc < 0)
+      return rc;
+    ret.omap_reads++;
+
+    std::map<string, bufferlist>::iterator kiter;
+    for (kiter = keys.begin(); kiter != keys.end(); ++kiter) {
+      if (count == op.num_entries) {
+        ret.is_truncated = true;
+        goto done;
+      }
+      count++;
+
+      if (list_common_prefix(kiter->first, op.filter_prefix, op.delimiter, &prefix)) {
+        /* skip everything else under this prefix, the next keys are
+         * likely to be in yet another one, so read a few at a time */
+        ret.common_prefixes.insert(prefix);
+        start_key = prefix + LIST_PREFIX_END;
+        chunk = LIST_SEEK_CHUNK;
+        break;
+      }
+
+      struct rgw_bucket_dir_entry entry;
+      bufferlist& entrybl = kiter->second;
+      bufferlist::iterator eiter = entrybl.begin();
+      try {
+        ::decode(entry, eiter);
+      } catch (buffer::error& err) {
+        CLS_LOG(1, "ERROR: rgw_bucket_list(): failed to decode entry, key=%s\n", kiter->first.c_str());
+        return -EINVAL;
+      }
+
+      m[kiter->first] = entry;
+      start_key = kiter->first;
     }
-    
-    m[kiter->first] = entry;
-  }
 
-  ret.is_truncated = (kiter != keys.end());
+    if (kiter == keys.end()) {
+      if (keys.size() < max)
+        break; /* nothing more to read */
+      chunk *= 2;
+    }
+  } while (true);
 
+done:
   ::encode(ret, *out);
   return 0;
 }
@@ -1115,37 +1173,53 @@ static int rgw_cls_gc_list(cls_method_context_t hctx, bufferlist *in, bufferlist
   return 0;
 }
 
+/*
+ * Remove the entries for all the tags at once: one lookup of their name
+ * index keys, and one removal of those and their time index keys.
+ */
 static int gc_remove(cls_method_context_t hctx, list<string>& tags)
 {
+  set<string> name_keys;
   list<string>::iterator iter;
 
+  for (iter = tags.begin(); iter != tags.end(); ++iter) {
+    string key;
+    prepend_index_prefix(*iter, GC_OBJ_NAME_INDEX, &key);
+    name_keys.insert(key);
+  }
+
+  map<string, bufferlist> vals;
+  int ret = cls_cxx_map_get_vals_by_keys(hctx, name_keys, &vals);
+  if (ret < 0)
+    return ret;
+
+  set<string> rm_keys;
   for (iter = tags.begin(); iter != tags.end(); ++iter) {
     string& tag = *iter;
-    cls_rgw_gc_obj_info info;
-    int ret = gc_omap_get(hctx, GC_OBJ_NAME_INDEX, tag, &info);
-    if (ret == -ENOENT) {
+    string key;
+    prepend_index_prefix(tag, GC_OBJ_NAME_INDEX, &key);
+
+    map<string, bufferlist>::iterator viter = vals.find(key);
+    if (viter == vals.end()) {
       CLS_LOG(0, "couldn't find tag in name index tag=%s\n", tag.c_str());
       continue;
     }
+    rm_keys.insert(key);
 
-    if (ret < 0)
-      return ret;
+    cls_rgw_gc_obj_info info;
+    if (gc_record_decode(viter->second, info) < 0)
+      continue;
 
-    string time_key;
+    string time_key, index;
     get_time_key(info.time, &time_key);
-    ret = gc_omap_remove(hctx, GC_OBJ_TIME_INDEX, time_key);
-    if (ret < 0 && ret != -ENOENT)
-      return ret;
-    if (ret == -ENOENT) {
-      CLS_LOG(0, "couldn't find key in time index key=%s\n", time_key.c_str());
-    }
-
-    ret = gc_omap_remove(hctx, GC_OBJ_NAME_INDEX, tag);
-    if (ret < 0 && ret != -ENOENT)
-      return ret;
+    prepend_index_prefix(time_key, GC_OBJ_TIME_INDEX, &index);
+    rm_keys.insert(index);
   }
 
-  return 0;
+  if (rm_keys.empty())
+    return 0;
+
+  return cls_cxx_map_remove_keys(hctx, rm_keys);
 }
 
 static int rgw_cls_gc_remove(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
@@ -1,6 +1,7 @@
 #include <errno.h>
 
 #include "include/types.h"
+#include "include/ceph_hash.h"
 #include "cls/rgw/cls_rgw_ops.h"
 #include "include/rados/librados.hpp"
 
@@ -55,13 +56,15 @@ void cls_rgw_bucket_complete_op(ObjectWriteOperation& o, uint8_t op, string& tag
 
 int cls_rgw_list_op(IoCtx& io_ctx, string& oid, string& start_obj,
                     string& filter_prefix, uint32_t num_entries,
-                    rgw_bucket_dir *dir, bool *is_truncated)
+                    rgw_bucket_dir *dir, bool *is_truncated,
+                    const string& delimiter, set<string> *common_prefixes)
 {
   bufferlist in, out;
   struct rgw_cls_list_op call;
   call.start_obj = start_obj;
   call.filter_prefix = filter_prefix;
   call.num_entries = num_entries;
+  call.delimiter = delimiter;
   ::encode(call, in);
   int r = io_ctx.exec(oid, "rgw", "bucket_list", in, out);
   if (r < 0)
@@ -79,6 +82,8 @@ int cls_rgw_list_op(IoCtx& io_ctx, string& oid, string& start_obj,
     *dir = ret.dir;
   if (is_truncated)
     *is_truncated = ret.is_truncated;
+  if (common_prefixes)
+    common_prefixes->swap(ret.common_prefixes);
 
  return r;
 }
@@ -153,6 +158,164 @@ int cls_rgw_get_dir_header(IoCtx& io_ctx, string& oid, rgw_bucket_dir_header *he
  return r;
 }
 
+/* sharded bucket index */
+
+int cls_rgw_bucket_shard_id(const string& name, uint32_t num_shards)
+{
+  if (!num_shards)
+    return 0;
+  return ceph_str_hash_linux(name.c_str(), name.size()) % num_shards;
+}
+
+static string shard_oid(const string& base_oid, int shard)
+{
+  char buf[16];
+  snprintf(buf, sizeof(buf), ".%d", shard);
+  return base_oid + buf;
+}
+
+void cls_rgw_bucket_shard_oid(const string& base_oid, uint32_t num_shards,
+                              const string& name, string& oid)
+{
+  if (!num_shards) {
+    oid = base_oid;
+    return;
+  }
+  oid = shard_oid(base_oid, cls_rgw_bucket_shard_id(name, num_shards));
+}
+
+void cls_rgw_bucket_shard_oids(const string& base_oid, uint32_t num_shards,
+                               vector<string>& oids)
+{
+  oids.clear();
+  if (!num_shards) {
+    oids.push_back(base_oid);
+    return;
+  }
+  for (uint32_t i = 0; i < num_shards; i++)
+    oids.push_back(shard_oid(base_oid, i));
+}
+
+/*
+ * send the same call to all the shards at once, and wait for all of them
+ */
+static int exec_all_shards(IoCtx& io_ctx, vector<string>& oids, const char *method,
+                           bufferlist& in, vector<bufferlist>& outs)
+{
+  vector<AioCompletion *> completions;
+  outs.resize(oids.size());
+  int r = 0;
+  for (size_t i = 0; i < oids.size(); i++) {
+    AioCompletion *c = Rados::aio_create_completion(NULL, NULL, NULL);
+    r = io_ctx.aio_exec(oids[i], c, "rgw", method, in, &outs[i]);
+    if (r < 0) {
+      c->release();
+      break;
+    }
+    completions.push_back(c);
+  }
+  for (size_t i = 0; i < completions.size(); i++) {
+    completions[i]->wait_for_complete();
+    int ret = completions[i]->get_return_value();
+    if (ret < 0 && r >= 0)
+      r = ret;
+    completions[i]->release();
+  }
+  return r;
+}
+
+int cls_rgw_list_op(IoCtx& io_ctx, vector<string>& oids, string& start_obj,
+                    string& filter_prefix, uint32_t num_entries,
+                    rgw_bucket_dir *dir, bool *is_truncated,
+                    const string& delimiter, set<string> *common_prefixes)
+{
+  bufferlist in;
+  struct rgw_cls_list_op call;
+  call.start_obj = start_obj;
+  call.filter_prefix = filter_prefix;
+  call.num_entries = num_entries;
+  call.delimiter = delimiter;
+  ::encode(call, in);
+  vector<bufferlist> outs;
+  int r = exec_all_shards(io_ctx, oids, "bucket_list", in, outs);
+  if (r < 0)
+    return r;
+
+  struct rgw_bucket_dir merged;
+  set<string> merged_prefixes;
+  bool truncated = false;
+  for (size_t i = 0; i < outs.size(); i++) {
+    struct rgw_cls_list_ret ret;
+    try {
+      bufferlist::iterator iter = outs[i].begin();
+      ::decode(ret, iter);
+    } catch (buffer::error& err) {
+      return -EIO;
+    }
+    merged.header.aggregate(ret.dir.header);
+    merged.m.insert(ret.dir.m.begin(), ret.dir.m.end());
+    merged_prefixes.insert(ret.common_prefixes.begin(), ret.common_prefixes.end());
+    if (ret.is_truncated)
+      truncated = true;
+  }
+
+  /* every shard returned its first num_entries (a common prefix counting
+   * as one); past that many, the merged list may be missing entries from
+   * a shard that was cut short */
+  if (merged.m.size() + merged_prefixes.size() > num_entries) {
+    map<string, struct rgw_bucket_dir_entry>::iterator miter = merged.m.begin();
+    set<string>::iterator piter = merged_prefixes.begin();
+    for (uint32_t i = 0; i < num_entries; i++) {
+      if (piter == merged_prefixes.end() ||
+          (miter != merged.m.end() && miter->first < *piter))
+        ++miter;
+      else
+        ++piter;
+    }
+    merged.m.erase(miter, merged.m.end());
+    merged_prefixes.erase(piter, merged_prefixes.end());
+    truncated = true;
+  }
+
+  if (dir) {
+    dir->header = merged.header;
+    dir->m.swap(merged.m);
+  }
+  if (is_truncated)
+    *is_truncated = truncated;
+  if (common_prefixes)
+    common_prefixes->swap(merged_prefixes);
+
+  return 0;
+}
+
+int cls_rgw_get_dir_headers(IoCtx& io_ctx, vector<string>& oids,
+                            vector<rgw_bucket_dir_header> *headers)
+{
+  bufferlist in;
+  struct rgw_cls_list_op call;
+  call.num_entries = 0;
+  ::encode(call, in);
+  vector<bufferlist> outs;
+  int r = exec_all_shards(io_ctx, oids, "bucket_list", in, outs);
+  if (r < 0)
+    return r;
+
+  headers->resize(outs.size());
+  for (size_t i = 0; i < outs.size(); i++) {
+    struct rgw_cls_list_ret ret;
+    try {
+      bufferlist::iterator iter = outs[i].begin();
+      ::decode(ret, iter);
+    } catch (buffer::error& err) {
+      return -EIO;
+    }
+    (*headers)[i] = ret.dir.header;
+  }
+
+  return 0;
+}
+
 int cls_rgw_usage_log_read(IoCtx& io_ctx, string& oid, string& user,
                            uint64_t start_epoch, uint64_t end_epoch, uint32_t max_entries,
                            string& read_iter, map<rgw_user_bucket, rgw_usage_log_entry>& usage,
@@ -19,7 +19,8 @@ void cls_rgw_bucket_complete_op(librados::ObjectWriteOperation& o, uint8_t op, s
 
 int cls_rgw_list_op(librados::IoCtx& io_ctx, string& oid, string& start_obj,
                     string& filter_prefix, uint32_t num_entries,
-                    rgw_bucket_dir *dir, bool *is_truncated);
+                    rgw_bucket_dir *dir, bool *is_truncated,
+                    const string& delimiter = "", set<string> *common_prefixes = NULL);
 
 int cls_rgw_bucket_check_index_op(librados::IoCtx& io_ctx, string& oid,
 				  rgw_bucket_dir_header *existing_header,
@@ -32,6 +33,20 @@ void cls_rgw_encode_suggestion(char op, rgw_bucket_dir_entry& dirent, bufferlist
 
 void cls_rgw_suggest_changes(librados::ObjectWriteOperation& o, bufferlist& updates);
 
+/* sharded bucket index */
+int cls_rgw_bucket_shard_id(const string& name, uint32_t num_shards);
+void cls_rgw_bucket_shard_oid(const string& base_oid, uint32_t num_shards,
+                              const string& name, string& oid);
+void cls_rgw_bucket_shard_oids(const string& base_oid, uint32_t num_shards,
+                               vector<string>& oids);
+
+int cls_rgw_list_op(librados::IoCtx& io_ctx, vector<string>& oids, string& start_obj,
+                    string& filter_prefix, uint32_t num_entries,
+                    rgw_bucket_dir *dir, bool *is_truncated,
+                    const string& delimiter = "", set<string> *common_prefixes = NULL);
+int cls_rgw_get_dir_headers(librados::IoCtx& io_ctx, vector<string>& oids,
+                            vector<rgw_bucket_dir_header> *headers);
+
 /* usage logging */
 int cls_rgw_usage_log_read(librados::IoCtx& io_ctx, string& oid, string& user,
                            uint64_t start_epoch, uint64_t end_epoch, uint32_t max_entries,
@@ -104,22 +104,26 @@ struct rgw_cls_list_op
   string start_obj;
   uint32_t num_entries;
   string filter_prefix;
+  string delimiter; /* if set, entries past it are returned as common prefixes */
 
   rgw_cls_list_op() : num_entries(0) {}
 
   void encode(bufferlist &bl) const {
-    ENCODE_START(3, 2, bl);
+    ENCODE_START(4, 2, bl);
     ::encode(start_obj, bl);
     ::encode(num_entries, bl);
     ::encode(filter_prefix, bl);
+    ::encode(delimiter, bl);
     ENCODE_FINISH(bl);
   }
   void decode(bufferlist::iterator &bl) {
-    DECODE_START_LEGACY_COMPAT_LEN(3, 2, 2, bl);
+    DECODE_START_LEGACY_COMPAT_LEN(4, 2, 2, bl);
     ::decode(start_obj, bl);
     ::decode(num_entries, bl);
     if (struct_v >= 3)
       ::decode(filter_prefix, bl);
+    if (struct_v >= 4)
+      ::decode(delimiter, bl);
     DECODE_FINISH(bl);
   }
   void dump(Formatter *f) const;
@@ -131,19 +135,27 @@ struct rgw_cls_list_ret
 {
   rgw_bucket_dir dir;
   bool is_truncated;
+  set<string> common_prefixes;
+  uint32_t omap_reads; /* omap reads the class did for this listing */
 
-  rgw_cls_list_ret() : is_truncated(false) {}
+  rgw_cls_list_ret() : is_truncated(false), omap_reads(0) {}
 
   void encode(bufferlist &bl) const {
-    ENCODE_START(2, 2, bl);
+    ENCODE_START(3, 2, bl);
     ::encode(dir, bl);
     ::encode(is_truncated, bl);
+    ::encode(common_prefixes, bl);
+    ::encode(omap_reads, bl);
     ENCODE_FINISH(bl);
   }
   void decode(bufferlist::iterator &bl) {
-    DECODE_START_LEGACY_COMPAT_LEN(2, 2, 2, bl);
+    DECODE_START_LEGACY_COMPAT_LEN(3, 2, 2, bl);
     ::decode(dir, bl);
     ::decode(is_truncated, bl);
+    if (struct_v >= 3) {
+      ::decode(common_prefixes, bl);
+      ::decode(omap_reads, bl);
+    }
     DECODE_FINISH(bl);
   }
   void dump(Formatter *f) const;
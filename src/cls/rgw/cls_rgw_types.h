@@ -165,6 +165,19 @@ struct rgw_bucket_dir_header {
 
   rgw_bucket_dir_header() : tag_timeout(0) {}
 
+  /// add in the stats of another shard of the same bucket index
+  void aggregate(const rgw_bucket_dir_header& other) {
+    map<uint8_t, rgw_bucket_category_stats>::const_iterator iter;
+    for (iter = other.stats.begin(); iter != other.stats.end(); ++iter) {
+      rgw_bucket_category_stats& s = stats[iter->first];
+      s.total_size += iter->second.total_size;
+      s.total_size_rounded += iter->second.total_size_rounded;
+      s.num_entries += iter->second.num_entries;
+    }
+    if (other.tag_timeout > tag_timeout)
+      tag_timeout = other.tag_timeout;
+  }
+
   void encode(bufferlist &bl) const {
     ENCODE_START(3, 2, bl);
     ::encode(stats, bl);
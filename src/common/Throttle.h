@@ -5,6 +5,7 @@
 #include "Cond.h"
 #include <list>
 #include "include/atomic.h"
+#include "include/Context.h"
 
 class CephContext;
 class PerfCounters;
@@ -54,5 +55,41 @@ public:
   int64_t put(int64_t c = 1);
 };
 
+/**
+ * simple throttle for a fixed number of concurrent operations
+ *
+ * Used to keep at most max operations in flight, e.g. aio requests
+ * issued from a loop.  start_op() blocks until a slot is free;
+ * end_op() releases it and records the first error seen, which
+ * wait_for_ret() returns once everything has drained.  If
+ * ignore_enoent is set, -ENOENT results are not treated as errors.
+ */
+class SimpleThrottle {
+public:
+  SimpleThrottle(uint64_t max, bool ignore_enoent);
+  ~SimpleThrottle();
+  void start_op();
+  void end_op(int r);
+  int wait_for_ret();
+private:
+  Mutex m_lock;
+  Cond m_cond;
+  uint64_t m_max;
+  uint64_t m_current;
+  int m_ret;
+  bool m_ignore_enoent;
+};
+
+class C_SimpleThrottle : public Context {
+public:
+  C_SimpleThrottle(SimpleThrottle *throttle) : m_throttle(throttle) {
+    m_throttle->start_op();
+  }
+  virtual void finish(int r) {
+    m_throttle->end_op(r);
+  }
+private:
+  SimpleThrottle *m_throttle;
+};
 
 #endif
@@ -341,6 +341,7 @@ OPTION(osd_auto_mark_unfound_lost, OPT_BOOL, false)
 OPTION(osd_recovery_delay_start, OPT_FLOAT, 0)
 OPTION(osd_recovery_max_active, OPT_INT, 5)
 OPTION(osd_recovery_max_chunk, OPT_U64, 8<<20)  // max size of push chunk
+OPTION(osd_recovery_batch_ops, OPT_BOOL, true)  // pack small objects into one push/pull message, up to osd_recovery_max_chunk
 OPTION(osd_recovery_forget_lost_objects, OPT_BOOL, false)   // off for now
 OPTION(osd_max_scrubs, OPT_INT, 1)
 OPTION(osd_scrub_load_threshold, OPT_FLOAT, 0.5)
@@ -437,6 +438,17 @@ OPTION(rbd_cache_size, OPT_LONGLONG, 32<<20)         // cache size in bytes
 OPTION(rbd_cache_max_dirty, OPT_LONGLONG, 24<<20)    // dirty limit in bytes - set to 0 for write-through caching
 OPTION(rbd_cache_target_dirty, OPT_LONGLONG, 16<<20) // target dirty limit in bytes
 OPTION(rbd_cache_max_dirty_age, OPT_FLOAT, 1.0)      // seconds in cache before writeback starts
+OPTION(rbd_readahead_trigger_requests, OPT_INT, 10) // number of sequential requests necessary to trigger readahead
+OPTION(rbd_readahead_min_bytes, OPT_LONGLONG, 128*1024) // size of the first readahead window
+OPTION(rbd_readahead_max_bytes, OPT_LONGLONG, 512*1024) // largest readahead window; set to 0 to disable readahead
+OPTION(rbd_persistent_cache, OPT_BOOL, false) // log writes to the image head to a local file, and write them back in the background
+OPTION(rbd_persistent_cache_path, OPT_STR, "/var/lib/ceph/rbd-cache") // directory (or mount point) to keep the logs in
+OPTION(rbd_persistent_cache_size, OPT_LONGLONG, 1ULL<<30) // size of each log in bytes
+OPTION(rbd_persistent_cache_writeback_ops, OPT_INT, 16) // how many writes to keep in flight while writing back a log
+OPTION(rbd_clone_copy_on_read, OPT_BOOL, false) // copy objects of a clone up from the parent when they are read
+OPTION(rbd_clone_copy_on_read_max_ops, OPT_INT, 4) // copy-ups triggered by reads to keep in flight; more are skipped
+OPTION(rbd_concurrent_management_ops, OPT_INT, 10) // how many object ops copy, flatten, remove, resize and rollback keep in flight
+OPTION(rbd_concurrent_discard_ops, OPT_INT, 16) // whole-object removes from discards to keep in flight per image
 
 OPTION(nss_db_path, OPT_STR, "") // path to nss db
 
@@ -444,7 +456,15 @@ OPTION(rgw_data, OPT_STR, "/var/lib/ceph/radosgw/$cluster-$id")
 OPTION(rgw_enable_apis, OPT_STR, "s3, swift, swift_auth, admin")
 OPTION(rgw_cache_enabled, OPT_BOOL, true)   // rgw cache enabled
 OPTION(rgw_cache_lru_size, OPT_INT, 10000)   // num of entries in rgw cache
+OPTION(rgw_cache_shards, OPT_INT, 16)   // num of independently locked parts of the rgw cache
+OPTION(rgw_cache_ttl, OPT_INT, 0)   // seconds before a cache entry expires (0 - never)
+OPTION(rgw_cache_negative_ttl, OPT_INT, 30)   // seconds before a cached ENOENT expires (0 - never)
 OPTION(rgw_socket_path, OPT_STR, "")   // path to unix domain socket, if not specified, rgw will not run as external fcgi
+OPTION(rgw_frontend, OPT_STR, "fastcgi")   // how requests reach rgw: fastcgi (through a web server) or http (embedded server)
+OPTION(rgw_http_addr, OPT_STR, "")   // address the http frontend listens on (empty - all)
+OPTION(rgw_http_port, OPT_INT, 7480)   // port the http frontend listens on
+OPTION(rgw_http_keepalive, OPT_BOOL, true)   // let http clients send more requests on a connection
+OPTION(rgw_http_timeout, OPT_INT, 60)   // seconds an http connection may sit idle, or stall a read or write
 OPTION(rgw_dns_name, OPT_STR, "")
 OPTION(rgw_swift_url, OPT_STR, "")             // the swift url, being published by the internal swift auth
 OPTION(rgw_swift_url_prefix, OPT_STR, "swift") // entry point for which a url is considered a swift url
@@ -463,6 +483,8 @@ OPTION(rgw_remote_addr_param, OPT_STR, "REMOTE_ADDR")  // e.g. X-Forwarded-For,
 OPTION(rgw_op_thread_timeout, OPT_INT, 10*60)
 OPTION(rgw_op_thread_suicide_timeout, OPT_INT, 0)
 OPTION(rgw_thread_pool_size, OPT_INT, 100)
+OPTION(rgw_async_ops, OPT_BOOL, false) // let GETs and PUTs give up their thread while waiting for rados
+OPTION(rgw_max_concurrent_requests, OPT_INT, 1024) // with rgw_async_ops, requests to handle at once (otherwise twice rgw_thread_pool_size)
 OPTION(rgw_num_control_oids, OPT_INT, 8)
 
 OPTION(rgw_cluster_root_pool, OPT_STR, ".rgw.root")
@@ -476,6 +498,9 @@ OPTION(rgw_enable_usage_log, OPT_BOOL, false) // enable logging bandwidth usage
 OPTION(rgw_ops_log_rados, OPT_BOOL, true) // whether ops log should go to rados
 OPTION(rgw_ops_log_socket_path, OPT_STR, "") // path to unix domain socket where ops log can go
 OPTION(rgw_ops_log_data_backlog, OPT_INT, 5 << 20) // max data backlog for ops log
+OPTION(rgw_ops_log_flush_interval, OPT_INT, 5) // write pending rados ops log entries every X seconds
+OPTION(rgw_ops_log_flush_size, OPT_INT, 128 << 10) // write pending rados ops log entries once this many bytes are pending
+OPTION(rgw_ops_log_max_pending, OPT_INT, 16 << 20) // drop rados ops log entries beyond this many pending bytes
 OPTION(rgw_usage_log_flush_threshold, OPT_INT, 1024) // threshold to flush pending log data
 OPTION(rgw_usage_log_tick_interval, OPT_INT, 30) // flush pending log data every X seconds
 OPTION(rgw_intent_log_object_name, OPT_STR, "%Y-%m-%d-%i-%n")  // man date to see codes (a subset are supported)
@@ -486,10 +511,21 @@ OPTION(rgw_gc_max_objs, OPT_INT, 32)
 OPTION(rgw_gc_obj_min_wait, OPT_INT, 2 * 3600)    // wait time before object may be handled by gc
 OPTION(rgw_gc_processor_max_time, OPT_INT, 3600)  // total run time for a single gc processor work
 OPTION(rgw_gc_processor_period, OPT_INT, 3600)  // gc processor cycle time
+OPTION(rgw_gc_max_concurrent_shards, OPT_INT, 4)  // gc shards processed in parallel
+OPTION(rgw_gc_max_concurrent_io, OPT_INT, 16)  // object removals in flight per gc shard
+OPTION(rgw_gc_max_trim_chunk, OPT_INT, 16)  // processed tags removed from a gc shard in a single op
 OPTION(rgw_s3_success_create_obj_status, OPT_INT, 0) // alternative success status response for create-obj (0 - default)
 OPTION(rgw_resolve_cname, OPT_BOOL, false)  // should rgw try to resolve hostname as a dns cname record
 OPTION(rgw_obj_stripe_size, OPT_INT, 4 << 20)
+OPTION(rgw_get_obj_window_size, OPT_INT, 16 << 20) // bytes of reads to keep in flight for a single GET
+OPTION(rgw_get_obj_max_req_size, OPT_INT, 4 << 20) // max length of a single read for a GET
+OPTION(rgw_put_obj_window_size, OPT_INT, 16 << 20) // bytes of writes to keep in flight for a single PUT
+OPTION(rgw_put_obj_max_req_size, OPT_INT, 4 << 20) // max length of a single write for a PUT
+OPTION(rgw_put_obj_hash_threads, OPT_INT, 0) // threads computing the md5 of uploads (0 - on the request thread)
+OPTION(rgw_put_obj_hash_window, OPT_INT, 8 << 20) // bytes of a single PUT waiting to be hashed
+OPTION(rgw_put_obj_skip_md5_users, OPT_STR, "") // users whose uploads are not hashed, their etag is the supplied md5 or random
 OPTION(rgw_extended_http_attrs, OPT_STR, "") // list of extended attrs that can be set on objects (beyond the default)
+OPTION(rgw_bucket_index_shards, OPT_INT, 0) // number of index objects for new buckets (0 - a single unsharded index object)
 OPTION(rgw_exit_timeout_secs, OPT_INT, 120) // how many seconds to wait for process to go down before exiting unconditionally
 
 OPTION(mutex_perf_counter, OPT_BOOL, false) // enable/disable mutex perf counter
@@ -297,6 +297,9 @@ int ObjBencher::fetch_bench_metadata(const std::string& metadata_file, int* obje
 }
 
 int ObjBencher::write_bench(int secondsToRun, int concurrentios) {
+  if (num_threads > 1)
+    return write_bench_threaded(secondsToRun, concurrentios);
+
   out(cout) << "Maintaining " << concurrentios << " concurrent writes of "
        << data.object_size << " bytes for at least "
        << secondsToRun << " seconds." << std::endl;
@@ -312,7 +315,6 @@ int ObjBencher::write_bench(int secondsToRun, int concurrentios) {
   utime_t start_times[concurrentios];
   utime_t stopTime;
   int r = 0;
-  bufferlist b_write;
   lock_cond lc(&lock);
   utime_t runtime;
   utime_t timePassed;
@@ -449,6 +451,23 @@ int ObjBencher::write_bench(int secondsToRun, int concurrentios) {
 
   pthread_join(print_thread, NULL);
 
+  write_bench_report(timePassed);
+
+  completions_done();
+
+  return 0;
+
+ ERR:
+  lock.Lock();
+  data.done = 1;
+  lock.Unlock();
+  pthread_join(print_thread, NULL);
+  delete newContents;
+  return -5;
+}
+
+void ObjBencher::write_bench_report(utime_t timePassed) {
+  bufferlist b_write;
   double bandwidth;
   bandwidth = ((double)data.finished)*((double)data.object_size)/(double)timePassed;
   bandwidth = bandwidth/(1024*1024); // we want it in MB/sec
@@ -477,18 +496,150 @@ int ObjBencher::write_bench(int secondsToRun, int concurrentios) {
 
   // PID-specific run
   sync_write(generate_metadata_name(), b_write, sizeof(int)*3);
+}
 
-  completions_done();
+void *ObjBencher::write_bench_thread(void *arg) {
+  bench_worker *w = (bench_worker *)arg;
+  w->ret = w->bencher->write_bench_worker(w->first_slot, w->num_slots, w->stop_time);
+  return NULL;
+}
 
-  return 0;
+/*
+ * Each worker keeps its own slots busy until stop_time and then waits
+ * for them to drain.  The shared counters and latency history are
+ * updated under lock, exactly as in the single threaded loop.
+ */
+int ObjBencher::write_bench_worker(int first_slot, int num_slots, utime_t stop_time) {
+  lock_cond lc(&lock);
+  std::vector<bufferlist*> contents(num_slots, (bufferlist*)NULL);
+  std::vector<utime_t> start_times(num_slots);
+  char *object_contents = new char[data.object_size];
+  int outstanding = 0;
+  int ret = 0;
+
+  while (true) {
+    bool submit = ret == 0 && ceph_clock_now(g_ceph_context) < stop_time;
+    if (!submit && !outstanding)
+      break;
+
+    // an idle slot if we are still submitting, else a finished one
+    int i = -1;
+    lock.Lock();
+    while (i < 0) {
+      for (int j = 0; j < num_slots; ++j) {
+	if (contents[j] ? completion_is_done(first_slot + j) : submit) {
+	  i = j;
+	  break;
+	}
+      }
+      if (i < 0)
+	lc.cond.Wait(lock);
+    }
+    lock.Unlock();
+    int slot = first_slot + i;
+
+    if (contents[i]) {
+      completion_wait(slot);
+      lock.Lock();
+      int r = completion_ret(slot);
+      if (r == 0) {
+	data.cur_latency = ceph_clock_now(g_ceph_context) - start_times[i];
+	data.history.latency.push_back(data.cur_latency);
+	if (data.cur_latency > data.max_latency) data.max_latency = data.cur_latency;
+	if (data.cur_latency < data.min_latency) data.min_latency = data.cur_latency;
+	++data.finished;
+	data.avg_latency += ((double)data.cur_latency - data.avg_latency) / data.finished;
+      } else {
+	ret = r;
+      }
+      --data.in_flight;
+      lock.Unlock();
+      release_completion(slot);
+      delete contents[i];
+      contents[i] = NULL;
+      --outstanding;
+      continue;
+    }
 
- ERR:
+    lock.Lock();
+    int n = data.started++;
+    ++data.in_flight;
+    lock.Unlock();
+    contents[i] = new bufferlist();
+    snprintf(object_contents, data.object_size, "I'm the %16dth object!", n);
+    contents[i]->append(object_contents, data.object_size);
+    ++outstanding;
+
+    start_times[i] = ceph_clock_now(g_ceph_context);
+    int r = create_completion(slot, _aio_cb, &lc);
+    if (r == 0) {
+      r = aio_write(generate_object_name(n), slot, *contents[i], data.object_size);
+      if (r < 0)
+	release_completion(slot);
+    }
+    if (r < 0) {
+      lock.Lock();
+      --data.started;
+      --data.in_flight;
+      lock.Unlock();
+      delete contents[i];
+      contents[i] = NULL;
+      --outstanding;
+      ret = r;
+    }
+  }
+
+  delete[] object_contents;
+  return ret;
+}
+
+int ObjBencher::write_bench_threaded(int secondsToRun, int concurrentios) {
+  int nthreads = MIN(num_threads, concurrentios);
+  out(cout) << "Maintaining " << concurrentios << " concurrent writes of "
+       << data.object_size << " bytes from " << nthreads << " threads for at least "
+       << secondsToRun << " seconds." << std::endl;
+  out(cout) << "Object prefix: " << generate_object_prefix() << std::endl;
+
+  int r = completions_init(concurrentios);
+  if (r < 0)
+    return r;
+
+  pthread_t print_thread;
+  pthread_create(&print_thread, NULL, ObjBencher::status_printer, (void *)this);
   lock.Lock();
-  data.done = 1;
+  data.start_time = ceph_clock_now(g_ceph_context);
+  lock.Unlock();
+
+  utime_t runtime;
+  runtime.set_from_double(secondsToRun);
+  std::vector<bench_worker> workers(nthreads);
+  int slot = 0;
+  for (int t = 0; t < nthreads; ++t) {
+    bench_worker &w = workers[t];
+    w.bencher = this;
+    w.first_slot = slot;
+    w.num_slots = concurrentios / nthreads + (t < concurrentios % nthreads ? 1 : 0);
+    w.stop_time = data.start_time + runtime;
+    w.ret = 0;
+    slot += w.num_slots;
+    pthread_create(&w.thread, NULL, ObjBencher::write_bench_thread, (void *)&w);
+  }
+  for (int t = 0; t < nthreads; ++t) {
+    pthread_join(workers[t].thread, NULL);
+    if (workers[t].ret < 0)
+      r = workers[t].ret;
+  }
+
+  utime_t timePassed = ceph_clock_now(g_ceph_context) - data.start_time;
+  lock.Lock();
+  data.done = true;
   lock.Unlock();
   pthread_join(print_thread, NULL);
-  delete newContents;
-  return -5;
+
+  if (r == 0)
+    write_bench_report(timePassed);
+  completions_done();
+  return r < 0 ? -5 : 0;
 }
 
 int ObjBencher::seq_read_bench(int seconds_to_run, int num_objects, int concurrentios, int pid) {
@@ -51,16 +51,31 @@ const int OP_RAND_READ = 3;
 
 class ObjBencher {
   bool show_time;
+  int num_threads;
 protected:
   Mutex lock;
 
   static void *status_printer(void *bencher);
 
+  /// one submitting thread of a multi-threaded write bench
+  struct bench_worker {
+    ObjBencher *bencher;
+    int first_slot;  ///< completion slots [first_slot, first_slot+num_slots)
+    int num_slots;
+    utime_t stop_time;
+    int ret;
+    pthread_t thread;
+  };
+  static void *write_bench_thread(void *arg);
+
   struct bench_data data;
 
   int fetch_bench_metadata(const std::string& metadata_file, int* object_size, int* num_objects, int* prevPid);
 
   int write_bench(int secondsToRun, int concurrentios);
+  int write_bench_threaded(int secondsToRun, int concurrentios);
+  int write_bench_worker(int first_slot, int num_slots, utime_t stop_time);
+  void write_bench_report(utime_t timePassed);
   int seq_read_bench(int secondsToRun, int concurrentios, int num_objects, int writePid);
 
   int clean_up(int num_objects, int prevPid, int concurrentios);
@@ -89,7 +104,7 @@ protected:
   ostream& out(ostream& os);
   ostream& out(ostream& os, utime_t& t);
 public:
-  ObjBencher() : show_time(false), lock("ObjBencher::lock") {}
+  ObjBencher() : show_time(false), num_threads(1), lock("ObjBencher::lock") {}
   virtual ~ObjBencher() {}
   int aio_bench(int operation, int secondsToRun, int concurrentios, int op_size, bool cleanup);
   int clean_up(const std::string& prefix, int concurrentios);
@@ -97,6 +112,11 @@ public:
   void set_show_time(bool dt) {
     show_time = dt;
   }
+  /// submit writes from this many threads, each driving its own share
+  /// of the concurrent ios
+  void set_num_threads(int n) {
+    num_threads = n;
+  }
 };
 
 
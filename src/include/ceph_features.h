@@ -32,6 +32,7 @@
 #define CEPH_FEATURE_CRUSH_TUNABLES2 (1<<25)
 #define CEPH_FEATURE_CREATEPOOLID   (1<<26)
 #define CEPH_FEATURE_REPLY_CREATE_INODE   (1<<27)
+#define CEPH_FEATURE_OSD_PACKED_RECOVERY (1<<28)
 
 /*
  * Features supported.  Should be everything above.
@@ -64,7 +65,8 @@
 	 CEPH_FEATURE_RECOVERY_RESERVATION | \
 	 CEPH_FEATURE_CRUSH_TUNABLES2 |	     \
 	 CEPH_FEATURE_CREATEPOOLID |	     \
-	 CEPH_FEATURE_REPLY_CREATE_INODE)
+	 CEPH_FEATURE_REPLY_CREATE_INODE |   \
+	 CEPH_FEATURE_OSD_PACKED_RECOVERY)
 
 #define CEPH_FEATURES_SUPPORTED_DEFAULT  CEPH_FEATURES_ALL
 
@@ -12,6 +12,7 @@
 #include "buffer.h"
 
 #include "librados.h"
+#include "rados_types.hpp"
 
 namespace librados
 {
@@ -237,6 +238,13 @@ namespace librados
      */
     void omap_rm_keys(const std::set<std::string> &to_rm);
 
+    /**
+     * Roll the object back to a self-managed snapshot
+     *
+     * @param snapid [in] snapshot to roll back to
+     */
+    void selfmanaged_snap_rollback(uint64_t snapid);
+
     friend class IoCtx;
   };
 
@@ -326,6 +334,17 @@ namespace librados
 			       std::map<std::string, bufferlist> *map,
 			       int *prval);
 
+    /**
+     * list_snaps: the clones of an object and the snaps they cover
+     *
+     * The operation must be performed with the read snap set to
+     * SNAP_DIR.
+     *
+     * @param out_snaps [out] clone information on completion
+     * @param prval [out] place error code in prval upon completion
+     */
+    void list_snaps(snap_set_t *out_snaps, int *prval);
+
   };
 
 
@@ -447,6 +466,9 @@ namespace librados
 
     int selfmanaged_snap_rollback(const std::string& oid, uint64_t snapid);
 
+    // List the clones of an object, regardless of the read snap
+    int list_snaps(const std::string& oid, snap_set_t *out_snaps);
+
     ObjectIterator objects_begin();
     const ObjectIterator& objects_end() const;
 
@@ -454,6 +476,23 @@ namespace librados
 
     int aio_read(const std::string& oid, AioCompletion *c,
 		 bufferlist *pbl, size_t len, uint64_t off);
+    /**
+     * Asynchronously read from an object into buffers the caller
+     * provides
+     *
+     * The data is received straight into the buffers in *pbl as it
+     * arrives, so they must not be touched until the read completes.
+     * Afterwards *pbl holds just the data read.
+     *
+     * @param oid the name of the object to read from
+     * @param c what to do when the read is complete
+     * @param pbl buffers of exactly len bytes to read into
+     * @param len the number of bytes to read
+     * @param off the offset to start reading from in the object
+     * @returns 0 on success, negative error code on failure
+     */
+    int aio_read_into(const std::string& oid, AioCompletion *c,
+		      bufferlist *pbl, size_t len, uint64_t off);
     int aio_sparse_read(const std::string& oid, AioCompletion *c,
 			std::map<uint64_t,uint64_t> *m, bufferlist *data_bl,
 			size_t len, uint64_t off);
@@ -0,0 +1,32 @@
+#ifndef CEPH_RADOS_TYPES_HPP
+#define CEPH_RADOS_TYPES_HPP
+
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+namespace librados {
+
+  typedef uint64_t snap_t;
+
+  /// the head (writeable) version of an object
+  const snap_t SNAP_HEAD = (uint64_t)(-2);
+  /// read at this snap to see all of an object's snapshots
+  const snap_t SNAP_DIR = (uint64_t)(-1);
+
+  struct clone_info_t {
+    snap_t cloneid;                    ///< SNAP_HEAD for the head
+    std::vector<snap_t> snaps;         ///< snaps this clone covers, ascending
+    std::vector<std::pair<uint64_t, uint64_t> > overlap;  ///< extents unchanged
+                                       ///< in the next newest clone or head
+    uint64_t size;
+  };
+
+  struct snap_set_t {
+    std::vector<clone_info_t> clones;  ///< ascending, head (if any) last
+    snap_t seq;                        ///< newest snap seq the object has seen
+  };
+
+}
+
+#endif
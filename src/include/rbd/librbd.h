@@ -26,6 +26,7 @@ extern "C" {
 #include <sys/types.h>
 #endif
 #include <string.h>
+#include <sys/uio.h>
 #include "../rados/librados.h"
 #include "features.h"
 
@@ -312,11 +313,65 @@ typedef void (*rbd_callback_t)(rbd_completion_t cb, void *arg);
 ssize_t rbd_read(rbd_image_t image, uint64_t ofs, size_t len, char *buf);
 int64_t rbd_read_iterate(rbd_image_t image, uint64_t ofs, size_t len,
 			 int (*cb)(uint64_t, size_t, const char *, void *), void *arg);
+/**
+ * get difference between two versions of an image
+ *
+ * This will return the differences between two versions of an image
+ * via a callback, which gets the offset and length and a flag
+ * indicating whether the extent exists (1), or is known/defined to
+ * be zeros (a hole, 0).  If the source snapshot name is NULL, we
+ * interpret that as the beginning of time and return all allocated
+ * regions of the image.  The end version is whatever is currently
+ * selected for the image handle (either a snapshot or the writeable
+ * head).  Extents are not reported in any particular order.
+ *
+ * @param fromsnapname start snapshot name, or NULL
+ * @param ofs start offset
+ * @param len len in bytes of region to report on
+ * @param cb callback to call for each allocated region
+ * @param arg argument to pass to the callback
+ * @returns 0 on success, or negative error code on error
+ */
+int rbd_diff_iterate(rbd_image_t image,
+		     const char *fromsnapname,
+		     uint64_t ofs, uint64_t len,
+		     int (*cb)(uint64_t, size_t, int, void *), void *arg);
 ssize_t rbd_write(rbd_image_t image, uint64_t ofs, size_t len, const char *buf);
 int rbd_discard(rbd_image_t image, uint64_t ofs, uint64_t len);
 int rbd_aio_write(rbd_image_t image, uint64_t off, size_t len, const char *buf, rbd_completion_t c);
 int rbd_aio_read(rbd_image_t image, uint64_t off, size_t len, char *buf, rbd_completion_t c);
 int rbd_aio_discard(rbd_image_t image, uint64_t off, uint64_t len, rbd_completion_t c);
+/**
+ * Asynchronously write from a set of buffers
+ *
+ * The buffers are written in order, starting at off, without being
+ * copied, so they must not change until the write completes.
+ *
+ * @param image the image to write to
+ * @param iov the buffers to write
+ * @param iovcnt the number of buffers
+ * @param off where in the image to start writing
+ * @param c what to do when the write is complete
+ * @returns 0 on success, negative error code on failure
+ */
+int rbd_aio_writev(rbd_image_t image, const struct iovec *iov, int iovcnt,
+		   uint64_t off, rbd_completion_t c);
+/**
+ * Asynchronously read into a set of buffers
+ *
+ * The buffers are filled in order with the data starting at off.  When
+ * there is no cache, the data is received directly into them, without
+ * an extra copy.
+ *
+ * @param image the image to read from
+ * @param iov the buffers to read into
+ * @param iovcnt the number of buffers
+ * @param off where in the image to start reading
+ * @param c what to do when the read is complete
+ * @returns 0 on success, negative error code on failure
+ */
+int rbd_aio_readv(rbd_image_t image, const struct iovec *iov, int iovcnt,
+		  uint64_t off, rbd_completion_t c);
 int rbd_aio_create_completion(void *cb_arg, rbd_callback_t complete_cb, rbd_completion_t *c);
 int rbd_aio_wait_for_complete(rbd_completion_t c);
 ssize_t rbd_aio_get_return_value(rbd_completion_t c);
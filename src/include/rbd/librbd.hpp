@@ -154,6 +154,22 @@ public:
   ssize_t read(uint64_t ofs, size_t len, ceph::bufferlist& bl);
   int64_t read_iterate(uint64_t ofs, size_t len,
 		       int (*cb)(uint64_t, size_t, const char *, void *), void *arg);
+  /**
+   * report which parts of the image changed since a snapshot
+   *
+   * See rbd_diff_iterate() for details.
+   *
+   * @param fromsnapname start snapshot name, or NULL for all data
+   * @param ofs start offset
+   * @param len len in bytes of region to report on
+   * @param cb callback for each changed extent: (offset, length,
+   *           exists, arg), where !exists means the extent is now zeros
+   * @param arg argument to pass to the callback
+   * @returns 0 on success, or negative error code on error
+   */
+  int diff_iterate(const char *fromsnapname,
+		   uint64_t ofs, uint64_t len,
+		   int (*cb)(uint64_t, size_t, int, void *), void *arg);
   ssize_t write(uint64_t ofs, size_t len, ceph::bufferlist& bl);
   int discard(uint64_t ofs, uint64_t len);
 
@@ -179,6 +195,22 @@ public:
   int aio_read(uint64_t off, size_t len, ceph::bufferlist& bl, RBD::AioCompletion *c);
   int aio_discard(uint64_t off, uint64_t len, RBD::AioCompletion *c);
 
+  /**
+   * write async from a set of buffers, without copying them
+   *
+   * The buffers must not change until the write completes.
+   */
+  int aio_writev(uint64_t off, const struct iovec *iov, int iovcnt,
+		 RBD::AioCompletion *c);
+  /**
+   * read async into a set of buffers
+   *
+   * When caching is disabled, the data is received directly into the
+   * buffers.
+   */
+  int aio_readv(uint64_t off, const struct iovec *iov, int iovcnt,
+		RBD::AioCompletion *c);
+
   int flush();
 
 private:
@@ -33,6 +33,13 @@
 #define RBD_DATA_PREFIX        "rbd_data."
 #define RBD_ID_PREFIX          "rbd_id."
 
+/*
+ * images with the object map feature also have
+ *   rbd_object_map.<id>     - which data objects may exist
+ */
+
+#define RBD_OBJECT_MAP_PREFIX  "rbd_object_map."
+
 /*
  * old-style rbd image 'foo' consists of objects
  *   foo.rbd      - image metadata
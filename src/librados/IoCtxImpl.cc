@@ -657,6 +657,35 @@ int librados::IoCtxImpl::operate_read(const object_t& oid,
   return r;
 }
 
+int librados::IoCtxImpl::list_snaps(const object_t& oid, snap_set_t *out_snaps)
+{
+  Mutex mylock("IoCtxImpl::list_snaps::mylock");
+  Cond cond;
+  bool done;
+  int r;
+  eversion_t ver;
+
+  ::ObjectOperation op;
+  op.list_snaps(out_snaps, NULL);
+
+  Context *onack = new C_SafeCond(&mylock, &cond, &done, &r);
+
+  lock->Lock();
+  objecter->read(oid, oloc,
+	         op, CEPH_SNAPDIR, NULL, 0,
+	         onack, &ver);
+  lock->Unlock();
+
+  mylock.Lock();
+  while (!done)
+    cond.Wait(mylock);
+  mylock.Unlock();
+
+  set_sync_op_version(ver);
+
+  return r;
+}
+
 int librados::IoCtxImpl::aio_operate_read(const object_t &oid,
 					  ::ObjectOperation *o,
 					  AioCompletionImpl *c, bufferlist *pbl)
@@ -667,10 +696,10 @@ int librados::IoCtxImpl::aio_operate_read(const object_t &oid,
   c->io = this;
   c->pbl = pbl;
 
-  Mutex::Locker l(*lock);
-  objecter->read(oid, oloc,
-		 *o, snap_seq, pbl, 0,
-		 onack, &c->objver);
+  objecter->op_submit_unlocked(
+    objecter->prepare_read_op(oid, oloc,
+			      *o, snap_seq, pbl, 0,
+			      onack, &c->objver));
   return 0;
 }
 
@@ -688,8 +717,9 @@ int librados::IoCtxImpl::aio_operate(const object_t& oid,
   c->io = this;
   queue_aio_write(c);
 
-  Mutex::Locker l(*lock);
-  objecter->mutate(oid, oloc, *o, snapc, ut, 0, onack, oncommit, &c->objver);
+  objecter->op_submit_unlocked(
+    objecter->prepare_mutate_op(oid, oloc, *o, snapc, ut, 0,
+				onack, oncommit, &c->objver));
 
   return 0;
 }
@@ -707,10 +737,34 @@ int librados::IoCtxImpl::aio_read(const object_t oid, AioCompletionImpl *c,
   c->io = this;
   c->pbl = pbl;
 
-  Mutex::Locker l(*lock);
-  objecter->read(oid, oloc,
-		 off, len, snap_seq, &c->bl, 0,
-		 onack, &c->objver);
+  objecter->op_submit_unlocked(
+    objecter->prepare_read_op(oid, oloc,
+			      off, len, snap_seq, &c->bl, 0,
+			      onack, &c->objver));
+  return 0;
+}
+
+int librados::IoCtxImpl::aio_read_into(const object_t oid,
+				       AioCompletionImpl *c,
+				       bufferlist *pbl, size_t len,
+				       uint64_t off)
+{
+  if (len > (size_t) INT_MAX)
+    return -EDOM;
+  if (pbl->length() != len)
+    return -EINVAL;
+
+  Context *onack = new C_aio_Ack(c);
+
+  c->is_read = true;
+  c->io = this;
+
+  // the reply is received straight into the caller's buffers, posted by
+  // the objecter when it sends the op
+  objecter->op_submit_unlocked(
+    objecter->prepare_read_op(oid, oloc,
+			      off, len, snap_seq, pbl, 0,
+			      onack, &c->objver));
   return 0;
 }
 
@@ -727,10 +781,10 @@ int librados::IoCtxImpl::aio_read(const object_t oid, AioCompletionImpl *c,
   c->buf = buf;
   c->maxlen = len;
 
-  Mutex::Locker l(*lock);
-  objecter->read(oid, oloc,
-		 off, len, snap_seq, &c->bl, 0,
-		 onack, &c->objver);
+  objecter->op_submit_unlocked(
+    objecter->prepare_read_op(oid, oloc,
+			      off, len, snap_seq, &c->bl, 0,
+			      onack, &c->objver));
 
   return 0;
 }
@@ -774,10 +828,10 @@ int librados::IoCtxImpl::aio_write(const object_t &oid, AioCompletionImpl *c,
   Context *onack = new C_aio_Ack(c);
   Context *onsafe = new C_aio_Safe(c);
 
-  Mutex::Locker l(*lock);
-  objecter->write(oid, oloc,
-		  off, len, snapc, bl, ut, 0,
-		  onack, onsafe, &c->objver);
+  objecter->op_submit_unlocked(
+    objecter->prepare_write_op(oid, oloc,
+			       off, len, snapc, bl, ut, 0,
+			       onack, onsafe, &c->objver));
 
   return 0;
 }
@@ -797,10 +851,10 @@ int librados::IoCtxImpl::aio_append(const object_t &oid, AioCompletionImpl *c,
   Context *onack = new C_aio_Ack(c);
   Context *onsafe = new C_aio_Safe(c);
 
-  Mutex::Locker l(*lock);
-  objecter->append(oid, oloc,
-		   len, snapc, bl, ut, 0,
-		   onack, onsafe, &c->objver);
+  objecter->op_submit_unlocked(
+    objecter->prepare_append_op(oid, oloc,
+				len, snapc, bl, ut, 0,
+				onack, onsafe, &c->objver));
 
   return 0;
 }
@@ -821,10 +875,10 @@ int librados::IoCtxImpl::aio_write_full(const object_t &oid,
   Context *onack = new C_aio_Ack(c);
   Context *onsafe = new C_aio_Safe(c);
 
-  Mutex::Locker l(*lock);
-  objecter->write_full(oid, oloc,
-		       snapc, bl, ut, 0,
-		       onack, onsafe, &c->objver);
+  objecter->op_submit_unlocked(
+    objecter->prepare_write_full_op(oid, oloc,
+				    snapc, bl, ut, 0,
+				    onack, onsafe, &c->objver));
 
   return 0;
 }
@@ -843,10 +897,10 @@ int librados::IoCtxImpl::aio_remove(const object_t &oid, AioCompletionImpl *c)
   Context *onack = new C_aio_Ack(c);
   Context *onsafe = new C_aio_Safe(c);
 
-  Mutex::Locker l(*lock);
-  objecter->remove(oid, oloc,
-		   snapc, ut, 0,
-		   onack, onsafe, &c->objver);
+  objecter->op_submit_unlocked(
+    objecter->prepare_remove_op(oid, oloc,
+				snapc, ut, 0,
+				onack, onsafe, &c->objver));
 
   return 0;
 }
@@ -104,6 +104,7 @@ struct librados::IoCtxImpl {
   int selfmanaged_snap_remove(uint64_t snapid);
   int selfmanaged_snap_rollback_object(const object_t& oid,
                                        ::SnapContext& snapc, uint64_t snapid);
+  int list_snaps(const object_t& oid, snap_set_t *out_snaps);
 
   // io
   int list(Objecter::ListContext *context, int max_entries);
@@ -173,6 +174,8 @@ struct librados::IoCtxImpl {
 			  bufferlist *pbl, size_t len, uint64_t off);
   int aio_read(object_t oid, AioCompletionImpl *c,
 	       char *buf, size_t len, uint64_t off);
+  int aio_read_into(const object_t oid, AioCompletionImpl *c,
+		    bufferlist *pbl, size_t len, uint64_t off);
   int aio_sparse_read(const object_t oid, AioCompletionImpl *c,
 		      std::map<uint64_t,uint64_t> *m, bufferlist *data_bl,
 		      size_t len, uint64_t off);
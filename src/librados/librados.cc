@@ -222,6 +222,12 @@ void librados::ObjectReadOperation::getxattrs(map<string, bufferlist> *pattrs, i
   o->getxattrs(pattrs, prval);
 }
 
+void librados::ObjectReadOperation::list_snaps(snap_set_t *out_snaps, int *prval)
+{
+  ::ObjectOperation *o = (::ObjectOperation *)impl;
+  o->list_snaps(out_snaps, prval);
+}
+
 void librados::ObjectWriteOperation::create(bool exclusive)
 {
   ::ObjectOperation *o = (::ObjectOperation *)impl;
@@ -312,6 +318,12 @@ void librados::ObjectWriteOperation::omap_rm_keys(
   o->omap_rm_keys(to_rm);
 }
 
+void librados::ObjectWriteOperation::selfmanaged_snap_rollback(uint64_t snapid)
+{
+  ::ObjectOperation *o = (::ObjectOperation *)impl;
+  o->rollback(snapid);
+}
+
 void librados::ObjectWriteOperation::tmap_put(const bufferlist &bl)
 {
   ::ObjectOperation *o = (::ObjectOperation *)impl;
@@ -888,6 +900,11 @@ int librados::IoCtx::rollback(const std::string& oid, const char *snapname)
   return io_ctx_impl->rollback(oid, snapname);
 }
 
+int librados::IoCtx::list_snaps(const std::string& oid, snap_set_t *out_snaps)
+{
+  return io_ctx_impl->list_snaps(oid, out_snaps);
+}
+
 int librados::IoCtx::selfmanaged_snap_create(uint64_t *snapid)
 {
   return io_ctx_impl->selfmanaged_snap_create(snapid);
@@ -931,6 +948,13 @@ int librados::IoCtx::aio_read(const std::string& oid, librados::AioCompletion *c
   return io_ctx_impl->aio_read(oid, c->pc, pbl, len, off);
 }
 
+int librados::IoCtx::aio_read_into(const std::string& oid,
+				   librados::AioCompletion *c,
+				   bufferlist *pbl, size_t len, uint64_t off)
+{
+  return io_ctx_impl->aio_read_into(oid, c->pc, pbl, len, off);
+}
+
 int librados::IoCtx::aio_exec(const std::string& oid,
 			      librados::AioCompletion *c, const char *cls,
 			      const char *method, bufferlist& inbl,
@@ -2,6 +2,7 @@
 // vim: ts=8 sw=2 smarttab
 
 #include <errno.h>
+#include <string.h>
 
 #include "common/ceph_context.h"
 #include "common/dout.h"
@@ -32,7 +33,8 @@ namespace librbd {
 
   void AioCompletion::finalize(CephContext *cct, ssize_t rval)
   {
-    ldout(cct, 20) << "AioCompletion::finalize() " << (void*)this << " rval " << rval << " read_buf " << (void*)read_buf
+    ldout(cct, 20) << "AioCompletion::finalize() " << (void*)this << " rval " << rval
+		   << " read_dest " << read_dest.length()
 		   << " read_bl " << (void*)read_bl << dendl;
     if (rval >= 0 && aio_type == AIO_TYPE_READ) {
       // FIXME: make the destriper write directly into a buffer so
@@ -40,11 +42,10 @@ namespace librbd {
       bufferlist bl;
       destriper.assemble_result(cct, bl, true);
 
-      if (read_buf) {
-	assert(bl.length() == read_buf_len);
-	bl.copy(0, read_buf_len, read_buf);
-	ldout(cct, 20) << "AioCompletion::finalize() copied resulting " << bl.length()
-		       << " bytes to " << (void*)read_buf << dendl;
+      if (read_dest.length()) {
+	uint64_t copied = copy_to_dest(bl);
+	ldout(cct, 20) << "AioCompletion::finalize() copied " << copied
+		       << " of " << bl.length() << " resulting bytes" << dendl;
       }
       if (read_bl) {
 	ldout(cct, 20) << "AioCompletion::finalize() moving resulting " << bl.length()
@@ -54,6 +55,39 @@ namespace librbd {
     }
   }
 
+  uint64_t AioCompletion::copy_to_dest(const bufferlist &bl)
+  {
+    // data read straight into the caller's memory is already in place
+    uint64_t copied = 0;
+    const std::list<bufferptr> &src = bl.buffers();
+    const std::list<bufferptr> &dst = read_dest.buffers();
+    std::list<bufferptr>::const_iterator s = src.begin();
+    std::list<bufferptr>::const_iterator d = dst.begin();
+    unsigned s_off = 0, d_off = 0;
+    while (s != src.end() && d != dst.end()) {
+      if (s_off == s->length()) {
+	++s;
+	s_off = 0;
+	continue;
+      }
+      if (d_off == d->length()) {
+	++d;
+	d_off = 0;
+	continue;
+      }
+      unsigned len = MIN(s->length() - s_off, d->length() - d_off);
+      const char *from = s->c_str() + s_off;
+      char *to = const_cast<char *>(d->c_str()) + d_off;
+      if (from != to) {
+	memcpy(to, from, len);
+	copied += len;
+      }
+      s_off += len;
+      d_off += len;
+    }
+    return copied;
+  }
+
   void AioCompletion::complete_request(CephContext *cct, ssize_t r)
   {
     ldout(cct, 20) << "AioCompletion::complete_request() "
@@ -24,6 +24,7 @@ namespace librbd {
     AIO_TYPE_READ = 0,
     AIO_TYPE_WRITE,
     AIO_TYPE_DISCARD,
+    AIO_TYPE_WRITEBACK,
     AIO_TYPE_NONE,
   } aio_type_t;
 
@@ -57,8 +58,7 @@ namespace librbd {
 
     Striper::StripedReadResult destriper;
     bufferlist *read_bl;
-    char *read_buf;
-    size_t read_buf_len;
+    bufferlist read_dest; ///< caller's memory to read into, if any
 
     AioCompletion() : lock("AioCompletion::lock", true),
 		      done(false), rval(0), complete_cb(NULL),
@@ -66,7 +66,7 @@ namespace librbd {
 		      pending_count(0), building(true),
 		      ref(1), released(false), ictx(NULL),
 		      aio_type(AIO_TYPE_NONE),
-		      read_bl(NULL), read_buf(NULL), read_buf_len(0) {
+		      read_bl(NULL) {
     }
     ~AioCompletion() {
     }
@@ -87,6 +87,8 @@ namespace librbd {
     }
 
     void finalize(CephContext *cct, ssize_t rval);
+    /// copy the parts of a read result not already in read_dest there
+    uint64_t copy_to_dest(const bufferlist &bl);
 
     void finish_adding_requests(CephContext *cct);
 
@@ -110,6 +112,8 @@ namespace librbd {
 	ictx->perfcounter->tinc(l_librbd_aio_wr_latency, elapsed); break;
       case AIO_TYPE_DISCARD:
 	ictx->perfcounter->tinc(l_librbd_aio_discard_latency, elapsed); break;
+      case AIO_TYPE_WRITEBACK:
+	ictx->perfcounter->tinc(l_librbd_pcache_writeback_latency, elapsed); break;
       default:
 	lderr(ictx->cct) << "completed invalid aio_type: " << aio_type << dendl;
 	break;
@@ -90,6 +90,12 @@ namespace librbd {
       }
     }
 
+    if (m_tried_parent && r >= 0 && m_snap_id == CEPH_NOSNAP &&
+	!m_ictx->read_only && m_ictx->cct->_conf->rbd_clone_copy_on_read) {
+      // save the next read of this object the trip to the parent
+      copy_on_read(m_ictx, m_object_no);
+    }
+
     return true;
   }
 
@@ -103,8 +109,9 @@ namespace librbd {
       r = m_ioctx.aio_sparse_read(m_oid, rados_completion, &m_ext_map,
 				  &m_read_data, m_object_len, m_object_off);
     } else {
-      r = m_ioctx.aio_read(m_oid, rados_completion, &m_read_data,
-			   m_object_len, m_object_off);
+      // m_read_data holds the slices of the caller's buffers
+      r = m_ioctx.aio_read_into(m_oid, rados_completion, &m_read_data,
+				m_object_len, m_object_off);
     }
     rados_completion->release();
     return r;
@@ -114,6 +121,7 @@ namespace librbd {
 
   AbstractWrite::AbstractWrite()
     : m_state(LIBRBD_AIO_WRITE_FLAT),
+      m_creates_object(true),
       m_parent_overlap(0) {}
   AbstractWrite::AbstractWrite(ImageCtx *ictx, const std::string &oid,
 			       uint64_t object_no, uint64_t object_off, uint64_t len,
@@ -123,7 +131,8 @@ namespace librbd {
 			       Context *completion,
 			       bool hide_enoent)
     : AioRequest(ictx, oid, object_no, object_off, len, snap_id, completion, hide_enoent),
-      m_state(LIBRBD_AIO_WRITE_FLAT)
+      m_state(LIBRBD_AIO_WRITE_FLAT),
+      m_creates_object(true)
   {
     m_object_image_extents = objectx;
     m_parent_overlap = object_overlap;
@@ -229,8 +238,32 @@ namespace librbd {
     return finished;
   }
 
+  class C_SendWrite : public Context {
+  public:
+    C_SendWrite(AbstractWrite *req) : m_req(req) {}
+    virtual void finish(int r) {
+      if (r >= 0)
+	r = m_req->send_write();
+      if (r < 0)
+	m_req->complete(r);
+    }
+  private:
+    AbstractWrite *m_req;
+  };
+
   int AbstractWrite::send() {
     ldout(m_ictx->cct, 20) << "send " << this << " " << m_oid << " " << m_object_off << "~" << m_object_len << dendl;
+    if (m_creates_object) {
+      // the first write to an object waits for its object map bit
+      Context *ctx = new C_SendWrite(this);
+      if (m_ictx->object_map.aio_mark_exists(m_object_no, ctx))
+	return 0;
+      delete ctx;
+    }
+    return send_write();
+  }
+
+  int AbstractWrite::send_write() {
     librados::AioCompletion *rados_completion =
       librados::Rados::aio_create_completion(this, NULL, rados_req_cb);
     int r;
@@ -107,6 +107,9 @@ namespace librbd {
       return !m_object_image_extents.empty();
     }
 
+    // once the object is in the object map
+    int send_write();
+
   private:
     /**
      * Writes go through the following state machine to deal with
@@ -134,6 +137,7 @@ namespace librbd {
     virtual void add_copyup_ops() = 0;
 
     write_state_d m_state;
+    bool m_creates_object; // so it must be in the object map first
     vector<pair<uint64_t,uint64_t> > m_object_image_extents;
     uint64_t m_parent_overlap;
     librados::ObjectWriteOperation m_write;
@@ -183,10 +187,12 @@ namespace librbd {
 		      objectx, object_overlap,
 		      snapc, snap_id, completion,
 		      true) {
-      if (has_parent())
+      if (has_parent()) {
 	m_write.truncate(0);
-      else
+      } else {
 	m_write.remove();
+	m_creates_object = false;
+      }
     }
     virtual ~AioRemove() {}
 
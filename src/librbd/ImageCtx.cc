@@ -7,7 +7,9 @@
 #include "common/errno.h"
 #include "common/perf_counters.h"
 
+#include "librbd/AioRequest.h"
 #include "librbd/internal.h"
+#include "librbd/PersistentCache.h"
 #include "librbd/WatchCtx.h"
 
 #include "librbd/ImageCtx.h"
@@ -44,12 +46,18 @@ namespace librbd {
       snap_lock("librbd::ImageCtx::snap_lock"),
       parent_lock("librbd::ImageCtx::parent_lock"),
       refresh_lock("librbd::ImageCtx::refresh_lock"),
+      copy_on_read_lock("librbd::ImageCtx::copy_on_read_lock"),
+      discard_lock("librbd::ImageCtx::discard_lock"),
       old_format(true),
       order(0), size(0), features(0),
       format_string(NULL),
       id(image_id), parent(NULL),
       stripe_unit(0), stripe_count(0),
-      object_cacher(NULL), writeback_handler(NULL), object_set(NULL)
+      object_cacher(NULL), writeback_handler(NULL), object_set(NULL),
+      persistent_cache(NULL),
+      copy_on_read_blocked(0),
+      discards_in_flight(0),
+      object_map(*this)
   {
     md_ctx.dup(p);
     data_ctx.dup(p);
@@ -66,7 +74,11 @@ namespace librbd {
     }
     perf_start(pname);
 
-    if (cct->_conf->rbd_cache) {
+    // writes to the head go through the persistent cache instead, if
+    // open_image() can set it up
+    bool persistent_cache_head = cct->_conf->rbd_persistent_cache &&
+      !ro && !snap;
+    if (cct->_conf->rbd_cache && !persistent_cache_head) {
       Mutex::Locker l(cache_lock);
       ldout(cct, 20) << "enabling writeback caching..." << dendl;
       writeback_handler = new LibrbdWriteback(this, cache_lock);
@@ -81,6 +93,10 @@ namespace librbd {
       object_set->return_enoent = true;
       object_cacher->start();
     }
+
+    readahead.set_trigger_requests(cct->_conf->rbd_readahead_trigger_requests);
+    readahead.set_min_readahead_size(cct->_conf->rbd_readahead_min_bytes);
+    readahead.set_max_readahead_size(cct->_conf->rbd_readahead_max_bytes);
   }
 
   ImageCtx::~ImageCtx() {
@@ -176,6 +192,12 @@ namespace librbd {
       object_cacher->set_max_objects(obj * 4 + 10);
     }
 
+    // read ahead in whole periods, or at least whole objects
+    vector<uint64_t> alignments;
+    alignments.push_back(stripe_count << order);
+    alignments.push_back(1ull << order);
+    readahead.set_alignments(alignments);
+
     ldout(cct, 10) << "init_layout stripe_unit " << stripe_unit
 		   << " stripe_count " << stripe_count
 		   << " object_size " << layout.fl_object_size
@@ -211,6 +233,15 @@ namespace librbd {
     plb.add_u64_counter(l_librbd_snap_rollback, "snap_rollback");
     plb.add_u64_counter(l_librbd_notify, "notify");
     plb.add_u64_counter(l_librbd_resize, "resize");
+    plb.add_u64_counter(l_librbd_copy_on_read, "copy_on_read");
+    plb.add_u64_counter(l_librbd_discard_skipped, "discard_skipped");
+    plb.add_u64_counter(l_librbd_discard_remove, "discard_remove");
+    plb.add_u64_counter(l_librbd_discard_zero, "discard_zero");
+    plb.add_u64_counter(l_librbd_discard_queued, "discard_queued");
+    plb.add_u64_counter(l_librbd_pcache_rd_hit_bytes, "pcache_rd_hit_bytes");
+    plb.add_u64_counter(l_librbd_pcache_writeback, "pcache_writeback");
+    plb.add_u64_counter(l_librbd_pcache_writeback_bytes, "pcache_writeback_bytes");
+    plb.add_time_avg(l_librbd_pcache_writeback_latency, "pcache_writeback_latency");
 
     perfcounter = plb.create_perf_counters();
     cct->get_perfcounters_collection()->add(perfcounter);
@@ -472,7 +503,7 @@ namespace librbd {
     cache_lock.Lock();
     int r = object_cacher->readx(rd, object_set, onfinish);
     cache_lock.Unlock();
-    if (r != 0)
+    if (r != 0 && onfinish)
       onfinish->complete(r);
   }
 
@@ -537,6 +568,13 @@ namespace librbd {
 
   void ImageCtx::invalidate_cache() {
     assert(md_lock.is_locked());
+    if (persistent_cache) {
+      int r = persistent_cache->invalidate();
+      if (r < 0)
+	lderr(cct) << "error invalidating persistent cache: "
+		   << cpp_strerror(r) << dendl;
+      return;
+    }
     if (!object_cacher)
       return;
     cache_lock.Lock();
@@ -552,6 +590,71 @@ namespace librbd {
       lderr(cct) << "could not release all objects from cache" << dendl;
   }
 
+  void ImageCtx::wait_for_copy_on_read() {
+    Mutex::Locker l(copy_on_read_lock);
+    while (!copy_on_read_objects.empty())
+      copy_on_read_cond.Wait(copy_on_read_lock);
+  }
+
+  /**
+   * Keep new copy-ups from starting, and wait for those in flight, for
+   * an operation that changes the objects or the parent overlap.
+   */
+  void ImageCtx::block_copy_on_read() {
+    Mutex::Locker l(copy_on_read_lock);
+    copy_on_read_blocked++;
+    while (!copy_on_read_objects.empty())
+      copy_on_read_cond.Wait(copy_on_read_lock);
+  }
+
+  void ImageCtx::unblock_copy_on_read() {
+    Mutex::Locker l(copy_on_read_lock);
+    assert(copy_on_read_blocked > 0);
+    copy_on_read_blocked--;
+  }
+
+  /**
+   * Send a request now if fewer than rbd_concurrent_discard_ops are in
+   * flight, or once enough of them finish.  The request's completion
+   * must call finish_discard() when it runs.  Something is always in
+   * flight while requests are queued, even if the option was lowered
+   * to 0 since aio_discard() checked it.
+   */
+  void ImageCtx::queue_discard(AioRequest *req) {
+    discard_lock.Lock();
+    if (discards_in_flight > 0 &&
+	discards_in_flight >= cct->_conf->rbd_concurrent_discard_ops) {
+      queued_discards.push_back(req);
+      discard_lock.Unlock();
+      perfcounter->inc(l_librbd_discard_queued);
+      return;
+    }
+    discards_in_flight++;
+    discard_lock.Unlock();
+
+    int r = req->send();
+    if (r < 0)
+      req->complete(r);
+  }
+
+  void ImageCtx::finish_discard() {
+    discard_lock.Lock();
+    assert(discards_in_flight > 0);
+    if (queued_discards.empty()) {
+      discards_in_flight--;
+      discard_lock.Unlock();
+      return;
+    }
+    // hand our slot to the next one
+    AioRequest *req = queued_discards.front();
+    queued_discards.pop_front();
+    discard_lock.Unlock();
+
+    int r = req->send();
+    if (r < 0)
+      req->complete(r);
+  }
+
   int ImageCtx::register_watch() {
     assert(!wctx);
     wctx = new WatchCtx(this);
@@ -5,11 +5,13 @@
 
 #include <inttypes.h>
 
+#include <deque>
 #include <map>
 #include <set>
 #include <string>
 #include <vector>
 
+#include "common/Cond.h"
 #include "common/Mutex.h"
 #include "common/snap_types.h"
 #include "include/buffer.h"
@@ -17,9 +19,11 @@
 #include "include/rbd_types.h"
 #include "include/types.h"
 #include "osdc/ObjectCacher.h"
+#include "osdc/Readahead.h"
 
 #include "cls/rbd/cls_rbd_client.h"
 #include "librbd/LibrbdWriteback.h"
+#include "librbd/ObjectMap.h"
 #include "librbd/SnapInfo.h"
 #include "librbd/parent_types.h"
 
@@ -28,6 +32,8 @@ class PerfCounters;
 
 namespace librbd {
 
+  class AioRequest;
+  class PersistentCache;
   class WatchCtx;
 
   struct ImageCtx {
@@ -57,7 +63,10 @@ namespace librbd {
 
     /**
      * Lock ordering:
-     * md_lock, cache_lock, snap_lock, parent_lock, refresh_lock
+     * md_lock, cache_lock, snap_lock, parent_lock, refresh_lock,
+     * copy_on_read_lock, discard_lock
+     *
+     * object_map has its own lock, which comes after all of these.
      */
     Mutex md_lock; // protects access to the mutable image metadata that
                    // isn't guarded by other locks below
@@ -66,6 +75,8 @@ namespace librbd {
     Mutex snap_lock; // protects snapshot-related member variables:
     Mutex parent_lock; // protects parent_md and parent
     Mutex refresh_lock; // protects refresh_seq and last_refresh
+    Mutex copy_on_read_lock; // protects copy_on_read_*
+    Mutex discard_lock; // protects queued_discards and discards_in_flight
 
     bool old_format;
     uint8_t order;
@@ -85,6 +96,25 @@ namespace librbd {
     LibrbdWriteback *writeback_handler;
     ObjectCacher::ObjectSet *object_set;
 
+    /// set up by open_image() instead of object_cacher, if configured
+    PersistentCache *persistent_cache;
+
+    Readahead readahead;
+
+    std::set<uint64_t> copy_on_read_objects; ///< objects being copied up
+					     ///< after a read from the parent
+    std::set<uint64_t> copy_on_read_zero; ///< objects with only zeros in
+					  ///< the parent snapshot, which
+					  ///< doesn't change
+    int copy_on_read_blocked; ///< ops that mustn't race with copy-ups
+    Cond copy_on_read_cond;
+
+    /// whole-object removes from discards, waiting for a slot
+    std::deque<AioRequest*> queued_discards;
+    int discards_in_flight;
+
+    ObjectMap object_map;
+
     /**
      * Either image_name or image_id must be set.
      * If id is not known, pass the empty std::string,
@@ -131,6 +161,11 @@ namespace librbd {
     int flush_cache();
     void shutdown_cache();
     void invalidate_cache();
+    void wait_for_copy_on_read();
+    void block_copy_on_read();
+    void unblock_copy_on_read();
+    void queue_discard(AioRequest *req);
+    void finish_discard();
     int register_watch();
     void unregister_watch();
     size_t parent_io_len(uint64_t offset, size_t length,
@@ -0,0 +1,234 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#include <errno.h>
+
+#include "common/ceph_context.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "include/rbd/features.h"
+#include "include/rbd_types.h"
+#include "include/rados/librados.hpp"
+
+#include "cls/rbd/cls_rbd_client.h"
+#include "include/Context.h"
+#include "librbd/ImageCtx.h"
+#include "librbd/internal.h"
+
+#include "librbd/ObjectMap.h"
+
+#include "include/assert.h"
+
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::ObjectMap: "
+
+using std::string;
+using std::vector;
+
+namespace librbd {
+
+  ObjectMap::ObjectMap(ImageCtx &image_ctx)
+    : m_image_ctx(image_ctx),
+      m_lock("librbd::ObjectMap::m_lock"),
+      m_enabled(false),
+      m_trusted(false),
+      m_marks_in_flight(0)
+  {
+  }
+
+  // whether this client holds the exclusive lock on the image
+  static bool have_exclusive_lock(ImageCtx &ictx)
+  {
+    assert(ictx.snap_lock.is_locked());
+    if (!ictx.exclusive_locked)
+      return false;
+    librados::Rados rados(ictx.md_ctx);
+    entity_name_t me = entity_name_t::CLIENT(rados.get_instance_id());
+    for (std::map<rados::cls::lock::locker_id_t,
+		  rados::cls::lock::locker_info_t>::const_iterator p =
+	   ictx.lockers.begin(); p != ictx.lockers.end(); ++p) {
+      if (p->first.locker == me)
+	return true;
+    }
+    return false;
+  }
+
+  string ObjectMap::object_map_name(const string &image_id)
+  {
+    return RBD_OBJECT_MAP_PREFIX + image_id;
+  }
+
+  int ObjectMap::refresh()
+  {
+    CephContext *cct = m_image_ctx.cct;
+
+    m_image_ctx.snap_lock.Lock();
+    bool enabled = !m_image_ctx.old_format &&
+      m_image_ctx.snap_id == CEPH_NOSNAP &&
+      (m_image_ctx.features & RBD_FEATURE_OBJECT_MAP);
+    bool trusted = enabled && have_exclusive_lock(m_image_ctx);
+    m_image_ctx.snap_lock.Unlock();
+
+    // hold m_lock across the load so it can't race with an update
+    // and bring back a stale copy of the bits it set
+    Mutex::Locker l(m_lock);
+    m_object_map.clear();
+    if (enabled) {
+      int r = cls_client::object_map_load(&m_image_ctx.md_ctx,
+					  object_map_name(m_image_ctx.id),
+					  &m_object_map);
+      if (r < 0) {
+	// fall back to asking the OSDs about every object
+	lderr(cct) << "error loading object map: " << cpp_strerror(r) << dendl;
+	enabled = false;
+	trusted = false;
+	m_object_map.clear();
+      }
+    }
+    m_enabled = enabled;
+    m_trusted = trusted;
+
+    ldout(cct, 20) << "refresh enabled=" << enabled << " trusted=" << trusted
+		   << " num_objs=" << m_object_map.size() << dendl;
+    return 0;
+  }
+
+  bool ObjectMap::trusted()
+  {
+    Mutex::Locker l(m_lock);
+    return m_trusted;
+  }
+
+  bool ObjectMap::object_may_exist(uint64_t object_no)
+  {
+    Mutex::Locker l(m_lock);
+    if (!m_trusted || object_no >= m_object_map.size())
+      return true;
+    return m_object_map[object_no];
+  }
+
+  class C_MarkExists : public Context {
+  public:
+    C_MarkExists(ObjectMap *object_map, uint64_t object_no)
+      : m_object_map(object_map), m_object_no(object_no) {}
+    virtual void finish(int r) {
+      m_object_map->finish_mark_exists(m_object_no, r);
+    }
+  private:
+    ObjectMap *m_object_map;
+    uint64_t m_object_no;
+  };
+
+  bool ObjectMap::aio_mark_exists(uint64_t object_no, Context *on_finish)
+  {
+    m_lock.Lock();
+    if (!m_enabled || object_no >= m_object_map.size() ||
+	m_object_map[object_no]) {
+      m_lock.Unlock();
+      return false;
+    }
+
+    std::list<Context *> &waiters = m_marking[object_no];
+    waiters.push_back(on_finish);
+    if (waiters.size() > 1) {
+      // already being marked
+      m_lock.Unlock();
+      return true;
+    }
+
+    ldout(m_image_ctx.cct, 20) << "aio_mark_exists " << object_no << dendl;
+    ++m_marks_in_flight;
+    librados::ObjectWriteOperation op;
+    cls_client::object_map_update(&op, object_no, object_no + 1, true);
+    Context *ctx = new C_MarkExists(this, object_no);
+    librados::AioCompletion *rados_completion =
+      librados::Rados::aio_create_completion(ctx, NULL, rados_ctx_cb);
+    int r = m_image_ctx.md_ctx.aio_operate(object_map_name(m_image_ctx.id),
+					   rados_completion, &op);
+    rados_completion->release();
+    m_lock.Unlock();
+
+    if (r < 0) {
+      // the callback won't run
+      ctx->complete(r);
+    }
+    return true;
+  }
+
+  void ObjectMap::wait_for_marks()
+  {
+    Mutex::Locker l(m_lock);
+    while (m_marks_in_flight > 0)
+      m_marks_cond.Wait(m_lock);
+  }
+
+  void ObjectMap::finish_mark_exists(uint64_t object_no, int r)
+  {
+    std::list<Context *> waiters;
+    m_lock.Lock();
+    if (r < 0) {
+      lderr(m_image_ctx.cct) << "error updating object map: "
+			     << cpp_strerror(r) << dendl;
+    } else if (object_no < m_object_map.size()) {
+      m_object_map[object_no] = true;
+    }
+    waiters.swap(m_marking[object_no]);
+    m_marking.erase(object_no);
+    m_lock.Unlock();
+
+    for (std::list<Context *>::iterator p = waiters.begin();
+	 p != waiters.end(); ++p)
+      (*p)->complete(r);
+
+    m_lock.Lock();
+    --m_marks_in_flight;
+    m_marks_cond.Signal();
+    m_lock.Unlock();
+  }
+
+  int ObjectMap::resize(uint64_t num_objs)
+  {
+    Mutex::Locker l(m_lock);
+    if (!m_enabled)
+      return 0;
+
+    ldout(m_image_ctx.cct, 20) << "resize " << num_objs << dendl;
+    int r = cls_client::object_map_resize(&m_image_ctx.md_ctx,
+					  object_map_name(m_image_ctx.id),
+					  num_objs);
+    if (r < 0) {
+      lderr(m_image_ctx.cct) << "error resizing object map: "
+			     << cpp_strerror(r) << dendl;
+      return r;
+    }
+    m_object_map.resize(num_objs, false);
+    return 0;
+  }
+
+  int ObjectMap::invalidate()
+  {
+    Mutex::Locker l(m_lock);
+    if (!m_enabled)
+      return 0;
+    return update(0, m_object_map.size(), true);
+  }
+
+  int ObjectMap::update(uint64_t start, uint64_t end, bool exists)
+  {
+    assert(m_lock.is_locked());
+    ldout(m_image_ctx.cct, 20) << "update [" << start << ", " << end
+			       << ") exists=" << exists << dendl;
+    int r = cls_client::object_map_update(&m_image_ctx.md_ctx,
+					  object_map_name(m_image_ctx.id),
+					  start, end, exists);
+    if (r < 0) {
+      lderr(m_image_ctx.cct) << "error updating object map: "
+			     << cpp_strerror(r) << dendl;
+      return r;
+    }
+    for (uint64_t i = start; i < end && i < m_object_map.size(); ++i)
+      m_object_map[i] = exists;
+    return 0;
+  }
+
+}
@@ -0,0 +1,103 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#ifndef CEPH_LIBRBD_OBJECTMAP_H
+#define CEPH_LIBRBD_OBJECTMAP_H
+
+#include <inttypes.h>
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common/Cond.h"
+#include "common/Mutex.h"
+
+class Context;
+
+namespace librbd {
+
+  class ImageCtx;
+
+  /**
+   * In-memory copy of the rbd_object_map.$image_id object, which
+   * records which data objects of the image head may exist.
+   *
+   * The map is only ever a superset of the objects that really exist:
+   * bits are set before an object is first written, and cleared only
+   * after it is gone.  A crash can therefore leave stale bits behind,
+   * but never a missing one, so a clear bit means the object can be
+   * skipped without asking the OSDs.
+   *
+   * When the image does not have RBD_FEATURE_OBJECT_MAP, or a snapshot
+   * is open, every object is reported as possibly existing.
+   *
+   * Every writer keeps the on-disk map up to date, but bits set by
+   * other clients are not pushed to this copy.  So unless this client
+   * holds the image's exclusive lock, and nobody else may write to it,
+   * the map is maintained but not trusted, and every object is again
+   * reported as possibly existing.
+   */
+  class ObjectMap {
+  public:
+    ObjectMap(ImageCtx &image_ctx);
+
+    static std::string object_map_name(const std::string &image_id);
+
+    /**
+     * Reload the map from the OSDs.  Must be called without snap_lock
+     * held whenever the features or the open snapshot may have changed.
+     */
+    int refresh();
+
+    /**
+     * Whether clear bits can be relied on, i.e. the map is enabled and
+     * this client holds the exclusive lock on the image.
+     */
+    bool trusted();
+    bool object_may_exist(uint64_t object_no);
+
+    /**
+     * Mark an object as existing before it is written.  Returns false
+     * if there is nothing to do, and the write can be sent right away.
+     * Otherwise on_finish is completed once the bit is on disk, or with
+     * the error setting it.  Only the first write to an object waits;
+     * later ones to the same object wait for the same update.
+     */
+    bool aio_mark_exists(uint64_t object_no, Context *on_finish);
+
+    /**
+     * Wait for the aio_mark_exists() updates in flight, and for the
+     * writes waiting on them to be sent.
+     */
+    void wait_for_marks();
+    int resize(uint64_t num_objs);
+
+    /**
+     * Mark every object as possibly existing, for when the image
+     * contents change in ways the map can't follow (e.g. rollback).
+     */
+    int invalidate();
+
+  private:
+    friend class C_MarkExists;
+
+    int update(uint64_t start, uint64_t end, bool exists);
+    void finish_mark_exists(uint64_t object_no, int r);
+
+    ImageCtx &m_image_ctx;
+    Mutex m_lock; // protects everything below; held across the
+		  // synchronous updates so the on-disk map never lags
+		  // it, but never across an aio_mark_exists() update
+    bool m_enabled;
+    bool m_trusted;
+    std::vector<bool> m_object_map;
+    // objects being marked, and the writes waiting for them
+    std::map<uint64_t, std::list<Context *> > m_marking;
+    int m_marks_in_flight;
+    Cond m_marks_cond;
+  };
+
+}
+
+#endif
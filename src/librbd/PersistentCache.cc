@@ -0,0 +1,818 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "common/ceph_context.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "common/safe_io.h"
+#include "include/rados/librados.hpp"
+#include "include/stringify.h"
+
+#include "librbd/AioCompletion.h"
+#include "librbd/ImageCtx.h"
+#include "librbd/internal.h"
+
+#include "librbd/PersistentCache.h"
+
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::PersistentCache: "
+
+using std::map;
+using std::string;
+
+namespace librbd {
+
+  /*
+   * The log file starts with a header block, followed by records:
+   *
+   *   __le32 magic
+   *   __le32 header length
+   *   __le32 crc32c of the header
+   *   header: log uuid, type, seq, image offset, length, data crc32c,
+   *           snap context
+   *   data, for writes
+   *
+   * padded to 8 bytes.  A record never straddles the end of the log;
+   * a wrap record marks the rest of the log as unused, or, if there is
+   * less than WRAP_RESERVE left, the next record simply starts at the
+   * beginning again.  Records carry the uuid of the log they belong to
+   * and consecutive seqs, so the first stale or torn record ends the
+   * log on recovery.
+   */
+  static const uint64_t HEADER_SIZE = 4096;
+  static const uint32_t RECORD_MAGIC = 0x72626463;  // "rbdc"
+  static const uint64_t RECORD_PREFIX_SIZE = 12;
+  static const uint64_t WRAP_RESERVE = 128;
+  static const uint64_t MAX_RECORD_DATA = 4 << 20;
+  static const uint32_t MAX_RECORD_HEADER = 64 << 10;
+  static const char *LOG_MAGIC = "rbd persistent cache v1";
+
+  static uint64_t round_up_8(uint64_t n)
+  {
+    return (n + 7) & ~7ull;
+  }
+
+  class PersistentCache::C_WritebackDone : public Context {
+  public:
+    C_WritebackDone(PersistentCache *cache, uint64_t seq)
+      : m_cache(cache), m_seq(seq) {}
+    virtual void finish(int r) {
+      m_cache->writeback_done(m_seq, r);
+    }
+  private:
+    PersistentCache *m_cache;
+    uint64_t m_seq;
+  };
+
+  PersistentCache::PersistentCache(ImageCtx *ictx, const string &path,
+				   uint64_t size, int writeback_ops)
+    : m_ictx(ictx), m_path(path), m_size(size),
+      m_writeback_ops(writeback_ops > 0 ? writeback_ops : 1),
+      m_fd(-1), m_log_start(HEADER_SIZE), m_log_end(0),
+      m_lock("librbd::PersistentCache::m_lock"),
+      m_head(0), m_next_seq(1), m_writeback_seq(1), m_tail_seq(1),
+      m_persisted_tail_seq(1), m_in_flight(0), m_writeback_error(0),
+      m_stopping(false), m_writeback_thread(this)
+  {
+  }
+
+  PersistentCache::~PersistentCache()
+  {
+    assert(m_fd < 0);
+  }
+
+  int PersistentCache::init()
+  {
+    CephContext *cct = m_ictx->cct;
+
+    // key the log on the cluster, pool and image, so that a log left
+    // behind by a crash is only ever replayed into its own image
+    string fsid;
+    librados::Rados rados(m_ictx->md_ctx);
+    int r = rados.cluster_fsid(&fsid);
+    if (r < 0)
+      return r;
+    m_path += "/rbd-" + fsid + "-" + stringify(m_ictx->data_ctx.get_id()) +
+      "-" + m_ictx->id;
+
+    m_fd = ::open(m_path.c_str(), O_RDWR | O_CREAT, 0600);
+    if (m_fd < 0) {
+      r = -errno;
+      lderr(cct) << "error opening cache log " << m_path << ": "
+		 << cpp_strerror(r) << dendl;
+      return r;
+    }
+    if (::flock(m_fd, LOCK_EX | LOCK_NB) < 0) {
+      r = -errno;
+      if (r == -EWOULDBLOCK)
+	r = -EBUSY;
+      lderr(cct) << "error locking cache log " << m_path << ", is the image "
+		 << "already open elsewhere on this host? " << cpp_strerror(r)
+		 << dendl;
+      ::close(m_fd);
+      m_fd = -1;
+      return r;
+    }
+
+    uint64_t tail_off, tail_seq;
+    r = read_header(&tail_off, &tail_seq);
+    if (r == 0) {
+      ldout(cct, 1) << "recovering cache log " << m_path << " from seq "
+		    << tail_seq << " at " << tail_off << dendl;
+      if (m_log_end != m_size)
+	ldout(cct, 1) << "keeping existing cache log size " << m_log_end
+		      << " rather than " << m_size << dendl;
+      r = recover(tail_off, tail_seq);
+    } else {
+      ldout(cct, 1) << "creating cache log " << m_path << dendl;
+      if (m_size < HEADER_SIZE + 2 * MAX_RECORD_DATA) {
+	lderr(cct) << "cache log size " << m_size << " is too small" << dendl;
+	r = -EINVAL;
+      } else if (::ftruncate(m_fd, m_size) < 0) {
+	r = -errno;
+      } else {
+	m_log_uuid.generate_random();
+	m_log_end = m_size;
+	m_head = m_log_start;
+	m_next_seq = 1;
+	tail_seq = 1;
+	r = write_header(m_head, m_next_seq);
+      }
+    }
+    if (r < 0) {
+      lderr(cct) << "error initializing cache log " << m_path << ": "
+		 << cpp_strerror(r) << dendl;
+      ::close(m_fd);
+      m_fd = -1;
+      return r;
+    }
+
+    m_tail_seq = m_persisted_tail_seq = m_writeback_seq = tail_seq;
+    m_writeback_thread.create();
+    return 0;
+  }
+
+  void PersistentCache::shutdown()
+  {
+    int r = writeback();
+    if (r < 0)
+      lderr(m_ictx->cct) << "error writing back cache log, leaving it for "
+			 << "the next open: " << cpp_strerror(r) << dendl;
+
+    m_lock.Lock();
+    m_stopping = true;
+    m_cond.SignalAll();
+    m_lock.Unlock();
+    m_writeback_thread.join();
+
+    ::fdatasync(m_fd);
+    ::close(m_fd);
+    m_fd = -1;
+  }
+
+  PersistentCache::Record &PersistentCache::get_record(uint64_t seq)
+  {
+    assert(m_lock.is_locked());
+    assert(!m_records.empty());
+    assert(seq >= m_records.front().seq);
+    Record &rec = m_records[seq - m_records.front().seq];
+    assert(rec.seq == seq);
+    return rec;
+  }
+
+  int PersistentCache::read_header(uint64_t *tail_off, uint64_t *tail_seq)
+  {
+    char buf[HEADER_SIZE];
+    ssize_t r = safe_pread(m_fd, buf, sizeof(buf), 0);
+    if (r < (ssize_t)sizeof(buf))
+      return -EINVAL;
+
+    bufferlist bl;
+    bl.append(buf, sizeof(buf));
+    bufferlist::iterator p = bl.begin();
+    try {
+      uint32_t len, crc;
+      ::decode(len, p);
+      ::decode(crc, p);
+      if (len > HEADER_SIZE - 8)
+	return -EINVAL;
+      bufferlist payload;
+      p.copy(len, payload);
+      if (payload.crc32c(0) != crc)
+	return -EINVAL;
+
+      bufferlist::iterator q = payload.begin();
+      string magic;
+      uint64_t log_end;
+      ::decode(magic, q);
+      if (magic != LOG_MAGIC)
+	return -EINVAL;
+      ::decode(m_log_uuid, q);
+      ::decode(log_end, q);
+      ::decode(*tail_off, q);
+      ::decode(*tail_seq, q);
+      if (log_end < HEADER_SIZE + 2 * MAX_RECORD_DATA ||
+	  *tail_off < m_log_start || *tail_off > log_end)
+	return -EINVAL;
+      m_log_end = log_end;
+    } catch (const buffer::error &err) {
+      return -EINVAL;
+    }
+    return 0;
+  }
+
+  int PersistentCache::write_header(uint64_t tail_off, uint64_t tail_seq)
+  {
+    // the payload is well under a sector, so the write is atomic
+    bufferlist payload;
+    ::encode(string(LOG_MAGIC), payload);
+    ::encode(m_log_uuid, payload);
+    ::encode(m_log_end, payload);
+    ::encode(tail_off, payload);
+    ::encode(tail_seq, payload);
+
+    bufferlist bl;
+    ::encode((uint32_t)payload.length(), bl);
+    ::encode(payload.crc32c(0), bl);
+    bl.claim_append(payload);
+    bl.append_zero(HEADER_SIZE - bl.length());
+
+    int r = safe_pwrite(m_fd, bl.c_str(), bl.length(), 0);
+    if (r < 0)
+      return r;
+    if (::fdatasync(m_fd) < 0)
+      return -errno;
+    return 0;
+  }
+
+  int PersistentCache::read_record(uint64_t off, Record *rec, bufferlist *data)
+  {
+    char prefix[RECORD_PREFIX_SIZE];
+    if (off + RECORD_PREFIX_SIZE > m_log_end)
+      return -EINVAL;
+    ssize_t r = safe_pread_exact(m_fd, prefix, sizeof(prefix), off);
+    if (r < 0)
+      return r;
+
+    bufferlist bl;
+    bl.append(prefix, sizeof(prefix));
+    bufferlist::iterator p = bl.begin();
+    uint32_t magic, header_len, header_crc;
+    ::decode(magic, p);
+    ::decode(header_len, p);
+    ::decode(header_crc, p);
+    if (magic != RECORD_MAGIC || header_len > MAX_RECORD_HEADER ||
+	off + RECORD_PREFIX_SIZE + header_len > m_log_end)
+      return -EINVAL;
+
+    bufferptr header_bp(header_len);
+    r = safe_pread_exact(m_fd, header_bp.c_str(), header_len,
+			 off + RECORD_PREFIX_SIZE);
+    if (r < 0)
+      return r;
+    bufferlist header;
+    header.push_back(header_bp);
+    if (header.crc32c(0) != header_crc)
+      return -EINVAL;
+
+    uint32_t data_crc;
+    try {
+      bufferlist::iterator q = header.begin();
+      uuid_d log_uuid;
+      ::decode(log_uuid, q);
+      if (log_uuid != m_log_uuid)
+	return -EINVAL;
+      ::decode(rec->type, q);
+      ::decode(rec->seq, q);
+      ::decode(rec->image_off, q);
+      ::decode(rec->length, q);
+      ::decode(data_crc, q);
+      ::decode(rec->snapc, q);
+    } catch (const buffer::error &err) {
+      return -EINVAL;
+    }
+
+    rec->log_off = off;
+    rec->data_off = off + RECORD_PREFIX_SIZE + header_len;
+    rec->state = STATE_LOGGED;
+    switch (rec->type) {
+    case RECORD_WRITE:
+      {
+	if (rec->length > MAX_RECORD_DATA ||
+	    rec->data_off + rec->length > m_log_end)
+	  return -EINVAL;
+	bufferptr bp(rec->length);
+	r = safe_pread_exact(m_fd, bp.c_str(), rec->length, rec->data_off);
+	if (r < 0)
+	  return r;
+	data->push_back(bp);
+	if (data->crc32c(0) != data_crc)
+	  return -EINVAL;
+	rec->size = round_up_8(RECORD_PREFIX_SIZE + header_len + rec->length);
+      }
+      break;
+    case RECORD_DISCARD:
+    case RECORD_FLUSH:
+      rec->size = round_up_8(RECORD_PREFIX_SIZE + header_len);
+      break;
+    case RECORD_WRAP:
+      rec->size = m_log_end - off;
+      break;
+    default:
+      return -EINVAL;
+    }
+    return 0;
+  }
+
+  int PersistentCache::recover(uint64_t tail_off, uint64_t tail_seq)
+  {
+    uint64_t off = tail_off;
+    uint64_t seq = tail_seq;
+    while (true) {
+      if (m_log_end - off < WRAP_RESERVE)
+	off = m_log_start;
+
+      Record rec;
+      bufferlist data;
+      int r = read_record(off, &rec, &data);
+      if (r < 0 || rec.seq != seq)
+	break;
+
+      ldout(m_ictx->cct, 20) << "recovered record " << seq << " type "
+			     << (int)rec.type << " " << rec.image_off << "~"
+			     << rec.length << " at " << off << dendl;
+      add_record(rec);
+      seq++;
+      if (rec.type == RECORD_WRAP)
+	off = m_log_start;
+      else
+	off += rec.size;
+    }
+
+    ldout(m_ictx->cct, 1) << "recovered " << (seq - tail_seq)
+			  << " records" << dendl;
+    m_head = off;
+    m_next_seq = seq;
+    return 0;
+  }
+
+  bool PersistentCache::fits(uint64_t size, bool *wrap)
+  {
+    *wrap = false;
+    if (m_records.empty()) {
+      if (m_head + size <= m_log_end)
+	return true;
+      *wrap = true;
+      return m_log_start + size <= m_log_end;
+    }
+
+    // the newest record ends where the oldest starts: we're full
+    uint64_t oldest = m_records.front().log_off;
+    if (oldest == m_head)
+      return false;
+    if (oldest > m_head)
+      return m_head + size <= oldest;
+    if (m_head + size <= m_log_end)
+      return true;
+    *wrap = true;
+    return m_log_start + size <= oldest;
+  }
+
+  int PersistentCache::write_record(const Record &rec, const bufferlist *data)
+  {
+    uint32_t data_crc = 0;
+    if (data) {
+      bufferlist copy(*data);
+      data_crc = copy.crc32c(0);
+    }
+
+    bufferlist header;
+    ::encode(m_log_uuid, header);
+    ::encode(rec.type, header);
+    ::encode(rec.seq, header);
+    ::encode(rec.image_off, header);
+    ::encode(rec.length, header);
+    ::encode(data_crc, header);
+    ::encode(rec.snapc, header);
+    assert(rec.data_off == rec.log_off + RECORD_PREFIX_SIZE + header.length());
+
+    bufferlist bl;
+    ::encode(RECORD_MAGIC, bl);
+    ::encode((uint32_t)header.length(), bl);
+    ::encode(header.crc32c(0), bl);
+    bl.claim_append(header);
+    if (data)
+      bl.append(*data);
+    if (rec.type != RECORD_WRAP)
+      bl.append_zero(rec.size - bl.length());
+
+    return safe_pwrite(m_fd, bl.c_str(), bl.length(), rec.log_off);
+  }
+
+  void PersistentCache::add_record(const Record &rec)
+  {
+    assert(m_records.empty() || m_records.back().seq + 1 == rec.seq);
+    m_records.push_back(rec);
+    if (rec.type == RECORD_WRITE)
+      add_extent(rec.image_off, rec.length, rec.data_off, rec.seq, false);
+    else if (rec.type == RECORD_DISCARD)
+      add_extent(rec.image_off, rec.length, 0, rec.seq, true);
+  }
+
+  void PersistentCache::trim_front()
+  {
+    const Record &rec = m_records.front();
+    assert(rec.state == STATE_DONE);
+    assert(rec.seq < m_persisted_tail_seq);
+    if (rec.type == RECORD_WRITE || rec.type == RECORD_DISCARD)
+      remove_extents(rec.image_off, rec.length, rec.seq);
+    m_records.pop_front();
+  }
+
+  int PersistentCache::append(uint8_t type, uint64_t image_off,
+			      uint64_t length, const ::SnapContext &snapc,
+			      const bufferlist *data)
+  {
+    assert(m_lock.is_locked());
+
+    Record rec;
+    rec.seq = 0;
+    rec.type = type;
+    rec.image_off = image_off;
+    rec.length = length;
+    rec.snapc = snapc;
+    rec.state = STATE_LOGGED;
+
+    // the header has a fixed size for a given snap context
+    bufferlist header;
+    ::encode(m_log_uuid, header);
+    ::encode(rec.type, header);
+    ::encode(rec.seq, header);
+    ::encode(rec.image_off, header);
+    ::encode(rec.length, header);
+    ::encode((uint32_t)0, header);
+    ::encode(rec.snapc, header);
+    if (header.length() > MAX_RECORD_HEADER)
+      return -EINVAL;
+    uint64_t data_len = data ? data->length() : 0;
+    rec.size = round_up_8(RECORD_PREFIX_SIZE + header.length() + data_len);
+
+    bool wrap;
+    while (!fits(rec.size, &wrap)) {
+      if (!m_records.empty() &&
+	  m_records.front().seq < m_persisted_tail_seq) {
+	trim_front();
+	continue;
+      }
+      if (m_writeback_error)
+	return take_writeback_error();
+      ldout(m_ictx->cct, 20) << "cache log full, waiting for writeback"
+			     << dendl;
+      m_cond.SignalAll();
+      m_cond.Wait(m_lock);
+    }
+
+    if (wrap) {
+      if (m_log_end - m_head >= WRAP_RESERVE) {
+	Record w;
+	w.seq = m_next_seq;
+	w.type = RECORD_WRAP;
+	w.image_off = 0;
+	w.length = 0;
+	w.log_off = m_head;
+	w.size = m_log_end - m_head;
+	w.state = STATE_LOGGED;
+	bufferlist wheader;
+	::encode(m_log_uuid, wheader);
+	::encode(w.type, wheader);
+	::encode(w.seq, wheader);
+	::encode(w.image_off, wheader);
+	::encode(w.length, wheader);
+	::encode((uint32_t)0, wheader);
+	::encode(w.snapc, wheader);
+	w.data_off = w.log_off + RECORD_PREFIX_SIZE + wheader.length();
+	int r = write_record(w, NULL);
+	if (r < 0)
+	  return r;
+	add_record(w);
+	m_next_seq++;
+      }
+      m_head = m_log_start;
+    }
+
+    rec.seq = m_next_seq;
+    rec.log_off = m_head;
+    rec.data_off = m_head + RECORD_PREFIX_SIZE + header.length();
+    int r = write_record(rec, data);
+    if (r < 0)
+      return r;
+    add_record(rec);
+    m_next_seq++;
+    m_head += rec.size;
+    m_cond.SignalAll();
+    return 0;
+  }
+
+  int PersistentCache::write(uint64_t off, const bufferlist &bl,
+			     const ::SnapContext &snapc)
+  {
+    ldout(m_ictx->cct, 20) << "write " << off << "~" << bl.length() << dendl;
+    Mutex::Locker l(m_lock);
+    uint64_t pos = 0;
+    while (pos < bl.length()) {
+      uint64_t len = MIN(bl.length() - pos, MAX_RECORD_DATA);
+      bufferlist data;
+      data.substr_of(bl, pos, len);
+      int r = append(RECORD_WRITE, off + pos, len, snapc, &data);
+      if (r < 0) {
+	lderr(m_ictx->cct) << "error logging write: " << cpp_strerror(r)
+			   << dendl;
+	return r;
+      }
+      pos += len;
+    }
+    return 0;
+  }
+
+  int PersistentCache::discard(uint64_t off, uint64_t len,
+			       const ::SnapContext &snapc)
+  {
+    ldout(m_ictx->cct, 20) << "discard " << off << "~" << len << dendl;
+    Mutex::Locker l(m_lock);
+    int r = append(RECORD_DISCARD, off, len, snapc, NULL);
+    if (r < 0)
+      lderr(m_ictx->cct) << "error logging discard: " << cpp_strerror(r)
+			 << dendl;
+    return r;
+  }
+
+  int PersistentCache::flush()
+  {
+    ldout(m_ictx->cct, 20) << "flush" << dendl;
+    m_lock.Lock();
+    int r = append(RECORD_FLUSH, 0, 0, ::SnapContext(), NULL);
+    m_lock.Unlock();
+    if (r < 0)
+      return r;
+    if (::fdatasync(m_fd) < 0)
+      return -errno;
+    return 0;
+  }
+
+  int PersistentCache::read(uint64_t off, uint64_t len,
+			    map<uint64_t, bufferlist> *hits)
+  {
+    Mutex::Locker l(m_lock);
+    uint64_t end = off + len;
+    map<uint64_t, Extent>::iterator p = m_extents.lower_bound(off);
+    if (p != m_extents.begin()) {
+      --p;
+      if (p->first + p->second.length <= off)
+	++p;
+    }
+    for (; p != m_extents.end() && p->first < end; ++p) {
+      uint64_t start = MAX(p->first, off);
+      uint64_t stop = MIN(p->first + p->second.length, end);
+      bufferptr bp(stop - start);
+      if (p->second.zero) {
+	bp.zero();
+      } else {
+	int r = safe_pread_exact(m_fd, bp.c_str(), bp.length(),
+				 p->second.data_off + (start - p->first));
+	if (r < 0) {
+	  lderr(m_ictx->cct) << "error reading cache log: "
+			     << cpp_strerror(r) << dendl;
+	  return r;
+	}
+      }
+      (*hits)[start].push_back(bp);
+    }
+    return 0;
+  }
+
+  void PersistentCache::punch(uint64_t off, uint64_t len)
+  {
+    uint64_t end = off + len;
+    map<uint64_t, Extent>::iterator p = m_extents.lower_bound(off);
+    if (p != m_extents.begin()) {
+      --p;
+      if (p->first + p->second.length <= off)
+	++p;
+    }
+    while (p != m_extents.end() && p->first < end) {
+      uint64_t e_off = p->first;
+      Extent e = p->second;
+      uint64_t e_end = e_off + e.length;
+      m_extents.erase(p++);
+      if (e_off < off) {
+	Extent left = e;
+	left.length = off - e_off;
+	m_extents[e_off] = left;
+      }
+      if (e_end > end) {
+	Extent right = e;
+	right.length = e_end - end;
+	if (!right.zero)
+	  right.data_off += end - e_off;
+	m_extents[end] = right;
+      }
+    }
+  }
+
+  void PersistentCache::add_extent(uint64_t off, uint64_t len,
+				   uint64_t data_off, uint64_t seq, bool zero)
+  {
+    punch(off, len);
+    Extent e;
+    e.length = len;
+    e.data_off = data_off;
+    e.seq = seq;
+    e.zero = zero;
+    m_extents[off] = e;
+  }
+
+  void PersistentCache::remove_extents(uint64_t off, uint64_t len,
+				       uint64_t seq)
+  {
+    uint64_t end = off + len;
+    map<uint64_t, Extent>::iterator p = m_extents.lower_bound(off);
+    if (p != m_extents.begin()) {
+      --p;
+      if (p->first + p->second.length <= off)
+	++p;
+    }
+    while (p != m_extents.end() && p->first < end) {
+      if (p->second.seq == seq)
+	m_extents.erase(p++);
+      else
+	++p;
+    }
+  }
+
+  int PersistentCache::writeback()
+  {
+    Mutex::Locker l(m_lock);
+    m_cond.SignalAll();
+    return wait_for_writeback(m_next_seq);
+  }
+
+  int PersistentCache::invalidate()
+  {
+    Mutex::Locker l(m_lock);
+    m_cond.SignalAll();
+    int r = wait_for_writeback(m_next_seq);
+    if (r < 0)
+      return r;
+    m_extents.clear();
+    return 0;
+  }
+
+  int PersistentCache::wait_for_writeback(uint64_t seq)
+  {
+    assert(m_lock.is_locked());
+    while (m_tail_seq < seq && !m_writeback_error)
+      m_cond.Wait(m_lock);
+    if (m_writeback_error)
+      return take_writeback_error();
+    return 0;
+  }
+
+  int PersistentCache::take_writeback_error()
+  {
+    assert(m_lock.is_locked());
+    assert(m_writeback_error);
+    while (m_in_flight)
+      m_cond.Wait(m_lock);
+
+    // records after the one that failed may have been written back
+    // already; writing them again in order is harmless
+    for (uint64_t seq = m_tail_seq; seq < m_writeback_seq; ++seq)
+      get_record(seq).state = STATE_LOGGED;
+    m_writeback_seq = m_tail_seq;
+
+    int r = m_writeback_error;
+    m_writeback_error = 0;
+    m_cond.SignalAll();
+    return r;
+  }
+
+  void PersistentCache::writeback_entry()
+  {
+    CephContext *cct = m_ictx->cct;
+    m_lock.Lock();
+    while (true) {
+      // issue records in order, stopping at a flush until everything
+      // before it is done
+      while (!m_writeback_error && m_writeback_seq < m_next_seq &&
+	     m_in_flight < m_writeback_ops) {
+	Record &rec = get_record(m_writeback_seq);
+	if (rec.type == RECORD_FLUSH && m_in_flight)
+	  break;
+	m_writeback_seq++;
+	if (rec.type == RECORD_FLUSH || rec.type == RECORD_WRAP) {
+	  rec.state = STATE_DONE;
+	  continue;
+	}
+
+	rec.state = STATE_WRITING;
+	m_in_flight++;
+	Record copy = rec;
+	m_lock.Unlock();
+	int r = send_writeback(copy);
+	if (r < 0)
+	  writeback_done(copy.seq, r);
+	m_lock.Lock();
+      }
+
+      // move the tail past everything written back
+      uint64_t tail_seq = m_tail_seq;
+      while (tail_seq < m_writeback_seq &&
+	     get_record(tail_seq).state == STATE_DONE)
+	tail_seq++;
+      if (tail_seq != m_tail_seq) {
+	m_tail_seq = tail_seq;
+	m_cond.SignalAll();
+      }
+
+      if (m_tail_seq != m_persisted_tail_seq && !m_writeback_error) {
+	uint64_t tail_off = m_tail_seq < m_next_seq ?
+	  get_record(m_tail_seq).log_off : m_head;
+	m_lock.Unlock();
+	int r = write_header(tail_off, tail_seq);
+	m_lock.Lock();
+	if (r < 0) {
+	  lderr(cct) << "error updating cache log header: "
+		     << cpp_strerror(r) << dendl;
+	  m_writeback_error = r;
+	} else {
+	  m_persisted_tail_seq = tail_seq;
+	}
+	m_cond.SignalAll();
+	continue;
+      }
+
+      if (m_stopping && !m_in_flight)
+	break;
+      m_cond.Wait(m_lock);
+    }
+    m_lock.Unlock();
+  }
+
+  int PersistentCache::send_writeback(const Record &rec)
+  {
+    ldout(m_ictx->cct, 20) << "writing back record " << rec.seq << " "
+			   << rec.image_off << "~" << rec.length << dendl;
+    Context *ctx = new C_WritebackDone(this, rec.seq);
+    AioCompletion *c = aio_create_completion_internal(ctx, rbd_ctx_cb);
+    c->init_time(m_ictx, AIO_TYPE_WRITEBACK);
+    int r;
+    if (rec.type == RECORD_WRITE) {
+      // the record's space can't be reused until it is written back
+      bufferptr bp(rec.length);
+      r = safe_pread_exact(m_fd, bp.c_str(), rec.length, rec.data_off);
+      if (r == 0) {
+	bufferlist bl;
+	bl.push_back(bp);
+	r = _aio_write(m_ictx, rec.image_off, bl, rec.snapc, c);
+      }
+    } else {
+      // sent right away, in log order, like the writes around it
+      r = _aio_discard(m_ictx, rec.image_off, rec.length, rec.snapc, c,
+		       false);
+    }
+    if (r < 0)
+      delete ctx;
+    c->release();
+    return r;
+  }
+
+  void PersistentCache::writeback_done(uint64_t seq, int r)
+  {
+    CephContext *cct = m_ictx->cct;
+    Mutex::Locker l(m_lock);
+    Record &rec = get_record(seq);
+    assert(rec.state == STATE_WRITING);
+    if (r < 0) {
+      // stop here: writing anything newer would break the ordering.  the
+      // record stays in the log and is retried on the next open.
+      lderr(cct) << "error writing back " << rec.image_off << "~"
+		 << rec.length << ": " << cpp_strerror(r) << dendl;
+      rec.state = STATE_LOGGED;
+      if (!m_writeback_error)
+	m_writeback_error = r;
+    } else {
+      rec.state = STATE_DONE;
+      m_ictx->perfcounter->inc(l_librbd_pcache_writeback);
+      m_ictx->perfcounter->inc(l_librbd_pcache_writeback_bytes, rec.length);
+    }
+    m_in_flight--;
+    m_cond.SignalAll();
+  }
+}
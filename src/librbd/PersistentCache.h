@@ -0,0 +1,194 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#ifndef CEPH_LIBRBD_PERSISTENTCACHE_H
+#define CEPH_LIBRBD_PERSISTENTCACHE_H
+
+#include <inttypes.h>
+
+#include <deque>
+#include <map>
+#include <string>
+
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "common/Thread.h"
+#include "common/snap_types.h"
+#include "include/buffer.h"
+#include "include/uuid.h"
+
+namespace librbd {
+
+  class ImageCtx;
+
+  /**
+   * Write-back cache for the image head, kept in a log on a local
+   * file or device.
+   *
+   * Writes and discards are appended to the log and acknowledged
+   * without waiting for the OSDs; flush() only has to make the log
+   * durable.  A writeback thread replays the log into the image in
+   * order, with the snapshot context each write was made with, and
+   * waits for everything in flight to finish before moving past a
+   * flush.  Writes between two flushes may reach the OSDs in any order,
+   * so the image on the OSDs always holds everything up to some flush,
+   * plus some subset of the writes made after it.
+   *
+   * The position of the oldest record not yet written back is kept in
+   * the log header, so after a crash the remaining records are found
+   * again on the next open, and replayed in the background.
+   *
+   * Reads of extents present in the log, whether already written back
+   * or not, are served from the log until its space is reused.
+   *
+   * The log is locked while open, so that only one opener of an image
+   * on this host uses it at a time.  Like the in-memory cache, this
+   * assumes no other client writes to the image while it is open.
+   *
+   * If writing back fails, nothing newer is written back until the
+   * error has been returned once, from writeback(), invalidate() or a
+   * write that is waiting for space in the log; writeback then starts
+   * over from the oldest record not written back.
+   */
+  class PersistentCache {
+  public:
+    PersistentCache(ImageCtx *ictx, const std::string &path, uint64_t size,
+		    int writeback_ops);
+    ~PersistentCache();
+
+    /**
+     * Open or create the log, recover any records left in it, and start
+     * writing them back.
+     */
+    int init();
+
+    /// write everything back and close the log
+    void shutdown();
+
+    int write(uint64_t off, const ceph::bufferlist &bl,
+	      const ::SnapContext &snapc);
+    int discard(uint64_t off, uint64_t len, const ::SnapContext &snapc);
+
+    /**
+     * Look up the parts of an image extent that are in the log.
+     *
+     * @param hits image offset -> data, for each part found
+     * @return 0 on success, or a negative error code
+     */
+    int read(uint64_t off, uint64_t len,
+	     std::map<uint64_t, ceph::bufferlist> *hits);
+
+    /// make everything logged so far durable, without writing it back
+    int flush();
+
+    /**
+     * Write back everything logged so far, and wait for it.
+     *
+     * @return 0 on success, or the error that stopped writeback
+     */
+    int writeback();
+
+    /**
+     * Write everything back and forget it, for when the image changes
+     * underneath the log (e.g. rollback or shrinking).
+     */
+    int invalidate();
+
+  private:
+    enum {
+      RECORD_WRITE = 1,
+      RECORD_DISCARD = 2,
+      RECORD_FLUSH = 3,
+      RECORD_WRAP = 4,
+    };
+
+    enum {
+      STATE_LOGGED,
+      STATE_WRITING,
+      STATE_DONE,
+    };
+
+    struct Record {
+      uint64_t seq;
+      uint8_t type;
+      uint64_t image_off;
+      uint64_t length;
+      ::SnapContext snapc;
+      uint64_t log_off;	  ///< start of the record in the log
+      uint64_t data_off;  ///< start of its data in the log
+      uint64_t size;	  ///< bytes of log it uses
+      int state;
+    };
+
+    /// a piece of the image found in the log
+    struct Extent {
+      uint64_t length;
+      uint64_t data_off;
+      uint64_t seq;
+      bool zero;
+    };
+
+    class WritebackThread : public Thread {
+    public:
+      WritebackThread(PersistentCache *cache) : m_cache(cache) {}
+      void *entry() {
+	m_cache->writeback_entry();
+	return 0;
+      }
+    private:
+      PersistentCache *m_cache;
+    };
+
+    class C_WritebackDone;
+
+    ImageCtx *m_ictx;
+    std::string m_path;
+    uint64_t m_size;
+    int m_writeback_ops;
+
+    int m_fd;
+    uuid_d m_log_uuid;
+    uint64_t m_log_start, m_log_end;
+
+    Mutex m_lock;
+    Cond m_cond;
+    uint64_t m_head;		   ///< where the next record goes
+    uint64_t m_next_seq;	   ///< seq of the next record
+    uint64_t m_writeback_seq;	   ///< next record to write back
+    uint64_t m_tail_seq;	   ///< oldest record not written back yet
+    uint64_t m_persisted_tail_seq; ///< m_tail_seq as of the last header update
+    std::deque<Record> m_records;  ///< records whose space isn't reused yet
+    std::map<uint64_t, Extent> m_extents; ///< image offset -> newest data
+    int m_in_flight;
+    int m_writeback_error;
+    bool m_stopping;
+    WritebackThread m_writeback_thread;
+
+    Record &get_record(uint64_t seq);
+
+    int read_header(uint64_t *tail_off, uint64_t *tail_seq);
+    int write_header(uint64_t tail_off, uint64_t tail_seq);
+    int recover(uint64_t tail_off, uint64_t tail_seq);
+    int read_record(uint64_t off, Record *rec, ceph::bufferlist *data);
+
+    int append(uint8_t type, uint64_t image_off, uint64_t length,
+	       const ::SnapContext &snapc, const ceph::bufferlist *data);
+    bool fits(uint64_t size, bool *wrap);
+    int write_record(const Record &rec, const ceph::bufferlist *data);
+    void add_record(const Record &rec);
+    void trim_front();
+
+    void punch(uint64_t off, uint64_t len);
+    void add_extent(uint64_t off, uint64_t len, uint64_t data_off,
+		    uint64_t seq, bool zero);
+    void remove_extents(uint64_t off, uint64_t len, uint64_t seq);
+
+    void writeback_entry();
+    int send_writeback(const Record &rec);
+    void writeback_done(uint64_t seq, int r);
+    int wait_for_writeback(uint64_t seq);
+    int take_writeback_error();
+  };
+
+}
+
+#endif
@@ -6,7 +6,9 @@
 #include "common/ceph_context.h"
 #include "common/dout.h"
 #include "common/errno.h"
+#include "common/Throttle.h"
 #include "cls/lock/cls_lock_client.h"
+#include "include/interval_set.h"
 #include "include/inttypes.h"
 #include "include/stringify.h"
 
@@ -18,6 +20,7 @@
 
 #include "librbd/internal.h"
 #include "librbd/parent_types.h"
+#include "librbd/PersistentCache.h"
 #include "include/util.h"
 
 #define dout_subsys ceph_subsys_rbd
@@ -141,10 +144,66 @@ namespace librbd {
     return 0;
   }
 
-  void trim_image(ImageCtx *ictx, uint64_t newsize, ProgressContext& prog_ctx)
+  // remove an object, holding a slot in the throttle until it is gone
+  static int aio_throttled_remove(ImageCtx *ictx, const string& oid,
+				  SimpleThrottle *throttle)
+  {
+    Context *ctx = new C_SimpleThrottle(throttle);
+    librados::AioCompletion *rados_completion =
+      librados::Rados::aio_create_completion(ctx, NULL, rados_ctx_cb);
+    int r = ictx->data_ctx.aio_remove(oid, rados_completion);
+    rados_completion->release();
+    if (r < 0)
+      ctx->complete(r);
+    return r;
+  }
+
+  // rbd_concurrent_management_ops, or -EINVAL if it is unusable
+  static int get_management_ops(CephContext *cct)
+  {
+    int max_ops = cct->_conf->rbd_concurrent_management_ops;
+    if (max_ops < 1) {
+      lderr(cct) << "rbd_concurrent_management_ops must be at least 1, not "
+		 << max_ops << dendl;
+      return -EINVAL;
+    }
+    return max_ops;
+  }
+
+  // get everything in the persistent cache onto the OSDs, before an
+  // operation that works on the objects there directly
+  static int drain_persistent_cache(ImageCtx *ictx)
+  {
+    if (!ictx->persistent_cache)
+      return 0;
+    int r = ictx->persistent_cache->writeback();
+    if (r < 0)
+      lderr(ictx->cct) << "error writing back persistent cache: "
+		       << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  // holds off copy-on-read for the duration of a resize, rollback or
+  // flatten
+  class CopyOnReadBlocker {
+  public:
+    CopyOnReadBlocker(ImageCtx *ictx) : m_ictx(ictx) {
+      m_ictx->block_copy_on_read();
+    }
+    ~CopyOnReadBlocker() {
+      m_ictx->unblock_copy_on_read();
+    }
+  private:
+    ImageCtx *m_ictx;
+  };
+
+  int trim_image(ImageCtx *ictx, uint64_t newsize, ProgressContext& prog_ctx)
   {
     assert(ictx->md_lock.is_locked());
     CephContext *cct = (CephContext *)ictx->data_ctx.cct();
+    int max_ops = get_management_ops(cct);
+    if (max_ops < 0)
+      return max_ops;
 
     uint64_t size = ictx->get_current_size();
     uint64_t period = ictx->get_stripe_period();
@@ -163,12 +222,17 @@ namespace librbd {
     if (delete_start < num_objects) {
       ldout(cct, 2) << "trim_image objects " << delete_start << " to "
 		    << (num_objects - 1) << dendl;
+      SimpleThrottle throttle(max_ops, true);
       for (uint64_t i = delete_start; i < num_objects; ++i) {
-	string oid = ictx->get_object_name(i);
-	ictx->data_ctx.remove(oid);
+	if (ictx->object_map.object_may_exist(i))
+	  aio_throttled_remove(ictx, ictx->get_object_name(i), &throttle);
 	prog_ctx.update_progress((i - delete_start) * object_size,
 				 (num_objects - delete_start) * object_size);
       }
+      int r = throttle.wait_for_ret();
+      if (r < 0)
+	lderr(cct) << "trim_image: error removing objects: "
+		   << cpp_strerror(r) << dendl;
     }
 
     // discard the weird boundary, if any
@@ -176,17 +240,32 @@ namespace librbd {
       vector<ObjectExtent> extents;
       Striper::file_to_extents(ictx->cct, ictx->format_string, &ictx->layout, newsize, delete_off - newsize, extents);
 
+      SimpleThrottle throttle(max_ops, true);
       for (vector<ObjectExtent>::iterator p = extents.begin(); p != extents.end(); ++p) {
 	ldout(ictx->cct, 20) << " ex " << *p << dendl;
+	if (!ictx->object_map.object_may_exist(p->objectno))
+	  continue;
 	if (p->offset == 0) {
-	  ictx->data_ctx.remove(p->oid.name);
+	  aio_throttled_remove(ictx, p->oid.name, &throttle);
 	} else {
 	  librados::ObjectWriteOperation op;
 	  op.truncate(p->offset);
-	  ictx->data_ctx.operate(p->oid.name, &op);
+	  Context *ctx = new C_SimpleThrottle(&throttle);
+	  librados::AioCompletion *rados_completion =
+	    librados::Rados::aio_create_completion(ctx, NULL, rados_ctx_cb);
+	  int r = ictx->data_ctx.aio_operate(p->oid.name, rados_completion,
+					     &op);
+	  rados_completion->release();
+	  if (r < 0)
+	    ctx->complete(r);
 	}
       }
+      int r = throttle.wait_for_ret();
+      if (r < 0)
+	lderr(cct) << "trim_image: error truncating objects: "
+		   << cpp_strerror(r) << dendl;
     }
+    return 0;
   }
 
   int read_rbd_info(IoCtx& io_ctx, const string& info_oid,
@@ -313,16 +392,34 @@ namespace librbd {
     assert(ictx->md_lock.is_locked());
     uint64_t numseg = ictx->get_num_objects();
     uint64_t bsize = ictx->get_object_size();
+    int r = get_management_ops(ictx->cct);
+    if (r < 0)
+      return r;
 
+    SimpleThrottle throttle(r, true);
     for (uint64_t i = 0; i < numseg; i++) {
-      int r;
       string oid = ictx->get_object_name(i);
-      r = ictx->data_ctx.selfmanaged_snap_rollback(oid, snap_id);
       ldout(ictx->cct, 10) << "selfmanaged_snap_rollback on " << oid << " to "
-			   << snap_id << " returned " << r << dendl;
+			   << snap_id << dendl;
+      librados::ObjectWriteOperation op;
+      op.selfmanaged_snap_rollback(snap_id);
+      Context *ctx = new C_SimpleThrottle(&throttle);
+      librados::AioCompletion *rados_completion =
+	librados::Rados::aio_create_completion(ctx, NULL, rados_ctx_cb);
+      r = ictx->data_ctx.aio_operate(oid, rados_completion, &op);
+      rados_completion->release();
+      if (r < 0) {
+	ctx->complete(r);
+	break;
+      }
       prog_ctx.update_progress(i * bsize, numseg * bsize);
-      if (r < 0 && r != -ENOENT)
-	return r;
+    }
+
+    r = throttle.wait_for_ret();
+    if (r < 0) {
+      lderr(ictx->cct) << "error rolling back image: " << cpp_strerror(r)
+		       << dendl;
+      return r;
     }
     return 0;
   }
@@ -431,6 +528,12 @@ namespace librbd {
     if (r < 0)
       return r;
 
+    // logged writes carry the snap context they were made with, so they
+    // must reach the OSDs before the snapshot exists
+    r = drain_persistent_cache(ictx);
+    if (r < 0)
+      return r;
+
     Mutex::Locker l(ictx->md_lock);
     do {
       r = add_snap(ictx, snap_name);
@@ -759,6 +862,19 @@ reprotect_and_return_err:
       }
     }
 
+    if (features & RBD_FEATURE_OBJECT_MAP) {
+      uint64_t count = stripe_count ? stripe_count : 1;
+      uint64_t period = count * (1ull << order);
+      uint64_t num_objs = ((size + period - 1) / period) * count;
+      r = cls_client::object_map_resize(&io_ctx, ObjectMap::object_map_name(id),
+					num_objs);
+      if (r < 0) {
+	lderr(cct) << "error creating object map: " << cpp_strerror(r)
+		   << dendl;
+	goto err_remove_header;
+      }
+    }
+
     ldout(cct, 2) << "done." << dendl;
     return 0;
 
@@ -1166,17 +1282,18 @@ reprotect_and_return_err:
     return ictx->get_parent_overlap(ictx->snap_id, overlap);
   }
 
-  int open_parent(ImageCtx *ictx)
+  /**
+   * Open a snapshot of a parent image, given its ids.  Needs no locks
+   * on the child.
+   */
+  static int open_parent_snap(ImageCtx *ictx, int64_t pool_id,
+			      const string &image_id, snap_t snap_id,
+			      ImageCtx **parent)
   {
-    assert(ictx->snap_lock.is_locked());
-    assert(ictx->parent_lock.is_locked());
     string pool_name;
     Rados rados(ictx->md_ctx);
 
-    int64_t pool_id = ictx->get_parent_pool_id(ictx->snap_id);
-    string parent_image_id = ictx->get_parent_image_id(ictx->snap_id);
-    snap_t parent_snap_id = ictx->get_parent_snap_id(ictx->snap_id);
-    assert(parent_snap_id != CEPH_NOSNAP);
+    assert(snap_id != CEPH_NOSNAP);
 
     if (pool_id < 0)
       return -ENOENT;
@@ -1197,31 +1314,41 @@ reprotect_and_return_err:
 
     // since we don't know the image and snapshot name, set their ids and
     // reset the snap_name and snap_exists fields after we read the header
-    ictx->parent = new ImageCtx("", parent_image_id, NULL, p_ioctx, true);
-    r = open_image(ictx->parent);
+    ImageCtx *p = new ImageCtx("", image_id, NULL, p_ioctx, true);
+    r = open_image(p);
     if (r < 0) {
       lderr(ictx->cct) << "error opening parent image: " << cpp_strerror(r)
 		       << dendl;
-      close_image(ictx->parent);
-      ictx->parent = NULL;
+      close_image(p);
       return r;
     }
 
-    ictx->parent->snap_lock.Lock();
-    r = ictx->parent->get_snap_name(parent_snap_id, &ictx->parent->snap_name);
+    p->snap_lock.Lock();
+    r = p->get_snap_name(snap_id, &p->snap_name);
     if (r < 0) {
       lderr(ictx->cct) << "parent snapshot does not exist" << dendl;
-      ictx->parent->snap_lock.Unlock();
-      close_image(ictx->parent);
-      ictx->parent = NULL;
+      p->snap_lock.Unlock();
+      close_image(p);
       return r;
     }
-    ictx->parent->snap_set(ictx->parent->snap_name);
-    ictx->parent->snap_lock.Unlock();
+    p->snap_set(p->snap_name);
+    p->snap_lock.Unlock();
 
+    *parent = p;
     return 0;
   }
 
+  int open_parent(ImageCtx *ictx)
+  {
+    assert(ictx->snap_lock.is_locked());
+    assert(ictx->parent_lock.is_locked());
+
+    return open_parent_snap(ictx, ictx->get_parent_pool_id(ictx->snap_id),
+			    ictx->get_parent_image_id(ictx->snap_id),
+			    ictx->get_parent_snap_id(ictx->snap_id),
+			    &ictx->parent);
+  }
+
   int get_parent_info(ImageCtx *ictx, string *parent_pool_name,
 		      string *parent_name, string *parent_snap_name)
   {
@@ -1305,8 +1432,12 @@ reprotect_and_return_err:
       unknown_format = false;
       id = ictx->id;
       ictx->md_lock.Lock();
-      trim_image(ictx, 0, prog_ctx);
+      r = trim_image(ictx, 0, prog_ctx);
       ictx->md_lock.Unlock();
+      if (r < 0) {
+	close_image(ictx);
+	return r;
+      }
 
       ictx->parent_lock.Lock();
       // struct assignment
@@ -1321,6 +1452,16 @@ reprotect_and_return_err:
       }
       close_image(ictx);
 
+      if (!old_format) {
+	ldout(cct, 2) << "removing object map..." << dendl;
+	r = io_ctx.remove(ObjectMap::object_map_name(id));
+	if (r < 0 && r != -ENOENT) {
+	  lderr(cct) << "error removing object map: " << cpp_strerror(-r)
+		     << dendl;
+	  return r;
+	}
+      }
+
       ldout(cct, 2) << "removing header..." << dendl;
       r = io_ctx.remove(header_oid);
       if (r < 0 && r != -ENOENT) {
@@ -1377,18 +1518,29 @@ reprotect_and_return_err:
       return 0;
     }
 
+    uint64_t period = ictx->get_stripe_period();
+    uint64_t num_objs = (size + period - 1) / period * ictx->get_stripe_count();
+    int r;
     if (size > ictx->size) {
       ldout(cct, 2) << "expanding image " << ictx->size << " -> " << size
 		    << dendl;
+      // grow the object map first so that no write to the new
+      // objects can be missing from it
+      r = ictx->object_map.resize(num_objs);
+      if (r < 0)
+	return r;
       // TODO: make ictx->set_size
     } else {
       ldout(cct, 2) << "shrinking image " << ictx->size << " -> " << size
 		    << dendl;
-      trim_image(ictx, size, prog_ctx);
+      r = trim_image(ictx, size, prog_ctx);
+      if (r < 0)
+	return r;
+      // stale bits are harmless, so a failure here is not fatal
+      ictx->object_map.resize(num_objs);
     }
     ictx->size = size;
 
-    int r;
     if (ictx->old_format) {
       // rewrite header
       bufferlist bl;
@@ -1426,8 +1578,15 @@ reprotect_and_return_err:
     if (r < 0)
       return r;
 
+    // don't let a copy-up recreate an object that is about to be removed
+    CopyOnReadBlocker cor_blocker(ictx);
+
+    r = drain_persistent_cache(ictx);
+    if (r < 0)
+      return r;
+
     Mutex::Locker l(ictx->md_lock);
-    if (size < ictx->size && ictx->object_cacher) {
+    if (size < ictx->size && (ictx->object_cacher || ictx->persistent_cache)) {
       // need to invalidate since we're deleting objects, and
       // ObjectCacher doesn't track non-existent objects
       ictx->invalidate_cache();
@@ -1721,6 +1880,8 @@ reprotect_and_return_err:
       ictx->data_ctx.selfmanaged_snap_set_write_ctx(ictx->snapc.seq, ictx->snaps);
     } // release snap_lock
 
+    ictx->object_map.refresh();
+
     if (new_snap) {
       _flush(ictx);
     }
@@ -1743,6 +1904,8 @@ reprotect_and_return_err:
     if (r < 0)
       return r;
 
+    CopyOnReadBlocker cor_blocker(ictx);
+
     Mutex::Locker l(ictx->md_lock);
     Mutex::Locker l2(ictx->snap_lock);
     if (!ictx->snap_exists)
@@ -1774,6 +1937,14 @@ reprotect_and_return_err:
       return r;
     }
 
+    // the map can't tell which objects the snapshot brings back
+    r = ictx->object_map.invalidate();
+    if (r < 0) {
+      lderr(cct) << "Error invalidating object map: "
+		 << cpp_strerror(-r) << dendl;
+      return r;
+    }
+
     r = rollback_image(ictx, snap_id, prog_ctx);
     if (r < 0) {
       lderr(cct) << "Error rolling back image: " << cpp_strerror(-r) << dendl;
@@ -1790,26 +1961,24 @@ reprotect_and_return_err:
     return r;
   }
 
-  struct CopyProgressCtx {
-    CopyProgressCtx(ProgressContext &p)
-      : destictx(NULL), src_size(0), prog_ctx(p)
-    { }
-
-    ImageCtx *destictx;
-    uint64_t src_size;
-    ProgressContext &prog_ctx;
+  class C_CopyWrite : public Context {
+  public:
+    C_CopyWrite(SimpleThrottle *throttle, bufferlist *bl)
+      : m_throttle(throttle), m_bl(bl) {}
+    virtual void finish(int r) {
+      delete m_bl;
+      m_throttle->end_op(r);
+    }
+  private:
+    SimpleThrottle *m_throttle;
+    bufferlist *m_bl;
   };
 
-  int do_copy_extent(uint64_t offset, size_t len, const char *buf, void *data)
-  {
-    CopyProgressCtx *cp = reinterpret_cast<CopyProgressCtx*>(data);
-    cp->prog_ctx.update_progress(offset, cp->src_size);
-    int ret = 0;
-    if (buf) {
-      ret = write(cp->destictx, offset, len, buf);
-    }
-    return ret;
-  }
+  struct CopyRead {
+    uint64_t offset;
+    bufferlist *bl;
+    AioCompletion *comp;
+  };
 
   int copy(ImageCtx *src, IoCtx& dest_md_ctx, const char *destname,
 	   ProgressContext &prog_ctx)
@@ -1820,13 +1989,18 @@ reprotect_and_return_err:
 		   << " -> " << destname << dendl;
     int order = src->order;
 
+    // don't leave an empty destination behind if the copy can't start
+    int r = get_management_ops(cct);
+    if (r < 0)
+      return r;
+
     src->md_lock.Lock();
     src->snap_lock.Lock();
     uint64_t src_size = src->get_image_size(src->snap_id);
     src->snap_lock.Unlock();
     src->md_lock.Unlock();
 
-    int r = create(dest_md_ctx, destname, src_size, src->old_format,
+    r = create(dest_md_ctx, destname, src_size, src->old_format,
 		   src->features, &order, src->stripe_unit, src->stripe_count);
     if (r < 0) {
       lderr(cct) << "header creation failed" << dendl;
@@ -1848,8 +2022,6 @@ reprotect_and_return_err:
 
   int copy(ImageCtx *src, ImageCtx *dest, ProgressContext &prog_ctx)
   {
-    CopyProgressCtx cp(prog_ctx);
-
     src->md_lock.Lock();
     src->snap_lock.Lock();
     uint64_t src_size = src->get_image_size(src->snap_id);
@@ -1867,36 +2039,101 @@ reprotect_and_return_err:
       return -EINVAL;
     }
 
-    cp.destictx = dest;
-    cp.src_size = src_size;
+    int r = ictx_check(src);
+    if (r < 0)
+      return r;
 
-    int64_t r = read_iterate(src, 0, src_size, do_copy_extent, &cp);
+    // copy a stripe period at a time, keeping up to
+    // rbd_concurrent_management_ops reads and as many writes in flight.
+    // writes are issued from this thread rather than from read
+    // completions, since a write into the cache may block waiting for
+    // writeback that completes on the same thread.
+    r = get_management_ops(src->cct);
+    if (r < 0)
+      return r;
+    uint64_t max_ops = r;
+    SimpleThrottle throttle(max_ops, false);
+    uint64_t period = src->get_stripe_period();
+    uint64_t offset = 0;
+    std::list<CopyRead> reads;
+    int ret = 0;
+    while (offset < src_size || !reads.empty()) {
+      while (ret == 0 && offset < src_size && reads.size() < max_ops) {
+	CopyRead rd;
+	rd.offset = offset;
+	rd.bl = new bufferlist();
+	rd.comp = aio_create_completion();
+	r = aio_read(src, offset, min(period, src_size - offset), NULL, rd.bl,
+		     rd.comp);
+	if (r < 0) {
+	  rd.comp->release();
+	  delete rd.bl;
+	  ret = r;
+	  break;
+	}
+	reads.push_back(rd);
+	offset += period;
+      }
+      if (reads.empty())
+	break;
+
+      CopyRead rd = reads.front();
+      reads.pop_front();
+      rd.comp->wait_for_complete();
+      r = rd.comp->get_return_value();
+      rd.comp->release();
+      if (r < 0 && ret == 0) {
+	lderr(src->cct) << "error reading from source image at offset "
+			<< rd.offset << ": " << cpp_strerror(r) << dendl;
+	ret = r;
+      }
+      if (ret < 0 || rd.bl->is_zero()) {
+	delete rd.bl;
+	continue;
+      }
 
-    if (r >= 0) {
-      // don't return total bytes read, which may not fit in an int
-      r = 0;
-      prog_ctx.update_progress(cp.src_size, cp.src_size);
+      Context *ctx = new C_CopyWrite(&throttle, rd.bl);
+      throttle.start_op();
+      AioCompletion *comp = aio_create_completion_internal(ctx, rbd_ctx_cb);
+      r = aio_write(dest, rd.offset, *rd.bl, comp);
+      if (r < 0) {
+	lderr(dest->cct) << "error writing to destination image at offset "
+			 << rd.offset << ": " << cpp_strerror(r) << dendl;
+	ctx->complete(r);
+      }
+      comp->release();
+      prog_ctx.update_progress(rd.offset, src_size);
     }
-    return r;
+
+    r = throttle.wait_for_ret();
+    if (ret < 0)
+      return ret;
+    if (r < 0)
+      return r;
+    prog_ctx.update_progress(src_size, src_size);
+    return 0;
   }
 
   // common snap_set functionality for snap_set and open_image
 
   int _snap_set(ImageCtx *ictx, const char *snap_name)
   {
-    Mutex::Locker l1(ictx->snap_lock);
-    Mutex::Locker l2(ictx->parent_lock);
-    int r;
-    if ((snap_name != NULL) && (strlen(snap_name) != 0)) {
-      r = ictx->snap_set(snap_name);
-    } else {
-      ictx->snap_unset();
-      r = 0;
-    }
-    if (r < 0) {
-      return r;
+    {
+      Mutex::Locker l1(ictx->snap_lock);
+      Mutex::Locker l2(ictx->parent_lock);
+      int r;
+      if ((snap_name != NULL) && (strlen(snap_name) != 0)) {
+	r = ictx->snap_set(snap_name);
+      } else {
+	ictx->snap_unset();
+	r = 0;
+      }
+      if (r < 0) {
+	return r;
+      }
+      refresh_parent(ictx);
     }
-    refresh_parent(ictx);
+    ictx->object_map.refresh();
     return 0;
   }
 
@@ -1939,6 +2176,27 @@ reprotect_and_return_err:
     if ((r = _snap_set(ictx, ictx->snap_name.c_str())) < 0)
       goto err_close;
 
+    if (ictx->cct->_conf->rbd_persistent_cache && !ictx->read_only &&
+	ictx->snap_name.empty()) {
+      if (ictx->old_format) {
+	// the log is named after the image id
+	lderr(ictx->cct) << "persistent cache requires a format 2 image, "
+			 << "not using it" << dendl;
+      } else {
+	ictx->persistent_cache =
+	  new PersistentCache(ictx,
+			      ictx->cct->_conf->rbd_persistent_cache_path,
+			      ictx->cct->_conf->rbd_persistent_cache_size,
+			      ictx->cct->_conf->rbd_persistent_cache_writeback_ops);
+	r = ictx->persistent_cache->init();
+	if (r < 0) {
+	  delete ictx->persistent_cache;
+	  ictx->persistent_cache = NULL;
+	  goto err_close;
+	}
+      }
+    }
+
     return 0;
 
   err_close:
@@ -1949,10 +2207,19 @@ reprotect_and_return_err:
   void close_image(ImageCtx *ictx)
   {
     ldout(ictx->cct, 20) << "close_image " << ictx << dendl;
-    if (ictx->object_cacher)
+    if (ictx->persistent_cache) {
+      ictx->persistent_cache->shutdown(); // writes everything back
+      delete ictx->persistent_cache;
+      ictx->persistent_cache = NULL;
+    } else if (ictx->object_cacher) {
       ictx->shutdown_cache(); // implicitly flushes
-    else
+    } else {
       flush(ictx);
+    }
+
+    // copy-ups read from the parent
+    ictx->wait_for_copy_on_read();
+    ictx->object_map.wait_for_marks();
 
     if (ictx->parent) {
       close_image(ictx->parent);
@@ -1965,6 +2232,79 @@ reprotect_and_return_err:
     delete ictx;
   }
 
+  /**
+   * Copy an object up from the parent data read into buf().  Completes
+   * with COPYUP_ZERO instead of 0 if that was all zeros, so nothing was
+   * written.
+   */
+  static const int COPYUP_ZERO = 1;
+
+  class C_CopyupObject : public Context {
+  public:
+    C_CopyupObject(Context *ctx, ImageCtx *ictx,
+		   uint64_t object_no, uint64_t object_size)
+      : m_ctx(ctx), m_ictx(ictx),
+	m_object_no(object_no), m_bp(buffer::create(object_size)) {}
+    char *buf() {
+      return m_bp.c_str();
+    }
+    virtual void finish(int r) {
+      if (r < 0) {
+	lderr(m_ictx->cct) << "reading from parent failed" << dendl;
+	m_ctx->complete(r);
+	return;
+      }
+
+      // for actual amount read, if data is all zero, don't bother with block
+      if (buf_is_zero(m_bp.c_str(), r)) {
+	m_ctx->complete(COPYUP_ZERO);
+	return;
+      }
+
+      bufferlist bl;
+      bl.append(m_bp, 0, r);
+      Context *ctx = new C_SendCopyup(m_ctx, m_ictx, m_object_no, bl);
+      if (!m_ictx->object_map.aio_mark_exists(m_object_no, ctx))
+	ctx->complete(0);
+    }
+  private:
+    // sends the copyup once the object is in the object map
+    class C_SendCopyup : public Context {
+    public:
+      C_SendCopyup(Context *ctx, ImageCtx *ictx, uint64_t object_no,
+		   bufferlist &bl)
+	: m_ctx(ctx), m_ictx(ictx), m_object_no(object_no), m_bl(bl) {}
+      virtual void finish(int r) {
+	if (r < 0) {
+	  m_ctx->complete(r);
+	  return;
+	}
+
+	librados::ObjectWriteOperation copyup;
+	copyup.exec("rbd", "copyup", m_bl);
+	librados::AioCompletion *rados_completion =
+	  librados::Rados::aio_create_completion(m_ctx, NULL, rados_ctx_cb);
+	r = m_ictx->data_ctx.aio_operate(m_ictx->get_object_name(m_object_no),
+					 rados_completion, &copyup);
+	rados_completion->release();
+	if (r < 0) {
+	  lderr(m_ictx->cct) << "failed to copy block to child" << dendl;
+	  m_ctx->complete(r);
+	}
+      }
+    private:
+      Context *m_ctx;
+      ImageCtx *m_ictx;
+      uint64_t m_object_no;
+      bufferlist m_bl;
+    };
+
+    Context *m_ctx;
+    ImageCtx *m_ictx;
+    uint64_t m_object_no;
+    bufferptr m_bp;
+  };
+
   // 'flatten' child image by copying all parent's blocks
   int flatten(ImageCtx *ictx, ProgressContext &prog_ctx)
   {
@@ -1980,6 +2320,10 @@ reprotect_and_return_err:
       return r;
     }
 
+    if ((r = drain_persistent_cache(ictx)) < 0)
+      return r;
+    CopyOnReadBlocker cor_blocker(ictx);
+
     Mutex::Locker l(ictx->md_lock);
     Mutex::Locker l2(ictx->snap_lock);
     Mutex::Locker l3(ictx->parent_lock);
@@ -2003,7 +2347,10 @@ reprotect_and_return_err:
     uint64_t overlap_periods = (overlap + period - 1) / period;
     uint64_t overlap_objects = overlap_periods * ictx->get_stripe_count();
 
-    char *buf = new char[object_size];
+    r = get_management_ops(ictx->cct);
+    if (r < 0)
+      return r;
+    SimpleThrottle throttle(r, false);
 
     for (uint64_t ono = 0; ono < overlap_objects; ono++) {
       prog_ctx.update_progress(ono, overlap_objects);
@@ -2016,24 +2363,23 @@ reprotect_and_return_err:
       uint64_t object_overlap = ictx->prune_parent_extents(objectx, overlap);
       assert(object_overlap <= object_size);
 
-      if ((r = read(ictx->parent, objectx, buf, NULL)) < 0) {
+      C_CopyupObject *req = new C_CopyupObject(new C_SimpleThrottle(&throttle),
+					       ictx, ono, object_size);
+      AioCompletion *comp = aio_create_completion_internal(req, rbd_ctx_cb);
+      r = aio_read(ictx->parent, objectx, req->buf(), NULL, comp);
+      if (r < 0) {
 	lderr(ictx->cct) << "reading from parent failed" << dendl;
-	goto err;
-      }
-
-      // for actual amount read, if data is all zero, don't bother with block
-      if (!buf_is_zero(buf, r)) {
-	bufferlist bl;
-	string oid = ictx->get_object_name(ono);
-	bl.append(buf, r);
-	r = cls_client::copyup(&ictx->data_ctx, oid, bl);
-	if (r < 0) {
-	  lderr(ictx->cct) << "failed to copy block to child" << dendl;
-	  goto err;
-	}
+	req->complete(r);
+	comp->release();
+	break;
       }
+      comp->release();
     }
 
+    r = throttle.wait_for_ret();
+    if (r < 0)
+      return r;
+
     // remove parent from this (base) image
     r = cls_client::remove_parent(&ictx->md_ctx, ictx->header_oid);
     if (r < 0) {
@@ -2057,9 +2403,7 @@ reprotect_and_return_err:
 
     ldout(ictx->cct, 20) << "finished flattening" << dendl;
 
-  err:
-    delete[] buf;
-    return r;
+    return 0;
   }
 
   int list_lockers(ImageCtx *ictx,
@@ -2239,6 +2583,247 @@ reprotect_and_return_err:
     return total_read;
   }
 
+  /**
+   * Work out which parts of an object changed between two snapshots,
+   * from the clone information the OSD keeps for it.
+   *
+   * @param snap_set clones of the object
+   * @param start snapshot to compare against, 0 for the beginning of time
+   * @param end snapshot to compare, or CEPH_NOSNAP for the head
+   * @param diff extents of the object that differ
+   * @param end_exists whether the object exists as of end
+   */
+  static void calc_snap_set_diff(CephContext *cct,
+				 const librados::snap_set_t& snap_set,
+				 snap_t start, snap_t end,
+				 interval_set<uint64_t> *diff, bool *end_exists)
+  {
+    bool saw_start = false;
+    uint64_t start_size = 0;
+    diff->clear();
+    *end_exists = false;
+
+    vector<librados::clone_info_t>::const_iterator r = snap_set.clones.begin();
+    while (r != snap_set.clones.end()) {
+      // the interval of snaps this clone (or the head) stands for
+      snap_t a, b;
+      if (r->cloneid == librados::SNAP_HEAD) {
+	a = snap_set.seq + 1;
+	b = librados::SNAP_HEAD;
+      } else {
+	if (r->snaps.empty()) {
+	  ++r;
+	  continue;
+	}
+	a = r->snaps[0];
+	b = r->snaps[r->snaps.size() - 1];
+      }
+      ldout(cct, 20) << " clone " << r->cloneid << " [" << a << "," << b << "]"
+		     << " size " << r->size << dendl;
+
+      if (b < start) {
+	++r;
+	continue;
+      }
+
+      if (!saw_start) {
+	if (start < a) {
+	  // the object did not exist at start
+	  if (r->size)
+	    diff->insert(0, r->size);
+	  start_size = 0;
+	} else {
+	  start_size = r->size;
+	}
+	saw_start = true;
+      }
+
+      if (end < a)
+	break;  // the object did not exist at end
+      if (end <= b) {
+	*end_exists = true;
+	break;
+      }
+
+      // everything up to the larger of this size and the next one,
+      // less what the next one has in common with this one
+      const vector<pair<uint64_t, uint64_t> >& overlap = r->overlap;
+      uint64_t max_size = r->size;
+      ++r;
+      if (r != snap_set.clones.end() && r->size > max_size)
+	max_size = r->size;
+      interval_set<uint64_t> diff_to_next;
+      if (max_size)
+	diff_to_next.insert(0, max_size);
+      for (vector<pair<uint64_t, uint64_t> >::const_iterator p = overlap.begin();
+	   p != overlap.end(); ++p) {
+	interval_set<uint64_t> o;
+	o.insert(p->first, p->second);
+	o.intersection_of(diff_to_next);
+	diff_to_next.subtract(o);
+      }
+      diff->union_of(diff_to_next);
+    }
+
+    if (!*end_exists) {
+      // whatever was there at start is gone
+      diff->clear();
+      if (start_size)
+	diff->insert(0, start_size);
+    }
+  }
+
+  static int diff_collect_cb(uint64_t off, size_t len, int exists, void *arg)
+  {
+    interval_set<uint64_t> *diff = static_cast<interval_set<uint64_t> *>(arg);
+    if (exists)
+      diff->insert(off, len);
+    return 0;
+  }
+
+  int diff_iterate(ImageCtx *ictx, const char *fromsnapname,
+		   uint64_t off, uint64_t len,
+		   int (*cb)(uint64_t, size_t, int, void *),
+		   void *arg)
+  {
+    CephContext *cct = ictx->cct;
+    ldout(cct, 20) << "diff_iterate " << ictx << " off = " << off
+		   << " len = " << len << " from "
+		   << (fromsnapname ? fromsnapname : "beginning") << dendl;
+
+    int r = ictx_check(ictx);
+    if (r < 0)
+      return r;
+
+    ictx->snap_lock.Lock();
+    snap_t from_snap_id = 0;
+    if (fromsnapname) {
+      from_snap_id = ictx->get_snap_id(fromsnapname);
+      if (from_snap_id == CEPH_NOSNAP) {
+	ictx->snap_lock.Unlock();
+	return -ENOENT;
+      }
+    }
+    snap_t end_snap_id = ictx->snap_id;
+    uint64_t end_size = ictx->get_image_size(end_snap_id);
+    ictx->snap_lock.Unlock();
+
+    if (from_snap_id >= end_snap_id) {
+      lderr(cct) << "diff_iterate: must diff against an earlier snapshot"
+		 << dendl;
+      return -EINVAL;
+    }
+
+    if (off >= end_size)
+      return 0;
+    len = min(len, end_size - off);
+
+    // a clone shows its parent's data wherever it has no object of its
+    // own, so a diff from the beginning of time has to include that
+    interval_set<uint64_t> parent_diff;
+    if (from_snap_id == 0) {
+      // the parent is listed synchronously, object by object, so don't
+      // hold up the child's snap_lock and parent_lock meanwhile; use a
+      // private handle on the parent, which can't be closed under us
+      uint64_t overlap = 0;
+      int64_t parent_pool_id = -1;
+      string parent_image_id;
+      snap_t parent_snap_id = CEPH_NOSNAP;
+      ictx->snap_lock.Lock();
+      ictx->parent_lock.Lock();
+      ictx->get_parent_overlap(end_snap_id, &overlap);
+      if (ictx->parent) {
+	parent_pool_id = ictx->get_parent_pool_id(end_snap_id);
+	parent_image_id = ictx->get_parent_image_id(end_snap_id);
+	parent_snap_id = ictx->get_parent_snap_id(end_snap_id);
+      }
+      ictx->parent_lock.Unlock();
+      ictx->snap_lock.Unlock();
+
+      if (parent_pool_id >= 0 && overlap > 0) {
+	ldout(cct, 10) << "diff_iterate: getting parent diff up to "
+		       << overlap << dendl;
+	ImageCtx *parent;
+	r = open_parent_snap(ictx, parent_pool_id, parent_image_id,
+			     parent_snap_id, &parent);
+	if (r < 0)
+	  return r;
+	r = diff_iterate(parent, NULL, 0, overlap, diff_collect_cb,
+			 &parent_diff);
+	close_image(parent);
+	if (r < 0)
+	  return r;
+      }
+    }
+
+    IoCtx io_ctx;
+    io_ctx.dup(ictx->data_ctx);
+    io_ctx.snap_set_read(librados::SNAP_DIR);
+
+    map<object_t, vector<ObjectExtent> > object_extents;
+    Striper::file_to_extents(cct, ictx->format_string, &ictx->layout,
+			     off, len, object_extents, 0);
+
+    for (map<object_t, vector<ObjectExtent> >::iterator p = object_extents.begin();
+	 p != object_extents.end(); ++p) {
+      ldout(cct, 20) << "diff_iterate object " << p->first << dendl;
+
+      librados::snap_set_t snap_set;
+      r = io_ctx.list_snaps(p->first.name, &snap_set);
+      interval_set<uint64_t> diff;
+      bool end_exists = false;
+      if (r == 0) {
+	calc_snap_set_diff(cct, snap_set, from_snap_id, end_snap_id,
+			   &diff, &end_exists);
+      } else if (r != -ENOENT) {
+	return r;
+      }
+      ldout(cct, 20) << "  diff " << diff << " end_exists " << end_exists
+		     << dendl;
+
+      for (vector<ObjectExtent>::iterator q = p->second.begin();
+	   q != p->second.end(); ++q) {
+	// what the object reports, restricted to this extent
+	interval_set<uint64_t> extent;
+	extent.insert(q->offset, q->length);
+	extent.intersection_of(diff);
+	for (interval_set<uint64_t>::iterator z = extent.begin();
+	     z != extent.end(); ++z) {
+	  vector<pair<uint64_t, uint64_t> > image_extents;
+	  Striper::extent_to_file(cct, &ictx->layout, q->objectno,
+				  z.get_start(), z.get_len(), image_extents);
+	  for (vector<pair<uint64_t, uint64_t> >::iterator e = image_extents.begin();
+	       e != image_extents.end(); ++e) {
+	    r = cb(e->first, e->second, end_exists, arg);
+	    if (r < 0)
+	      return r;
+	  }
+	}
+
+	if (end_exists || parent_diff.empty())
+	  continue;
+
+	// fill in from the parent where the child has nothing
+	vector<pair<uint64_t, uint64_t> > image_extents;
+	Striper::extent_to_file(cct, &ictx->layout, q->objectno,
+				q->offset, q->length, image_extents);
+	for (vector<pair<uint64_t, uint64_t> >::iterator e = image_extents.begin();
+	     e != image_extents.end(); ++e) {
+	  interval_set<uint64_t> o;
+	  o.insert(e->first, e->second);
+	  o.intersection_of(parent_diff);
+	  for (interval_set<uint64_t>::iterator z = o.begin(); z != o.end(); ++z) {
+	    r = cb(z.get_start(), z.get_len(), true, arg);
+	    if (r < 0)
+	      return r;
+	  }
+	}
+      }
+    }
+
+    return 0;
+  }
+
   int simple_read_cb(uint64_t ofs, size_t len, const char *buf, void *arg)
   {
     char *dest_buf = (char *)arg;
@@ -2426,6 +3011,12 @@ reprotect_and_return_err:
     req->complete(rados_aio_get_return_value(c));
   }
 
+  void rados_ctx_cb(rados_completion_t c, void *arg)
+  {
+    Context *ctx = reinterpret_cast<Context *>(arg);
+    ctx->complete(rados_aio_get_return_value(c));
+  }
+
   // validate extent against image size; clip to image size if necessary
   int clip_io(ImageCtx *ictx, uint64_t off, uint64_t *len)
   {
@@ -2463,6 +3054,10 @@ reprotect_and_return_err:
     if (r < 0)
       return r;
 
+    // writes only have to be durable, not on the OSDs yet
+    if (ictx->persistent_cache)
+      return ictx->persistent_cache->flush();
+
     return _flush(ictx);
   }
 
@@ -2471,9 +3066,13 @@ reprotect_and_return_err:
     CephContext *cct = ictx->cct;
     int r;
     // flush any outstanding writes
-    if (ictx->object_cacher) {
+    if (ictx->persistent_cache) {
+      r = ictx->persistent_cache->writeback();
+    } else if (ictx->object_cacher) {
       r = ictx->flush_cache();
     } else {
+      // writes waiting on the object map haven't been sent yet
+      ictx->object_map.wait_for_marks();
       r = ictx->data_ctx.aio_flush();
     }
 
@@ -2485,19 +3084,51 @@ reprotect_and_return_err:
 
   int aio_write(ImageCtx *ictx, uint64_t off, size_t len, const char *buf,
 		AioCompletion *c)
+  {
+    ldout(ictx->cct, 20) << "aio_write " << ictx << " off = " << off << " len = "
+			 << len << " buf = " << (void*)buf << dendl;
+
+    // the caller keeps buf around until the write completes, so there's
+    // no need to copy it
+    bufferlist bl;
+    if (len)
+      bl.push_back(buffer::create_static(len, const_cast<char *>(buf)));
+    return aio_write(ictx, off, bl, c);
+  }
+
+  int aio_writev(ImageCtx *ictx, uint64_t off, const struct iovec *iov,
+		 int iovcnt, AioCompletion *c)
+  {
+    ldout(ictx->cct, 20) << "aio_writev " << ictx << " off = " << off
+			 << " iovcnt = " << iovcnt << dendl;
+
+    if (iovcnt < 0)
+      return -EINVAL;
+
+    bufferlist bl;
+    for (int i = 0; i < iovcnt; ++i) {
+      if (iov[i].iov_len)
+	bl.push_back(buffer::create_static(iov[i].iov_len,
+					   (char *)iov[i].iov_base));
+    }
+    return aio_write(ictx, off, bl, c);
+  }
+
+  int aio_write(ImageCtx *ictx, uint64_t off, const bufferlist &bl,
+		AioCompletion *c)
   {
     CephContext *cct = ictx->cct;
-    ldout(cct, 20) << "aio_write " << ictx << " off = " << off << " len = "
-		   << len << " buf = " << &buf << dendl;
+    ldout(cct, 20) << "aio_write " << ictx << " off = " << off << " bl = "
+		   << bl.length() << dendl;
 
-    if (!len)
+    if (!bl.length())
       return 0;
 
     int r = ictx_check(ictx);
     if (r < 0)
       return r;
 
-    uint64_t mylen = len;
+    uint64_t mylen = bl.length();
     r = clip_io(ictx, off, &mylen);
     if (r < 0)
       return r;
@@ -2505,40 +3136,78 @@ reprotect_and_return_err:
     ictx->snap_lock.Lock();
     snapid_t snap_id = ictx->snap_id;
     ::SnapContext snapc = ictx->snapc;
-    ictx->parent_lock.Lock();
-    uint64_t overlap = 0;
-    ictx->get_parent_overlap(ictx->snap_id, &overlap);
-    ictx->parent_lock.Unlock();
     ictx->snap_lock.Unlock();
 
     if (snap_id != CEPH_NOSNAP || ictx->read_only)
       return -EROFS;
 
+    bufferlist data;
+    data.substr_of(bl, 0, mylen);
+    if (ictx->persistent_cache) {
+      // may block
+      r = ictx->persistent_cache->write(off, data, snapc);
+      if (r < 0)
+	return r;
+      c->get();
+      c->init_time(ictx, AIO_TYPE_WRITE);
+      c->finish_adding_requests(cct);
+      c->put();
+    } else {
+      c->init_time(ictx, AIO_TYPE_WRITE);
+      r = _aio_write(ictx, off, data, snapc, c);
+    }
+
+    ictx->perfcounter->inc(l_librbd_aio_wr);
+    ictx->perfcounter->inc(l_librbd_aio_wr_bytes, mylen);
+    return r;
+  }
+
+  int _aio_write(ImageCtx *ictx, uint64_t off, const bufferlist &bl,
+		 const ::SnapContext &snapc, AioCompletion *c)
+  {
+    CephContext *cct = ictx->cct;
+    int r;
+
+    ictx->snap_lock.Lock();
+    ictx->parent_lock.Lock();
+    uint64_t overlap = 0;
+    ictx->get_parent_overlap(CEPH_NOSNAP, &overlap);
+    ictx->parent_lock.Unlock();
+    ictx->snap_lock.Unlock();
+
     ldout(cct, 20) << "  parent overlap " << overlap << dendl;
 
     // map
     vector<ObjectExtent> extents;
-    Striper::file_to_extents(ictx->cct, ictx->format_string, &ictx->layout, off, mylen, extents);
+    Striper::file_to_extents(ictx->cct, ictx->format_string, &ictx->layout,
+			     off, bl.length(), extents);
 
     size_t total_write = 0;
 
     c->get();
-    c->init_time(ictx, AIO_TYPE_WRITE);
     for (vector<ObjectExtent>::iterator p = extents.begin(); p != extents.end(); ++p) {
       ldout(cct, 20) << " oid " << p->oid << " " << p->offset << "~" << p->length
 		     << " from " << p->buffer_extents << dendl;
 
       // assemble extent
-      bufferlist bl;
+      bufferlist object_bl;
       for (vector<pair<uint64_t,uint64_t> >::iterator q = p->buffer_extents.begin();
 	   q != p->buffer_extents.end();
 	   ++q) {
-	bl.append(buf + q->first, q->second);
+	bufferlist sub;
+	sub.substr_of(bl, q->first, q->second);
+	object_bl.claim_append(sub);
       }
 
       if (ictx->object_cacher) {
+	// the cache keeps the data after the write completes, so it
+	// can't refer to the caller's memory
+	bufferptr bp(object_bl.length());
+	object_bl.copy(0, object_bl.length(), bp.c_str());
+	bufferlist cache_bl;
+	cache_bl.push_back(bp);
 	// may block
-	ictx->write_to_cache(p->oid, bl, p->length, p->offset);
+	ictx->write_to_cache(p->oid, cache_bl, p->length, p->offset);
       } else {
 	// reverse map this object extent onto the parent
 	vector<pair<uint64_t,uint64_t> > objectx;
@@ -2550,21 +3219,18 @@ reprotect_and_return_err:
 	C_AioWrite *req_comp = new C_AioWrite(cct, c);
 	AioWrite *req = new AioWrite(ictx, p->oid.name, p->objectno, p->offset,
 				     objectx, object_overlap,
-				     bl, snapc, snap_id, req_comp);
+				     object_bl, snapc, CEPH_NOSNAP, req_comp);
 	c->add_request();
 	r = req->send();
 	if (r < 0)
 	  goto done;
       }
-      total_write += bl.length();
+      total_write += object_bl.length();
     }
   done:
     c->finish_adding_requests(ictx->cct);
     c->put();
 
-    ictx->perfcounter->inc(l_librbd_aio_wr);
-    ictx->perfcounter->inc(l_librbd_aio_wr_bytes, mylen);
-
     /* FIXME: cleanup all the allocated stuff */
     return r;
   }
@@ -2586,31 +3252,77 @@ reprotect_and_return_err:
     if (r < 0)
       return r;
 
-    // TODO: check for snap
     ictx->snap_lock.Lock();
     snapid_t snap_id = ictx->snap_id;
     ::SnapContext snapc = ictx->snapc;
-    ictx->parent_lock.Lock();
-    uint64_t overlap = 0;
-    ictx->get_parent_overlap(ictx->snap_id, &overlap);
-    ictx->parent_lock.Unlock();
     ictx->snap_lock.Unlock();
 
     if (snap_id != CEPH_NOSNAP || ictx->read_only)
       return -EROFS;
 
+    // no remove could ever be sent
+    if (cct->_conf->rbd_concurrent_discard_ops < 1) {
+      lderr(cct) << "rbd_concurrent_discard_ops must be at least 1, not "
+		 << cct->_conf->rbd_concurrent_discard_ops << dendl;
+      return -EINVAL;
+    }
+
+    if (ictx->persistent_cache) {
+      r = ictx->persistent_cache->discard(off, len, snapc);
+      if (r < 0)
+	return r;
+      c->get();
+      c->init_time(ictx, AIO_TYPE_DISCARD);
+      c->finish_adding_requests(cct);
+      c->put();
+    } else {
+      c->init_time(ictx, AIO_TYPE_DISCARD);
+      r = _aio_discard(ictx, off, len, snapc, c);
+    }
+
+    ictx->perfcounter->inc(l_librbd_aio_discard);
+    ictx->perfcounter->inc(l_librbd_aio_discard_bytes, len);
+    return r;
+  }
+
+  // completion for a remove queued by a discard, freeing its slot
+  class C_DiscardRemove : public Context {
+  public:
+    C_DiscardRemove(ImageCtx *ictx, Context *ctx)
+      : m_ictx(ictx), m_ctx(ctx) {}
+    virtual void finish(int r) {
+      // the image may be closed once m_ctx runs
+      m_ictx->finish_discard();
+      m_ctx->complete(r);
+    }
+  private:
+    ImageCtx *m_ictx;
+    Context *m_ctx;
+  };
+
+  int _aio_discard(ImageCtx *ictx, uint64_t off, uint64_t len,
+		   const ::SnapContext &snapc, AioCompletion *c,
+		   bool throttle_removes)
+  {
+    CephContext *cct = ictx->cct;
+
+    ictx->snap_lock.Lock();
+    uint64_t image_size = ictx->get_current_size();
+    ictx->parent_lock.Lock();
+    uint64_t overlap = 0;
+    ictx->get_parent_overlap(CEPH_NOSNAP, &overlap);
+    ictx->parent_lock.Unlock();
+    ictx->snap_lock.Unlock();
+
     // map
     vector<ObjectExtent> extents;
     Striper::file_to_extents(ictx->cct, ictx->format_string, &ictx->layout, off, len, extents);
 
+    uint64_t object_size = ictx->layout.fl_object_size;
     c->get();
-    c->init_time(ictx, AIO_TYPE_DISCARD);
     for (vector<ObjectExtent>::iterator p = extents.begin(); p != extents.end(); ++p) {
       ldout(cct, 20) << " oid " << p->oid << " " << p->offset << "~" << p->length
 		     << " from " << p->buffer_extents << dendl;
-      C_AioWrite *req_comp = new C_AioWrite(cct, c);
-      AbstractWrite *req;
-      c->add_request();
 
       // reverse map this object extent onto the parent
       vector<pair<uint64_t,uint64_t> > objectx;
@@ -2622,24 +3334,57 @@ reprotect_and_return_err:
 	object_overlap = ictx->prune_parent_extents(objectx, overlap);
       }
 
-      if (p->offset == 0 && p->length == ictx->layout.fl_object_size) {
-	req = new AioRemove(ictx, p->oid.name, p->objectno, objectx, object_overlap,
-			    snapc, snap_id, req_comp);
-      } else if (p->offset + p->length == ictx->layout.fl_object_size) {
-	req = new AioTruncate(ictx, p->oid.name, p->objectno, p->offset, objectx, object_overlap,
-			      snapc, snap_id, req_comp);
+      // nothing to discard, and no parent data to hide
+      if (!object_overlap && !ictx->object_map.object_may_exist(p->objectno)) {
+	ictx->perfcounter->inc(l_librbd_discard_skipped);
+	continue;
+      }
+
+      // without striping, the end of the image may cut the last
+      // object short, and nothing past that needs to be kept
+      uint64_t object_end = object_size;
+      if (ictx->get_stripe_count() == 1 &&
+	  (p->objectno + 1) * object_size > image_size)
+	object_end = image_size - p->objectno * object_size;
+
+      Context *req_comp = new C_AioWrite(cct, c);
+      c->add_request();
+
+      bool remove = p->offset == 0 && p->length >= object_end;
+      AbstractWrite *req;
+      if (remove) {
+	// fstrim of a large range turns into many of these, so only
+	// send a bounded number at a time, per image.  the persistent
+	// cache writes back in log order, and has its own bound, so it
+	// can't let a remove fall behind later writes to the object.
+	if (throttle_removes)
+	  req_comp = new C_DiscardRemove(ictx, req_comp);
+	req = new AioRemove(ictx, p->oid.name, p->objectno,
+			    objectx, object_overlap,
+			    snapc, CEPH_NOSNAP, req_comp);
+	ictx->perfcounter->inc(l_librbd_discard_remove);
+	if (throttle_removes) {
+	  ictx->queue_discard(req);
+	  continue;
+	}
       } else {
-	req = new AioZero(ictx, p->oid.name, p->objectno, p->offset, p->length,
-			  objectx, object_overlap,
-			  snapc, snap_id, req_comp);
+	if (p->offset + p->length >= object_end) {
+	  req = new AioTruncate(ictx, p->oid.name, p->objectno, p->offset, objectx, object_overlap,
+				snapc, CEPH_NOSNAP, req_comp);
+	} else {
+	  req = new AioZero(ictx, p->oid.name, p->objectno, p->offset, p->length,
+			    objectx, object_overlap,
+			    snapc, CEPH_NOSNAP, req_comp);
+	}
+	ictx->perfcounter->inc(l_librbd_discard_zero);
       }
 
-      r = req->send();
+      // an error is reported through the completion
+      int r = req->send();
       if (r < 0)
-	goto done;
+	req->complete(r);
     }
-    r = 0;
-  done:
+
     if (ictx->object_cacher) {
       Mutex::Locker l(ictx->cache_lock);
       ictx->object_cacher->discard_set(ictx->object_set, extents);
@@ -2648,11 +3393,85 @@ reprotect_and_return_err:
     c->finish_adding_requests(ictx->cct);
     c->put();
 
-    ictx->perfcounter->inc(l_librbd_aio_discard);
-    ictx->perfcounter->inc(l_librbd_aio_discard_bytes, len);
+    return 0;
+  }
 
-    /* FIXME: cleanup all the allocated stuff */
-    return r;
+  class C_CopyOnRead : public Context {
+  public:
+    C_CopyOnRead(ImageCtx *ictx, uint64_t object_no)
+      : m_ictx(ictx), m_object_no(object_no) {}
+    virtual void finish(int r) {
+      if (r < 0)
+	lderr(m_ictx->cct) << "copy-on-read of object " << m_object_no
+			   << " failed: " << cpp_strerror(r) << dendl;
+      else if (r == 0)
+	m_ictx->perfcounter->inc(l_librbd_copy_on_read);
+
+      Mutex::Locker l(m_ictx->copy_on_read_lock);
+      m_ictx->copy_on_read_objects.erase(m_object_no);
+      if (r == COPYUP_ZERO) {
+	// reads will keep going to the parent, but needn't try again
+	m_ictx->copy_on_read_zero.insert(m_object_no);
+      }
+      m_ictx->copy_on_read_cond.Signal();
+    }
+  private:
+    ImageCtx *m_ictx;
+    uint64_t m_object_no;
+  };
+
+  // copy a whole object up from the parent after a read had to go there
+  void copy_on_read(ImageCtx *ictx, uint64_t object_no)
+  {
+    CephContext *cct = ictx->cct;
+    {
+      Mutex::Locker l(ictx->copy_on_read_lock);
+      if (ictx->copy_on_read_blocked ||
+	  ictx->copy_on_read_objects.count(object_no) ||
+	  ictx->copy_on_read_zero.count(object_no))
+	return;
+      if ((int)ictx->copy_on_read_objects.size() >=
+	  cct->_conf->rbd_clone_copy_on_read_max_ops) {
+	// the next read of this object will try again
+	ldout(cct, 20) << "copy_on_read: too many copy-ups in flight, "
+		       << "skipping object " << object_no << dendl;
+	return;
+      }
+      ictx->copy_on_read_objects.insert(object_no);
+    }
+    ldout(cct, 20) << "copy_on_read object " << object_no << dendl;
+
+    Mutex::Locker l(ictx->snap_lock);
+    Mutex::Locker l2(ictx->parent_lock);
+
+    // map child object onto the parent
+    uint64_t object_size = ictx->get_object_size();
+    vector<pair<uint64_t,uint64_t> > objectx;
+    Striper::extent_to_file(cct, &ictx->layout,
+			    object_no, 0, object_size,
+			    objectx);
+    uint64_t object_overlap = 0;
+    if (ictx->parent)
+      object_overlap = ictx->prune_parent_extents(objectx,
+						  ictx->parent_md.overlap);
+
+    if (!object_overlap) {
+      // flattened or shrunk in the meantime
+      Mutex::Locker l3(ictx->copy_on_read_lock);
+      ictx->copy_on_read_objects.erase(object_no);
+      ictx->copy_on_read_cond.Signal();
+      return;
+    }
+
+    Context *ctx = new C_CopyOnRead(ictx, object_no);
+
+    C_CopyupObject *req = new C_CopyupObject(ctx, ictx, object_no,
+					     object_size);
+    AioCompletion *comp = aio_create_completion_internal(req, rbd_ctx_cb);
+    int r = aio_read(ictx->parent, objectx, req->buf(), NULL, comp);
+    if (r < 0)
+      req->complete(r);
+    comp->release();
   }
 
   void rbd_req_cb(completion_t cb, void *arg)
@@ -2662,6 +3481,46 @@ reprotect_and_return_err:
     req->complete(comp->get_return_value());
   }
 
+  static void readahead(ImageCtx *ictx,
+			const vector<pair<uint64_t,uint64_t> >& image_extents)
+  {
+    ictx->md_lock.Lock();
+    ictx->snap_lock.Lock();
+    snap_t snap_id = ictx->snap_id;
+    uint64_t image_size = ictx->get_image_size(snap_id);
+    ictx->snap_lock.Unlock();
+    ictx->md_lock.Unlock();
+
+    for (vector<pair<uint64_t,uint64_t> >::const_iterator p = image_extents.begin();
+	 p != image_extents.end();
+	 ++p) {
+      pair<uint64_t, uint64_t> readahead_extent =
+	ictx->readahead.update(p->first, p->second, image_size);
+      if (readahead_extent.second == 0)
+	continue;
+
+      ldout(ictx->cct, 20) << "readahead " << readahead_extent.first << "~"
+			   << readahead_extent.second << dendl;
+      map<object_t,vector<ObjectExtent> > readahead_object_extents;
+      Striper::file_to_extents(ictx->cct, ictx->format_string, &ictx->layout,
+			       readahead_extent.first, readahead_extent.second,
+			       readahead_object_extents, 0);
+      for (map<object_t,vector<ObjectExtent> >::iterator q = readahead_object_extents.begin();
+	   q != readahead_object_extents.end();
+	   ++q) {
+	for (vector<ObjectExtent>::iterator r = q->second.begin();
+	     r != q->second.end();
+	     ++r) {
+	  if (snap_id == CEPH_NOSNAP &&
+	      !ictx->object_map.object_may_exist(r->objectno))
+	    continue;
+	  // no buffer and no completion: this only populates the cache
+	  ictx->aio_read_from_cache(r->oid, NULL, r->length, r->offset, NULL);
+	}
+      }
+    }
+  }
+
   int aio_read(ImageCtx *ictx, uint64_t off, size_t len,
 	       char *buf, bufferlist *bl,
 	       AioCompletion *c)
@@ -2671,6 +3530,26 @@ reprotect_and_return_err:
     return aio_read(ictx, image_extents, buf, bl, c);
   }
 
+  int aio_readv(ImageCtx *ictx, uint64_t off, const struct iovec *iov,
+		int iovcnt, AioCompletion *c)
+  {
+    ldout(ictx->cct, 20) << "aio_readv " << ictx << " off = " << off
+			 << " iovcnt = " << iovcnt << dendl;
+
+    if (iovcnt < 0)
+      return -EINVAL;
+
+    size_t len = 0;
+    c->read_dest.clear();
+    for (int i = 0; i < iovcnt; ++i) {
+      if (iov[i].iov_len)
+	c->read_dest.push_back(buffer::create_static(iov[i].iov_len,
+						     (char *)iov[i].iov_base));
+      len += iov[i].iov_len;
+    }
+    return aio_read(ictx, off, len, NULL, NULL, c);
+  }
+
   int aio_read(ImageCtx *ictx, const vector<pair<uint64_t,uint64_t> >& image_extents,
 	       char *buf, bufferlist *pbl, AioCompletion *c)
   {
@@ -2686,6 +3565,8 @@ reprotect_and_return_err:
 
     // map
     map<object_t,vector<ObjectExtent> > object_extents;
+    // buffer offset -> data found in the persistent cache
+    map<uint64_t,bufferlist> cache_hits;
 
     uint64_t buffer_ofs = 0;
     for (vector<pair<uint64_t,uint64_t> >::const_iterator p = image_extents.begin();
@@ -2696,38 +3577,97 @@ reprotect_and_return_err:
       if (r < 0)
 	return r;
 
-      Striper::file_to_extents(ictx->cct, ictx->format_string, &ictx->layout,
-			       p->first, len, object_extents, buffer_ofs);
+      if (ictx->persistent_cache && snap_id == CEPH_NOSNAP) {
+	map<uint64_t,bufferlist> hits;
+	r = ictx->persistent_cache->read(p->first, len, &hits);
+	if (r < 0)
+	  return r;
+	// read whatever the log doesn't have from the image
+	uint64_t pos = p->first;
+	for (map<uint64_t,bufferlist>::iterator q = hits.begin();
+	     q != hits.end();
+	     ++q) {
+	  if (q->first > pos)
+	    Striper::file_to_extents(ictx->cct, ictx->format_string,
+				     &ictx->layout, pos, q->first - pos,
+				     object_extents,
+				     buffer_ofs + (pos - p->first));
+	  cache_hits[buffer_ofs + (q->first - p->first)].claim(q->second);
+	  pos = q->first + cache_hits.rbegin()->second.length();
+	}
+	if (pos < p->first + len)
+	  Striper::file_to_extents(ictx->cct, ictx->format_string,
+				   &ictx->layout, pos, p->first + len - pos,
+				   object_extents,
+				   buffer_ofs + (pos - p->first));
+      } else {
+	Striper::file_to_extents(ictx->cct, ictx->format_string, &ictx->layout,
+				 p->first, len, object_extents, buffer_ofs);
+      }
       buffer_ofs += len;
     }
 
     int64_t ret;
 
-    c->read_buf = buf;
-    c->read_buf_len = buffer_ofs;
+    if (buf && buffer_ofs)
+      c->read_dest.push_back(buffer::create_static(buffer_ofs, buf));
     c->read_bl = pbl;
+    // without a cache in the way, have the messenger receive straight
+    // into the caller's memory
+    bool direct = c->read_dest.length() && !ictx->object_cacher;
 
     c->get();
     c->init_time(ictx, AIO_TYPE_READ);
+    for (map<uint64_t,bufferlist>::iterator p = cache_hits.begin();
+	 p != cache_hits.end();
+	 ++p) {
+      uint64_t hit_len = p->second.length();
+      ldout(ictx->cct, 20) << " persistent cache hit " << p->first << "~"
+			   << hit_len << dendl;
+      vector<pair<uint64_t,uint64_t> > buffer_extents;
+      buffer_extents.push_back(make_pair(p->first, hit_len));
+      c->add_request();
+      c->lock.Lock();
+      c->destriper.add_partial_result(ictx->cct, p->second, buffer_extents);
+      c->lock.Unlock();
+      c->complete_request(ictx->cct, hit_len);
+      ictx->perfcounter->inc(l_librbd_pcache_rd_hit_bytes, hit_len);
+    }
     for (map<object_t,vector<ObjectExtent> >::iterator p = object_extents.begin(); p != object_extents.end(); ++p) {
       for (vector<ObjectExtent>::iterator q = p->second.begin(); q != p->second.end(); ++q) {
 	ldout(ictx->cct, 20) << " oid " << q->oid << " " << q->offset << "~" << q->length
 			     << " from " << q->buffer_extents << dendl;
 
 	C_AioRead *req_comp = new C_AioRead(ictx->cct, c);
-	AioRead *req = new AioRead(ictx, q->oid.name, 
+	// a sparse read's data doesn't line up with the object extent, so
+	// it can't be received in place
+	AioRead *req = new AioRead(ictx, q->oid.name,
 				   q->objectno, q->offset, q->length,
 				   q->buffer_extents,
-				   snap_id, true, req_comp);
+				   snap_id, !direct, req_comp);
 	req_comp->set_req(req);
 	c->add_request();
 
-	if (ictx->object_cacher) {
+	if (snap_id == CEPH_NOSNAP &&
+	    !ictx->object_map.object_may_exist(q->objectno)) {
+	  // behave as if the OSD said it wasn't there; this still falls
+	  // back to the parent for clones
+	  req->complete(-ENOENT);
+	} else if (ictx->object_cacher) {
 	  C_CacheRead *cache_comp = new C_CacheRead(req_comp, req);
 	  ictx->aio_read_from_cache(q->oid, &req->data(),
 				    q->length, q->offset,
 				    cache_comp);
 	} else {
+	  if (direct) {
+	    for (vector<pair<uint64_t,uint64_t> >::iterator b = q->buffer_extents.begin();
+		 b != q->buffer_extents.end();
+		 ++b) {
+	      bufferlist sub;
+	      sub.substr_of(c->read_dest, b->first, b->second);
+	      req->data().claim_append(sub);
+	    }
+	  }
 	  r = req->send();
 	  if (r < 0 && r == -ENOENT)
 	    r = 0;
@@ -2738,6 +3678,10 @@ reprotect_and_return_err:
 	}
       }
     }
+
+    if (ictx->object_cacher)
+      readahead(ictx, image_extents);
+
     ret = buffer_ofs;
   done:
     c->finish_adding_requests(ictx->cct);
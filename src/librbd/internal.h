@@ -4,12 +4,14 @@
 #define CEPH_LIBRBD_INTERNAL_H
 
 #include <inttypes.h>
+#include <sys/uio.h>
 
 #include <map>
 #include <set>
 #include <string>
 #include <vector>
 
+#include "common/snap_types.h"
 #include "include/buffer.h"
 #include "include/rbd/librbd.hpp"
 #include "include/rbd_types.h"
@@ -44,6 +46,17 @@ enum {
 
   l_librbd_notify,
   l_librbd_resize,
+  l_librbd_copy_on_read,     // objects copied up after a read from the parent
+
+  l_librbd_discard_skipped,  // object extents not discarded: no object there
+  l_librbd_discard_remove,   // whole objects removed by discards
+  l_librbd_discard_zero,     // partial object extents zeroed or truncated
+  l_librbd_discard_queued,   // removes that waited for a free slot
+
+  l_librbd_pcache_rd_hit_bytes,        // bytes read from the persistent cache
+  l_librbd_pcache_writeback,           // records written back to the image
+  l_librbd_pcache_writeback_bytes,
+  l_librbd_pcache_writeback_latency,
 
   l_librbd_last,
 };
@@ -136,7 +149,7 @@ namespace librbd {
   int break_lock(ImageCtx *ictx, const std::string& client,
 		 const std::string& cookie);
 
-  void trim_image(ImageCtx *ictx, uint64_t newsize, ProgressContext& prog_ctx);
+  int trim_image(ImageCtx *ictx, uint64_t newsize, ProgressContext& prog_ctx);
   int read_rbd_info(librados::IoCtx& io_ctx, const std::string& info_oid,
 		    struct rbd_info *info);
 
@@ -165,6 +178,10 @@ namespace librbd {
   int64_t read_iterate(ImageCtx *ictx, uint64_t off, size_t len,
 		       int (*cb)(uint64_t, size_t, const char *, void *),
 		       void *arg);
+  int diff_iterate(ImageCtx *ictx, const char *fromsnapname,
+		   uint64_t off, uint64_t len,
+		   int (*cb)(uint64_t, size_t, int, void *),
+		   void *arg);
   ssize_t read(ImageCtx *ictx, uint64_t off, size_t len, char *buf);
   ssize_t read(ImageCtx *ictx, const vector<pair<uint64_t,uint64_t> >& image_extents,
 	       char *buf, bufferlist *pbl);
@@ -172,11 +189,23 @@ namespace librbd {
   int discard(ImageCtx *ictx, uint64_t off, uint64_t len);
   int aio_write(ImageCtx *ictx, uint64_t off, size_t len, const char *buf,
 		AioCompletion *c);
+  int aio_writev(ImageCtx *ictx, uint64_t off, const struct iovec *iov,
+		 int iovcnt, AioCompletion *c);
+  int aio_write(ImageCtx *ictx, uint64_t off, const bufferlist &bl,
+		AioCompletion *c);
   int aio_discard(ImageCtx *ictx, uint64_t off, uint64_t len, AioCompletion *c);
+  int _aio_write(ImageCtx *ictx, uint64_t off, const bufferlist &bl,
+		 const ::SnapContext &snapc, AioCompletion *c);
+  int _aio_discard(ImageCtx *ictx, uint64_t off, uint64_t len,
+		   const ::SnapContext &snapc, AioCompletion *c,
+		   bool throttle_removes = true);
+  void copy_on_read(ImageCtx *ictx, uint64_t object_no);
   int aio_read(ImageCtx *ictx, uint64_t off, size_t len,
 	       char *buf, bufferlist *pbl, AioCompletion *c);
   int aio_read(ImageCtx *ictx, const vector<pair<uint64_t,uint64_t> >& image_extents,
 	       char *buf, bufferlist *pbl, AioCompletion *c);
+  int aio_readv(ImageCtx *ictx, uint64_t off, const struct iovec *iov,
+		int iovcnt, AioCompletion *c);
   int flush(ImageCtx *ictx);
   int _flush(ImageCtx *ictx);
 
@@ -196,6 +225,8 @@ namespace librbd {
   // raw callbacks
   int simple_read_cb(uint64_t ofs, size_t len, const char *buf, void *arg);
   void rados_req_cb(rados_completion_t cb, void *arg);
+  void rados_ctx_cb(rados_completion_t cb, void *arg);
+  void rbd_ctx_cb(completion_t cb, void *arg);
   void rbd_req_cb(completion_t cb, void *arg);
 }
 
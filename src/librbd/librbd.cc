@@ -430,6 +430,15 @@ namespace librbd {
     return librbd::read_iterate(ictx, ofs, len, cb, arg);
   }
 
+  int Image::diff_iterate(const char *fromsnapname,
+			  uint64_t ofs, uint64_t len,
+			  int (*cb)(uint64_t, size_t, int, void *),
+			  void *arg)
+  {
+    ImageCtx *ictx = (ImageCtx *)ctx;
+    return librbd::diff_iterate(ictx, fromsnapname, ofs, len, cb, arg);
+  }
+
   ssize_t Image::write(uint64_t ofs, size_t len, bufferlist& bl)
   {
     ImageCtx *ictx = (ImageCtx *)ctx;
@@ -450,8 +459,9 @@ namespace librbd {
     ImageCtx *ictx = (ImageCtx *)ctx;
     if (bl.length() < len)
       return -EINVAL;
-    return librbd::aio_write(ictx, off, len, bl.c_str(),
-			     (librbd::AioCompletion *)c->pc);
+    bufferlist data;
+    data.substr_of(bl, 0, len);
+    return librbd::aio_write(ictx, off, data, (librbd::AioCompletion *)c->pc);
   }
 
   int Image::aio_discard(uint64_t off, uint64_t len, RBD::AioCompletion *c)
@@ -464,11 +474,27 @@ namespace librbd {
 		      RBD::AioCompletion *c)
   {
     ImageCtx *ictx = (ImageCtx *)ctx;
-    ldout(ictx->cct, 10) << "Image::aio_read() buf=" << (void *)bl.c_str() << "~"
-			 << (void *)(bl.c_str() + len - 1) << dendl;
+    ldout(ictx->cct, 10) << "Image::aio_read() " << off << "~" << len
+			 << " into bl " << (void *)&bl << dendl;
     return librbd::aio_read(ictx, off, len, NULL, &bl, (librbd::AioCompletion *)c->pc);
   }
 
+  int Image::aio_writev(uint64_t off, const struct iovec *iov, int iovcnt,
+			RBD::AioCompletion *c)
+  {
+    ImageCtx *ictx = (ImageCtx *)ctx;
+    return librbd::aio_writev(ictx, off, iov, iovcnt,
+			      (librbd::AioCompletion *)c->pc);
+  }
+
+  int Image::aio_readv(uint64_t off, const struct iovec *iov, int iovcnt,
+		       RBD::AioCompletion *c)
+  {
+    ImageCtx *ictx = (ImageCtx *)ctx;
+    return librbd::aio_readv(ictx, off, iov, iovcnt,
+			     (librbd::AioCompletion *)c->pc);
+  }
+
   int Image::flush()
   {
     ImageCtx *ictx = (ImageCtx *)ctx;
@@ -1005,6 +1031,16 @@ extern "C" int64_t rbd_read_iterate(rbd_image_t image, uint64_t ofs, size_t len,
   return librbd::read_iterate(ictx, ofs, len, cb, arg);
 }
 
+extern "C" int rbd_diff_iterate(rbd_image_t image,
+				const char *fromsnapname,
+				uint64_t ofs, uint64_t len,
+				int (*cb)(uint64_t, size_t, int, void *),
+				void *arg)
+{
+  librbd::ImageCtx *ictx = (librbd::ImageCtx *)image;
+  return librbd::diff_iterate(ictx, fromsnapname, ofs, len, cb, arg);
+}
+
 extern "C" ssize_t rbd_write(rbd_image_t image, uint64_t ofs, size_t len,
 			     const char *buf)
 {
@@ -1054,6 +1090,24 @@ extern "C" int rbd_aio_read(rbd_image_t image, uint64_t off, size_t len,
 			  (librbd::AioCompletion *)comp->pc);
 }
 
+extern "C" int rbd_aio_writev(rbd_image_t image, const struct iovec *iov,
+			      int iovcnt, uint64_t off, rbd_completion_t c)
+{
+  librbd::ImageCtx *ictx = (librbd::ImageCtx *)image;
+  librbd::RBD::AioCompletion *comp = (librbd::RBD::AioCompletion *)c;
+  return librbd::aio_writev(ictx, off, iov, iovcnt,
+			    (librbd::AioCompletion *)comp->pc);
+}
+
+extern "C" int rbd_aio_readv(rbd_image_t image, const struct iovec *iov,
+			     int iovcnt, uint64_t off, rbd_completion_t c)
+{
+  librbd::ImageCtx *ictx = (librbd::ImageCtx *)image;
+  librbd::RBD::AioCompletion *comp = (librbd::RBD::AioCompletion *)c;
+  return librbd::aio_readv(ictx, off, iov, iovcnt,
+			   (librbd::AioCompletion *)comp->pc);
+}
+
 extern "C" int rbd_flush(rbd_image_t image)
 {
   librbd::ImageCtx *ictx = (librbd::ImageCtx *)image;
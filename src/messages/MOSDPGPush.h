@@ -0,0 +1,63 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*- 
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2013 Inktank Storage, Inc.
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software 
+ * Foundation.  See file COPYING.
+ * 
+ */
+
+#ifndef CEPH_MOSDPGPUSH_H
+#define CEPH_MOSDPGPUSH_H
+
+#include "msg/Message.h"
+#include "osd/osd_types.h"
+
+class MOSDPGPush : public Message {
+  static const int HEAD_VERSION = 1;
+  static const int COMPAT_VERSION = 1;
+
+public:
+  pg_t pgid;
+  epoch_t map_epoch;
+  vector<PushOp> pushes;
+
+  MOSDPGPush()
+    : Message(MSG_OSD_PG_PUSH, HEAD_VERSION, COMPAT_VERSION) {}
+  MOSDPGPush(pg_t pg, epoch_t epoch)
+    : Message(MSG_OSD_PG_PUSH, HEAD_VERSION, COMPAT_VERSION),
+      pgid(pg),
+      map_epoch(epoch) {}
+private:
+  ~MOSDPGPush() {}
+
+public:
+  virtual void decode_payload() {
+    bufferlist::iterator p = payload.begin();
+    ::decode(pgid, p);
+    ::decode(map_epoch, p);
+    ::decode(pushes, p);
+  }
+
+  virtual void encode_payload(uint64_t features) {
+    ::encode(pgid, payload);
+    ::encode(map_epoch, payload);
+    ::encode(pushes, payload);
+  }
+
+  const char *get_type_name() const { return "pg_push"; }
+
+  void print(ostream& out) const {
+    out << "pg_push(" << pgid
+	<< " " << map_epoch
+	<< " " << pushes
+	<< ")";
+  }
+};
+
+#endif
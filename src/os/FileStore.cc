@@ -1952,6 +1952,8 @@ void FileStore::_do_op(OpSequencer *osr)
   Op *o = osr->peek_queue();
   apply_manager.op_apply_start(o->op);
   dout(5) << "_do_op " << o << " seq " << o->op << " " << *osr << "/" << osr->parent << " start" << dendl;
+  if (o->osd_op)
+    o->osd_op->mark_event("filestore_apply_started");
   int r = do_transactions(o->tls, o->op);
   apply_manager.op_apply_finish(o->op);
   dout(10) << "_do_op " << o << " seq " << o->op << " r = " << r
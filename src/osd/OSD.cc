@@ -71,6 +71,9 @@
 #include "messages/MOSDPGTrim.h"
 #include "messages/MOSDPGScan.h"
 #include "messages/MOSDPGBackfill.h"
+#include "messages/MOSDPGPush.h"
+#include "messages/MOSDPGPull.h"
+#include "messages/MOSDPGPushReply.h"
 #include "messages/MOSDPGMissing.h"
 #include "messages/MBackfillReserve.h"
 #include "messages/MRecoveryReserve.h"
@@ -1023,6 +1026,17 @@ void OSD::create_logger()
   osd_plb.add_time_avg(l_osd_op_rw_rlat,"op_rw_rlat");  // client rmw readable/applied latency
   osd_plb.add_time_avg(l_osd_op_rw_lat, "op_rw_latency");   // client rmw latency
 
+  // client op latency, broken down by stage
+  osd_plb.add_time_avg(l_osd_op_throttle_lat, "op_throttle_latency"); // messenger throttle wait
+  osd_plb.add_time_avg(l_osd_op_read_lat,     "op_read_latency");     // messenger read of op payload
+  osd_plb.add_time_avg(l_osd_op_dispatch_lat, "op_dispatch_latency"); // messenger dispatch queue
+  osd_plb.add_time_avg(l_osd_op_queue_lat,    "op_queue_latency");    // op work queue wait
+  osd_plb.add_time_avg(l_osd_op_pg_lock_lat,  "op_pg_lock_latency");  // pg lock wait
+  osd_plb.add_time_avg(l_osd_op_journal_lat,  "op_journal_latency");  // journal submit to completion
+  osd_plb.add_time_avg(l_osd_op_apply_lat,    "op_apply_latency");    // filestore apply
+  osd_plb.add_time_avg(l_osd_op_repop_ack_lat,    "op_repop_ack_latency");    // per-replica applied ack
+  osd_plb.add_time_avg(l_osd_op_repop_commit_lat, "op_repop_commit_latency"); // per-replica commit ack
+
   osd_plb.add_u64_counter(l_osd_sop,       "subop");         // subops
   osd_plb.add_u64_counter(l_osd_sop_inb,   "subop_in_bytes");     // subop in bytes
   osd_plb.add_time_avg(l_osd_sop_lat,   "subop_latency");     // subop latency
@@ -3394,6 +3408,15 @@ void OSD::dispatch_op(OpRequestRef op)
   case MSG_OSD_SUBOPREPLY:
     handle_sub_op_reply(op);
     break;
+  case MSG_OSD_PG_PUSH:
+    handle_replica_op<MOSDPGPush, MSG_OSD_PG_PUSH>(op);
+    break;
+  case MSG_OSD_PG_PULL:
+    handle_replica_op<MOSDPGPull, MSG_OSD_PG_PULL>(op);
+    break;
+  case MSG_OSD_PG_PUSH_REPLY:
+    handle_replica_op<MOSDPGPushReply, MSG_OSD_PG_PUSH_REPLY>(op);
+    break;
   }
 }
 
@@ -6007,6 +6030,48 @@ void OSD::handle_sub_op_reply(OpRequestRef op)
   enqueue_op(pg, op);
 }
 
+/*
+ * batched recovery messages (MOSDPGPush, MOSDPGPull, MOSDPGPushReply)
+ * all carry a pgid and map_epoch; route them like sub ops.
+ */
+template <typename T, int MSGTYPE>
+void OSD::handle_replica_op(OpRequestRef op)
+{
+  T *m = static_cast<T *>(op->request);
+  assert(m->get_header().type == MSGTYPE);
+
+  dout(10) << __func__ << " " << *m << " epoch " << m->map_epoch << dendl;
+  if (m->map_epoch < up_epoch) {
+    dout(3) << "replica op from before up" << dendl;
+    return;
+  }
+
+  if (!require_osd_peer(op))
+    return;
+
+  // must be a rep op.
+  assert(m->get_source().is_osd());
+
+  // require same or newer map
+  if (!require_same_or_newer_map(op, m->map_epoch))
+    return;
+
+  // share our map with sender, if they're old
+  _share_map_incoming(m->get_source_inst(), m->map_epoch,
+		      (Session*)m->get_connection()->get_priv());
+
+  if (service.splitting(m->pgid)) {
+    waiting_for_pg[m->pgid].push_back(op);
+    return;
+  }
+
+  PG *pg = _have_pg(m->pgid) ? _lookup_pg(m->pgid) : NULL;
+  if (!pg) {
+    return;
+  }
+  enqueue_op(pg, op);
+}
+
 bool OSD::op_is_discardable(MOSDOp *op)
 {
   // drop client request if they are not connected and can't get the
@@ -6025,6 +6090,7 @@ bool OSD::op_is_discardable(MOSDOp *op)
 void OSD::enqueue_op(PG *pg, OpRequestRef op)
 {
   dout(15) << "enqueue_op " << op << " " << *(op->request) << dendl;
+  op->mark_queued_for_pg();
   op_wq.queue(make_pair(PGRef(pg), op));
 }
 
@@ -6072,6 +6138,7 @@ PGRef OSD::OpWQ::_dequeue()
     Mutex::Locker l(qlock);
     pair<PGRef, OpRequestRef> ret = pqueue.dequeue();
     pg = ret.first;
+    ret.second->mark_event("dequeued");
     pg_for_processing[&*pg].push_back(ret.second);
   }
   osd->logger->set(l_osd_opq, pqueue.length());
@@ -78,6 +78,16 @@ enum {
   l_osd_op_rw_rlat,
   l_osd_op_rw_lat,
 
+  l_osd_op_throttle_lat,
+  l_osd_op_read_lat,
+  l_osd_op_dispatch_lat,
+  l_osd_op_queue_lat,
+  l_osd_op_pg_lock_lat,
+  l_osd_op_journal_lat,
+  l_osd_op_apply_lat,
+  l_osd_op_repop_ack_lat,
+  l_osd_op_repop_commit_lat,
+
   l_osd_sop,
   l_osd_sop_inb,
   l_osd_sop_lat,
@@ -1419,6 +1429,8 @@ public:
   void handle_op(OpRequestRef op);
   void handle_sub_op(OpRequestRef op);
   void handle_sub_op_reply(OpRequestRef op);
+  template <typename T, int MSGTYPE>
+  void handle_replica_op(OpRequestRef op);
 
   /// check if we can throw out op from a disconnected client
   static bool op_is_discardable(class MOSDOp *m);
@@ -195,13 +195,17 @@ void OpRequest::dump(utime_t now, Formatter *f) const
   }
   {
     f->open_array_section("events");
+    utime_t last = received_time;
     for (list<pair<utime_t, string> >::const_iterator i = events.begin();
 	 i != events.end();
 	 ++i) {
       f->open_object_section("event");
       f->dump_stream("time") << i->first;
       f->dump_string("event", i->second);
+      // time spent in the stage that this event ends
+      f->dump_float("stage_duration", i->first - last);
       f->close_section();
+      last = i->first;
     }
     f->close_section();
   }
@@ -238,19 +242,42 @@ OpRequestRef OpTracker::create_request(Message *ref)
   } else if (ref->get_type() == MSG_OSD_SUBOP) {
     retval->reqid = static_cast<MOSDSubOp*>(ref)->reqid;
   }
-  _mark_event(retval.get(), "header_read", ref->get_recv_stamp());
-  _mark_event(retval.get(), "throttled", ref->get_throttle_stamp());
-  _mark_event(retval.get(), "all_read", ref->get_recv_complete_stamp());
-  _mark_event(retval.get(), "dispatched", ref->get_dispatch_stamp());
+  // replay the messenger's receive path so that it shows up in the
+  // event timeline; stamps the messenger did not fill in are skipped
+  if (ref->get_recv_stamp() != utime_t())
+    retval->mark_event("header_read", ref->get_recv_stamp());
+  if (ref->get_throttle_stamp() != utime_t())
+    retval->mark_event("throttled", ref->get_throttle_stamp());
+  if (ref->get_recv_complete_stamp() != utime_t())
+    retval->mark_event("all_read", ref->get_recv_complete_stamp());
+  if (ref->get_dispatch_stamp() != utime_t())
+    retval->mark_event("dispatched", ref->get_dispatch_stamp());
   return retval;
 }
 
 void OpRequest::mark_event(const string &event)
 {
   utime_t now = ceph_clock_now(g_ceph_context);
+  mark_event(event, now);
+}
+
+void OpRequest::mark_event(const string &event, utime_t stamp)
+{
   {
     Mutex::Locker l(lock);
-    events.push_back(make_pair(now, event));
+    events.push_back(make_pair(stamp, event));
+  }
+  tracker->_mark_event(this, event, stamp);
+}
+
+utime_t OpRequest::get_last_event_stamp(const string &event)
+{
+  Mutex::Locker l(lock);
+  for (list<pair<utime_t, string> >::reverse_iterator i = events.rbegin();
+       i != events.rend();
+       ++i) {
+    if (i->second == event)
+      return i->first;
   }
-  tracker->mark_event(this, event);
+  return utime_t();
 }
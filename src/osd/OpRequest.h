@@ -199,13 +199,25 @@ public:
     hit_flag_points |= flag_started;
     latest_flag_point = flag_started;
   }
-  void mark_sub_op_sent() {
-    mark_event("sub_op_sent");
+  void mark_sub_op_sent(int peer) {
+    stringstream ss;
+    ss << "sub_op_sent to osd." << peer;
+    mark_event(ss.str());
     hit_flag_points |= flag_sub_op_sent;
     latest_flag_point = flag_sub_op_sent;
   }
 
   void mark_event(const string &event);
+  void mark_event(const string &event, utime_t stamp);
+
+  /**
+   * Find when an event was last marked on this op.
+   *
+   * @param event exact name of the event
+   * @return the stamp of the most recent matching event, or a zero
+   * utime_t if the event was never marked.
+   */
+  utime_t get_last_event_stamp(const string &event);
   osd_reqid_t get_reqid() const {
     return reqid;
   }
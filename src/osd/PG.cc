@@ -27,6 +27,9 @@
 #include "messages/MOSDPGTrim.h"
 #include "messages/MOSDPGScan.h"
 #include "messages/MOSDPGBackfill.h"
+#include "messages/MOSDPGPush.h"
+#include "messages/MOSDPGPull.h"
+#include "messages/MOSDPGPushReply.h"
 #include "messages/MBackfillReserve.h"
 #include "messages/MRecoveryReserve.h"
 
@@ -1697,6 +1700,18 @@ void PG::do_request(OpRequestRef op)
     do_backfill(op);
     break;
 
+  case MSG_OSD_PG_PUSH:
+    do_push(op);
+    break;
+
+  case MSG_OSD_PG_PULL:
+    do_pull(op);
+    break;
+
+  case MSG_OSD_PG_PUSH_REPLY:
+    do_push_reply(op);
+    break;
+
   default:
     assert(0 == "bad message type in do_request");
   }
@@ -4883,6 +4898,23 @@ bool PG::can_discard_backfill(OpRequestRef op)
 
 }
 
+template<typename T, int MSGTYPE>
+bool PG::can_discard_replica_op(OpRequestRef op)
+{
+  T *m = static_cast<T *>(op->request);
+  assert(m->get_header().type == MSGTYPE);
+
+  // same pg?
+  //  if pg changes _at all_, we reset and repeer!
+  if (old_peering_msg(m->map_epoch, m->map_epoch)) {
+    dout(10) << "can_discard_replica_op pg changed " << info.history
+	     << " after " << m->map_epoch
+	     << ", dropping" << dendl;
+    return true;
+  }
+  return false;
+}
+
 bool PG::can_discard_request(OpRequestRef op)
 {
   switch (op->request->get_type()) {
@@ -4897,6 +4929,13 @@ bool PG::can_discard_request(OpRequestRef op)
 
   case MSG_OSD_PG_BACKFILL:
     return can_discard_backfill(op);
+
+  case MSG_OSD_PG_PUSH:
+    return can_discard_replica_op<MOSDPGPush, MSG_OSD_PG_PUSH>(op);
+  case MSG_OSD_PG_PULL:
+    return can_discard_replica_op<MOSDPGPull, MSG_OSD_PG_PULL>(op);
+  case MSG_OSD_PG_PUSH_REPLY:
+    return can_discard_replica_op<MOSDPGPushReply, MSG_OSD_PG_PUSH_REPLY>(op);
   }
   return true;
 }
@@ -4915,6 +4954,12 @@ bool PG::split_request(OpRequestRef op, unsigned match, unsigned bits)
     return false;
   case MSG_OSD_PG_BACKFILL:
     return false;
+  case MSG_OSD_PG_PUSH:
+    return false;
+  case MSG_OSD_PG_PULL:
+    return false;
+  case MSG_OSD_PG_PUSH_REPLY:
+    return false;
   }
   return false;
 }
@@ -4941,6 +4986,18 @@ bool PG::must_delay_request(OpRequestRef op)
   case MSG_OSD_PG_BACKFILL:
     return !require_same_or_newer_map(
       static_cast<MOSDPGBackfill*>(op->request)->map_epoch);
+
+  case MSG_OSD_PG_PUSH:
+    return !require_same_or_newer_map(
+      static_cast<MOSDPGPush*>(op->request)->map_epoch);
+
+  case MSG_OSD_PG_PULL:
+    return !require_same_or_newer_map(
+      static_cast<MOSDPGPull*>(op->request)->map_epoch);
+
+  case MSG_OSD_PG_PUSH_REPLY:
+    return !require_same_or_newer_map(
+      static_cast<MOSDPGPushReply*>(op->request)->map_epoch);
   }
   assert(0);
   return false;
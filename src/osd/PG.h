@@ -1797,6 +1797,8 @@ public:
   bool can_discard_scan(OpRequestRef op);
   bool can_discard_subop(OpRequestRef op);
   bool can_discard_backfill(OpRequestRef op);
+  template<typename T, int MSGTYPE>
+  bool can_discard_replica_op(OpRequestRef op);
   bool can_discard_request(OpRequestRef op);
 
   bool must_delay_request(OpRequestRef op);
@@ -1847,6 +1849,9 @@ public:
   virtual void do_sub_op_reply(OpRequestRef op) = 0;
   virtual void do_scan(OpRequestRef op) = 0;
   virtual void do_backfill(OpRequestRef op) = 0;
+  virtual void do_push(OpRequestRef op) = 0;
+  virtual void do_pull(OpRequestRef op) = 0;
+  virtual void do_push_reply(OpRequestRef op) = 0;
   virtual void snap_trimmer() = 0;
 
   virtual int do_command(vector<string>& cmd, ostream& ss,
@@ -30,6 +30,9 @@
 #include "messages/MOSDPGTrim.h"
 #include "messages/MOSDPGScan.h"
 #include "messages/MOSDPGBackfill.h"
+#include "messages/MOSDPGPush.h"
+#include "messages/MOSDPGPull.h"
+#include "messages/MOSDPGPushReply.h"
 
 #include "messages/MOSDPing.h"
 #include "messages/MWatchNotify.h"
@@ -120,6 +123,7 @@ void ReplicatedPG::wait_for_missing_object(const hobject_t& soid, OpRequestRef o
   else {
     dout(7) << "missing " << soid << " v " << v << ", pulling." << dendl;
     pull(soid, v, g_conf->osd_client_op_priority);
+    send_recovery_batches();
   }
   waiting_for_missing_object[soid].push_back(op);
   op->mark_delayed();
@@ -176,6 +180,7 @@ void ReplicatedPG::wait_for_degraded_object(const hobject_t& soid, OpRequestRef
       }
     }
     recover_object_replicas(soid, v, g_conf->osd_client_op_priority);
+    send_recovery_batches();
   }
   waiting_for_degraded_object[soid].push_back(op);
   op->mark_delayed();
@@ -824,6 +829,40 @@ void ReplicatedPG::do_op(OpRequestRef op)
     return;
   }
 
+  // list-snaps needs the object_info of every clone
+  if (m->get_snapid() == CEPH_SNAPDIR && obc->ssc) {
+    bool list_snaps = false;
+    for (vector<OSDOp>::iterator p = m->ops.begin(); p != m->ops.end(); ++p)
+      if (p->op.op == CEPH_OSD_OP_LIST_SNAPS)
+	list_snaps = true;
+    if (list_snaps) {
+      vector<snapid_t>& clones = obc->ssc->snapset.clones;
+      for (vector<snapid_t>::iterator p = clones.begin(); p != clones.end(); ++p) {
+	hobject_t clone_oid = obc->obs.oi.soid;
+	clone_oid.snap = *p;
+	if (src_obc.count(clone_oid))
+	  continue;
+	if (is_missing_object(clone_oid)) {
+	  wait_for_missing_object(clone_oid, op);
+	  put_object_contexts(src_obc);
+	  put_object_context(obc);
+	  return;
+	}
+	ObjectContext *sobc = get_object_context(clone_oid,
+						 m->get_object_locator(), false);
+	if (!sobc) {
+	  osd->clog.error() << info.pgid << " " << obc->obs.oi.soid
+			    << " clone " << *p << " in snapset but missing\n";
+	  put_object_contexts(src_obc);
+	  put_object_context(obc);
+	  osd->reply_op_error(op, -EIO);
+	  return;
+	}
+	src_obc[clone_oid] = sobc;
+      }
+    }
+  }
+
   op->mark_started();
 
   const hobject_t& soid = obc->obs.oi.soid;
@@ -1050,6 +1089,8 @@ void ReplicatedPG::log_op_stats(OpContext *ctx)
   } else
     assert(0);
 
+  log_op_stage_stats(op);
+
   dout(15) << "log_op_stats " << *m
 	   << " inb " << inb
 	   << " outb " << outb
@@ -1057,6 +1098,37 @@ void ReplicatedPG::log_op_stats(OpContext *ctx)
 	   << " lat " << latency << dendl;
 }
 
+void ReplicatedPG::log_op_stage(OpRequestRef op, int tag_lat,
+				const string &from, const string &to)
+{
+  utime_t start = op->get_last_event_stamp(from);
+  utime_t end = op->get_last_event_stamp(to);
+  if (start == utime_t() || end == utime_t() || end < start)
+    return;
+  osd->logger->tinc(tag_lat, end - start);
+}
+
+void ReplicatedPG::log_op_stage_stats(OpRequestRef op)
+{
+  Message *m = op->request;
+  utime_t recv = m->get_recv_stamp();
+  utime_t throttled = m->get_throttle_stamp();
+  utime_t all_read = m->get_recv_complete_stamp();
+  utime_t dispatched = m->get_dispatch_stamp();
+
+  // messenger stages come straight off the message stamps
+  if (recv != utime_t() && throttled >= recv)
+    osd->logger->tinc(l_osd_op_throttle_lat, throttled - recv);
+  if (throttled != utime_t() && all_read >= throttled)
+    osd->logger->tinc(l_osd_op_read_lat, all_read - throttled);
+  if (all_read != utime_t() && dispatched >= all_read)
+    osd->logger->tinc(l_osd_op_dispatch_lat, dispatched - all_read);
+
+  // an op may be requeued several times; account only its final pass
+  log_op_stage(op, l_osd_op_queue_lat, "queued_for_pg", "dequeued");
+  log_op_stage(op, l_osd_op_pg_lock_lat, "dequeued", "reached_pg");
+}
+
 void ReplicatedPG::log_subop_stats(OpRequestRef op, int tag_inb, int tag_lat)
 {
   utime_t now = ceph_clock_now(g_ceph_context);
@@ -2188,6 +2260,57 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
       }
       break;
 
+    case CEPH_OSD_OP_LIST_SNAPS:
+      {
+	if (ctx->obc->obs.oi.soid.snap != CEPH_NOSNAP &&
+	    ctx->obc->obs.oi.soid.snap != CEPH_SNAPDIR) {
+	  result = -EINVAL;
+	  break;
+	}
+
+	obj_list_snap_response_t resp;
+	if (ssc) {
+	  const SnapSet& snapset = ssc->snapset;
+	  for (vector<snapid_t>::const_iterator p = snapset.clones.begin();
+	       p != snapset.clones.end(); ++p) {
+	    clone_info ci;
+	    ci.cloneid = *p;
+
+	    hobject_t clone_oid = soid;
+	    clone_oid.snap = *p;
+	    ObjectContext *clone_obc = ctx->src_obc[clone_oid];
+	    assert(clone_obc);
+	    // object_info_t keeps them newest first
+	    ci.snaps.assign(clone_obc->obs.oi.snaps.rbegin(),
+			    clone_obc->obs.oi.snaps.rend());
+
+	    map<snapid_t, interval_set<uint64_t> >::const_iterator o =
+	      snapset.clone_overlap.find(*p);
+	    if (o != snapset.clone_overlap.end()) {
+	      for (interval_set<uint64_t>::const_iterator q = o->second.begin();
+		   q != o->second.end(); ++q)
+		ci.overlap.push_back(make_pair(q.get_start(), q.get_len()));
+	    }
+
+	    map<snapid_t, uint64_t>::const_iterator sz = snapset.clone_size.find(*p);
+	    if (sz != snapset.clone_size.end())
+	      ci.size = sz->second;
+
+	    resp.clones.push_back(ci);
+	  }
+	  resp.seq = snapset.seq;
+	}
+	if (soid.snap == CEPH_NOSNAP && obs.exists) {
+	  clone_info ci;
+	  ci.cloneid = CEPH_NOSNAP;
+	  ci.size = oi.size;
+	  resp.clones.push_back(ci);
+	}
+	resp.encode(osd_op.outdata);
+	ctx->delta_stats.num_rd++;
+      }
+      break;
+
     case CEPH_OSD_OP_GETXATTR:
       {
 	string aname;
@@ -3717,8 +3840,11 @@ void ReplicatedPG::op_applied(RepGather *repop)
 {
   lock();
   dout(10) << "op_applied " << *repop << dendl;
-  if (repop->ctx->op)
+  if (repop->ctx->op) {
     repop->ctx->op->mark_event("op_applied");
+    log_op_stage(repop->ctx->op, l_osd_op_apply_lat,
+		 "filestore_apply_started", "op_applied");
+  }
   
   repop->applying = false;
   repop->applied = true;
@@ -3779,8 +3905,11 @@ void ReplicatedPG::op_applied(RepGather *repop)
 void ReplicatedPG::op_commit(RepGather *repop)
 {
   lock();
-  if (repop->ctx->op)
+  if (repop->ctx->op) {
     repop->ctx->op->mark_event("op_commit");
+    log_op_stage(repop->ctx->op, l_osd_op_journal_lat,
+		 "commit_queued_for_journal_write", "journaled_completion_queued");
+  }
 
   if (repop->aborted) {
     dout(10) << "op_commit " << *repop << " -- aborted" << dendl;
@@ -3962,9 +4091,9 @@ void ReplicatedPG::issue_repop(RepGather *repop, utime_t now,
   int acks_wanted = CEPH_OSD_FLAG_ACK | CEPH_OSD_FLAG_ONDISK;
 
   for (unsigned i=1; i<acting.size(); i++) {
-    if (ctx->op)
-      ctx->op->mark_sub_op_sent();
     int peer = acting[i];
+    if (ctx->op)
+      ctx->op->mark_sub_op_sent(peer);
     pg_info_t &pinfo = peer_info[peer];
 
     repop->waitfor_ack.insert(peer);
@@ -4070,9 +4199,15 @@ void ReplicatedPG::repop_ack(RepGather *repop, int result, int ack_type,
 	    << " from osd." << fromosd
 	    << dendl;
   
+  utime_t lat = ceph_clock_now(g_ceph_context);
+  lat -= repop->start;
   if (ack_type & CEPH_OSD_FLAG_ONDISK) {
-    if (repop->ctx->op)
-      repop->ctx->op->mark_event("sub_op_commit_rec");
+    if (repop->ctx->op) {
+      stringstream ss;
+      ss << "sub_op_commit_rec from osd." << fromosd;
+      repop->ctx->op->mark_event(ss.str());
+      osd->logger->tinc(l_osd_op_repop_commit_lat, lat);
+    }
     // disk
     if (repop->waitfor_disk.count(fromosd)) {
       repop->waitfor_disk.erase(fromosd);
@@ -4086,8 +4221,12 @@ void ReplicatedPG::repop_ack(RepGather *repop, int result, int ack_type,
     repop->waitfor_ack.erase(fromosd);*/
   } else {
     // ack
-    if (repop->ctx->op)
-      repop->ctx->op->mark_event("sub_op_applied_rec");
+    if (repop->ctx->op) {
+      stringstream ss;
+      ss << "sub_op_applied_rec from osd." << fromosd;
+      repop->ctx->op->mark_event(ss.str());
+      osd->logger->tinc(l_osd_op_repop_ack_lat, lat);
+    }
     repop->waitfor_ack.erase(fromosd);
   }
 
@@ -4377,6 +4516,29 @@ int ReplicatedPG::find_object_context(const hobject_t& oid,
     return 0;
   }
 
+  // want the snapdir?  that's the head, or the snapdir object if the
+  // head has been deleted, along with its snapset.
+  if (oid.snap == CEPH_SNAPDIR) {
+    ObjectContext *obc = get_object_context(head, oloc, false);
+    if (obc && !obc->obs.exists) {
+      put_object_context(obc);
+      obc = NULL;
+    }
+    if (!obc) {
+      hobject_t snapdir(oid.oid, oid.get_key(), CEPH_SNAPDIR, oid.hash,
+			info.pgid.pool());
+      obc = get_object_context(snapdir, oloc, false);
+    }
+    if (!obc)
+      return -ENOENT;
+    dout(10) << "find_object_context " << oid << " @" << oid.snap
+	     << " -> " << obc->obs.oi.soid << dendl;
+    if (!obc->ssc)
+      obc->ssc = get_snapset_context(oid.oid, oid.get_key(), oid.hash, false);
+    *pobc = obc;
+    return 0;
+  }
+
   // we want a snap
   SnapSetContext *ssc = get_snapset_context(oid.oid, oid.get_key(), oid.hash, can_create);
   if (!ssc)
@@ -5050,7 +5212,7 @@ int ReplicatedPG::pull(
   pi.recovery_info = recovery_info;
   pi.recovery_progress = progress;
   pi.priority = priority;
-  send_pull(priority, fromosd, recovery_info, progress);
+  queue_pull(priority, fromosd, recovery_info, progress);
 
   start_recovery_op(soid);
   return PULL_YES;
@@ -5163,9 +5325,9 @@ void ReplicatedPG::push_start(
   pi.priority = prio;
 
   ObjectRecoveryProgress new_progress;
-  send_push(pi.priority,
-	    peer, pi.recovery_info,
-	    pi.recovery_progress, &new_progress);
+  queue_push(pi.priority,
+	     peer, pi.recovery_info,
+	     pi.recovery_progress, &new_progress);
   pi.recovery_progress = new_progress;
 }
 
@@ -5312,34 +5474,65 @@ ObjectRecoveryInfo ReplicatedPG::recalc_subsets(const ObjectRecoveryInfo& recove
 void ReplicatedPG::handle_pull_response(OpRequestRef op)
 {
   MOSDSubOp *m = (MOSDSubOp *)op->request;
+  int from = m->get_source().num();
+
+  PushOp pop;
+  pop.soid = m->poid;
+  pop.version = m->version;
+  m->claim_data(pop.data);
+  pop.data_included = m->data_included;
+  pop.omap_header = m->omap_header;
+  pop.omap_entries = m->omap_entries;
+  pop.attrset = m->attrset;
+  pop.recovery_info = m->recovery_info;
+  pop.before_progress = m->current_progress;
+  pop.after_progress = m->recovery_progress;
+
+  PullOp response;
+  if (handle_pull_response(op, from, pop, &response)) {
+    assert(pulling.count(response.soid));
+    send_pull(pulling[response.soid].priority,
+	      from,
+	      response.recovery_info,
+	      response.recovery_progress);
+  }
+}
+
+/*
+ * apply one object's worth of pulled data.  returns true and fills
+ * in *response if there is more of the object left to pull.
+ */
+bool ReplicatedPG::handle_pull_response(OpRequestRef op, int from,
+					PushOp &pop, PullOp *response)
+{
   bufferlist data;
-  m->claim_data(data);
-  interval_set<uint64_t> data_included = m->data_included;
+  data.claim(pop.data);
+  interval_set<uint64_t> data_included = pop.data_included;
   dout(10) << "handle_pull_response "
-	   << m->recovery_info
-	   << m->recovery_progress
+	   << pop.recovery_info
+	   << pop.after_progress
 	   << " data.size() is " << data.length()
 	   << " data_included: " << data_included
 	   << dendl;
-  if (m->version == eversion_t()) {
+  if (pop.version == eversion_t()) {
     // replica doesn't have it!
-    _failed_push(op);
-    return;
+    _failed_push(from, pop.soid);
+    return false;
   }
 
-  hobject_t &hoid = m->recovery_info.soid;
+  hobject_t &hoid = pop.recovery_info.soid;
   assert((data_included.empty() && data.length() == 0) ||
 	 (!data_included.empty() && data.length() > 0));
 
   if (!pulling.count(hoid)) {
-    return;
+    return false;
   }
 
   PullInfo &pi = pulling[hoid];
   if (pi.recovery_info.size == (uint64_t(-1))) {
-    pi.recovery_info.size = m->recovery_info.size;
+    pi.recovery_info.size = pop.recovery_info.size;
     pi.recovery_info.copy_subset.intersection_of(
-      m->recovery_info.copy_subset);
+      pop.recovery_info.copy_subset);
   }
 
   pi.recovery_info = recalc_subsets(pi.recovery_info);
@@ -5355,7 +5548,7 @@ void ReplicatedPG::handle_pull_response(OpRequestRef op)
   data.claim(usable_data);
 
   bool first = pi.recovery_progress.first;
-  pi.recovery_progress = m->recovery_progress;
+  pi.recovery_progress = pop.after_progress;
 
   dout(10) << "new recovery_info " << pi.recovery_info
 	   << ", new progress " << pi.recovery_progress
@@ -5363,15 +5556,15 @@ void ReplicatedPG::handle_pull_response(OpRequestRef op)
 
   if (first) {
     bufferlist oibl;
-    if (m->attrset.count(OI_ATTR)) {
-      oibl.push_back(m->attrset[OI_ATTR]);
+    if (pop.attrset.count(OI_ATTR)) {
+      oibl.push_back(pop.attrset[OI_ATTR]);
       ::decode(pi.recovery_info.oi, oibl);
     } else {
       assert(0);
     }
     bufferlist ssbl;
-    if (m->attrset.count(SS_ATTR)) {
-      ssbl.push_back(m->attrset[SS_ATTR]);
+    if (pop.attrset.count(SS_ATTR)) {
+      ssbl.push_back(pop.attrset[SS_ATTR]);
       ::decode(pi.recovery_info.ss, ssbl);
     } else {
       assert(pi.recovery_info.soid.snap != CEPH_NOSNAP &&
@@ -5386,9 +5579,9 @@ void ReplicatedPG::handle_pull_response(OpRequestRef op)
   Context *onreadable_sync = 0;
   submit_push_data(pi.recovery_info, first,
 		   data_included, data,
-		   m->omap_header,
-		   m->attrset,
-		   m->omap_entries,
+		   pop.omap_header,
+		   pop.attrset,
+		   pop.omap_entries,
 		   t);
 
   if (complete) {
@@ -5428,7 +5621,7 @@ void ReplicatedPG::handle_pull_response(OpRequestRef op)
   if (complete) {
     finish_recovery_op(hoid);
     pulling.erase(hoid);
-    pull_from_peer[m->get_source().num()].erase(hoid);
+    pull_from_peer[from].erase(hoid);
     update_stats();
     if (waiting_for_missing_object.count(hoid)) {
       dout(20) << " kicking waiters on " << hoid << dendl;
@@ -5439,26 +5632,31 @@ void ReplicatedPG::handle_pull_response(OpRequestRef op)
 	waiting_for_all_missing.clear();
       }
     }
+    return false;
   } else {
-    send_pull(pi.priority,
-	      m->get_source().num(),
-	      pi.recovery_info,
-	      pi.recovery_progress);
+    response->soid = hoid;
+    response->recovery_info = pi.recovery_info;
+    response->recovery_progress = pi.recovery_progress;
+    return true;
   }
 }
 
 void ReplicatedPG::handle_push(OpRequestRef op)
 {
   MOSDSubOp *m = (MOSDSubOp *)op->request;
-  dout(10) << "handle_push "
-	   << m->recovery_info
-	   << m->recovery_progress
-	   << dendl;
-  bufferlist data;
-  m->claim_data(data);
-  bool first = m->current_progress.first;
-  bool complete = m->recovery_progress.data_complete &&
-    m->recovery_progress.omap_complete;
+
+  PushOp pop;
+  pop.soid = m->recovery_info.soid;
+  pop.version = m->version;
+  m->claim_data(pop.data);
+  pop.data_included = m->data_included;
+  pop.omap_header = m->omap_header;
+  pop.omap_entries = m->omap_entries;
+  pop.attrset = m->attrset;
+  pop.recovery_info = m->recovery_info;
+  pop.before_progress = m->current_progress;
+  pop.after_progress = m->recovery_progress;
+
   ObjectStore::Transaction *t = new ObjectStore::Transaction;
 
   // keep track of active pushes for scrub
@@ -5466,17 +5664,7 @@ void ReplicatedPG::handle_push(OpRequestRef op)
 
   Context *onreadable = new C_OSD_AppliedRecoveredObjectReplica(this, t);
   Context *onreadable_sync = 0;
-  submit_push_data(m->recovery_info,
-		   first,
-		   m->data_included,
-		   data,
-		   m->omap_header,
-		   m->attrset,
-		   m->omap_entries,
-		   t);
-  if (complete)
-    submit_push_complete(m->recovery_info,
-			 t);
+  handle_push(m->get_source().num(), pop, t);
 
   int r = osd->store->
     queue_transaction(osr.get(), t,
@@ -5497,53 +5685,72 @@ void ReplicatedPG::handle_push(OpRequestRef op)
   osd->send_message_osd_cluster(reply, m->get_connection());
 }
 
-int ReplicatedPG::send_push(int prio, int peer,
-			    const ObjectRecoveryInfo &recovery_info,
-			    ObjectRecoveryProgress progress,
-			    ObjectRecoveryProgress *out_progress)
+void ReplicatedPG::handle_push(int from, PushOp &pop,
+			       ObjectStore::Transaction *t)
 {
-  ObjectRecoveryProgress new_progress = progress;
+  dout(10) << "handle_push "
+	   << pop.recovery_info
+	   << pop.after_progress
+	   << " from osd." << from
+	   << dendl;
+  bufferlist data;
+  data.claim(pop.data);
+  bool first = pop.before_progress.first;
+  bool complete = pop.after_progress.data_complete &&
+    pop.after_progress.omap_complete;
 
-  tid_t tid = osd->get_tid();
-  osd_reqid_t rid(osd->get_cluster_msgr_name(), 0, tid);
-  MOSDSubOp *subop = new MOSDSubOp(rid, info.pgid, recovery_info.soid,
-				   false, 0, get_osdmap()->get_epoch(),
-				   tid, recovery_info.version);
-  subop->set_priority(prio);
+  submit_push_data(pop.recovery_info,
+		   first,
+		   pop.data_included,
+		   data,
+		   pop.omap_header,
+		   pop.attrset,
+		   pop.omap_entries,
+		   t);
+  if (complete)
+    submit_push_complete(pop.recovery_info,
+			 t);
+}
 
-  dout(7) << "send_push_op " << recovery_info.soid
+/*
+ * read the next chunk of an object (at most available bytes of data
+ * and omap) into *out_op.
+ */
+int ReplicatedPG::build_push_op(const ObjectRecoveryInfo &recovery_info,
+				const ObjectRecoveryProgress &progress,
+				uint64_t available,
+				ObjectRecoveryProgress *out_progress,
+				PushOp *out_op)
+{
+  ObjectRecoveryProgress new_progress = progress;
+
+  dout(7) << "build_push_op " << recovery_info.soid
 	  << " v " << recovery_info.version
 	  << " size " << recovery_info.size
-          << " to osd." << peer
 	  << " recovery_info: " << recovery_info
-          << dendl;
-
-  subop->ops = vector<OSDOp>(1);
-  subop->ops[0].op.op = CEPH_OSD_OP_PUSH;
+	  << dendl;
 
   if (progress.first) {
-    osd->store->omap_get_header(coll, recovery_info.soid, &subop->omap_header);
-    osd->store->getattrs(coll, recovery_info.soid, subop->attrset);
+    osd->store->omap_get_header(coll, recovery_info.soid, &out_op->omap_header);
+    osd->store->getattrs(coll, recovery_info.soid, out_op->attrset);
 
     // Debug
     bufferlist bv;
-    bv.push_back(subop->attrset[OI_ATTR]);
+    bv.push_back(out_op->attrset[OI_ATTR]);
     object_info_t oi(bv);
 
     if (oi.version != recovery_info.version) {
       osd->clog.error() << info.pgid << " push "
 			<< recovery_info.soid << " v "
-			<< recovery_info.version << " to osd." << peer
+			<< recovery_info.version
 			<< " failed because local copy is "
 			<< oi.version << "\n";
-      subop->put();
       return -1;
     }
 
     new_progress.first = false;
   }
 
-  uint64_t available = g_conf->osd_recovery_max_chunk;
   if (!progress.omap_complete) {
     ObjectMap::ObjectMapIterator iter =
       osd->store->get_omap_iterator(coll,
@@ -5553,7 +5760,7 @@ int ReplicatedPG::send_push(int prio, int peer,
 	 iter->next()) {
       if (available < (iter->key().size() + iter->value().length()))
 	break;
-      subop->omap_entries.insert(make_pair(iter->key(), iter->value()));
+      out_op->omap_entries.insert(make_pair(iter->key(), iter->value()));
       available -= (iter->key().size() + iter->value().length());
     }
     if (!iter->valid())
@@ -5562,12 +5769,12 @@ int ReplicatedPG::send_push(int prio, int peer,
       new_progress.omap_recovered_to = iter->key();
   }
 
-  subop->data_included.span_of(recovery_info.copy_subset,
-			       progress.data_recovered_to,
-			       available);
+  out_op->data_included.span_of(recovery_info.copy_subset,
+				progress.data_recovered_to,
+				available);
 
-  for (interval_set<uint64_t>::iterator p = subop->data_included.begin();
-       p != subop->data_included.end();
+  for (interval_set<uint64_t>::iterator p = out_op->data_included.begin();
+       p != out_op->data_included.end();
        ++p) {
     bufferlist bit;
     osd->store->read(coll, recovery_info.soid,
@@ -5579,28 +5786,182 @@ int ReplicatedPG::send_push(int prio, int peer,
       p.set_len(bit.length());
       new_progress.data_complete = true;
     }
-    subop->ops[0].indata.claim_append(bit);
+    out_op->data.claim_append(bit);
   }
 
-  if (!subop->data_included.empty())
-    new_progress.data_recovered_to = subop->data_included.range_end();
+  if (!out_op->data_included.empty())
+    new_progress.data_recovered_to = out_op->data_included.range_end();
 
   if (new_progress.is_complete(recovery_info))
     new_progress.data_complete = true;
 
   osd->logger->inc(l_osd_push);
-  osd->logger->inc(l_osd_push_outb, subop->ops[0].indata.length());
-  
+  osd->logger->inc(l_osd_push_outb, out_op->data.length());
+
+  out_op->soid = recovery_info.soid;
+  out_op->version = recovery_info.version;
+  out_op->recovery_info = recovery_info;
+  out_op->after_progress = new_progress;
+  out_op->before_progress = progress;
+
+  if (out_progress)
+    *out_progress = new_progress;
+  return 0;
+}
+
+int ReplicatedPG::send_push(int prio, int peer,
+			    const ObjectRecoveryInfo &recovery_info,
+			    ObjectRecoveryProgress progress,
+			    ObjectRecoveryProgress *out_progress)
+{
+  PushOp pop;
+  int r = build_push_op(recovery_info, progress,
+			g_conf->osd_recovery_max_chunk,
+			out_progress, &pop);
+  if (r < 0)
+    return r;
+
+  tid_t tid = osd->get_tid();
+  osd_reqid_t rid(osd->get_cluster_msgr_name(), 0, tid);
+  MOSDSubOp *subop = new MOSDSubOp(rid, info.pgid, recovery_info.soid,
+				   false, 0, get_osdmap()->get_epoch(),
+				   tid, recovery_info.version);
+  subop->set_priority(prio);
+
+  dout(7) << "send_push_op " << recovery_info.soid
+	  << " v " << recovery_info.version
+	  << " size " << recovery_info.size
+          << " to osd." << peer
+	  << " recovery_info: " << recovery_info
+          << dendl;
+
+  subop->ops = vector<OSDOp>(1);
+  subop->ops[0].op.op = CEPH_OSD_OP_PUSH;
+  subop->ops[0].indata.claim(pop.data);
+  subop->omap_header.claim(pop.omap_header);
+  subop->omap_entries.swap(pop.omap_entries);
+  subop->attrset.swap(pop.attrset);
+  subop->data_included.swap(pop.data_included);
+
   // send
   subop->recovery_info = recovery_info;
-  subop->recovery_progress = new_progress;
+  subop->recovery_progress = pop.after_progress;
   subop->current_progress = progress;
   osd->send_message_osd_cluster(peer, subop, get_osdmap()->get_epoch());
-  if (out_progress)
-    *out_progress = new_progress;
   return 0;
 }
 
+bool ReplicatedPG::can_batch_recovery(int peer)
+{
+  if (!g_conf->osd_recovery_batch_ops)
+    return false;
+  ConnectionRef con = osd->get_con_osd_cluster(peer, get_osdmap()->get_epoch());
+  return con && (con->features & CEPH_FEATURE_OSD_PACKED_RECOVERY);
+}
+
+/*
+ * push the next chunk of an object to peer, packing it in with other
+ * small objects bound for the same peer if it understands MOSDPGPush.
+ */
+int ReplicatedPG::queue_push(int prio, int peer,
+			     const ObjectRecoveryInfo &recovery_info,
+			     ObjectRecoveryProgress progress,
+			     ObjectRecoveryProgress *out_progress)
+{
+  if (!can_batch_recovery(peer))
+    return send_push(prio, peer, recovery_info, progress, out_progress);
+
+  uint64_t max = g_conf->osd_recovery_max_chunk;
+
+  // start a fresh batch rather than split an object that would
+  // otherwise fit in a single chunk
+  uint64_t want = MIN(recovery_info.copy_subset.size(), max);
+  map<int, RecoveryBatch>::iterator p = recovery_batches.find(peer);
+  if (p != recovery_batches.end() && p->second.cost + want > max)
+    send_recovery_batch(peer);
+
+  RecoveryBatch &batch = recovery_batches[peer];
+  batch.pushes.push_back(PushOp());
+  int r = build_push_op(recovery_info, progress,
+			max - batch.cost,
+			out_progress, &batch.pushes.back());
+  if (r < 0) {
+    batch.pushes.pop_back();
+    if (batch.empty())
+      recovery_batches.erase(peer);
+    return r;
+  }
+
+  dout(10) << "queue_push " << batch.pushes.back() << " to osd." << peer
+	   << " (" << batch.pushes.size() << " batched, cost "
+	   << batch.cost << ")" << dendl;
+  batch.cost += batch.pushes.back().cost();
+  if (prio > batch.priority)
+    batch.priority = prio;
+
+  if (batch.cost >= max)
+    send_recovery_batch(peer);
+  return 0;
+}
+
+void ReplicatedPG::queue_pull(int prio, int peer,
+			      const ObjectRecoveryInfo &recovery_info,
+			      ObjectRecoveryProgress progress)
+{
+  if (!can_batch_recovery(peer)) {
+    send_pull(prio, peer, recovery_info, progress);
+    return;
+  }
+
+  dout(10) << "queue_pull " << recovery_info.soid << " "
+	   << recovery_info.version
+	   << " first=" << progress.first
+	   << " data " << recovery_info.copy_subset
+	   << " from osd." << peer << dendl;
+
+  RecoveryBatch &batch = recovery_batches[peer];
+  batch.pulls.push_back(PullOp());
+  batch.pulls.back().soid = recovery_info.soid;
+  batch.pulls.back().recovery_info = recovery_info;
+  batch.pulls.back().recovery_progress = progress;
+  if (prio > batch.priority)
+    batch.priority = prio;
+  osd->logger->inc(l_osd_pull);
+}
+
+void ReplicatedPG::send_recovery_batch(int peer)
+{
+  map<int, RecoveryBatch>::iterator p = recovery_batches.find(peer);
+  if (p == recovery_batches.end())
+    return;
+
+  RecoveryBatch &batch = p->second;
+  epoch_t e = get_osdmap()->get_epoch();
+  if (!batch.pushes.empty()) {
+    dout(10) << "send_recovery_batch " << batch.pushes.size()
+	     << " pushes (cost " << batch.cost << ") to osd." << peer << dendl;
+    MOSDPGPush *msg = new MOSDPGPush(info.pgid, e);
+    msg->set_priority(batch.priority);
+    msg->pushes.swap(batch.pushes);
+    osd->send_message_osd_cluster(peer, msg, e);
+  }
+  if (!batch.pulls.empty()) {
+    dout(10) << "send_recovery_batch " << batch.pulls.size()
+	     << " pulls from osd." << peer << dendl;
+    MOSDPGPull *msg = new MOSDPGPull(info.pgid, e);
+    msg->set_priority(batch.priority);
+    msg->pulls.swap(batch.pulls);
+    osd->send_message_osd_cluster(peer, msg, e);
+  }
+  recovery_batches.erase(p);
+}
+
+void ReplicatedPG::send_recovery_batches()
+{
+  while (!recovery_batches.empty())
+    send_recovery_batch(recovery_batches.begin()->first);
+}
+
 void ReplicatedPG::send_push_op_blank(const hobject_t& soid, int peer)
 {
   // send a blank push back to the primary
@@ -5622,10 +5983,13 @@ void ReplicatedPG::sub_op_push_reply(OpRequestRef op)
   dout(10) << "sub_op_push_reply from " << reply->get_source() << " " << *reply << dendl;
 
   op->mark_started();
-  
-  int peer = reply->get_source().num();
-  const hobject_t& soid = reply->get_poid();
-  
+
+  handle_push_reply(reply->get_source().num(), reply->get_poid());
+  send_recovery_batches();
+}
+
+void ReplicatedPG::handle_push_reply(int peer, const hobject_t &soid)
+{
   if (pushing.count(soid) == 0) {
     dout(10) << "huh, i wasn't pushing " << soid << " to osd." << peer
 	     << ", or anybody else"
@@ -5641,7 +6005,7 @@ void ReplicatedPG::sub_op_push_reply(OpRequestRef op)
 	       << pi->recovery_progress.data_recovered_to
 	       << " of " << pi->recovery_info.copy_subset << dendl;
       ObjectRecoveryProgress new_progress;
-      send_push(
+      queue_push(
 	pi->priority,
 	peer, pi->recovery_info,
 	pi->recovery_progress, &new_progress);
@@ -5902,6 +6266,164 @@ void ReplicatedPG::trim_pushed_data(
   }
 }
 
+/** do_push
+ * a batch of pushes from the primary, or of pull responses from a
+ * replica, applied in a single transaction where possible.
+ * NOTE: called from opqueue.
+ */
+void ReplicatedPG::do_push(OpRequestRef op)
+{
+  MOSDPGPush *m = static_cast<MOSDPGPush *>(op->request);
+  assert(m->get_header().type == MSG_OSD_PG_PUSH);
+  if (!is_active()) {
+    waiting_for_active.push_back(op);
+    return;
+  }
+
+  op->mark_started();
+
+  int from = m->get_source().num();
+  dout(10) << "do_push " << m->pushes.size() << " objects from osd."
+	   << from << dendl;
+
+  if (is_primary()) {
+    // pull responses; each completed object needs its own obc, so
+    // they keep their own transactions.
+    for (vector<PushOp>::iterator i = m->pushes.begin();
+	 i != m->pushes.end();
+	 ++i) {
+      PullOp response;
+      if (handle_pull_response(i == m->pushes.begin() ? op : OpRequestRef(),
+			       from, *i, &response)) {
+	assert(pulling.count(response.soid));
+	queue_pull(pulling[response.soid].priority, from,
+		   response.recovery_info, response.recovery_progress);
+      }
+    }
+    send_recovery_batches();
+    return;
+  }
+
+  ObjectStore::Transaction *t = new ObjectStore::Transaction;
+  MOSDPGPushReply *reply = new MOSDPGPushReply(info.pgid,
+					       get_osdmap()->get_epoch());
+  reply->set_priority(m->get_priority());
+
+  // keep track of active pushes for scrub
+  ++active_pushes;
+
+  for (vector<PushOp>::iterator i = m->pushes.begin();
+       i != m->pushes.end();
+       ++i) {
+    osd->logger->inc(l_osd_push_in);
+    osd->logger->inc(l_osd_push_inb, i->data.length());
+    reply->replies.push_back(PushReplyOp());
+    reply->replies.back().soid = i->soid;
+    handle_push(from, *i, t);
+  }
+
+  int r = osd->store->
+    queue_transaction(osr.get(), t,
+		      new C_OSD_AppliedRecoveredObjectReplica(this, t),
+		      new C_OSD_CommittedPushedObject(
+			this, op,
+			info.history.same_interval_since,
+			info.last_complete),
+		      0);
+  assert(r == 0);
+
+  assert(entity_name_t::TYPE_OSD == m->get_connection()->peer_type);
+  osd->send_message_osd_cluster(reply, m->get_connection());
+}
+
+void ReplicatedPG::handle_pull(int from, PullOp &pop, PushOp *response,
+			       uint64_t available)
+{
+  const hobject_t &soid = pop.soid;
+  struct stat st;
+  int r = osd->store->stat(coll, soid, &st);
+  if (r != 0) {
+    osd->clog.error() << info.pgid << " osd." << from << " tried to pull "
+		      << soid << " but got " << cpp_strerror(-r) << "\n";
+  } else {
+    ObjectRecoveryInfo &recovery_info = pop.recovery_info;
+    ObjectRecoveryProgress &progress = pop.recovery_progress;
+    if (progress.first && recovery_info.size == ((uint64_t)-1)) {
+      // Adjust size and copy_subset
+      recovery_info.size = st.st_size;
+      recovery_info.copy_subset.clear();
+      if (st.st_size)
+	recovery_info.copy_subset.insert(0, st.st_size);
+      assert(recovery_info.clone_subset.empty());
+    }
+
+    r = build_push_op(recovery_info, progress, available, 0, response);
+  }
+
+  if (r < 0) {
+    // blank push tells the primary we don't have it
+    *response = PushOp();
+    response->soid = soid;
+  }
+}
+
+/** do_pull
+ * answer a batch of pulls with a single MOSDPGPush.
+ * NOTE: called from opqueue.
+ */
+void ReplicatedPG::do_pull(OpRequestRef op)
+{
+  MOSDPGPull *m = static_cast<MOSDPGPull *>(op->request);
+  assert(m->get_header().type == MSG_OSD_PG_PULL);
+
+  op->mark_started();
+
+  int from = m->get_source().num();
+  dout(7) << "do_pull " << m->pulls.size() << " objects from osd."
+	  << from << dendl;
+
+  assert(!is_primary());  // we should be a replica or stray.
+
+  uint64_t max = g_conf->osd_recovery_max_chunk;
+  uint64_t cost = 0;
+  MOSDPGPush *reply = new MOSDPGPush(info.pgid, get_osdmap()->get_epoch());
+  reply->set_priority(m->get_priority());
+  for (vector<PullOp>::iterator i = m->pulls.begin();
+       i != m->pulls.end();
+       ++i) {
+    reply->pushes.push_back(PushOp());
+    handle_pull(from, *i, &reply->pushes.back(),
+		cost < max ? max - cost : 0);
+    cost += reply->pushes.back().cost();
+  }
+  osd->send_message_osd_cluster(reply, m->get_connection());
+
+  log_subop_stats(op, 0, l_osd_sop_pull_lat);
+}
+
+/** do_push_reply
+ * replica acks for a batch of pushes; continue or finish each object.
+ * NOTE: called from opqueue.
+ */
+void ReplicatedPG::do_push_reply(OpRequestRef op)
+{
+  MOSDPGPushReply *m = static_cast<MOSDPGPushReply *>(op->request);
+  assert(m->get_header().type == MSG_OSD_PG_PUSH_REPLY);
+
+  op->mark_started();
+
+  int from = m->get_source().num();
+  dout(10) << "do_push_reply " << m->replies.size() << " objects from osd."
+	   << from << dendl;
+
+  for (vector<PushReplyOp>::iterator i = m->replies.begin();
+       i != m->replies.end();
+       ++i) {
+    handle_push_reply(from, i->soid);
+  }
+  send_recovery_batches();
+}
+
 /** op_push
  * NOTE: called from opqueue.
  */
@@ -5917,12 +6439,8 @@ void ReplicatedPG::sub_op_push(OpRequestRef op)
   return;
 }
 
-void ReplicatedPG::_failed_push(OpRequestRef op)
+void ReplicatedPG::_failed_push(int from, const hobject_t &soid)
 {
-  MOSDSubOp *m = (MOSDSubOp*)op->request;
-  assert(m->get_header().type == MSG_OSD_SUBOP);
-  const hobject_t& soid = m->poid;
-  int from = m->get_source().num();
   map<hobject_t,set<int> >::iterator p = missing_loc.find(soid);
   if (p != missing_loc.end()) {
     dout(0) << "_failed_push " << soid << " from osd." << from
@@ -6257,6 +6775,7 @@ void ReplicatedPG::on_change()
   pushing.clear();
   pulling.clear();
   pull_from_peer.clear();
+  recovery_batches.clear();
 
   // clear snap_trimmer state
   snap_trimmer_machine.process_event(Reset());
@@ -6282,6 +6801,7 @@ void ReplicatedPG::_clear_recovery_state()
   pulling.clear();
   pushing.clear();
   pull_from_peer.clear();
+  recovery_batches.clear();
 }
 
 void ReplicatedPG::check_recovery_sources(const OSDMapRef osdmap)
@@ -6425,6 +6945,7 @@ int ReplicatedPG::start_recovery_ops(int max, RecoveryCtx *prctx)
       started += recover_backfill(max - started);
     }
   }
+  send_recovery_batches();
 
   dout(10) << " started " << started << dendl;
   osd->logger->inc(l_osd_rop, started);
@@ -6789,6 +7310,7 @@ int ReplicatedPG::recover_backfill(int max)
   map<hobject_t, pair<eversion_t, eversion_t> > to_push;
   map<hobject_t, eversion_t> to_remove;
   set<hobject_t> add_to_stat;
+  object_stat_sum_t backfill_delta;
 
   pbi.trim();
   backfill_info.trim();
@@ -6839,12 +7361,19 @@ int ReplicatedPG::recover_backfill(int max)
       // and we can't increment ops without requeueing ourself
       // for recovery.
     } else if (pbi.begin == backfill_info.begin) {
+      // the peer has a copy; only push it if the object_info_t
+      // versions (as read from the OI_ATTR headers by scan_range on
+      // both sides) disagree.  this is what keeps backfilling an osd
+      // that was down past the end of the log proportional to what
+      // changed rather than to the size of the pg.
+      backfill_delta.num_objects_backfill_scanned++;
       if (pbi.objects.begin()->second !=
 	  backfill_info.objects.begin()->second) {
 	dout(20) << " replacing peer " << pbi.begin << " with local "
 		 << backfill_info.objects.begin()->second << dendl;
 	to_push[pbi.begin] = make_pair(backfill_info.objects.begin()->second,
 				       pbi.objects.begin()->second);
+	backfill_delta.num_objects_backfill_pushed++;
 	ops++;
       } else {
 	dout(20) << " keeping peer " << pbi.begin << " "
@@ -6868,11 +7397,21 @@ int ReplicatedPG::recover_backfill(int max)
 		  eversion_t());
       add_to_stat.insert(backfill_info.begin);
       backfill_info.pop_front();
+      backfill_delta.num_objects_backfill_scanned++;
+      backfill_delta.num_objects_backfill_pushed++;
       ops++;
     }
   }
   backfill_pos = backfill_info.begin > pbi.begin ? pbi.begin : backfill_info.begin;
 
+  dout(10) << " scanned " << backfill_delta.num_objects_backfill_scanned
+	   << ", pushing " << backfill_delta.num_objects_backfill_pushed
+	   << ", removing " << to_remove.size() << dendl;
+  if (!backfill_delta.is_zero()) {
+    info.stats.stats.add(backfill_delta, string());
+    update_stats();
+  }
+
   for (set<hobject_t>::iterator i = add_to_stat.begin();
        i != add_to_stat.end();
        ++i) {
@@ -618,6 +618,38 @@ protected:
   };
   map<hobject_t, PullInfo> pulling;
 
+  /*
+   * Batched recovery
+   *
+   * Pushes and pulls destined for the same peer are accumulated here
+   * and sent as a single MOSDPGPush/MOSDPGPull, bounded by
+   * osd_recovery_max_chunk.  Anything queued must be sent with
+   * send_recovery_batches() before the pg lock is dropped.
+   */
+  struct RecoveryBatch {
+    int priority;
+    uint64_t cost;
+    vector<PushOp> pushes;
+    vector<PullOp> pulls;
+
+    RecoveryBatch() : priority(0), cost(0) {}
+    bool empty() const {
+      return pushes.empty() && pulls.empty();
+    }
+  };
+  map<int, RecoveryBatch> recovery_batches;
+
+  bool can_batch_recovery(int peer);
+  int queue_push(int priority, int peer,
+		 const ObjectRecoveryInfo& recovery_info,
+		 ObjectRecoveryProgress progress,
+		 ObjectRecoveryProgress *out_progress = 0);
+  void queue_pull(int priority, int peer,
+		  const ObjectRecoveryInfo& recovery_info,
+		  ObjectRecoveryProgress progress);
+  void send_recovery_batch(int peer);
+  void send_recovery_batches();
+
   ObjectRecoveryInfo recalc_subsets(const ObjectRecoveryInfo& recovery_info);
   static void trim_pushed_data(const interval_set<uint64_t> &copy_subset,
 			       const interval_set<uint64_t> &intervals_received,
@@ -625,7 +657,18 @@ protected:
 			       interval_set<uint64_t> *intervals_usable,
 			       bufferlist *data_usable);
   void handle_pull_response(OpRequestRef op);
+  bool handle_pull_response(OpRequestRef op, int from, PushOp &pop,
+			    PullOp *response);
   void handle_push(OpRequestRef op);
+  void handle_push(int from, PushOp &pop, ObjectStore::Transaction *t);
+  void handle_pull(int from, PullOp &pop, PushOp *response,
+		   uint64_t available);
+  void handle_push_reply(int peer, const hobject_t &soid);
+  int build_push_op(const ObjectRecoveryInfo &recovery_info,
+		    const ObjectRecoveryProgress &progress,
+		    uint64_t available,
+		    ObjectRecoveryProgress *out_progress,
+		    PushOp *out_op);
   int send_push(int priority, int peer,
 		const ObjectRecoveryInfo& recovery_info,
 		ObjectRecoveryProgress progress,
@@ -785,6 +828,9 @@ protected:
 		   object_info_t *poi);
   void make_writeable(OpContext *ctx);
   void log_op_stats(OpContext *ctx);
+  void log_op_stage(OpRequestRef op, int tag_lat,
+		    const string &from, const string &to);
+  void log_op_stage_stats(OpRequestRef op);
 
   void write_update_size_and_usage(object_stat_sum_t& stats, object_info_t& oi,
 				   SnapSet& ss, interval_set<uint64_t>& modified,
@@ -917,7 +963,7 @@ protected:
   void _committed_pushed_object(OpRequestRef op, epoch_t same_since, eversion_t lc);
   void recover_got(hobject_t oid, eversion_t v);
   void sub_op_push(OpRequestRef op);
-  void _failed_push(OpRequestRef op);
+  void _failed_push(int from, const hobject_t &soid);
   void sub_op_push_reply(OpRequestRef op);
   void sub_op_pull(OpRequestRef op);
 
@@ -955,6 +1001,9 @@ public:
   void do_sub_op_reply(OpRequestRef op);
   void do_scan(OpRequestRef op);
   void do_backfill(OpRequestRef op);
+  void do_push(OpRequestRef op);
+  void do_pull(OpRequestRef op);
+  void do_push_reply(OpRequestRef op);
   bool get_obs_to_trim(snapid_t &snap_to_trim,
 		       coll_t &col_to_trim,
 		       vector<hobject_t> &obs_to_trim);
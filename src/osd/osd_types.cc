@@ -858,11 +858,13 @@ void object_stat_sum_t::dump(Formatter *f) const
   f->dump_unsigned("num_read_kb", num_rd_kb);
   f->dump_unsigned("num_write", num_wr);
   f->dump_unsigned("num_write_kb", num_wr_kb);
+  f->dump_unsigned("num_objects_backfill_scanned", num_objects_backfill_scanned);
+  f->dump_unsigned("num_objects_backfill_pushed", num_objects_backfill_pushed);
 }
 
 void object_stat_sum_t::encode(bufferlist& bl) const
 {
-  ENCODE_START(3, 3, bl);
+  ENCODE_START(4, 3, bl);
   ::encode(num_bytes, bl);
   ::encode(num_objects, bl);
   ::encode(num_object_clones, bl);
@@ -874,12 +876,14 @@ void object_stat_sum_t::encode(bufferlist& bl) const
   ::encode(num_rd_kb, bl);
   ::encode(num_wr, bl);
   ::encode(num_wr_kb, bl);
+  ::encode(num_objects_backfill_scanned, bl);
+  ::encode(num_objects_backfill_pushed, bl);
   ENCODE_FINISH(bl);
 }
 
 void object_stat_sum_t::decode(bufferlist::iterator& bl)
 {
-  DECODE_START_LEGACY_COMPAT_LEN(3, 3, 3, bl);
+  DECODE_START_LEGACY_COMPAT_LEN(4, 3, 3, bl);
   ::decode(num_bytes, bl);
   if (struct_v < 3) {
     uint64_t num_kb;
@@ -896,6 +900,13 @@ void object_stat_sum_t::decode(bufferlist::iterator& bl)
   ::decode(num_rd_kb, bl);
   ::decode(num_wr, bl);
   ::decode(num_wr_kb, bl);
+  if (struct_v >= 4) {
+    ::decode(num_objects_backfill_scanned, bl);
+    ::decode(num_objects_backfill_pushed, bl);
+  } else {
+    num_objects_backfill_scanned = 0;
+    num_objects_backfill_pushed = 0;
+  }
   DECODE_FINISH(bl);
 }
 
@@ -913,6 +924,8 @@ void object_stat_sum_t::generate_test_instances(list<object_stat_sum_t*>& o)
   a.num_objects_unfound = 8;
   a.num_rd = 9; a.num_rd_kb = 10;
   a.num_wr = 11; a.num_wr_kb = 12;
+  a.num_objects_backfill_scanned = 13;
+  a.num_objects_backfill_pushed = 14;
   o.push_back(new object_stat_sum_t(a));
 }
 
@@ -929,6 +942,8 @@ void object_stat_sum_t::add(const object_stat_sum_t& o)
   num_wr += o.num_wr;
   num_wr_kb += o.num_wr_kb;
   num_objects_unfound += o.num_objects_unfound;
+  num_objects_backfill_scanned += o.num_objects_backfill_scanned;
+  num_objects_backfill_pushed += o.num_objects_backfill_pushed;
 }
 
 void object_stat_sum_t::sub(const object_stat_sum_t& o)
@@ -944,6 +959,8 @@ void object_stat_sum_t::sub(const object_stat_sum_t& o)
   num_wr -= o.num_wr;
   num_wr_kb -= o.num_wr_kb;
   num_objects_unfound -= o.num_objects_unfound;
+  num_objects_backfill_scanned -= o.num_objects_backfill_scanned;
+  num_objects_backfill_pushed -= o.num_objects_backfill_pushed;
 }
 
 
@@ -2289,6 +2306,107 @@ ostream& operator<<(ostream& out, const SnapSet& cs)
 	     << (cs.head_exists ? "+head":"");
 }
 
+// -- clone_info --
+
+void clone_info::encode(bufferlist& bl) const
+{
+  ENCODE_START(1, 1, bl);
+  ::encode(cloneid, bl);
+  ::encode(snaps, bl);
+  ::encode(overlap, bl);
+  ::encode(size, bl);
+  ENCODE_FINISH(bl);
+}
+
+void clone_info::decode(bufferlist::iterator& bl)
+{
+  DECODE_START(1, bl);
+  ::decode(cloneid, bl);
+  ::decode(snaps, bl);
+  ::decode(overlap, bl);
+  ::decode(size, bl);
+  DECODE_FINISH(bl);
+}
+
+void clone_info::dump(Formatter *f) const
+{
+  if (cloneid == CEPH_NOSNAP)
+    f->dump_string("cloneid", "HEAD");
+  else
+    f->dump_unsigned("cloneid", cloneid.val);
+  f->open_array_section("snapshots");
+  for (vector<snapid_t>::const_iterator p = snaps.begin(); p != snaps.end(); ++p)
+    f->dump_unsigned("snap", *p);
+  f->close_section();
+  f->open_array_section("overlaps");
+  for (vector<pair<uint64_t,uint64_t> >::const_iterator q = overlap.begin();
+       q != overlap.end(); ++q) {
+    f->open_object_section("overlap");
+    f->dump_unsigned("offset", q->first);
+    f->dump_unsigned("length", q->second);
+    f->close_section();
+  }
+  f->close_section();
+  f->dump_unsigned("size", size);
+}
+
+void clone_info::generate_test_instances(list<clone_info*>& o)
+{
+  o.push_back(new clone_info);
+  o.push_back(new clone_info);
+  o.back()->cloneid = 1;
+  o.back()->snaps.push_back(1);
+  o.back()->overlap.push_back(pair<uint64_t,uint64_t>(0,4096));
+  o.back()->overlap.push_back(pair<uint64_t,uint64_t>(8192,4096));
+  o.back()->size = 16384;
+  o.push_back(new clone_info);
+  o.back()->cloneid = CEPH_NOSNAP;
+  o.back()->size = 32768;
+}
+
+// -- obj_list_snap_response_t --
+
+void obj_list_snap_response_t::encode(bufferlist& bl) const
+{
+  ENCODE_START(1, 1, bl);
+  ::encode(clones, bl);
+  ::encode(seq, bl);
+  ENCODE_FINISH(bl);
+}
+
+void obj_list_snap_response_t::decode(bufferlist::iterator& bl)
+{
+  DECODE_START(1, bl);
+  ::decode(clones, bl);
+  ::decode(seq, bl);
+  DECODE_FINISH(bl);
+}
+
+void obj_list_snap_response_t::dump(Formatter *f) const
+{
+  f->open_array_section("clones");
+  for (vector<clone_info>::const_iterator p = clones.begin(); p != clones.end(); ++p) {
+    f->open_object_section("clone");
+    p->dump(f);
+    f->close_section();
+  }
+  f->close_section();
+  f->dump_unsigned("seq", seq);
+}
+
+void obj_list_snap_response_t::generate_test_instances(list<obj_list_snap_response_t*>& o)
+{
+  o.push_back(new obj_list_snap_response_t);
+  list<clone_info*> cl;
+  clone_info::generate_test_instances(cl);
+  o.push_back(new obj_list_snap_response_t);
+  for (list<clone_info*>::iterator p = cl.begin(); p != cl.end(); ++p) {
+    o.back()->clones.push_back(**p);
+    delete *p;
+  }
+  o.back()->seq = 123;
+}
+
 // -- watch_info_t --
 
 void watch_info_t::encode(bufferlist& bl) const
@@ -2630,6 +2748,215 @@ ostream &ObjectRecoveryInfo::print(ostream &out) const
 	     << ")";
 }
 
+// -- PushOp --
+
+void PushOp::encode(bufferlist &bl) const
+{
+  ENCODE_START(1, 1, bl);
+  ::encode(soid, bl);
+  ::encode(version, bl);
+  ::encode(data, bl);
+  ::encode(data_included, bl);
+  ::encode(omap_header, bl);
+  ::encode(omap_entries, bl);
+  ::encode(attrset, bl);
+  ::encode(recovery_info, bl);
+  ::encode(after_progress, bl);
+  ::encode(before_progress, bl);
+  ENCODE_FINISH(bl);
+}
+
+void PushOp::decode(bufferlist::iterator &bl)
+{
+  DECODE_START(1, bl);
+  ::decode(soid, bl);
+  ::decode(version, bl);
+  ::decode(data, bl);
+  ::decode(data_included, bl);
+  ::decode(omap_header, bl);
+  ::decode(omap_entries, bl);
+  ::decode(attrset, bl);
+  ::decode(recovery_info, bl);
+  ::decode(after_progress, bl);
+  ::decode(before_progress, bl);
+  DECODE_FINISH(bl);
+}
+
+void PushOp::generate_test_instances(list<PushOp*> &o)
+{
+  o.push_back(new PushOp);
+  o.push_back(new PushOp);
+  o.back()->soid = hobject_t(sobject_t("asdf", 2));
+  o.back()->version = eversion_t(3, 10);
+  o.push_back(new PushOp);
+  o.back()->soid = hobject_t(sobject_t("asdf", CEPH_NOSNAP));
+  o.back()->version = eversion_t(0, 0);
+  o.back()->data.append("bar", 3);
+  o.back()->data_included.insert(0, 3);
+}
+
+void PushOp::dump(Formatter *f) const
+{
+  f->dump_stream("soid") << soid;
+  f->dump_stream("version") << version;
+  f->dump_int("data_len", data.length());
+  f->dump_stream("data_included") << data_included;
+  f->dump_int("omap_header_len", omap_header.length());
+  f->dump_int("omap_entries_len", omap_entries.size());
+  f->dump_int("attrset_len", attrset.size());
+  {
+    f->open_object_section("recovery_info");
+    recovery_info.dump(f);
+    f->close_section();
+  }
+  {
+    f->open_object_section("after_progress");
+    after_progress.dump(f);
+    f->close_section();
+  }
+  {
+    f->open_object_section("before_progress");
+    before_progress.dump(f);
+    f->close_section();
+  }
+}
+
+ostream &PushOp::print(ostream &out) const
+{
+  return out
+    << "PushOp(" << soid
+    << ", version: " << version
+    << ", data_included: " << data_included
+    << ", data_size: " << data.length()
+    << ", omap_header_size: " << omap_header.length()
+    << ", omap_entries_size: " << omap_entries.size()
+    << ", attrset_size: " << attrset.size()
+    << ", recovery_info: " << recovery_info
+    << ", after_progress: " << after_progress
+    << ", before_progress: " << before_progress
+    << ")";
+}
+
+ostream& operator<<(ostream& out, const PushOp &op)
+{
+  return op.print(out);
+}
+
+uint64_t PushOp::cost() const
+{
+  uint64_t cost = data_included.size();
+  for (map<string, bufferlist>::const_iterator i = omap_entries.begin();
+       i != omap_entries.end();
+       ++i) {
+    cost += i->first.size() + i->second.length();
+  }
+  for (map<string, bufferptr>::const_iterator i = attrset.begin();
+       i != attrset.end();
+       ++i) {
+    cost += i->first.size() + i->second.length();
+  }
+  return cost + omap_header.length();
+}
+
+// -- PushReplyOp --
+
+void PushReplyOp::encode(bufferlist &bl) const
+{
+  ENCODE_START(1, 1, bl);
+  ::encode(soid, bl);
+  ENCODE_FINISH(bl);
+}
+
+void PushReplyOp::decode(bufferlist::iterator &bl)
+{
+  DECODE_START(1, bl);
+  ::decode(soid, bl);
+  DECODE_FINISH(bl);
+}
+
+void PushReplyOp::generate_test_instances(list<PushReplyOp*> &o)
+{
+  o.push_back(new PushReplyOp);
+  o.push_back(new PushReplyOp);
+  o.back()->soid = hobject_t(sobject_t("asdf", 2));
+  o.push_back(new PushReplyOp);
+  o.back()->soid = hobject_t(sobject_t("asdf", CEPH_NOSNAP));
+}
+
+void PushReplyOp::dump(Formatter *f) const
+{
+  f->dump_stream("soid") << soid;
+}
+
+ostream &PushReplyOp::print(ostream &out) const
+{
+  return out << "PushReplyOp(" << soid << ")";
+}
+
+ostream& operator<<(ostream& out, const PushReplyOp &op)
+{
+  return op.print(out);
+}
+
+// -- PullOp --
+
+void PullOp::encode(bufferlist &bl) const
+{
+  ENCODE_START(1, 1, bl);
+  ::encode(soid, bl);
+  ::encode(recovery_info, bl);
+  ::encode(recovery_progress, bl);
+  ENCODE_FINISH(bl);
+}
+
+void PullOp::decode(bufferlist::iterator &bl)
+{
+  DECODE_START(1, bl);
+  ::decode(soid, bl);
+  ::decode(recovery_info, bl);
+  ::decode(recovery_progress, bl);
+  DECODE_FINISH(bl);
+}
+
+void PullOp::generate_test_instances(list<PullOp*> &o)
+{
+  o.push_back(new PullOp);
+  o.push_back(new PullOp);
+  o.back()->soid = hobject_t(sobject_t("asdf", 2));
+  o.back()->recovery_info.version = eversion_t(3, 10);
+  o.push_back(new PullOp);
+  o.back()->soid = hobject_t(sobject_t("asdf", CEPH_NOSNAP));
+  o.back()->recovery_info.version = eversion_t(0, 0);
+}
+
+void PullOp::dump(Formatter *f) const
+{
+  f->dump_stream("soid") << soid;
+  {
+    f->open_object_section("recovery_info");
+    recovery_info.dump(f);
+    f->close_section();
+  }
+  {
+    f->open_object_section("recovery_progress");
+    recovery_progress.dump(f);
+    f->close_section();
+  }
+}
+
+ostream &PullOp::print(ostream &out) const
+{
+  return out << "PullOp(" << soid
+	     << ", recovery_info: " << recovery_info
+	     << ", recovery_progress: " << recovery_progress
+	     << ")";
+}
+
+ostream& operator<<(ostream& out, const PullOp &op)
+{
+  return op.print(out);
+}
+
 // -- ScrubMap --
 
 void ScrubMap::merge_incr(const ScrubMap &l)
@@ -773,12 +773,15 @@ struct object_stat_sum_t {
   int64_t num_objects_unfound;
   int64_t num_rd, num_rd_kb;
   int64_t num_wr, num_wr_kb;
+  int64_t num_objects_backfill_scanned;  // compared against the backfill target
+  int64_t num_objects_backfill_pushed;   // ...and found to differ
 
   object_stat_sum_t()
     : num_bytes(0),
       num_objects(0), num_object_clones(0), num_object_copies(0),
       num_objects_missing_on_primary(0), num_objects_degraded(0), num_objects_unfound(0),
-      num_rd(0), num_rd_kb(0), num_wr(0), num_wr_kb(0)
+      num_rd(0), num_rd_kb(0), num_wr(0), num_wr_kb(0),
+      num_objects_backfill_scanned(0), num_objects_backfill_pushed(0)
   {}
 
   void clear() {
@@ -1666,6 +1669,36 @@ WRITE_CLASS_ENCODER(SnapSet)
 
 ostream& operator<<(ostream& out, const SnapSet& cs);
 
+/*
+ * list-snaps response: one entry per clone of an object, plus one for
+ * the head if it exists (with cloneid CEPH_NOSNAP)
+ */
+struct clone_info {
+  snapid_t cloneid;
+  vector<snapid_t> snaps;  // ascending
+  vector< pair<uint64_t,uint64_t> > overlap;  // with next newest
+  uint64_t size;
+
+  clone_info() : cloneid(CEPH_NOSNAP), size(0) {}
+
+  void encode(bufferlist& bl) const;
+  void decode(bufferlist::iterator& bl);
+  void dump(Formatter *f) const;
+  static void generate_test_instances(list<clone_info*>& o);
+};
+WRITE_CLASS_ENCODER(clone_info)
+
+struct obj_list_snap_response_t {
+  vector<clone_info> clones;   // ascending
+  snapid_t seq;
+
+  void encode(bufferlist& bl) const;
+  void decode(bufferlist::iterator& bl);
+  void dump(Formatter *f) const;
+  static void generate_test_instances(list<obj_list_snap_response_t*>& o);
+};
+WRITE_CLASS_ENCODER(obj_list_snap_response_t)
+
 
 
 #define OI_ATTR "_"
@@ -1809,6 +1842,61 @@ struct ObjectRecoveryProgress {
 WRITE_CLASS_ENCODER(ObjectRecoveryProgress)
 ostream& operator<<(ostream& out, const ObjectRecoveryProgress &prog);
 
+/*
+ * One object's worth of recovery data, packed with others into a
+ * single MOSDPGPush so that small objects can be recovered in batches.
+ */
+struct PushOp {
+  hobject_t soid;
+  eversion_t version;
+  bufferlist data;
+  interval_set<uint64_t> data_included;
+  bufferlist omap_header;
+  map<string, bufferlist> omap_entries;
+  map<string, bufferptr> attrset;
+
+  ObjectRecoveryInfo recovery_info;
+  ObjectRecoveryProgress before_progress;
+  ObjectRecoveryProgress after_progress;
+
+  static void generate_test_instances(list<PushOp*>& o);
+  void encode(bufferlist &bl) const;
+  void decode(bufferlist::iterator &bl);
+  ostream &print(ostream &out) const;
+  void dump(Formatter *f) const;
+
+  uint64_t cost() const;
+};
+WRITE_CLASS_ENCODER(PushOp)
+ostream& operator<<(ostream& out, const PushOp &op);
+
+struct PushReplyOp {
+  hobject_t soid;
+
+  static void generate_test_instances(list<PushReplyOp*>& o);
+  void encode(bufferlist &bl) const;
+  void decode(bufferlist::iterator &bl);
+  ostream &print(ostream &out) const;
+  void dump(Formatter *f) const;
+};
+WRITE_CLASS_ENCODER(PushReplyOp)
+ostream& operator<<(ostream& out, const PushReplyOp &op);
+
+struct PullOp {
+  hobject_t soid;
+
+  ObjectRecoveryInfo recovery_info;
+  ObjectRecoveryProgress recovery_progress;
+
+  static void generate_test_instances(list<PullOp*>& o);
+  void encode(bufferlist &bl) const;
+  void decode(bufferlist::iterator &bl);
+  ostream &print(ostream &out) const;
+  void dump(Formatter *f) const;
+};
+WRITE_CLASS_ENCODER(PullOp)
+ostream& operator<<(ostream& out, const PullOp &op);
+
 
 /*
  * summarize pg contents for purposes of a scrub
@@ -32,6 +32,7 @@ ObjectCacher::BufferHead *ObjectCacher::Object::split(BufferHead *left, loff_t o
   right->last_write_tid = left->last_write_tid;
   right->set_state(left->get_state());
   right->snapc = left->snapc;
+  right->readahead = left->readahead;
 
   loff_t newleftlen = off - left->start();
   right->set_start(off);
@@ -119,7 +120,8 @@ void ObjectCacher::Object::try_merge_bh(BufferHead *bh)
   if (p != data.begin()) {
     p--;
     if (p->second->end() == bh->start() &&
-	p->second->get_state() == bh->get_state()) {
+	p->second->get_state() == bh->get_state() &&
+	p->second->readahead == bh->readahead) {
       merge_left(p->second, bh);
       bh = p->second;
     } else {
@@ -131,7 +133,8 @@ void ObjectCacher::Object::try_merge_bh(BufferHead *bh)
   p++;
   if (p != data.end() &&
       p->second->start() == bh->end() &&
-      p->second->get_state() == bh->get_state())
+      p->second->get_state() == bh->get_state() &&
+      p->second->readahead == bh->readahead)
     merge_left(bh, p->second);
 }
 
@@ -538,6 +541,11 @@ void ObjectCacher::perf_start()
   plb.add_u64_counter(l_objectcacher_write_ops_blocked, "write_ops_blocked");
   plb.add_u64_counter(l_objectcacher_write_bytes_blocked, "write_bytes_blocked");
   plb.add_time(l_objectcacher_write_time_blocked, "write_time_blocked");
+  plb.add_u64_counter(l_objectcacher_readahead_bytes, "readahead_bytes");
+  plb.add_u64_counter(l_objectcacher_readahead_hit_bytes,
+		      "readahead_hit_bytes");
+  plb.add_u64_counter(l_objectcacher_readahead_waste_bytes,
+		      "readahead_waste_bytes");
 
   perfcounter = plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(perfcounter);
@@ -897,6 +905,8 @@ void ObjectCacher::trim(loff_t max_bytes, loff_t max_ob)
 
     ldout(cct, 10) << "trim trimming " << *bh << dendl;
     assert(bh->is_clean() || bh->is_zero());
+    if (bh->readahead && perfcounter)
+      perfcounter->inc(l_objectcacher_readahead_waste_bytes, bh->length());
 
     Object *ob = bh->ob;
     bh_remove(ob, bh);
@@ -965,8 +975,13 @@ int ObjectCacher::_readx(OSDRead *rd, ObjectSet *oset, Context *onfinish,
   uint64_t bytes_in_cache = 0;
   uint64_t bytes_not_in_cache = 0;
   uint64_t total_bytes_read = 0;
+  uint64_t readahead_bytes = 0;
+  uint64_t readahead_hit_bytes = 0;
   map<uint64_t, bufferlist> stripe_map;  // final buffer offset -> substring
 
+  // a read nobody is waiting for is only warming the cache
+  bool readahead = !rd->bl && !onfinish;
+
   for (vector<ObjectExtent>::iterator ex_it = rd->extents.begin();
        ex_it != rd->extents.end();
        ex_it++) {
@@ -1047,6 +1062,10 @@ int ObjectCacher::_readx(OSDRead *rd, ObjectSet *oset, Context *onfinish,
            bh_it != missing.end();
            bh_it++) {
         bh_read(bh_it->second);
+        if (readahead) {
+          bh_it->second->readahead = true;
+          readahead_bytes += bh_it->second->length();
+        }
         if (success && onfinish) {
           ldout(cct, 10) << "readx missed, waiting on " << *bh_it->second 
                    << " off " << bh_it->first << dendl;
@@ -1081,6 +1100,15 @@ int ObjectCacher::_readx(OSDRead *rd, ObjectSet *oset, Context *onfinish,
 	  error = bh_it->second->error;
         hit_ls.push_back(bh_it->second);
         bytes_in_cache += bh_it->second->length();
+        if (!readahead && bh_it->second->readahead) {
+          // count what this read uses; the rest of the bh is no longer
+          // considered waste either
+          loff_t start = MAX(bh_it->second->start(), (loff_t)ex_it->offset);
+          loff_t end = MIN(bh_it->second->end(),
+                           (loff_t)(ex_it->offset + ex_it->length));
+          readahead_hit_bytes += end - start;
+          bh_it->second->readahead = false;
+        }
       }
 
       // create reverse map of buffer offset -> object for the eventual result.
@@ -1142,8 +1170,15 @@ int ObjectCacher::_readx(OSDRead *rd, ObjectSet *oset, Context *onfinish,
        bhit++) 
     touch_bh(*bhit);
   
+  if (perfcounter) {
+    if (readahead_bytes)
+      perfcounter->inc(l_objectcacher_readahead_bytes, readahead_bytes);
+    if (readahead_hit_bytes)
+      perfcounter->inc(l_objectcacher_readahead_hit_bytes, readahead_hit_bytes);
+  }
+
   if (!success) {
-    if (perfcounter && external_call) {
+    if (perfcounter && external_call && !readahead) {
       perfcounter->inc(l_objectcacher_data_read, total_bytes_read);
       perfcounter->inc(l_objectcacher_cache_bytes_miss, bytes_not_in_cache);
       perfcounter->inc(l_objectcacher_cache_ops_miss);
@@ -1156,7 +1191,7 @@ int ObjectCacher::_readx(OSDRead *rd, ObjectSet *oset, Context *onfinish,
     }
     return 0;  // wait!
   }
-  if (perfcounter && external_call) {
+  if (perfcounter && external_call && !readahead) {
     perfcounter->inc(l_objectcacher_data_read, total_bytes_read);
     perfcounter->inc(l_objectcacher_cache_bytes_hit, bytes_in_cache);
     perfcounter->inc(l_objectcacher_cache_ops_hit);
@@ -1214,6 +1249,7 @@ int ObjectCacher::writex(OSDWrite *wr, ObjectSet *oset, Mutex& wait_on_lock)
     // map it all into a single bufferhead.
     BufferHead *bh = o->map_write(wr);
     bh->snapc = wr->snapc;
+    bh->readahead = false;
     
     bytes_written += bh->length();
     if (bh->is_tx()) {
@@ -1251,6 +1287,7 @@ int ObjectCacher::writex(OSDWrite *wr, ObjectSet *oset, Mutex& wait_on_lock)
     // ok, now bh is dirty.
     mark_dirty(bh);
     touch_bh(bh);
+    touch_ob(o);
     bh->last_write = now;
 
     o->try_merge_bh(bh);
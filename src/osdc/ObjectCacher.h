@@ -36,6 +36,10 @@ enum {
   l_objectcacher_write_bytes_blocked, // total number of write bytes we delayed due to dirty limits
   l_objectcacher_write_time_blocked, // total time in seconds spent blocking a write due to dirty limits
 
+  l_objectcacher_readahead_bytes, // bytes we fetched speculatively
+  l_objectcacher_readahead_hit_bytes, // readahead bytes later read by someone
+  l_objectcacher_readahead_waste_bytes, // readahead bytes trimmed before anyone read them
+
   l_objectcacher_last,
 };
 
@@ -105,6 +109,7 @@ class ObjectCacher {
     utime_t last_write;
     SnapContext snapc;
     int error; // holds return value for failed reads
+    bool readahead; // fetched by readahead, not read by anyone yet
     
     map< loff_t, list<Context*> > waitfor_read;
     
@@ -114,7 +119,8 @@ class ObjectCacher {
       ref(0),
       ob(o),
       last_write_tid(0),
-      error(0) {
+      error(0),
+      readahead(false) {
       ex.start = ex.length = 0;
     }
   
@@ -384,12 +390,12 @@ class ObjectCacher {
   loff_t get_stat_clean() { return stat_clean; }
   loff_t get_stat_zero() { return stat_zero; }
 
+  // callers touch the object once per extent, not once per bh
   void touch_bh(BufferHead *bh) {
     if (bh->is_dirty())
       bh_lru_dirty.lru_touch(bh);
     else
       bh_lru_rest.lru_touch(bh);
-    touch_ob(bh->ob);
   }
   void touch_ob(Object *ob) {
     ob_lru.lru_touch(ob);
@@ -619,6 +625,7 @@ inline ostream& operator<<(ostream& out, ObjectCacher::BufferHead &bh)
   if (bh.is_missing()) out << " missing";
   if (bh.bl.length() > 0) out << " firstbyte=" << (int)bh.bl[0];
   if (bh.error) out << " error=" << bh.error;
+  if (bh.readahead) out << " readahead";
   out << "]";
   out << " waiters = {";
   for (map<loff_t, list<Context*> >::const_iterator it = bh.waitfor_read.begin();
@@ -237,6 +237,13 @@ void Objecter::shutdown_locked()
     timer.cancel_event(tick_event);
     tick_event = NULL;
   }
+
+  ops_without_pg.clear();
+  while (!ops_by_pg.empty()) {
+    ops_by_pg.begin()->second->ops.clear();
+    delete ops_by_pg.begin()->second;
+    ops_by_pg.erase(ops_by_pg.begin());
+  }
 }
 
 void Objecter::shutdown_unlocked()
@@ -394,7 +401,25 @@ void Objecter::dispatch(Message *m)
   }
 }
 
-void Objecter::scan_requests(bool skipped_map,
+/*
+ * Only crush, osd state and weight, pg_temp, and pool changes can
+ * move a pg.  Anything else (up_thru, blacklist, ...) leaves every
+ * in-flight op where it is.
+ */
+static bool incremental_may_remap(const OSDMap::Incremental& inc)
+{
+  return inc.fullmap.length() ||
+    inc.crush.length() ||
+    inc.new_max_osd >= 0 ||
+    !inc.new_pools.empty() ||
+    !inc.old_pools.empty() ||
+    !inc.new_up_client.empty() ||
+    !inc.new_state.empty() ||
+    !inc.new_weight.empty() ||
+    !inc.new_pg_temp.empty();
+}
+
+void Objecter::scan_requests(bool skipped_map, bool may_remap,
 			     map<tid_t, Op*>& need_resend,
 			     list<LingerOp*>& need_resend_linger)
 {
@@ -421,11 +446,41 @@ void Objecter::scan_requests(bool skipped_map,
     }
   }
 
-  // check for changed request mappings
-  map<tid_t,Op*>::iterator p = ops.begin();
-  while (p != ops.end()) {
-    Op *op = p->second;
-    ++p;   // check_op_pool_dne() may touch ops; prevent iterator invalidation
+  // ops we could not map are always rechecked
+  vector<Op*> to_check;
+  for (xlist<Op*>::iterator p = ops_without_pg.begin(); !p.end(); ++p)
+    to_check.push_back(*p);
+
+  // check for changed pg mappings.  only ops on a pg that moved (or
+  // whose pool split or went away) need to be retargeted.
+  unsigned pgs_changed = 0;
+  if (skipped_map || may_remap) {
+    for (map<pg_t,PGOps*>::iterator p = ops_by_pg.begin();
+	 p != ops_by_pg.end();
+	 ++p) {
+      PGOps *pg = p->second;
+      const pg_pool_t *pi = osdmap->get_pg_pool(p->first.pool());
+      if (pi) {
+	vector<int> acting;
+	osdmap->pg_to_acting_osds(p->first, acting);
+	if (!skipped_map && pi->get_pg_num() == pg->pg_num && acting == pg->acting)
+	  continue;
+	pg->pg_num = pi->get_pg_num();
+	pg->acting.swap(acting);
+      }
+      ++pgs_changed;
+      for (xlist<Op*>::iterator q = pg->ops.begin(); !q.end(); ++q)
+	to_check.push_back(*q);
+    }
+  }
+  ldout(cct, 10) << "scan_requests " << pgs_changed << "/" << ops_by_pg.size()
+		 << " pgs changed, checking " << to_check.size() << "/" << ops.size()
+		 << " ops" << dendl;
+
+  // recalc_op_target() may move ops between pgs, and check_op_pool_dne()
+  // may finish them, so only touch the index once we are done walking it.
+  for (vector<Op*>::iterator p = to_check.begin(); p != to_check.end(); ++p) {
+    Op *op = *p;
     ldout(cct, 10) << " checking op " << op->tid << dendl;
     int r = recalc_op_target(op);
     switch (r) {
@@ -481,17 +536,22 @@ void Objecter::handle_osd_map(MOSDMap *m)
       for (epoch_t e = osdmap->get_epoch() + 1;
 	   e <= m->get_last();
 	   e++) {
- 
+	bool may_remap = true;
 	if (osdmap->get_epoch() == e-1 &&
 	    m->incremental_maps.count(e)) {
 	  ldout(cct, 3) << "handle_osd_map decoding incremental epoch " << e << dendl;
 	  OSDMap::Incremental inc(m->incremental_maps[e]);
+	  rwlock.get_write();
 	  osdmap->apply_incremental(inc);
+	  rwlock.put_write();
+	  may_remap = incremental_may_remap(inc);
 	  logger->inc(l_osdc_map_inc);
 	}
 	else if (m->maps.count(e)) {
 	  ldout(cct, 3) << "handle_osd_map decoding full epoch " << e << dendl;
+	  rwlock.get_write();
 	  osdmap->decode(m->maps[e]);
+	  rwlock.put_write();
 	  logger->inc(l_osdc_map_full);
 	}
 	else {
@@ -508,7 +568,7 @@ void Objecter::handle_osd_map(MOSDMap *m)
 	}
 	logger->set(l_osdc_map_epoch, osdmap->get_epoch());
 	
-	scan_requests(skipped_map, need_resend, need_resend_linger);
+	scan_requests(skipped_map, may_remap, need_resend, need_resend_linger);
 
 	// osd addr changes?
 	for (map<int,OSDSession*>::iterator p = osd_sessions.begin();
@@ -530,9 +590,11 @@ void Objecter::handle_osd_map(MOSDMap *m)
       // first map.  we want the full thing.
       if (m->maps.count(m->get_last())) {
 	ldout(cct, 3) << "handle_osd_map decoding full epoch " << m->get_last() << dendl;
+	rwlock.get_write();
 	osdmap->decode(m->maps[m->get_last()]);
+	rwlock.put_write();
 
-	scan_requests(false, need_resend, need_resend_linger);
+	scan_requests(false, true, need_resend, need_resend_linger);
       } else {
 	ldout(cct, 3) << "handle_osd_map hmm, i want a full map, requesting" << dendl;
 	monc->sub_want("osdmap", 0, CEPH_SUBSCRIBE_ONETIME);
@@ -652,7 +714,8 @@ void Objecter::check_op_pool_dne(Op *op)
       if (op->oncommit) {
 	op->oncommit->complete(-ENOENT);
       }
-      op->session_item.remove_myself();
+      _session_op_assign(op, NULL);
+      _unindex_op_pg(op);
       ops.erase(op->tid);
       delete op;
     }
@@ -765,6 +828,7 @@ void Objecter::reopen_session(OSDSession *s)
 {
   entity_inst_t inst = osdmap->get_inst(s->osd);
   ldout(cct, 10) << "reopen_session osd." << s->osd << " session, addr now " << inst << dendl;
+  Mutex::Locker l(s->lock);
   if (s->con) {
     messenger->mark_down(s->con);
     s->con->put();
@@ -778,6 +842,7 @@ void Objecter::reopen_session(OSDSession *s)
 void Objecter::close_session(OSDSession *s)
 {
   ldout(cct, 10) << "close_session for osd." << s->osd << dendl;
+  s->lock.Lock();  // wait for any unlocked sender to finish with it
   if (s->con) {
     messenger->mark_down(s->con);
     s->con->put();
@@ -786,6 +851,7 @@ void Objecter::close_session(OSDSession *s)
   s->ops.clear();
   s->linger_ops.clear();
   osd_sessions.erase(s->osd);
+  s->lock.Unlock();
   delete s;
 
   logger->set(l_osdc_osd_sessions, osd_sessions.size());
@@ -978,7 +1044,65 @@ tid_t Objecter::op_submit(Op *op)
   return _op_submit(op);
 }
 
-tid_t Objecter::_op_submit(Op *op)
+tid_t Objecter::op_submit_unlocked(Op *op)
+{
+  assert(!client_lock.is_locked_by_me());
+  assert(initialized);
+
+  assert(op->ops.size() == op->out_bl.size());
+  assert(op->ops.size() == op->out_rval.size());
+  assert(op->ops.size() == op->out_handler.size());
+
+  // the throttles have their own locks; block on them before we take
+  // anything else.
+  int op_budget = calc_op_budget(op);
+  if (keep_balanced_budget) {
+    op_throttle_bytes.get(op_budget);
+    op_throttle_ops.get(1);
+  } else {
+    op_throttle_bytes.take(op_budget);
+    op_throttle_ops.take(1);
+  }
+  op->budgeted = true;
+
+  // placement is the expensive part; do it against a stable map
+  // without serializing on client_lock.  if the map moves before we
+  // get client_lock, recalc_op_target() will notice and redo it.
+  rwlock.get_read();
+  _calc_target(op);
+  rwlock.put_read();
+
+  MOSDOp *m = NULL;
+  client_lock.Lock();
+  tid_t tid = _op_submit(op, &m);
+  if (!m) {
+    client_lock.Unlock();
+    return tid;
+  }
+
+  // hand the message to the messenger outside client_lock.  the
+  // session lock keeps anything sent after us on this session from
+  // going out first, and keeps the session itself alive.  the op can
+  // not be retargeted, resent or finished without it either, but make
+  // sure what we prepared is still the op's latest attempt on this
+  // session before it goes out.
+  OSDSession *s = op->session;
+  int attempt = op->attempts;
+  Connection *con = s->con->get();
+  s->lock.Lock();
+  client_lock.Unlock();
+  if (op->session == s && op->attempts == attempt) {
+    messenger->send_message(m, con);
+  } else {
+    ldout(cct, 10) << "op_submit_unlocked tid " << tid << " was retargeted, dropping stale message" << dendl;
+    m->put();
+  }
+  s->lock.Unlock();
+  con->put();
+  return tid;
+}
+
+tid_t Objecter::_op_submit(Op *op, MOSDOp **pm)
 {
   // pick tid
   tid_t mytid = ++last_tid;
@@ -1074,7 +1198,10 @@ tid_t Objecter::_op_submit(Op *op)
     op->paused = true;
     maybe_request_map();
   } else if (op->session) {
-    send_op(op);
+    if (pm)
+      *pm = _prepare_osd_op(op);
+    else
+      send_op(op);
   } else {
     maybe_request_map();
   }
@@ -1101,20 +1228,48 @@ bool Objecter::is_pg_changed(vector<int>& o, vector<int>& n, bool any_change)
   return false;      // same primary (tho replicas may have changed)
 }
 
-int Objecter::recalc_op_target(Op *op)
+void Objecter::_calc_target(Op *op)
 {
-  vector<int> acting;
+  op->target_epoch = 0;
   pg_t pgid = op->pgid;
   if (op->precalc_pgid) {
-    ldout(cct, 10) << "recalc_op_target have " << pgid << " pool " << osdmap->have_pg_pool(pgid.pool()) << dendl;
     if (!osdmap->have_pg_pool(pgid.pool()))
-      return RECALC_OP_TARGET_POOL_DNE;
+      return;
   } else {
-    int ret = osdmap->object_locator_to_pg(op->oid, op->oloc, pgid);
-    if (ret == -ENOENT)
-      return RECALC_OP_TARGET_POOL_DNE;
+    if (osdmap->object_locator_to_pg(op->oid, op->oloc, pgid) < 0)
+      return;
+  }
+  op->target_pgid = pgid;
+  osdmap->pg_to_acting_osds(pgid, op->target_acting);
+  op->target_epoch = osdmap->get_epoch();
+}
+
+int Objecter::recalc_op_target(Op *op)
+{
+  vector<int> acting;
+  pg_t pgid = op->pgid;
+  bool have_target = op->target_epoch && op->target_epoch == osdmap->get_epoch();
+  op->target_epoch = 0;
+  if (have_target) {
+    // computed by op_submit_unlocked() against this very map
+    pgid = op->target_pgid;
+    acting.swap(op->target_acting);
+  } else {
+    if (op->precalc_pgid) {
+      ldout(cct, 10) << "recalc_op_target have " << pgid << " pool " << osdmap->have_pg_pool(pgid.pool()) << dendl;
+      if (!osdmap->have_pg_pool(pgid.pool())) {
+	_index_op_pg(op, false);
+	return RECALC_OP_TARGET_POOL_DNE;
+      }
+    } else {
+      int ret = osdmap->object_locator_to_pg(op->oid, op->oloc, pgid);
+      if (ret == -ENOENT) {
+	_index_op_pg(op, false);
+	return RECALC_OP_TARGET_POOL_DNE;
+      }
+    }
+    osdmap->pg_to_acting_osds(pgid, acting);
   }
-  osdmap->pg_to_acting_osds(pgid, acting);
 
   if (op->pgid != pgid || is_pg_changed(op->acting, acting, op->used_replica)) {
     op->pgid = pgid;
@@ -1156,18 +1311,62 @@ int Objecter::recalc_op_target(Op *op)
     if (op->session != s) {
       if (!op->session)
 	num_homeless_ops--;
-      op->session_item.remove_myself();
-      op->session = s;
-      if (s)
-	s->ops.push_back(&op->session_item);
-      else
+      _session_op_assign(op, s);
+      if (!s)
 	num_homeless_ops++;
     }
+    _index_op_pg(op, true);
     return RECALC_OP_TARGET_NEED_RESEND;
   }
+  _index_op_pg(op, true);
   return RECALC_OP_TARGET_NO_ACTION;
 }
 
+void Objecter::_index_op_pg(Op *op, bool mapped)
+{
+  if (!mapped) {
+    if (op->pg_item.get_list() != &ops_without_pg) {
+      _unindex_op_pg(op);
+      ops_without_pg.push_back(&op->pg_item);
+    }
+    return;
+  }
+
+  pg_t pgid = osdmap->raw_pg_to_pg(op->pgid);
+  if (op->pg_item.is_on_list() &&
+      op->pg_item.get_list() != &ops_without_pg &&
+      op->indexed_pgid == pgid)
+    return;
+  _unindex_op_pg(op);
+
+  PGOps *pg;
+  map<pg_t,PGOps*>::iterator p = ops_by_pg.find(pgid);
+  if (p == ops_by_pg.end()) {
+    pg = new PGOps;
+    pg->pg_num = osdmap->get_pg_pool(pgid.pool())->get_pg_num();
+    osdmap->pg_to_acting_osds(pgid, pg->acting);
+    ops_by_pg[pgid] = pg;
+  } else {
+    pg = p->second;
+  }
+  op->indexed_pgid = pgid;
+  pg->ops.push_back(&op->pg_item);
+}
+
+void Objecter::_unindex_op_pg(Op *op)
+{
+  xlist<Op*> *ls = op->pg_item.get_list();
+  if (!ls)
+    return;
+  op->pg_item.remove_myself();
+  if (ls != &ops_without_pg && ls->empty()) {
+    map<pg_t,PGOps*>::iterator p = ops_by_pg.find(op->indexed_pgid);
+    assert(p != ops_by_pg.end());
+    delete p->second;
+    ops_by_pg.erase(p);
+  }
+}
+
 bool Objecter::recalc_linger_op_target(LingerOp *linger_op)
 {
   vector<int> acting;
@@ -1213,7 +1412,8 @@ void Objecter::finish_op(Op *op)
 {
   ldout(cct, 15) << "finish_op " << op->tid << dendl;
 
-  op->session_item.remove_myself();
+  _session_op_assign(op, NULL);
+  _unindex_op_pg(op);
   if (op->budgeted)
     put_op_budget(op);
   if (op->con)
@@ -1225,7 +1425,28 @@ void Objecter::finish_op(Op *op)
   delete op;
 }
 
+void Objecter::_session_op_assign(Op *op, OSDSession *to)
+{
+  OSDSession *from = op->session;
+  if (from) {
+    Mutex::Locker l(from->lock);
+    op->session_item.remove_myself();
+    op->session = to;
+  } else {
+    op->session = to;
+  }
+  if (to)
+    to->ops.push_back(&op->session_item);
+}
+
 void Objecter::send_op(Op *op)
+{
+  Mutex::Locker l(op->session->lock);
+  MOSDOp *m = _prepare_osd_op(op);
+  messenger->send_message(m, op->session->con);
+}
+
+MOSDOp *Objecter::_prepare_osd_op(Op *op)
 {
   ldout(cct, 15) << "send_op " << op->tid << " to osd." << op->session->osd << dendl;
 
@@ -1276,7 +1497,7 @@ void Objecter::send_op(Op *op)
   logger->inc(l_osdc_op_send);
   logger->inc(l_osdc_op_send_bytes, m->get_data().length());
 
-  messenger->send_message(m, op->session->con);
+  return m;
 }
 
 int Objecter::calc_op_budget(Op *op)
@@ -18,11 +18,13 @@
 #include "include/types.h"
 #include "include/buffer.h"
 #include "include/xlist.h"
+#include "include/rados/rados_types.hpp"
 
 #include "osd/OSDMap.h"
 #include "messages/MOSDOp.h"
 
 #include "common/admin_socket.h"
+#include "common/RWLock.h"
 #include "common/Timer.h"
 
 #include <list>
@@ -251,6 +253,10 @@ struct ObjectOperation {
     bufferlist bl;
     add_data(CEPH_OSD_OP_DELETE, 0, 0, bl);
   }
+  void rollback(uint64_t snapid) {
+    OSDOp& osd_op = add_op(CEPH_OSD_OP_ROLLBACK);
+    osd_op.op.snap.snapid = snapid;
+  }
   void mapext(uint64_t off, uint64_t len) {
     bufferlist bl;
     add_data(CEPH_OSD_OP_MAPEXT, off, len, bl);
@@ -445,6 +451,49 @@ struct ObjectOperation {
     }
   }
 
+  struct C_ObjectOperation_decodesnaps : public Context {
+    bufferlist bl;
+    librados::snap_set_t *psnaps;
+    int *prval;
+    C_ObjectOperation_decodesnaps(librados::snap_set_t *ps, int *pr)
+      : psnaps(ps), prval(pr) {}
+    void finish(int r) {
+      if (r >= 0) {
+	bufferlist::iterator p = bl.begin();
+	try {
+	  obj_list_snap_response_t resp;
+	  ::decode(resp, p);
+	  if (psnaps) {
+	    psnaps->clones.clear();
+	    for (vector<clone_info>::iterator ci = resp.clones.begin();
+		 ci != resp.clones.end(); ++ci) {
+	      librados::clone_info_t clone;
+	      clone.cloneid = ci->cloneid;
+	      clone.snaps.assign(ci->snaps.begin(), ci->snaps.end());
+	      clone.overlap = ci->overlap;
+	      clone.size = ci->size;
+	      psnaps->clones.push_back(clone);
+	    }
+	    psnaps->seq = resp.seq;
+	  }
+	}
+	catch (buffer::error& e) {
+	  if (prval)
+	    *prval = -EIO;
+	}
+      }
+    }
+  };
+  void list_snaps(librados::snap_set_t *out, int *prval) {
+    add_op(CEPH_OSD_OP_LIST_SNAPS);
+    unsigned p = ops.size() - 1;
+    C_ObjectOperation_decodesnaps *h =
+      new C_ObjectOperation_decodesnaps(out, prval);
+    out_handler[p] = h;
+    out_bl[p] = &h->bl;
+    out_rval[p] = prval;
+  }
+
   void omap_get_header(bufferlist *bl, int *prval) {
     add_op(CEPH_OSD_OP_OMAPGETHEADER);
     unsigned p = ops.size() - 1;
@@ -552,6 +601,15 @@ class Objecter {
   Mutex &client_lock;
   SafeTimer &timer;
 
+  /**
+   * Protects *osdmap against the submitters that compute an op's
+   * target without holding client_lock (see op_submit_unlocked()).
+   * It is taken for write, with client_lock held, only while a new
+   * map is decoded or applied; anyone holding client_lock may read
+   * the map without it.
+   */
+  RWLock rwlock;
+
   PerfCounters *logger;
   
   class C_Tick : public Context {
@@ -592,6 +650,9 @@ public:
     vector<int> acting;
     bool used_replica;
 
+    xlist<Op*>::item pg_item;  ///< on ops_by_pg or ops_without_pg
+    pg_t indexed_pgid;         ///< key into ops_by_pg
+
     Connection *con;  // for rx buffer only
 
     vector<OSDOp> ops;
@@ -622,6 +683,11 @@ public:
     bool precalc_pgid;
     epoch_t map_dne_bound;
 
+    /// target computed outside client_lock; valid only for target_epoch
+    epoch_t target_epoch;
+    pg_t target_pgid;
+    vector<int> target_acting;
+
     bool budgeted;
 
     /// true if we should resend this message on failure
@@ -631,13 +697,14 @@ public:
        int f, Context *ac, Context *co, eversion_t *ov) :
       session(NULL), session_item(this), incarnation(0),
       oid(o), oloc(ol),
-      used_replica(false), con(NULL),
+      used_replica(false), pg_item(this), con(NULL),
       snapid(CEPH_NOSNAP),
       outbl(NULL),
       flags(f), priority(0), onack(ac), oncommit(co),
       tid(0), attempts(0),
       paused(false), objver(ov), reply_epoch(NULL), precalc_pgid(false),
       map_dne_bound(0),
+      target_epoch(0),
       budgeted(false),
       should_resend(true) {
       ops.swap(op);
@@ -869,13 +936,24 @@ public:
 
   // -- osd sessions --
   struct OSDSession {
+    /**
+     * Serializes sends on this session.  A submitter may drop
+     * client_lock before its message is handed to the messenger, so it
+     * takes this lock first to keep later sends to the same osd (and
+     * close/reopen of the connection) from overtaking it.  An op on
+     * this session is only moved off it, resent or finished with this
+     * lock held as well.  Lock order is client_lock, then session lock.
+     */
+    Mutex lock;
     xlist<Op*> ops;
     xlist<LingerOp*> linger_ops;
     int osd;
     int incarnation;
     Connection *con;
 
-    OSDSession(int o) : osd(o), incarnation(0), con(NULL) {}
+    OSDSession(int o) :
+      lock("Objecter::OSDSession::lock"),
+      osd(o), incarnation(0), con(NULL) {}
   };
   map<int,OSDSession*> osd_sessions;
 
@@ -896,7 +974,25 @@ public:
 
   map<epoch_t,list< pair<Context*, int> > > waiting_for_map;
 
+  /**
+   * In-flight ops indexed by the pg they map to, so that a new map
+   * only retargets ops on pgs whose mapping actually changed.
+   */
+  struct PGOps {
+    unsigned pg_num;     ///< pool pg_num the pg was folded with
+    vector<int> acting;  ///< acting set as of the last map we scanned
+    xlist<Op*> ops;
+    PGOps() : pg_num(0) {}
+  };
+  map<pg_t, PGOps*> ops_by_pg;
+  xlist<Op*> ops_without_pg;  ///< ops whose pool we have not seen (yet)
+
+  void _index_op_pg(Op *op, bool mapped);
+  void _unindex_op_pg(Op *op);
+
+  MOSDOp *_prepare_osd_op(Op *op);
   void send_op(Op *op);
+  void _session_op_assign(Op *op, OSDSession *to);
   void cancel_op(Op *op);
   void finish_op(Op *op);
   bool is_pg_changed(vector<int>& a, vector<int>& b, bool any_change=false);
@@ -906,6 +1002,7 @@ public:
     RECALC_OP_TARGET_POOL_DNE,
   };
   int recalc_op_target(Op *op);
+  void _calc_target(Op *op);
   bool recalc_linger_op_target(LingerOp *op);
 
   void send_linger(LingerOp *info);
@@ -968,6 +1065,7 @@ public:
     last_seen_osdmap_version(0),
     last_seen_pgmap_version(0),
     client_lock(l), timer(t),
+    rwlock("Objecter::rwlock"),
     logger(NULL), tick_event(NULL),
     m_request_state_hook(NULL),
     num_homeless_ops(0),
@@ -998,7 +1096,7 @@ public:
   void set_honor_osdmap_full() { honor_osdmap_full = true; }
   void unset_honor_osdmap_full() { honor_osdmap_full = false; }
 
-  void scan_requests(bool skipped_map,
+  void scan_requests(bool skipped_map, bool may_remap,
 		     map<tid_t, Op*>& need_resend,
 		     list<LingerOp*>& need_resend_linger);
 
@@ -1011,8 +1109,21 @@ public:
 
 private:
   // low-level
+  tid_t _op_submit(Op *op, MOSDOp **pm = NULL);
+
+ public:
   tid_t op_submit(Op *op);
-  tid_t _op_submit(Op *op);
+
+  /**
+   * Submit an op without holding client_lock.
+   *
+   * The op's placement is computed under a read lock on the osdmap
+   * and the message is handed to the messenger after client_lock is
+   * dropped, so that threads submitting to different osds only
+   * serialize on the (short) bookkeeping in between.  The op must
+   * come from one of the prepare_*_op() helpers.
+   */
+  tid_t op_submit_unlocked(Op *op);
 
   // public interface
  public:
@@ -1044,20 +1155,27 @@ private:
   void clear_global_op_flag(int flags) { global_op_flags &= ~flags; }
 
   // mid-level helpers
-  tid_t mutate(const object_t& oid, const object_locator_t& oloc, 
-	       ObjectOperation& op,
-	       const SnapContext& snapc, utime_t mtime, int flags,
-	       Context *onack, Context *oncommit, eversion_t *objver = NULL) {
+  Op *prepare_mutate_op(const object_t& oid, const object_locator_t& oloc,
+			ObjectOperation& op,
+			const SnapContext& snapc, utime_t mtime, int flags,
+			Context *onack, Context *oncommit, eversion_t *objver = NULL) {
     Op *o = new Op(oid, oloc, op.ops, flags | global_op_flags | CEPH_OSD_FLAG_WRITE, onack, oncommit, objver);
     o->priority = op.priority;
     o->mtime = mtime;
     o->snapc = snapc;
-    return op_submit(o);
+    return o;
   }
-  tid_t read(const object_t& oid, const object_locator_t& oloc,
-	     ObjectOperation& op,
-	     snapid_t snapid, bufferlist *pbl, int flags,
-	     Context *onack, eversion_t *objver = NULL) {
+  tid_t mutate(const object_t& oid, const object_locator_t& oloc, 
+	       ObjectOperation& op,
+	       const SnapContext& snapc, utime_t mtime, int flags,
+	       Context *onack, Context *oncommit, eversion_t *objver = NULL) {
+    return op_submit(prepare_mutate_op(oid, oloc, op, snapc, mtime, flags,
+				       onack, oncommit, objver));
+  }
+  Op *prepare_read_op(const object_t& oid, const object_locator_t& oloc,
+		      ObjectOperation& op,
+		      snapid_t snapid, bufferlist *pbl, int flags,
+		      Context *onack, eversion_t *objver = NULL) {
     Op *o = new Op(oid, oloc, op.ops, flags | global_op_flags | CEPH_OSD_FLAG_READ, onack, NULL, objver);
     o->priority = op.priority;
     o->snapid = snapid;
@@ -1065,7 +1183,14 @@ private:
     o->out_bl.swap(op.out_bl);
     o->out_handler.swap(op.out_handler);
     o->out_rval.swap(op.out_rval);
-    return op_submit(o);
+    return o;
+  }
+  tid_t read(const object_t& oid, const object_locator_t& oloc,
+	     ObjectOperation& op,
+	     snapid_t snapid, bufferlist *pbl, int flags,
+	     Context *onack, eversion_t *objver = NULL) {
+    return op_submit(prepare_read_op(oid, oloc, op, snapid, pbl, flags,
+				     onack, objver));
   }
   tid_t linger(const object_t& oid, const object_locator_t& oloc, 
 	       ObjectOperation& op,
@@ -1116,10 +1241,10 @@ private:
     return op_submit(o);
   }
 
-  tid_t read(const object_t& oid, const object_locator_t& oloc, 
-	     uint64_t off, uint64_t len, snapid_t snap, bufferlist *pbl, int flags,
-	     Context *onfinish,
-	     eversion_t *objver = NULL, ObjectOperation *extra_ops = NULL) {
+  Op *prepare_read_op(const object_t& oid, const object_locator_t& oloc,
+		      uint64_t off, uint64_t len, snapid_t snap, bufferlist *pbl, int flags,
+		      Context *onfinish,
+		      eversion_t *objver = NULL, ObjectOperation *extra_ops = NULL) {
     vector<OSDOp> ops;
     int i = init_ops(ops, 1, extra_ops);
     ops[i].op.op = CEPH_OSD_OP_READ;
@@ -1130,7 +1255,14 @@ private:
     Op *o = new Op(oid, oloc, ops, flags | global_op_flags | CEPH_OSD_FLAG_READ, onfinish, 0, objver);
     o->snapid = snap;
     o->outbl = pbl;
-    return op_submit(o);
+    return o;
+  }
+  tid_t read(const object_t& oid, const object_locator_t& oloc, 
+	     uint64_t off, uint64_t len, snapid_t snap, bufferlist *pbl, int flags,
+	     Context *onfinish,
+	     eversion_t *objver = NULL, ObjectOperation *extra_ops = NULL) {
+    return op_submit(prepare_read_op(oid, oloc, off, len, snap, pbl, flags,
+				     onfinish, objver, extra_ops));
   }
 
   tid_t read_trunc(const object_t& oid, const object_locator_t& oloc, 
@@ -1232,11 +1364,11 @@ private:
     o->snapc = snapc;
     return op_submit(o);
   }
-  tid_t write(const object_t& oid, const object_locator_t& oloc,
-	      uint64_t off, uint64_t len, const SnapContext& snapc, const bufferlist &bl,
-	      utime_t mtime, int flags,
-	      Context *onack, Context *oncommit,
-	      eversion_t *objver = NULL, ObjectOperation *extra_ops = NULL) {
+  Op *prepare_write_op(const object_t& oid, const object_locator_t& oloc,
+		       uint64_t off, uint64_t len, const SnapContext& snapc, const bufferlist &bl,
+		       utime_t mtime, int flags,
+		       Context *onack, Context *oncommit,
+		       eversion_t *objver = NULL, ObjectOperation *extra_ops = NULL) {
     vector<OSDOp> ops;
     int i = init_ops(ops, 1, extra_ops);
     ops[i].op.op = CEPH_OSD_OP_WRITE;
@@ -1248,13 +1380,21 @@ private:
     Op *o = new Op(oid, oloc, ops, flags | global_op_flags | CEPH_OSD_FLAG_WRITE, onack, oncommit, objver);
     o->mtime = mtime;
     o->snapc = snapc;
-    return op_submit(o);
+    return o;
   }
-  tid_t append(const object_t& oid, const object_locator_t& oloc,
-	       uint64_t len, const SnapContext& snapc, const bufferlist &bl,
-	       utime_t mtime, int flags,
-	       Context *onack, Context *oncommit,
-	       eversion_t *objver = NULL, ObjectOperation *extra_ops = NULL) {
+  tid_t write(const object_t& oid, const object_locator_t& oloc,
+	      uint64_t off, uint64_t len, const SnapContext& snapc, const bufferlist &bl,
+	      utime_t mtime, int flags,
+	      Context *onack, Context *oncommit,
+	      eversion_t *objver = NULL, ObjectOperation *extra_ops = NULL) {
+    return op_submit(prepare_write_op(oid, oloc, off, len, snapc, bl, mtime, flags,
+				      onack, oncommit, objver, extra_ops));
+  }
+  Op *prepare_append_op(const object_t& oid, const object_locator_t& oloc,
+			uint64_t len, const SnapContext& snapc, const bufferlist &bl,
+			utime_t mtime, int flags,
+			Context *onack, Context *oncommit,
+			eversion_t *objver = NULL, ObjectOperation *extra_ops = NULL) {
     vector<OSDOp> ops;
     int i = init_ops(ops, 1, extra_ops);
     ops[i].op.op = CEPH_OSD_OP_APPEND;
@@ -1266,7 +1406,15 @@ private:
     Op *o = new Op(oid, oloc, ops, flags | global_op_flags | CEPH_OSD_FLAG_WRITE, onack, oncommit, objver);
     o->mtime = mtime;
     o->snapc = snapc;
-    return op_submit(o);
+    return o;
+  }
+  tid_t append(const object_t& oid, const object_locator_t& oloc,
+	       uint64_t len, const SnapContext& snapc, const bufferlist &bl,
+	       utime_t mtime, int flags,
+	       Context *onack, Context *oncommit,
+	       eversion_t *objver = NULL, ObjectOperation *extra_ops = NULL) {
+    return op_submit(prepare_append_op(oid, oloc, len, snapc, bl, mtime, flags,
+				       onack, oncommit, objver, extra_ops));
   }
   tid_t write_trunc(const object_t& oid, const object_locator_t& oloc,
 	      uint64_t off, uint64_t len, const SnapContext& snapc, const bufferlist &bl,
@@ -1287,10 +1435,10 @@ private:
     o->snapc = snapc;
     return op_submit(o);
   }
-  tid_t write_full(const object_t& oid, const object_locator_t& oloc,
-		   const SnapContext& snapc, const bufferlist &bl, utime_t mtime, int flags,
-		   Context *onack, Context *oncommit,
-		   eversion_t *objver = NULL, ObjectOperation *extra_ops = NULL) {
+  Op *prepare_write_full_op(const object_t& oid, const object_locator_t& oloc,
+			    const SnapContext& snapc, const bufferlist &bl, utime_t mtime, int flags,
+			    Context *onack, Context *oncommit,
+			    eversion_t *objver = NULL, ObjectOperation *extra_ops = NULL) {
     vector<OSDOp> ops;
     int i = init_ops(ops, 1, extra_ops);
     ops[i].op.op = CEPH_OSD_OP_WRITEFULL;
@@ -1300,7 +1448,14 @@ private:
     Op *o = new Op(oid, oloc, ops, flags | global_op_flags | CEPH_OSD_FLAG_WRITE, onack, oncommit, objver);
     o->mtime = mtime;
     o->snapc = snapc;
-    return op_submit(o);
+    return o;
+  }
+  tid_t write_full(const object_t& oid, const object_locator_t& oloc,
+		   const SnapContext& snapc, const bufferlist &bl, utime_t mtime, int flags,
+		   Context *onack, Context *oncommit,
+		   eversion_t *objver = NULL, ObjectOperation *extra_ops = NULL) {
+    return op_submit(prepare_write_full_op(oid, oloc, snapc, bl, mtime, flags,
+					   onack, oncommit, objver, extra_ops));
   }
   tid_t trunc(const object_t& oid, const object_locator_t& oloc,
 	      const SnapContext& snapc,
@@ -1360,17 +1515,24 @@ private:
     o->snapc = snapc;
     return op_submit(o);
   }
-  tid_t remove(const object_t& oid, const object_locator_t& oloc, 
-	       const SnapContext& snapc, utime_t mtime, int flags,
-	       Context *onack, Context *oncommit,
-	       eversion_t *objver = NULL, ObjectOperation *extra_ops = NULL) {
+  Op *prepare_remove_op(const object_t& oid, const object_locator_t& oloc, 
+			const SnapContext& snapc, utime_t mtime, int flags,
+			Context *onack, Context *oncommit,
+			eversion_t *objver = NULL, ObjectOperation *extra_ops = NULL) {
     vector<OSDOp> ops;
     int i = init_ops(ops, 1, extra_ops);
     ops[i].op.op = CEPH_OSD_OP_DELETE;
     Op *o = new Op(oid, oloc, ops, flags | global_op_flags | CEPH_OSD_FLAG_WRITE, onack, oncommit, objver);
     o->mtime = mtime;
     o->snapc = snapc;
-    return op_submit(o);
+    return o;
+  }
+  tid_t remove(const object_t& oid, const object_locator_t& oloc, 
+	       const SnapContext& snapc, utime_t mtime, int flags,
+	       Context *onack, Context *oncommit,
+	       eversion_t *objver = NULL, ObjectOperation *extra_ops = NULL) {
+    return op_submit(prepare_remove_op(oid, oloc, snapc, mtime, flags,
+				       onack, oncommit, objver, extra_ops));
   }
 
   tid_t lock(const object_t& oid, const object_locator_t& oloc, int op, int flags,
@@ -0,0 +1,116 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "Readahead.h"
+
+Readahead::Readahead()
+  : lock("Readahead::lock"),
+    trigger_requests(10),
+    min_readahead_size(0),
+    max_readahead_size(0),
+    nr_consec_read(0),
+    consec_read_bytes(0),
+    last_pos(0),
+    readahead_pos(0),
+    readahead_trigger_pos(0),
+    readahead_size(0)
+{
+}
+
+Readahead::extent_t Readahead::update(uint64_t offset, uint64_t length,
+				      uint64_t limit)
+{
+  Mutex::Locker l(lock);
+  if (offset != last_pos)
+    _reset();
+  else
+    nr_consec_read++;
+  consec_read_bytes += length;
+  last_pos = offset + length;
+
+  if (nr_consec_read < trigger_requests)
+    return extent_t(0, 0);
+  return _compute_readahead(limit);
+}
+
+Readahead::extent_t Readahead::_compute_readahead(uint64_t limit)
+{
+  // still working through the last window?
+  if (last_pos < readahead_trigger_pos)
+    return extent_t(0, 0);
+
+  uint64_t size;
+  if (readahead_size == 0)
+    size = MAX(consec_read_bytes, min_readahead_size);
+  else
+    size = readahead_size * 2;
+  size = MIN(size, max_readahead_size);
+  if (size == 0)
+    return extent_t(0, 0);
+
+  // pick up where the last window ended, unless the reader already
+  // went past it
+  uint64_t start = MAX(last_pos, readahead_pos);
+  uint64_t end = start + size;
+
+  for (std::vector<uint64_t>::const_iterator p = alignments.begin();
+       p != alignments.end();
+       ++p) {
+    if (*p == 0)
+      continue;
+    uint64_t aligned = end - (end % *p);
+    if (aligned > start) {
+      end = aligned;
+      break;
+    }
+  }
+
+  if (end > limit)
+    end = limit;
+  if (end <= start)
+    return extent_t(0, 0);
+
+  readahead_size = size;
+  readahead_pos = end;
+  readahead_trigger_pos = start + (end - start) / 2;
+  return extent_t(start, end - start);
+}
+
+void Readahead::set_trigger_requests(int trigger_requests)
+{
+  Mutex::Locker l(lock);
+  this->trigger_requests = trigger_requests;
+}
+
+void Readahead::set_min_readahead_size(uint64_t min_size)
+{
+  Mutex::Locker l(lock);
+  min_readahead_size = min_size;
+}
+
+void Readahead::set_max_readahead_size(uint64_t max_size)
+{
+  Mutex::Locker l(lock);
+  max_readahead_size = max_size;
+}
+
+void Readahead::set_alignments(const std::vector<uint64_t> &alignments)
+{
+  Mutex::Locker l(lock);
+  this->alignments = alignments;
+}
+
+void Readahead::reset()
+{
+  Mutex::Locker l(lock);
+  _reset();
+}
+
+void Readahead::_reset()
+{
+  nr_consec_read = 0;
+  consec_read_bytes = 0;
+  readahead_pos = 0;
+  readahead_trigger_pos = 0;
+  readahead_size = 0;
+}
@@ -0,0 +1,91 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OSDC_READAHEAD_H
+#define CEPH_OSDC_READAHEAD_H
+
+#include <utility>
+#include <vector>
+
+#include "include/types.h"
+#include "common/Mutex.h"
+
+/**
+ * Sequential read detection for a single stream (an open file or an
+ * image).
+ *
+ * Callers feed every read through update(), and get back an extent to
+ * prefetch, if any.  Once trigger_requests sequential reads have been
+ * seen, a readahead window is started right after the read.  Each
+ * subsequent window doubles in size, up to the maximum, and starts
+ * where the previous one ended; the next one is issued once reads get
+ * halfway into the previous one, so the prefetch stays ahead of the
+ * reader.  The end of each window is rounded down to the largest
+ * alignment (e.g., object size or stripe period) that still leaves it
+ * non-empty, so that readahead is issued in whole objects.
+ *
+ * A non-sequential read resets everything.
+ */
+class Readahead {
+public:
+  typedef std::pair<uint64_t, uint64_t> extent_t;
+
+  Readahead();
+
+  /**
+   * Record a read and decide whether to read ahead.
+   *
+   * @param offset start of the read
+   * @param length length of the read
+   * @param limit size of the underlying file or image; never read
+   *  ahead past this
+   * @return offset and length to read ahead; the length is 0 if no
+   *  readahead should be done
+   */
+  extent_t update(uint64_t offset, uint64_t length, uint64_t limit);
+
+  /// number of sequential reads needed before readahead starts
+  void set_trigger_requests(int trigger_requests);
+  /// size of the first readahead window
+  void set_min_readahead_size(uint64_t min_size);
+  /// largest readahead window; 0 disables readahead
+  void set_max_readahead_size(uint64_t max_size);
+  /// boundaries to align the end of readahead windows to, largest first
+  void set_alignments(const std::vector<uint64_t> &alignments);
+
+  /// forget about any sequential stream seen so far
+  void reset();
+
+private:
+  void _reset();
+  extent_t _compute_readahead(uint64_t limit);
+
+  Mutex lock;
+
+  // configuration
+  int trigger_requests;
+  uint64_t min_readahead_size;
+  uint64_t max_readahead_size;
+  std::vector<uint64_t> alignments;
+
+  // sequential read state
+  int nr_consec_read;
+  uint64_t consec_read_bytes;
+  uint64_t last_pos;
+
+  // readahead state
+  uint64_t readahead_pos;          ///< end of the last readahead window
+  uint64_t readahead_trigger_pos;  ///< issue the next window once reads get here
+  uint64_t readahead_size;         ///< size the last window was computed with
+};
+
+#endif
@@ -148,6 +148,8 @@ void usage(ostream& out)
 "   -t N\n"
 "   --concurrent-ios=N\n"
 "        Set number of concurrent I/O operations\n"
+"   --threads=N\n"
+"        Submit writes from N threads, splitting the concurrent ios among them\n"
 "   --show-time\n"
 "        prefix output with date/time\n"
 "\n"
@@ -1002,6 +1004,7 @@ static int rados_tool_common(const std::map < std::string, std::string > &opts,
   const char *target_pool_name = NULL;
   string oloc, target_oloc;
   int concurrent_ios = 16;
+  int num_threads = 1;
   int op_size = 1 << 22;
   bool cleanup = true;
   const char *snapname = NULL;
@@ -1053,6 +1056,10 @@ static int rados_tool_common(const std::map < std::string, std::string > &opts,
   if (i != opts.end()) {
     concurrent_ios = strtol(i->second.c_str(), NULL, 10);
   }
+  i = opts.find("threads");
+  if (i != opts.end()) {
+    num_threads = strtol(i->second.c_str(), NULL, 10);
+  }
   i = opts.find("block-size");
   if (i != opts.end()) {
     op_size = strtol(i->second.c_str(), NULL, 10);
@@ -1869,6 +1876,7 @@ static int rados_tool_common(const std::map < std::string, std::string > &opts,
       usage_exit();
     RadosBencher bencher(rados, io_ctx);
     bencher.set_show_time(show_time);
+    bencher.set_num_threads(num_threads);
     ret = bencher.aio_bench(operation, seconds, concurrent_ios, op_size, cleanup);
     if (ret != 0)
       cerr << "error during benchmark: " << ret << std::endl;
@@ -2022,6 +2030,8 @@ int main(int argc, const char **argv)
       opts["category"] = val;
     } else if (ceph_argparse_witharg(args, i, &val, "-t", "--concurrent-ios", (char*)NULL)) {
       opts["concurrent-ios"] = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--threads", (char*)NULL)) {
+      opts["threads"] = val;
     } else if (ceph_argparse_witharg(args, i, &val, "--block-size", (char*)NULL)) {
       opts["block-size"] = val;
     } else if (ceph_argparse_witharg(args, i, &val, "-b", (char*)NULL)) {
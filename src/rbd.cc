@@ -46,6 +46,9 @@
 
 #include "include/rbd_types.h"
 #include "common/TextTable.h"
+#include "common/Formatter.h"
+#include "test/bench/detailed_stat_collector.h"
+#include "test/bench/distribution.h"
 #include "include/util.h"
 
 #if defined(__linux__)
@@ -90,6 +93,12 @@ void usage()
 "                                              (dest defaults\n"
 "                                               as the filename part of file)\n"
 "                                              \"-\" for stdin\n"
+"  export-diff <image-name> [--from-snap <snap-name>] <path>\n"
+"                                              export an incremental diff to\n"
+"                                              path, or \"-\" for stdout\n"
+"  import-diff <path> <image-name>             apply an incremental diff to\n"
+"                                              image-name\n"
+"                                              \"-\" for stdin\n"
 "  (cp | copy) <src> <dest>                    copy src image to dest\n"
 "  (mv | rename) <src> <dest>                  rename src image to dest\n"
 "  snap ls <image-name>                        dump list of image snapshots\n"
@@ -110,6 +119,11 @@ void usage()
 "  lock add <image-name> <id> [--shared <tag>] take a lock called id on an image\n"
 "  lock remove <image-name> <id> <locker>      release a lock on an image\n"
 "  bench-write <image-name> --io-size <bytes> --io-threads <num> --io-total <bytes>\n"
+"  bench-read <image-name> --io-size <bytes> --io-threads <num> --io-total <bytes>\n"
+"  bench <image-name> --io-type <read | write | rw> [--io-pattern <seq | rand>]\n"
+"        [--rw-mix-read <percent>] --io-size <bytes> [--io-size-max <bytes>]\n"
+"        --io-threads <num> [--io-total <bytes>] [--duration <seconds>]\n"
+"                                              simple io benchmark\n"
 "\n"
 "<image-name>, <snap-name> are [pool/]name[@snap], or you may specify\n"
 "individual pieces of names with -p/--pool, --image, and/or --snap.\n"
@@ -121,12 +135,14 @@ void usage()
 "  --snap <snap-name>           snapshot name\n"
 "  --dest-pool <name>           destination pool name\n"
 "  --path <path-name>           path name for import/export\n"
+"  --from-snap <snap-name>      starting snapshot for export-diff\n"
 "  --size <size in MB>          size of image for create and resize\n"
 "  --order <bits>               the object size in bits; object size will be\n"
 "                               (1 << order) bytes. Default is 22 (4 MB).\n"
 "  --format <format-number>     format to use when creating an image\n"
 "                               format 1 is the original format (default)\n"
 "                               format 2 supports cloning\n"
+"  --object-map                 track which objects exist (format 2 only)\n"
 "  --id <username>              rados user (without 'client.' prefix) to authenticate as\n"
 "  --keyfile <path>             file containing secret key for use with cephx\n"
 "  --shared <tag>               take a shared (rather than exclusive) lock\n"
@@ -144,6 +160,11 @@ static string feature_str(uint64_t features)
       s += ", ";
     s += "striping";
   }
+  if (features & RBD_FEATURE_OBJECT_MAP) {
+    if (s.size())
+      s += ", ";
+    s += "object map";
+  }
   return s;
 }
 
@@ -585,31 +606,78 @@ static int do_lock_remove(librbd::Image& image, const char *client,
   return image.break_lock(client, cookie);
 }
 
+enum {
+  IO_TYPE_READ,
+  IO_TYPE_WRITE,
+  IO_TYPE_RW,
+};
+
+static const char *io_type_name(int io_type)
+{
+  switch (io_type) {
+  case IO_TYPE_READ:
+    return "read";
+  case IO_TYPE_WRITE:
+    return "write";
+  default:
+    return "rw";
+  }
+}
+
 static void rbd_bencher_completion(void *c, void *pc);
 
 struct rbd_bencher;
 
+struct rbd_bencher_op {
+  rbd_bencher *bencher;
+  bool write;
+  uint64_t len;
+  uint64_t seq;
+};
+
 struct rbd_bencher {
   librbd::Image *image;
+  StatCollector *stats;
   Mutex lock;
   Cond cond;
   int in_flight;
 
-  rbd_bencher(librbd::Image *i)
+  // completed ops
+  uint64_t ops, bytes, errors;
+
+  rbd_bencher(librbd::Image *i, StatCollector *s)
     : image(i),
+      stats(s),
       lock("rbd_bencher::lock"),
-      in_flight(0)
+      in_flight(0),
+      ops(0), bytes(0), errors(0)
   { }
 
-  bool start_write(int max, uint64_t off, uint64_t len, bufferlist& bl) {
-    Mutex::Locker l(lock);
-    if (in_flight >= max)
-      return false;
-    in_flight++;
-    librbd::RBD::AioCompletion *c = new librbd::RBD::AioCompletion((void *)this, rbd_bencher_completion);
-    image->aio_write(off, len, bl, c);
+  void start_io(bool write, uint64_t off, uint64_t len, char *buf) {
+    rbd_bencher_op *op = new rbd_bencher_op;
+    op->bencher = this;
+    op->write = write;
+    op->len = len;
+    // also reports the last interval's stats, once it is over
+    op->seq = stats->next_seq();
+    if (write)
+      stats->start_write(op->seq, len);
+    else
+      stats->start_read(op->seq, len);
+
+    {
+      Mutex::Locker l(lock);
+      in_flight++;
+    }
+    librbd::RBD::AioCompletion *c = new librbd::RBD::AioCompletion((void *)op, rbd_bencher_completion);
+    struct iovec iov;
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    if (write)
+      image->aio_writev(off, &iov, 1, c);
+    else
+      image->aio_readv(off, &iov, 1, c);
     //cout << "start " << c << " at " << off << "~" << len << std::endl;
-    return true;
   }
 
   void wait_for(int max) {
@@ -621,63 +689,158 @@ struct rbd_bencher {
     }
   }
 
+  void complete(rbd_bencher_op *op, int r) {
+    if (r >= 0) {
+      if (op->write) {
+	// librbd only says when a write is safe, so it's applied then too
+	stats->write_applied(op->seq);
+	stats->write_committed(op->seq);
+      } else {
+	stats->read_complete(op->seq);
+      }
+    }
+    Mutex::Locker l(lock);
+    in_flight--;
+    if (r < 0) {
+      errors++;
+    } else {
+      ops++;
+      bytes += op->len;
+    }
+    cond.Signal();
+  }
 };
 
 void rbd_bencher_completion(void *vc, void *pc)
 {
   librbd::RBD::AioCompletion *c = (librbd::RBD::AioCompletion *)vc;
-  rbd_bencher *b = (rbd_bencher *)pc;
+  rbd_bencher_op *op = (rbd_bencher_op *)pc;
   //cout << "complete " << c << std::endl;
-  b->lock.Lock();
-  b->in_flight--;
-  b->cond.Signal();
-  b->lock.Unlock();
+  op->bencher->complete(op, c->get_return_value());
   c->release();
+  delete op;
 }
 
-static int do_bench_write(librbd::Image& image, uint64_t io_size, uint64_t io_threads, uint64_t io_bytes)
+/*
+ * Issue ops of io_size to io_size_max bytes, io_threads at a time, until
+ * io_bytes have been issued or duration seconds have passed (0 for no
+ * limit), either walking the image from the start or at random io_size
+ * aligned offsets.  For IO_TYPE_RW, rw_mix_read percent of the ops are
+ * reads.  The stats of each second, with the latency percentiles, are
+ * dumped as they go by.
+ */
+static int do_bench(librbd::Image& image, const char *name, int io_type,
+		    bool random, uint64_t io_size, uint64_t io_size_max,
+		    uint64_t io_threads, uint64_t io_bytes, uint64_t duration,
+		    int rw_mix_read)
 {
-  rbd_bencher b(&image);
-
-  cout << "bench-write "
-       << " io_size " << io_size
-       << " io_threads " << io_threads
-       << " bytes " << io_bytes
-       << std::endl;
+  if (io_size == 0 || io_threads == 0) {
+    cerr << "rbd: io-size and io-threads must be greater than zero"
+	 << std::endl;
+    return -EINVAL;
+  }
+  if (io_size_max < io_size)
+    io_size_max = io_size;
+  if (rw_mix_read < 0 || rw_mix_read > 100) {
+    cerr << "rbd: rw-mix-read must be a percentage" << std::endl;
+    return -EINVAL;
+  }
 
-  bufferptr bp(io_size);
+  librbd::image_info_t info;
+  int r = image.stat(info, sizeof(info));
+  if (r < 0)
+    return r;
+  if (io_size_max > info.size) {
+    cerr << "rbd: io-size " << io_size_max << " is larger than the image"
+	 << std::endl;
+    return -EINVAL;
+  }
+  // a sequential read pass stops at the end of the image
+  if (io_type == IO_TYPE_READ && !random && !duration &&
+      (!io_bytes || io_bytes > info.size))
+    io_bytes = info.size;
+
+  cout << name
+       << " io_type " << io_type_name(io_type)
+       << " io_pattern " << (random ? "rand" : "seq")
+       << " io_size " << io_size;
+  if (io_size_max > io_size)
+    cout << "-" << io_size_max;
+  cout << " io_threads " << io_threads;
+  if (io_bytes)
+    cout << " bytes " << io_bytes;
+  if (duration)
+    cout << " duration " << duration;
+  if (io_type == IO_TYPE_RW)
+    cout << " rw_mix_read " << rw_mix_read;
+  cout << std::endl;
+
+  rngen_t rng(time(NULL) ^ getpid());
+  boost::scoped_ptr<Distribution<uint64_t> > size_gen;
+  if (io_size_max > io_size) {
+    // keep to whole sectors if the smallest size is
+    size_gen.reset(new Align(new UniformRandom(rng, io_size, io_size_max),
+			     io_size % 512 ? 1 : 512));
+  } else {
+    size_gen.reset(new Uniform(io_size));
+  }
+  rng.seed(rng());
+  boost::scoped_ptr<Distribution<uint64_t> > offset_gen(
+    new Align(new UniformRandom(rng, 0, info.size - io_size_max), io_size));
+  rng.seed(rng());
+  set<pair<double, bool> > ops;
+  if (io_type != IO_TYPE_WRITE)
+    ops.insert(make_pair((double)(io_type == IO_TYPE_RW ? rw_mix_read : 100),
+			 false));
+  if (io_type != IO_TYPE_READ)
+    ops.insert(make_pair((double)(io_type == IO_TYPE_RW ? 100 - rw_mix_read : 100),
+			 true));
+  WeightedDist<bool> write_gen(rng, ops);
+
+  DetailedStatCollector stats(1, new JSONFormatter(true), NULL, &cout);
+  rbd_bencher b(&image, &stats);
+
+  // reads are thrown away, so every op can share one buffer
+  bufferptr bp(io_size_max);
   bp.zero();
-  bufferlist bl;
-  bl.push_back(bp);
 
   utime_t start = ceph_clock_now(NULL);
-  utime_t last;
-  unsigned ios = 0;
-
-  printf("  SEC       OPS   OPS/SEC   BYTES/SEC\n");
-  uint64_t off;
-  for (off = 0; off < io_bytes; off += io_size) {
+  uint64_t seq_off = 0;
+  uint64_t issued = 0;
+  while (!io_bytes || issued < io_bytes) {
     b.wait_for(io_threads - 1);
-    while (b.start_write(io_threads, off, io_size, bl))
-      ios++;
+    if (duration && ceph_clock_now(NULL) - start >= (double)duration)
+      break;
 
-    utime_t now = ceph_clock_now(NULL);
-    utime_t elapsed = now - start;
-    if (elapsed.sec() != last.sec()) {
-      printf("%5d  %8d  %8.2lf  %8.2lf\n", (int)elapsed, (int)(ios - io_threads),
-	     (double)(ios - io_threads) / elapsed,
-	     (double)(off - io_threads * io_size) / elapsed);
-      last = elapsed;
+    uint64_t len = (*size_gen)();
+    if (io_bytes)
+      len = MIN(len, io_bytes - issued);
+    uint64_t off;
+    if (random) {
+      off = (*offset_gen)();
+    } else {
+      if (seq_off + len > info.size)
+	seq_off = 0;
+      off = seq_off;
     }
+    b.start_io(write_gen(), off, len, bp.c_str());
+    issued += len;
+    seq_off = off + len;
   }
   b.wait_for(0);
+  stats.dump_summary();
 
   utime_t now = ceph_clock_now(NULL);
   double elapsed = now - start;
 
-  printf("elapsed: %5d  ops: %8d  ops/sec: %8.2lf  bytes/sec: %8.2lf\n", (int)elapsed, ios,
-	     (double)ios / elapsed,
-	     (double)off / elapsed);
+  printf("elapsed: %5d  ops: %8llu  ops/sec: %8.2lf  bytes/sec: %8.2lf\n",
+	 (int)elapsed, (unsigned long long)b.ops,
+	 (double)b.ops / elapsed,
+	 (double)b.bytes / elapsed);
+  if (b.errors) {
+    cerr << "rbd: " << b.errors << " ops failed" << std::endl;
+    return -EIO;
+  }
 
   return 0;
 }
@@ -743,6 +906,26 @@ static int export_read_cb(uint64_t ofs, size_t len, const char *buf, void *arg)
   return 0;
 }
 
+/*
+ * wait for the oldest outstanding aio requests until at most max are
+ * left in flight; returns the first error seen
+ */
+static int wait_for_aio(std::list<librbd::RBD::AioCompletion *>& pending,
+			size_t max)
+{
+  int ret = 0;
+  while (pending.size() > max) {
+    librbd::RBD::AioCompletion *c = pending.front();
+    pending.pop_front();
+    c->wait_for_complete();
+    int r = c->get_return_value();
+    c->release();
+    if (r < 0 && ret == 0)
+      ret = r;
+  }
+  return ret;
+}
+
 static int do_export(librbd::Image& image, const char *path)
 {
   int64_t r;
@@ -761,7 +944,42 @@ static int do_export(librbd::Image& image, const char *path)
     return -errno;
 
   ExportContext ec(fd, info.size);
-  r = image.read_iterate(0, info.size, export_read_cb, (void *)&ec);
+
+  // keep a window of object-sized reads in flight, but hand the data
+  // to export_read_cb in order, since stdout can't seek
+  size_t max_ops = g_conf->rbd_concurrent_management_ops;
+  std::list<librbd::RBD::AioCompletion *> pending;
+  std::list<pair<uint64_t, bufferlist *> > reads;
+  uint64_t off = 0;
+  while (off < info.size || !pending.empty()) {
+    while (r == 0 && off < info.size && pending.size() < max_ops) {
+      uint64_t len = MIN(info.obj_size, info.size - off);
+      bufferlist *bl = new bufferlist;
+      librbd::RBD::AioCompletion *c =
+	new librbd::RBD::AioCompletion(NULL, NULL);
+      r = image.aio_read(off, len, *bl, c);
+      if (r < 0) {
+	c->release();
+	delete bl;
+	break;
+      }
+      pending.push_back(c);
+      reads.push_back(make_pair(off, bl));
+      off += len;
+    }
+    if (pending.empty())
+      break;
+
+    int ret = wait_for_aio(pending, pending.size() - 1);
+    uint64_t read_off = reads.front().first;
+    bufferlist *bl = reads.front().second;
+    reads.pop_front();
+    if (ret < 0 && r == 0)
+      r = ret;
+    if (r == 0)
+      r = export_read_cb(read_off, bl->length(), bl->c_str(), &ec);
+    delete bl;
+  }
   if (r < 0)
     goto out;
 
@@ -779,6 +997,330 @@ static int do_export(librbd::Image& image, const char *path)
   return r;
 }
 
+/*
+ * export-diff stream format:
+ *
+ *   "rbd diff v1\n"
+ *   'f' <le32 len> <from snap name>     (optional)
+ *   't' <le32 len> <to snap name>       (optional)
+ *   's' <le64 image size>
+ *   'w' <le64 offset> <le64 length> <data>
+ *   'z' <le64 offset> <le64 length>     (zeroed or discarded extent)
+ *   ...
+ *   'e'
+ */
+#define RBD_DIFF_BANNER "rbd diff v1\n"
+
+// the data of a 'w' record is read and written in pieces of at most
+// this much, however long the record claims to be
+#define RBD_DIFF_MAX_WRITE (4 * 1024 * 1024)
+
+struct ExportDiffContext {
+  librbd::Image *image;
+  int fd;
+  uint64_t totalsize;
+  MyProgressContext pc;
+
+  ExportDiffContext(librbd::Image *i, int f, uint64_t t) :
+    image(i), fd(f), totalsize(t), pc("Exporting image") {}
+};
+
+static int export_diff_cb(uint64_t ofs, size_t _len, int exists, void *arg)
+{
+  ExportDiffContext *edc = (ExportDiffContext *)arg;
+
+  bufferlist bl;
+  __u8 tag = exists ? 'w' : 'z';
+  uint64_t len = _len;
+  ::encode(tag, bl);
+  ::encode(ofs, bl);
+  ::encode(len, bl);
+  if (exists) {
+    bufferlist data;
+    ssize_t r = edc->image->read(ofs, len, data);
+    if (r < 0)
+      return r;
+    bl.claim_append(data);
+  }
+  int r = bl.write_fd(edc->fd);
+  if (r < 0)
+    return r;
+
+  if (edc->fd != 1)
+    edc->pc.update_progress(ofs, edc->totalsize);
+  return 0;
+}
+
+static int do_export_diff(librbd::Image& image, const char *fromsnapname,
+			  const char *endsnapname, const char *path)
+{
+  int r;
+  librbd::image_info_t info;
+  int fd;
+
+  r = image.stat(info, sizeof(info));
+  if (r < 0)
+    return r;
+
+  if (strcmp(path, "-") == 0)
+    fd = 1;
+  else
+    fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+  if (fd < 0)
+    return -errno;
+
+  {
+    // header
+    bufferlist bl;
+    bl.append(RBD_DIFF_BANNER, strlen(RBD_DIFF_BANNER));
+
+    __u8 tag;
+    if (fromsnapname) {
+      tag = 'f';
+      ::encode(tag, bl);
+      string from(fromsnapname);
+      ::encode(from, bl);
+    }
+
+    if (endsnapname) {
+      tag = 't';
+      ::encode(tag, bl);
+      string to(endsnapname);
+      ::encode(to, bl);
+    }
+
+    tag = 's';
+    ::encode(tag, bl);
+    uint64_t endsize = info.size;
+    ::encode(endsize, bl);
+
+    r = bl.write_fd(fd);
+    if (r < 0) {
+      close(fd);
+      return r;
+    }
+  }
+
+  ExportDiffContext edc(&image, fd, info.size);
+  r = image.diff_iterate(fromsnapname, 0, info.size, export_diff_cb,
+			 (void *)&edc);
+  if (r < 0)
+    goto out;
+
+  {
+    __u8 tag = 'e';
+    bufferlist bl;
+    ::encode(tag, bl);
+    r = bl.write_fd(fd);
+  }
+
+ out:
+  if (fd != 1) {
+    close(fd);
+    if (r < 0)
+      edc.pc.fail();
+    else
+      edc.pc.finish();
+  }
+  return r;
+}
+
+static int read_diff_string(int fd, string *s)
+{
+  char buf[4];
+  int r = safe_read_exact(fd, buf, 4);
+  if (r < 0)
+    return r;
+  bufferlist bl;
+  bl.append(buf, 4);
+  bufferlist::iterator p = bl.begin();
+  __u32 len;
+  ::decode(len, p);
+  if (len > 4096)
+    return -EINVAL;
+  bufferptr name = buffer::create(len);
+  r = safe_read_exact(fd, name.c_str(), len);
+  if (r < 0)
+    return r;
+  s->assign(name.c_str(), len);
+  return 0;
+}
+
+static int read_diff_extent(int fd, uint64_t *off, uint64_t *len)
+{
+  char buf[16];
+  int r = safe_read_exact(fd, buf, 16);
+  if (r < 0)
+    return r;
+  bufferlist bl;
+  bl.append(buf, 16);
+  bufferlist::iterator p = bl.begin();
+  ::decode(*off, p);
+  ::decode(*len, p);
+  return 0;
+}
+
+static int snap_exists(librbd::Image& image, const string& name)
+{
+  vector<librbd::snap_info_t> snaps;
+  int r = image.snap_list(snaps);
+  if (r < 0)
+    return r;
+  for (vector<librbd::snap_info_t>::iterator p = snaps.begin();
+       p != snaps.end(); ++p)
+    if (p->name == name)
+      return 1;
+  return 0;
+}
+
+static int do_import_diff(librbd::Image &image, const char *path)
+{
+  int fd, r;
+  struct stat stat_buf;
+  MyProgressContext pc("Importing image diff");
+  uint64_t size = 0;
+  string from, to;
+  char banner[sizeof(RBD_DIFF_BANNER)];
+
+  if (strcmp(path, "-") == 0) {
+    fd = 0;
+  } else {
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+      r = -errno;
+      cerr << "rbd: error opening " << path << std::endl;
+      return r;
+    }
+    r = ::fstat(fd, &stat_buf);
+    if (r < 0) {
+      r = -errno;
+      goto done;
+    }
+    size = (uint64_t)stat_buf.st_size;
+  }
+
+  r = safe_read_exact(fd, banner, strlen(RBD_DIFF_BANNER));
+  if (r < 0)
+    goto done;
+  banner[strlen(RBD_DIFF_BANNER)] = '\0';
+  if (strcmp(banner, RBD_DIFF_BANNER)) {
+    cerr << "rbd: invalid or unexpected diff banner" << std::endl;
+    r = -EINVAL;
+    goto done;
+  }
+
+  while (true) {
+    __u8 tag;
+    r = safe_read_exact(fd, &tag, 1);
+    if (r < 0)
+      goto done;
+
+    if (tag == 'e') {
+      break;
+    } else if (tag == 'f') {
+      r = read_diff_string(fd, &from);
+      if (r < 0)
+	goto done;
+      r = snap_exists(image, from);
+      if (r < 0)
+	goto done;
+      if (!r) {
+	cerr << "rbd: start snapshot '" << from
+	     << "' does not exist in the image, aborting" << std::endl;
+	r = -EINVAL;
+	goto done;
+      }
+    } else if (tag == 't') {
+      r = read_diff_string(fd, &to);
+      if (r < 0)
+	goto done;
+      r = snap_exists(image, to);
+      if (r < 0)
+	goto done;
+      if (r) {
+	cerr << "rbd: end snapshot '" << to
+	     << "' already exists, aborting" << std::endl;
+	r = -EEXIST;
+	goto done;
+      }
+    } else if (tag == 's') {
+      char sbuf[8];
+      r = safe_read_exact(fd, sbuf, 8);
+      if (r < 0)
+	goto done;
+      bufferlist bl;
+      bl.append(sbuf, 8);
+      bufferlist::iterator p = bl.begin();
+      uint64_t end_size;
+      ::decode(end_size, p);
+      uint64_t cur_size;
+      r = image.size(&cur_size);
+      if (r < 0)
+	goto done;
+      if (cur_size != end_size) {
+	r = image.resize(end_size);
+	if (r < 0)
+	  goto done;
+      }
+    } else if (tag == 'w' || tag == 'z') {
+      uint64_t off, len;
+      r = read_diff_extent(fd, &off, &len);
+      if (r < 0)
+	goto done;
+
+      if (off + len < off) {
+	cerr << "rbd: invalid extent " << off << "~" << len
+	     << " in diff stream" << std::endl;
+	r = -EINVAL;
+	goto done;
+      }
+
+      if (tag == 'w') {
+	while (len > 0) {
+	  uint64_t chunk = MIN(len, RBD_DIFF_MAX_WRITE);
+	  bufferptr bp = buffer::create(chunk);
+	  r = safe_read_exact(fd, bp.c_str(), chunk);
+	  if (r < 0)
+	    goto done;
+	  bufferlist data;
+	  data.append(bp);
+	  r = image.write(off, chunk, data);
+	  if (r < 0)
+	    goto done;
+	  off += chunk;
+	  len -= chunk;
+	}
+      } else {
+	r = image.discard(off, len);
+      }
+      if (r < 0)
+	goto done;
+    } else {
+      cerr << "rbd: unrecognized tag byte " << (int)tag
+	   << " in diff stream" << std::endl;
+      r = -EINVAL;
+      goto done;
+    }
+
+    if (size)
+      pc.update_progress(lseek64(fd, 0, SEEK_CUR), size);
+  }
+
+  // take final snapshot
+  if (to.length()) {
+    r = image.snap_create(to.c_str());
+  }
+
+ done:
+  if (r < 0)
+    pc.fail();
+  else
+    pc.finish();
+  if (fd != 0)
+    close(fd);
+  return r;
+}
+
 static const char *imgname_from_path(const char *path)
 {
   const char *imgname;
@@ -864,6 +1406,8 @@ static int do_import_from_stdin(librbd::RBD &rbd, librados::IoCtx& io_ctx,
   size_t reqlen = imgblklen;	// amount requested from read
   ssize_t readlen;		// amount received from one read
   size_t blklen = 0;		// amount accumulated from reads to fill blk
+  size_t max_ops = g_conf->rbd_concurrent_management_ops;
+  std::list<librbd::RBD::AioCompletion *> pending;
 
   // loop body handles 0 return, as we may have a block to flush
   while ((readlen = ::read(0, p + blklen, reqlen)) >= 0) {
@@ -879,6 +1423,7 @@ static int do_import_from_stdin(librbd::RBD &rbd, librados::IoCtx& io_ctx,
       cur_size *= 2;
       r = image.resize(cur_size);
       if (r < 0) {
+	wait_for_aio(pending, 0);
 	cerr << "rbd: can't resize image during import" << std::endl;
 	return r;
       }
@@ -889,8 +1434,18 @@ static int do_import_from_stdin(librbd::RBD &rbd, librados::IoCtx& io_ctx,
     bl.append(p, blklen);
     // but skip writing zeros to create sparse images
     if (!bl.is_zero()) {
-      r = image.write(image_pos, blklen, bl);
+      r = wait_for_aio(pending, max_ops - 1);
+      if (r >= 0) {
+	librbd::RBD::AioCompletion *c =
+	  new librbd::RBD::AioCompletion(NULL, NULL);
+	r = image.aio_write(image_pos, blklen, bl, c);
+	if (r < 0)
+	  c->release();
+	else
+	  pending.push_back(c);
+      }
       if (r < 0) {
+	wait_for_aio(pending, 0);
 	cerr << "rbd: error writing to image block" << cpp_strerror(r) << std::endl;
 	return r;
       }
@@ -903,6 +1458,11 @@ static int do_import_from_stdin(librbd::RBD &rbd, librados::IoCtx& io_ctx,
     blklen = 0;
     reqlen = imgblklen;
   }
+  r = wait_for_aio(pending, 0);
+  if (r < 0) {
+    cerr << "rbd: error writing to image block" << cpp_strerror(r) << std::endl;
+    return r;
+  }
   r = image.resize(image_pos);
   if (r < 0) {
     cerr << "rbd: final image resize failed" << std::endl;
@@ -997,6 +1557,8 @@ static int do_import(librbd::RBD &rbd, librados::IoCtx& io_ctx,
   }
 
   uint64_t extent = 0;
+  size_t max_ops = g_conf->rbd_concurrent_management_ops;
+  std::list<librbd::RBD::AioCompletion *> pending;
 
   while (extent < fiemap->fm_mapped_extents) {
     off_t file_pos, end_ofs;
@@ -1044,21 +1606,18 @@ static int do_import(librbd::RBD &rbd, librados::IoCtx& io_ctx,
         }
         bufferlist bl;
         bl.append(p);
-        librbd::RBD::AioCompletion *completion = new librbd::RBD::AioCompletion(NULL, NULL);
-        if (!completion) {
-          r = -ENOMEM;
+	r = wait_for_aio(pending, max_ops - 1);
+        if (r < 0) {
+          cerr << "rbd: error writing to image block" << std::endl;
           goto done;
         }
+        librbd::RBD::AioCompletion *completion = new librbd::RBD::AioCompletion(NULL, NULL);
 	r = image.aio_write(file_pos, len, bl, completion);
-        if (r < 0)
-          goto done;
-	completion->wait_for_complete();
-	r = completion->get_return_value();
-	completion->release();
         if (r < 0) {
-          cerr << "rbd: error writing to image block" << std::endl;
+	  completion->release();
           goto done;
-        }
+	}
+	pending.push_back(completion);
 
         file_pos += len;
         cur_seg -= len;
@@ -1070,6 +1629,13 @@ static int do_import(librbd::RBD &rbd, librados::IoCtx& io_ctx,
   r = 0;
 
  done:
+  {
+    int ret = wait_for_aio(pending, 0);
+    if (ret < 0 && r == 0) {
+      cerr << "rbd: error writing to image block" << std::endl;
+      r = ret;
+    }
+  }
   if (r < 0)
     pc.fail();
   else
@@ -1431,6 +1997,8 @@ enum {
   OPT_RM,
   OPT_EXPORT,
   OPT_IMPORT,
+  OPT_EXPORT_DIFF,
+  OPT_IMPORT_DIFF,
   OPT_COPY,
   OPT_RENAME,
   OPT_SNAP_CREATE,
@@ -1448,6 +2016,8 @@ enum {
   OPT_LOCK_ADD,
   OPT_LOCK_REMOVE,
   OPT_BENCH_WRITE,
+  OPT_BENCH_READ,
+  OPT_BENCH,
 };
 
 static int get_cmd(const char *cmd, bool snapcmd, bool lockcmd)
@@ -1474,6 +2044,10 @@ static int get_cmd(const char *cmd, bool snapcmd, bool lockcmd)
       return OPT_EXPORT;
     if (strcmp(cmd, "import") == 0)
       return OPT_IMPORT;
+    if (strcmp(cmd, "export-diff") == 0)
+      return OPT_EXPORT_DIFF;
+    if (strcmp(cmd, "import-diff") == 0)
+      return OPT_IMPORT_DIFF;
     if (strcmp(cmd, "copy") == 0 ||
         strcmp(cmd, "cp") == 0)
       return OPT_COPY;
@@ -1490,6 +2064,10 @@ static int get_cmd(const char *cmd, bool snapcmd, bool lockcmd)
       return OPT_UNMAP;
     if (strcmp(cmd, "bench-write") == 0)
       return OPT_BENCH_WRITE;
+    if (strcmp(cmd, "bench-read") == 0)
+      return OPT_BENCH_READ;
+    if (strcmp(cmd, "bench") == 0)
+      return OPT_BENCH;
   } else if (snapcmd) {
     if (strcmp(cmd, "create") == 0 ||
         strcmp(cmd, "add") == 0)
@@ -1566,13 +2144,17 @@ int main(int argc, const char **argv)
   bool format_specified = false;
   int format = 1;
   uint64_t features = RBD_FEATURE_LAYERING;
+  bool object_map = false;
   const char *imgname = NULL, *snapname = NULL, *destname = NULL,
     *dest_poolname = NULL, *dest_snapname = NULL, *path = NULL,
     *devpath = NULL, *lock_cookie = NULL, *lock_client = NULL,
-    *lock_tag = NULL;
+    *lock_tag = NULL, *fromsnapname = NULL;
   bool lflag = false;
   long long stripe_unit = 0, stripe_count = 0;
-  long long bench_io_size = 4096, bench_io_threads = 16, bench_bytes = 1 << 30;
+  long long bench_io_size = 4096, bench_io_size_max = 0, bench_io_threads = 16;
+  long long bench_bytes = 0, bench_duration = 0;
+  int bench_io_type = -1, bench_rw_mix_read = 70;
+  bool bench_random = false;
 
   std::string val;
   std::ostringstream err;
@@ -1603,6 +2185,8 @@ int main(int argc, const char **argv)
       dest_poolname = strdup(val.c_str());
     } else if (ceph_argparse_witharg(args, i, &val, "--snap", (char*)NULL)) {
       snapname = strdup(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--from-snap", (char*)NULL)) {
+      fromsnapname = strdup(val.c_str());
     } else if (ceph_argparse_witharg(args, i, &val, "-i", "--image", (char*)NULL)) {
       imgname = strdup(val.c_str());
     } else if (ceph_argparse_withlonglong(args, i, &sizell, &err, "-s", "--size", (char*)NULL)) {
@@ -1627,7 +2211,34 @@ int main(int argc, const char **argv)
       }
     } else if (ceph_argparse_withlonglong(args, i, &bench_io_size, &err, "--io-size", (char*)NULL)) {
     } else if (ceph_argparse_withlonglong(args, i, &bench_io_threads, &err, "--io-threads", (char*)NULL)) {
+    } else if (ceph_argparse_withlonglong(args, i, &bench_io_size_max, &err, "--io-size-max", (char*)NULL)) {
     } else if (ceph_argparse_withlonglong(args, i, &bench_bytes, &err, "--io-total", (char*)NULL)) {
+    } else if (ceph_argparse_withlonglong(args, i, &bench_duration, &err, "--duration", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &val, "--io-type", (char*)NULL)) {
+      if (val == "read") {
+	bench_io_type = IO_TYPE_READ;
+      } else if (val == "write") {
+	bench_io_type = IO_TYPE_WRITE;
+      } else if (val == "rw") {
+	bench_io_type = IO_TYPE_RW;
+      } else {
+	cerr << "rbd: --io-type must be read, write or rw" << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_witharg(args, i, &val, "--io-pattern", (char*)NULL)) {
+      if (val == "seq") {
+	bench_random = false;
+      } else if (val == "rand") {
+	bench_random = true;
+      } else {
+	cerr << "rbd: --io-pattern must be seq or rand" << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_withint(args, i, &bench_rw_mix_read, &err, "--rw-mix-read", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << "rbd: " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
     } else if (ceph_argparse_withlonglong(args, i, &stripe_count, &err, "--stripe-count", (char*)NULL)) {
     } else if (ceph_argparse_witharg(args, i, &val, "--path", (char*)NULL)) {
       path = strdup(val.c_str());
@@ -1639,6 +2250,9 @@ int main(int argc, const char **argv)
       lock_tag = strdup(val.c_str());
     } else if (ceph_argparse_flag(args, i, "--no-settle", (char *)NULL)) {
       udevadm_settle = false;
+    } else if (ceph_argparse_flag(args, i, "--object-map", (char *)NULL)) {
+      object_map = true;
+      features |= RBD_FEATURE_OBJECT_MAP;
     } else {
       ++i;
     }
@@ -1704,6 +2318,8 @@ if (!set_conf_param(v, p1, p2, p3)) { \
       case OPT_WATCH:
       case OPT_MAP:
       case OPT_BENCH_WRITE:
+      case OPT_BENCH_READ:
+      case OPT_BENCH:
       case OPT_LOCK_LIST:
 	SET_CONF_PARAM(v, &imgname, NULL, NULL);
 	break;
@@ -1711,9 +2327,11 @@ if (!set_conf_param(v, p1, p2, p3)) { \
 	SET_CONF_PARAM(v, &devpath, NULL, NULL);
 	break;
       case OPT_EXPORT:
+      case OPT_EXPORT_DIFF:
 	SET_CONF_PARAM(v, &imgname, &path, NULL);
 	break;
       case OPT_IMPORT:
+      case OPT_IMPORT_DIFF:
 	SET_CONF_PARAM(v, &path, &destname, NULL);
 	break;
       case OPT_COPY:
@@ -1739,6 +2357,12 @@ if (!set_conf_param(v, p1, p2, p3)) { \
     }
   }
 
+  if (g_conf->rbd_concurrent_management_ops < 1) {
+    cerr << "rbd: rbd_concurrent_management_ops must be at least 1"
+	 << std::endl;
+    return EXIT_FAILURE;
+  }
+
   if (format_specified && opt_cmd != OPT_IMPORT && opt_cmd != OPT_CREATE) {
     cerr << "rbd: format can only be set when "
 	 << "creating or importing an image" << std::endl;
@@ -1752,16 +2376,40 @@ if (!set_conf_param(v, p1, p2, p3)) { \
     }
   }
 
-  if (opt_cmd == OPT_EXPORT && !imgname) {
+  if (object_map) {
+    if (opt_cmd != OPT_IMPORT && opt_cmd != OPT_CREATE &&
+	opt_cmd != OPT_CLONE) {
+      cerr << "rbd: object map can only be enabled when "
+	   << "creating, cloning or importing an image" << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (opt_cmd != OPT_CLONE && format != 2) {
+      cerr << "rbd: object map requires format 2" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (fromsnapname && opt_cmd != OPT_EXPORT_DIFF) {
+    cerr << "rbd: --from-snap is only used by export-diff" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if ((opt_cmd == OPT_EXPORT || opt_cmd == OPT_EXPORT_DIFF) && !imgname) {
     cerr << "rbd: image name was not specified" << std::endl;
     return EXIT_FAILURE;
   }
 
-  if (opt_cmd == OPT_IMPORT && !path) {
+  if ((opt_cmd == OPT_IMPORT || opt_cmd == OPT_IMPORT_DIFF) && !path) {
     cerr << "rbd: path was not specified" << std::endl;
     return EXIT_FAILURE;
   }
 
+  if (opt_cmd == OPT_IMPORT_DIFF && destname) {
+    // the destination image is the one we open and modify
+    imgname = destname;
+    destname = NULL;
+  }
+
   if (opt_cmd == OPT_IMPORT && !destname) {
     destname = imgname;
     if (!destname)
@@ -1775,6 +2423,26 @@ if (!set_conf_param(v, p1, p2, p3)) { \
     return EXIT_FAILURE;
   }
 
+  if (opt_cmd == OPT_BENCH && bench_io_type < 0) {
+    cerr << "rbd: bench requires --io-type" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (opt_cmd == OPT_BENCH_READ)
+    bench_io_type = IO_TYPE_READ;
+  else if (opt_cmd == OPT_BENCH_WRITE)
+    bench_io_type = IO_TYPE_WRITE;
+  bool bench_read_only = (opt_cmd == OPT_BENCH_READ || opt_cmd == OPT_BENCH) &&
+    bench_io_type == IO_TYPE_READ;
+  if (bench_io_size < 0 || bench_io_size_max < 0 || bench_io_threads < 0 ||
+      bench_bytes < 0 || bench_duration < 0) {
+    cerr << "rbd: bench sizes, counts and durations can't be negative"
+	 << std::endl;
+    return EXIT_FAILURE;
+  }
+  // with a duration, run for that long unless a total is given too
+  if (!bench_bytes && !bench_duration)
+    bench_bytes = 1 << 30;
+
   if ((opt_cmd == OPT_LOCK_ADD || opt_cmd == OPT_LOCK_REMOVE) &&
       !lock_cookie) {
     cerr << "rbd: lock id was not specified" << std::endl;
@@ -1798,10 +2466,11 @@ if (!set_conf_param(v, p1, p2, p3)) { \
 		      (char **)&imgname, (char **)&snapname);
   if (snapname && opt_cmd != OPT_SNAP_CREATE && opt_cmd != OPT_SNAP_ROLLBACK &&
       opt_cmd != OPT_SNAP_REMOVE && opt_cmd != OPT_INFO &&
-      opt_cmd != OPT_EXPORT && opt_cmd != OPT_COPY &&
+      opt_cmd != OPT_EXPORT && opt_cmd != OPT_EXPORT_DIFF &&
+      opt_cmd != OPT_COPY &&
       opt_cmd != OPT_MAP && opt_cmd != OPT_CLONE &&
       opt_cmd != OPT_SNAP_PROTECT && opt_cmd != OPT_SNAP_UNPROTECT &&
-      opt_cmd != OPT_CHILDREN) {
+      opt_cmd != OPT_CHILDREN && !bench_read_only) {
     cerr << "rbd: snapname specified for a command that doesn't use it"
 	 << std::endl;
     return EXIT_FAILURE;
@@ -1838,6 +2507,11 @@ if (!set_conf_param(v, p1, p2, p3)) { \
   if (opt_cmd == OPT_EXPORT && !path)
     path = imgname;
 
+  if (opt_cmd == OPT_EXPORT_DIFF && !path) {
+    cerr << "rbd: export-diff requires pathname" << std::endl;
+    return EXIT_FAILURE;
+  }
+
   if ((opt_cmd == OPT_COPY || opt_cmd == OPT_CLONE || opt_cmd == OPT_RENAME) &&
       !destname ) {
     cerr << "rbd: destination image name was not specified" << std::endl;
@@ -1891,12 +2565,15 @@ if (!set_conf_param(v, p1, p2, p3)) { \
        opt_cmd == OPT_SNAP_UNPROTECT || opt_cmd == OPT_WATCH ||
        opt_cmd == OPT_FLATTEN || opt_cmd == OPT_LOCK_ADD ||
        opt_cmd == OPT_LOCK_REMOVE || opt_cmd == OPT_BENCH_WRITE ||
+       opt_cmd == OPT_BENCH_READ || opt_cmd == OPT_BENCH ||
        opt_cmd == OPT_INFO || opt_cmd == OPT_SNAP_LIST ||
-       opt_cmd == OPT_EXPORT || opt_cmd == OPT_COPY ||
+       opt_cmd == OPT_EXPORT || opt_cmd == OPT_EXPORT_DIFF ||
+       opt_cmd == OPT_IMPORT_DIFF || opt_cmd == OPT_COPY ||
        opt_cmd == OPT_CHILDREN || opt_cmd == OPT_LOCK_LIST)) {
 
     if (opt_cmd == OPT_INFO || opt_cmd == OPT_SNAP_LIST ||
-	opt_cmd == OPT_EXPORT || opt_cmd == OPT_COPY ||
+	opt_cmd == OPT_EXPORT || opt_cmd == OPT_EXPORT_DIFF ||
+	opt_cmd == OPT_COPY || bench_read_only ||
 	opt_cmd == OPT_CHILDREN || opt_cmd == OPT_LOCK_LIST) {
       r = rbd.open_read_only(io_ctx, image, imgname, NULL);
     } else {
@@ -1910,8 +2587,9 @@ if (!set_conf_param(v, p1, p2, p3)) { \
   }
 
   if (snapname && talk_to_cluster &&
-      (opt_cmd == OPT_INFO || opt_cmd == OPT_EXPORT || opt_cmd == OPT_COPY ||
-       opt_cmd == OPT_CHILDREN)) {
+      (opt_cmd == OPT_INFO || opt_cmd == OPT_EXPORT ||
+       opt_cmd == OPT_EXPORT_DIFF || opt_cmd == OPT_COPY ||
+       opt_cmd == OPT_CHILDREN || bench_read_only)) {
     r = image.snap_set(snapname);
     if (r < 0) {
       cerr << "rbd: error setting snapshot context: " << cpp_strerror(-r)
@@ -2164,6 +2842,22 @@ if (!set_conf_param(v, p1, p2, p3)) { \
     }
     break;
 
+  case OPT_EXPORT_DIFF:
+    r = do_export_diff(image, fromsnapname, snapname, path);
+    if (r < 0) {
+      cerr << "rbd: export-diff error: " << cpp_strerror(-r) << std::endl;
+      return EXIT_FAILURE;
+    }
+    break;
+
+  case OPT_IMPORT_DIFF:
+    r = do_import_diff(image, path);
+    if (r < 0) {
+      cerr << "rbd: import-diff failed: " << cpp_strerror(-r) << std::endl;
+      return EXIT_FAILURE;
+    }
+    break;
+
   case OPT_COPY:
     r = do_copy(image, dest_io_ctx, destname);
     if (r < 0) {
@@ -2238,10 +2932,18 @@ if (!set_conf_param(v, p1, p2, p3)) { \
     break;
 
   case OPT_BENCH_WRITE:
-    r = do_bench_write(image, bench_io_size, bench_io_threads, bench_bytes);
-    if (r < 0) {
-      cerr << "bench-write failed: " << cpp_strerror(-r) << std::endl;
-      return EXIT_FAILURE;
+  case OPT_BENCH_READ:
+  case OPT_BENCH:
+    {
+      const char *name = opt_cmd == OPT_BENCH_WRITE ? "bench-write" :
+	(opt_cmd == OPT_BENCH_READ ? "bench-read" : "bench");
+      r = do_bench(image, name, bench_io_type, bench_random, bench_io_size,
+		   bench_io_size_max, bench_io_threads, bench_bytes,
+		   bench_duration, bench_rw_mix_read);
+      if (r < 0) {
+	cerr << name << " failed: " << cpp_strerror(-r) << std::endl;
+	return EXIT_FAILURE;
+      }
     }
     break;
   }
@@ -22,6 +22,7 @@ using namespace std;
 #include "rgw_log.h"
 #include "rgw_formats.h"
 #include "rgw_usage.h"
+#include "rgw_gc.h"
 #include "auth/Crypto.h"
 
 #define dout_subsys ceph_subsys_rgw
@@ -54,6 +55,7 @@ void _usage()
   cerr << "  bucket stats               returns bucket statistics\n";
   cerr << "  bucket rm                  remove bucket\n";
   cerr << "  bucket check               check bucket index\n";
+  cerr << "  bucket shards              show the size of each bucket index shard\n";
   cerr << "  object rm                  remove object\n";
   cerr << "  cluster info               show cluster params info\n";
   cerr << "  pool add                   add an existing pool for data placement\n";
@@ -70,6 +72,7 @@ void _usage()
   cerr << "                             specified date (and optional time)\n";
   cerr << "  gc list                    dump expired garbage collection objects\n";
   cerr << "  gc process                 manually process garbage\n";
+  cerr << "  gc stats                   show expired garbage waiting in each gc shard\n";
   cerr << "options:\n";
   cerr << "   --uid=<id>                user id\n";
   cerr << "   --subuser=<name>          subuser name\n";
@@ -144,6 +147,7 @@ enum {
   OPT_BUCKET_STATS,
   OPT_BUCKET_RM,
   OPT_BUCKET_CHECK,
+  OPT_BUCKET_SHARDS,
   OPT_POLICY,
   OPT_POOL_ADD,
   OPT_POOL_RM,
@@ -157,6 +161,7 @@ enum {
   OPT_OBJECT_RM,
   OPT_GC_LIST,
   OPT_GC_PROCESS,
+  OPT_GC_STATS,
   OPT_CLUSTER_INFO,
   OPT_CAPS_ADD,
   OPT_CAPS_RM,
@@ -287,6 +292,8 @@ static int get_cmd(const char *cmd, const char *prev_cmd, bool *need_more)
       return OPT_BUCKET_RM;
     if (strcmp(cmd, "check") == 0)
       return OPT_BUCKET_CHECK;
+    if (strcmp(cmd, "shards") == 0)
+      return OPT_BUCKET_SHARDS;
   } else if (strcmp(prev_cmd, "log") == 0) {
     if (strcmp(cmd, "list") == 0)
       return OPT_LOG_LIST;
@@ -326,6 +333,8 @@ static int get_cmd(const char *cmd, const char *prev_cmd, bool *need_more)
       return OPT_GC_LIST;
     if (strcmp(cmd, "process") == 0)
       return OPT_GC_PROCESS;
+    if (strcmp(cmd, "stats") == 0)
+      return OPT_GC_STATS;
   }
 
   return -EINVAL;
@@ -562,6 +571,7 @@ int bucket_stats(rgw_bucket& bucket, Formatter *formatter)
   
   formatter->dump_string("id", bucket.bucket_id);
   formatter->dump_string("marker", bucket.marker);
+  formatter->dump_int("num_shards", bucket.num_shards);
   formatter->dump_string("owner", bucket_info.owner);
   dump_bucket_usage(stats, formatter);
   formatter->close_section();
@@ -1705,6 +1715,33 @@ next:
     }
   }
 
+  if (opt_cmd == OPT_BUCKET_SHARDS) {
+    if (bucket_name.empty()) {
+      cerr << "bucket was not specified" << std::endl;
+      return usage();
+    }
+    vector<map<RGWObjCategory, RGWBucketStats> > stats;
+    int ret = store->get_bucket_shard_stats(bucket, stats);
+    if (ret < 0) {
+      cerr << "ERROR: could not read bucket index: " << cpp_strerror(-ret) << std::endl;
+      return 1;
+    }
+    formatter->open_object_section("bucket_index");
+    formatter->dump_string("bucket", bucket.name);
+    formatter->dump_int("num_shards", bucket.num_shards);
+    formatter->open_array_section("shards");
+    for (size_t i = 0; i < stats.size(); i++) {
+      formatter->open_object_section("shard");
+      formatter->dump_int("id", i);
+      dump_bucket_usage(stats[i], formatter);
+      formatter->close_section();
+    }
+    formatter->close_section();
+    formatter->close_section();
+    formatter->flush(cout);
+    cout << std::endl;
+  }
+
   if (opt_cmd == OPT_GC_LIST) {
     int ret;
     int index = 0;
@@ -1746,11 +1783,58 @@ next:
   }
 
   if (opt_cmd == OPT_GC_PROCESS) {
+    utime_t start = ceph_clock_now(g_ceph_context);
     int ret = store->process_gc();
     if (ret < 0) {
       cerr << "ERROR: gc processing returned error: " << cpp_strerror(-ret) << std::endl;
       return 1;
     }
+    utime_t duration = ceph_clock_now(g_ceph_context) - start;
+
+    RGWGCStats stats;
+    store->get_gc_stats(stats);
+    formatter->open_object_section("gc_process");
+    formatter->dump_unsigned("chains_removed", stats.chains_removed);
+    formatter->dump_unsigned("objs_removed", stats.objs_removed);
+    formatter->dump_unsigned("remove_failed", stats.remove_failed);
+    formatter->dump_float("seconds", (double)duration);
+    formatter->dump_float("objs_per_sec", (double)duration > 0 ? stats.objs_removed / (double)duration : 0);
+    formatter->close_section();
+    formatter->flush(cout);
+    cout << std::endl;
+  }
+
+  if (opt_cmd == OPT_GC_STATS) {
+    list<RGWGCShardStats> stats;
+    int ret = store->get_gc_shard_stats(stats);
+    if (ret < 0) {
+      cerr << "ERROR: failed to read gc shards: " << cpp_strerror(-ret) << std::endl;
+      return 1;
+    }
+
+    uint64_t total_chains = 0, total_objs = 0;
+    formatter->open_object_section("gc_stats");
+    formatter->open_array_section("shards");
+    list<RGWGCShardStats>::iterator iter;
+    for (iter = stats.begin(); iter != stats.end(); ++iter) {
+      RGWGCShardStats& s = *iter;
+      formatter->open_object_section("shard");
+      formatter->dump_int("index", s.index);
+      formatter->dump_string("oid", s.oid);
+      formatter->dump_unsigned("chains", s.chains);
+      formatter->dump_unsigned("objs", s.objs);
+      if (s.chains)
+        formatter->dump_stream("oldest") << s.oldest;
+      formatter->close_section();
+      total_chains += s.chains;
+      total_objs += s.objs;
+    }
+    formatter->close_section(); // shards
+    formatter->dump_unsigned("total_chains", total_chains);
+    formatter->dump_unsigned("total_objs", total_objs);
+    formatter->close_section();
+    formatter->flush(cout);
+    cout << std::endl;
   }
 
   if (opt_cmd == OPT_CLUSTER_INFO) {
@@ -2,53 +2,133 @@
 
 #include <errno.h>
 
+#include "include/ceph_hash.h"
+
 #define dout_subsys ceph_subsys_rgw
 
 using namespace std;
 
-int ObjectCache::get(string& name, ObjectCacheInfo& info, uint32_t mask)
+ObjectCache::~ObjectCache()
+{
+  for (vector<Shard *>::iterator iter = shards.begin(); iter != shards.end(); ++iter)
+    delete *iter;
+}
+
+void ObjectCache::set_ctx(CephContext *_cct)
+{
+  cct = _cct;
+
+  int num_shards = cct->_conf->rgw_cache_shards;
+  if (num_shards < 1)
+    num_shards = 1;
+
+  assert(shards.empty());
+  for (int i = 0; i < num_shards; i++)
+    shards.push_back(new Shard);
+
+  lru_size = cct->_conf->rgw_cache_lru_size / num_shards;
+  if (!lru_size)
+    lru_size = 1;
+}
+
+ObjectCache::Shard *ObjectCache::get_shard(const string& name)
+{
+  uint32_t hash = ceph_str_hash_linux(name.c_str(), name.size());
+  return shards[hash % shards.size()];
+}
+
+void ObjectCache::inc_counter(int obj_class, int total_idx, int bucket_idx, int user_idx)
+{
+  if (!perfcounter)
+    return;
+
+  perfcounter->inc(total_idx);
+  switch (obj_class) {
+  case RGW_CACHE_CLASS_BUCKET:
+    perfcounter->inc(bucket_idx);
+    break;
+  case RGW_CACHE_CLASS_USER:
+    perfcounter->inc(user_idx);
+    break;
+  }
+}
+
+int ObjectCache::get(string& name, ObjectCacheInfo& info, uint32_t mask, int obj_class)
 {
-  Mutex::Locker l(lock);
+  Shard *shard = get_shard(name);
+  Mutex::Locker l(shard->lock);
 
-  map<string, ObjectCacheEntry>::iterator iter = cache_map.find(name);
-  if (iter == cache_map.end()) {
+  map<string, ObjectCacheEntry>::iterator iter = shard->cache_map.find(name);
+  if (iter == shard->cache_map.end()) {
     ldout(cct, 10) << "cache get: name=" << name << " : miss" << dendl;
-    if(perfcounter) perfcounter->inc(l_rgw_cache_miss);
+    inc_counter(obj_class, l_rgw_cache_miss, l_rgw_cache_bucket_miss, l_rgw_cache_user_miss);
+    return -ENOENT;
+  }
+
+  ObjectCacheEntry& entry = iter->second;
+  if (!entry.expiration.is_zero() && entry.expiration <= ceph_clock_now(cct)) {
+    ldout(cct, 10) << "cache get: name=" << name << " : expired" << dendl;
+    inc_counter(entry.obj_class, l_rgw_cache_evict, l_rgw_cache_bucket_evict, l_rgw_cache_user_evict);
+    inc_counter(obj_class, l_rgw_cache_miss, l_rgw_cache_bucket_miss, l_rgw_cache_user_miss);
+    remove_lru(shard, name, entry.lru_iter);
+    shard->cache_map.erase(iter);
     return -ENOENT;
   }
 
-  touch_lru(name, iter->second.lru_iter);
+  touch_lru(shard, name, entry.lru_iter);
 
-  ObjectCacheInfo& src = iter->second.info;
-  if ((src.flags & mask) != mask) {
+  ObjectCacheInfo& src = entry.info;
+  if (src.status >= 0 && (src.flags & mask) != mask) {
     ldout(cct, 10) << "cache get: name=" << name << " : type miss (requested=" << mask << ", cached=" << src.flags << ")" << dendl;
-    if(perfcounter) perfcounter->inc(l_rgw_cache_miss);
+    inc_counter(obj_class, l_rgw_cache_miss, l_rgw_cache_bucket_miss, l_rgw_cache_user_miss);
     return -ENOENT;
   }
-  ldout(cct, 10) << "cache get: name=" << name << " : hit" << dendl;
+  ldout(cct, 10) << "cache get: name=" << name << " : hit" << (src.status < 0 ? " (negative)" : "") << dendl;
 
   info = src;
-  if(perfcounter) perfcounter->inc(l_rgw_cache_hit);
+  inc_counter(obj_class, l_rgw_cache_hit, l_rgw_cache_bucket_hit, l_rgw_cache_user_hit);
 
   return 0;
 }
 
-void ObjectCache::put(string& name, ObjectCacheInfo& info)
+void ObjectCache::put(string& name, ObjectCacheInfo& info, int obj_class)
 {
-  Mutex::Locker l(lock);
+  Shard *shard = get_shard(name);
+  Mutex::Locker l(shard->lock);
 
   ldout(cct, 10) << "cache put: name=" << name << dendl;
-  map<string, ObjectCacheEntry>::iterator iter = cache_map.find(name);
-  if (iter == cache_map.end()) {
+  map<string, ObjectCacheEntry>::iterator iter = shard->cache_map.find(name);
+  if (iter != shard->cache_map.end() && info.status < 0) {
+    /*
+     * a lookup that raced with a write may come back with ENOENT after
+     * the write filled the cache; only let it replace a stale entry
+     */
+    ObjectCacheEntry& entry = iter->second;
+    if (entry.info.status >= 0 &&
+        (entry.expiration.is_zero() || entry.expiration > ceph_clock_now(cct))) {
+      ldout(cct, 10) << "cache put: name=" << name << " : not replacing valid entry with negative one" << dendl;
+      return;
+    }
+  }
+  if (iter == shard->cache_map.end()) {
     ObjectCacheEntry entry;
-    entry.lru_iter = lru.end();
-    cache_map.insert(pair<string, ObjectCacheEntry>(name, entry));
-    iter = cache_map.find(name);
+    entry.lru_iter = shard->lru.end();
+    shard->cache_map.insert(pair<string, ObjectCacheEntry>(name, entry));
+    iter = shard->cache_map.find(name);
   }
   ObjectCacheEntry& entry = iter->second;
   ObjectCacheInfo& target = entry.info;
 
-  touch_lru(name, entry.lru_iter);
+  touch_lru(shard, name, entry.lru_iter);
+
+  entry.obj_class = obj_class;
+  int ttl = (info.status < 0 ? cct->_conf->rgw_cache_negative_ttl : cct->_conf->rgw_cache_ttl);
+  if (ttl > 0) {
+    entry.expiration = ceph_clock_now(cct);
+    entry.expiration += ttl;
+  } else {
+    entry.expiration = utime_t();
+  }
 
   target.status = info.status;
 
@@ -90,21 +170,25 @@ void ObjectCache::put(string& name, ObjectCacheInfo& info)
 
 void ObjectCache::remove(string& name)
 {
-  Mutex::Locker l(lock);
+  Shard *shard = get_shard(name);
+  Mutex::Locker l(shard->lock);
 
-  map<string, ObjectCacheEntry>::iterator iter = cache_map.find(name);
-  if (iter == cache_map.end())
+  map<string, ObjectCacheEntry>::iterator iter = shard->cache_map.find(name);
+  if (iter == shard->cache_map.end())
     return;
 
   ldout(cct, 10) << "removing " << name << " from cache" << dendl;
 
-  remove_lru(name, iter->second.lru_iter);
-  cache_map.erase(iter);
+  remove_lru(shard, name, iter->second.lru_iter);
+  shard->cache_map.erase(iter);
 }
 
-void ObjectCache::touch_lru(string& name, std::list<string>::iterator& lru_iter)
+void ObjectCache::touch_lru(Shard *shard, string& name, std::list<string>::iterator& lru_iter)
 {
-  while (lru.size() > (size_t)cct->_conf->rgw_cache_lru_size) {
+  std::list<string>& lru = shard->lru;
+  map<string, ObjectCacheEntry>& cache_map = shard->cache_map;
+
+  while (lru.size() > lru_size) {
     list<string>::iterator iter = lru.begin();
     if ((*iter).compare(name) == 0) {
       /*
@@ -115,8 +199,10 @@ void ObjectCache::touch_lru(string& name, std::list<string>::iterator& lru_iter)
     }
     map<string, ObjectCacheEntry>::iterator map_iter = cache_map.find(*iter);
     ldout(cct, 10) << "removing entry: name=" << *iter << " from cache LRU" << dendl;
-    if (map_iter != cache_map.end())
+    if (map_iter != cache_map.end()) {
+      inc_counter(map_iter->second.obj_class, l_rgw_cache_evict, l_rgw_cache_bucket_evict, l_rgw_cache_user_evict);
       cache_map.erase(map_iter);
+    }
     lru.pop_front();
   }
 
@@ -133,13 +219,13 @@ void ObjectCache::touch_lru(string& name, std::list<string>::iterator& lru_iter)
   }
 }
 
-void ObjectCache::remove_lru(string& name, std::list<string>::iterator& lru_iter)
+void ObjectCache::remove_lru(Shard *shard, string& name, std::list<string>::iterator& lru_iter)
 {
-  if (lru_iter == lru.end())
+  if (lru_iter == shard->lru.end())
     return;
 
-  lru.erase(lru_iter);
-  lru_iter = lru.end();
+  shard->lru.erase(lru_iter);
+  lru_iter = shard->lru.end();
 }
 
 
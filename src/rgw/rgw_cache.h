@@ -118,25 +118,53 @@ struct RGWCacheNotifyInfo {
 };
 WRITE_CLASS_ENCODER(RGWCacheNotifyInfo)
 
+/* what a cached object is, for the perf counters */
+enum {
+  RGW_CACHE_CLASS_OTHER,
+  RGW_CACHE_CLASS_BUCKET,
+  RGW_CACHE_CLASS_USER,
+};
+
 struct ObjectCacheEntry {
   ObjectCacheInfo info;
   std::list<string>::iterator lru_iter;
+  int obj_class;
+  utime_t expiration; /* zero if the entry does not expire */
+
+  ObjectCacheEntry() : obj_class(RGW_CACHE_CLASS_OTHER) {}
 };
 
+/*
+ * The cache is split into shards by a hash of the object name, each
+ * with its own map, lru and lock, so that requests looking up different
+ * objects do not contend.  Failed lookups (ENOENT) are cached too, as
+ * negative entries.  Entries expire after rgw_cache_ttl seconds, or
+ * rgw_cache_negative_ttl seconds for negative entries; 0 means never.
+ */
 class ObjectCache {
-  std::map<string, ObjectCacheEntry> cache_map;
-  std::list<string> lru;
-  Mutex lock;
+  struct Shard {
+    std::map<string, ObjectCacheEntry> cache_map;
+    std::list<string> lru;
+    Mutex lock;
+
+    Shard() : lock("ObjectCache::Shard::lock") {}
+  };
+
+  vector<Shard *> shards;
+  size_t lru_size; /* per shard */
   CephContext *cct;
 
-  void touch_lru(string& name, std::list<string>::iterator& lru_iter);
-  void remove_lru(string& name, std::list<string>::iterator& lru_iter);
+  Shard *get_shard(const string& name);
+  void touch_lru(Shard *shard, string& name, std::list<string>::iterator& lru_iter);
+  void remove_lru(Shard *shard, string& name, std::list<string>::iterator& lru_iter);
+  void inc_counter(int obj_class, int total_idx, int bucket_idx, int user_idx);
 public:
-  ObjectCache() : lock("ObjectCache"), cct(NULL) { }
-  int get(std::string& name, ObjectCacheInfo& bl, uint32_t mask);
-  void put(std::string& name, ObjectCacheInfo& bl);
+  ObjectCache() : lru_size(0), cct(NULL) { }
+  ~ObjectCache();
+  int get(std::string& name, ObjectCacheInfo& bl, uint32_t mask, int obj_class = RGW_CACHE_CLASS_OTHER);
+  void put(std::string& name, ObjectCacheInfo& bl, int obj_class = RGW_CACHE_CLASS_OTHER);
   void remove(std::string& name);
-  void set_ctx(CephContext *_cct) { cct = _cct; }
+  void set_ctx(CephContext *_cct);
 };
 
 template <class T>
@@ -161,6 +189,7 @@ class RGWCache  : public T
   }
 
   void normalize_bucket_and_obj(rgw_bucket& src_bucket, string& src_obj, rgw_bucket& dst_bucket, string& dst_obj);
+  int cache_class(rgw_bucket& bucket);
   string normal_name(rgw_obj& obj) {
     return normal_name(obj.bucket, obj.object);
   }
@@ -216,6 +245,19 @@ void RGWCache<T>::normalize_bucket_and_obj(rgw_bucket& src_bucket, string& src_o
   }
 }
 
+template <class T>
+int RGWCache<T>::cache_class(rgw_bucket& bucket)
+{
+  if (bucket.name == T::params.domain_root.name)
+    return RGW_CACHE_CLASS_BUCKET;
+  if (bucket.name == T::params.user_uid_pool.name ||
+      bucket.name == T::params.user_keys_pool.name ||
+      bucket.name == T::params.user_email_pool.name ||
+      bucket.name == T::params.user_swift_pool.name)
+    return RGW_CACHE_CLASS_USER;
+  return RGW_CACHE_CLASS_OTHER;
+}
+
 template <class T>
 int RGWCache<T>::delete_obj(void *ctx, rgw_obj& obj)
 {
@@ -246,7 +288,7 @@ int RGWCache<T>::get_obj(void *ctx, void **handle, rgw_obj& obj, bufferlist& obl
   string name = normal_name(obj.bucket, oid);
 
   ObjectCacheInfo info;
-  if (cache.get(name, info, CACHE_FLAG_DATA) == 0) {
+  if (cache.get(name, info, CACHE_FLAG_DATA, cache_class(bucket)) == 0) {
     if (info.status < 0)
       return info.status;
 
@@ -263,7 +305,7 @@ int RGWCache<T>::get_obj(void *ctx, void **handle, rgw_obj& obj, bufferlist& obl
   if (r < 0) {
     if (r == -ENOENT) { // only update ENOENT, we'd rather retry other errors
       info.status = r;
-      cache.put(name, info);
+      cache.put(name, info, cache_class(bucket));
     }
     return r;
   }
@@ -280,7 +322,7 @@ int RGWCache<T>::get_obj(void *ctx, void **handle, rgw_obj& obj, bufferlist& obl
   o.copy_all(bl);
   info.status = 0;
   info.flags = CACHE_FLAG_DATA;
-  cache.put(name, info);
+  cache.put(name, info, cache_class(bucket));
   return r;
 }
 
@@ -302,7 +344,7 @@ int RGWCache<T>::set_attr(void *ctx, rgw_obj& obj, const char *attr_name, buffer
   if (cacheable) {
     string name = normal_name(bucket, oid);
     if (ret >= 0) {
-      cache.put(name, info);
+      cache.put(name, info, cache_class(bucket));
       int r = distribute_cache(name, obj, info, UPDATE_OBJ);
       if (r < 0)
         mydout(0) << "ERROR: failed to distribute cache for " << obj << dendl;
@@ -336,7 +378,7 @@ int RGWCache<T>::set_attrs(void *ctx, rgw_obj& obj,
   if (cacheable) {
     string name = normal_name(bucket, oid);
     if (ret >= 0) {
-      cache.put(name, info);
+      cache.put(name, info, cache_class(bucket));
       int r = distribute_cache(name, obj, info, UPDATE_OBJ);
       if (r < 0)
         mydout(0) << "ERROR: failed to distribute cache for " << obj << dendl;
@@ -373,7 +415,7 @@ int RGWCache<T>::put_obj_meta(void *ctx, rgw_obj& obj, uint64_t size, time_t *mt
   if (cacheable) {
     string name = normal_name(bucket, oid);
     if (ret >= 0) {
-      cache.put(name, info);
+      cache.put(name, info, cache_class(bucket));
       int r = distribute_cache(name, obj, info, UPDATE_OBJ);
       if (r < 0)
         mydout(0) << "ERROR: failed to distribute cache for " << obj << dendl;
@@ -408,7 +450,7 @@ int RGWCache<T>::put_obj_data(void *ctx, rgw_obj& obj, const char *data,
   if (cacheable) {
     string name = normal_name(bucket, oid);
     if (ret >= 0) {
-      cache.put(name, info);
+      cache.put(name, info, cache_class(bucket));
       int r = distribute_cache(name, obj, info, UPDATE_OBJ);
       if (r < 0)
         mydout(0) << "ERROR: failed to distribute cache for " << obj << dendl;
@@ -438,7 +480,7 @@ int RGWCache<T>::obj_stat(void *ctx, rgw_obj& obj, uint64_t *psize, time_t *pmti
   uint64_t epoch;
 
   ObjectCacheInfo info;
-  int r = cache.get(name, info, CACHE_FLAG_META | CACHE_FLAG_XATTRS);
+  int r = cache.get(name, info, CACHE_FLAG_META | CACHE_FLAG_XATTRS, cache_class(bucket));
   if (r == 0) {
     if (info.status < 0)
       return info.status;
@@ -452,7 +494,7 @@ int RGWCache<T>::obj_stat(void *ctx, rgw_obj& obj, uint64_t *psize, time_t *pmti
   if (r < 0) {
     if (r == -ENOENT) {
       info.status = r;
-      cache.put(name, info);
+      cache.put(name, info, cache_class(bucket));
     }
     return r;
   }
@@ -461,7 +503,7 @@ int RGWCache<T>::obj_stat(void *ctx, rgw_obj& obj, uint64_t *psize, time_t *pmti
   info.meta.mtime = mtime;
   info.meta.size = size;
   info.flags = CACHE_FLAG_META | CACHE_FLAG_XATTRS;
-  cache.put(name, info);
+  cache.put(name, info, cache_class(bucket));
 done:
   if (psize)
     *psize = size;
@@ -512,7 +554,7 @@ int RGWCache<T>::watch_cb(int opcode, uint64_t ver, bufferlist& bl)
 
   switch (info.op) {
   case UPDATE_OBJ:
-    cache.put(name, info.obj_info);
+    cache.put(name, info.obj_info, cache_class(bucket));
     break;
   case REMOVE_OBJ:
     cache.remove(name);
@@ -44,6 +44,34 @@ int RGWClientIO::write(const char *buf, int len)
   return 0;
 }
 
+/*
+ * Write each of the buffers as they are, without copying them into one
+ * (which bl.c_str() would do).
+ */
+int RGWClientIO::write_buffers(bufferlist& bl)
+{
+  for (std::list<bufferptr>::const_iterator iter = bl.buffers().begin();
+       iter != bl.buffers().end(); ++iter) {
+    if (!iter->length())
+      continue;
+    int ret = write_data(iter->c_str(), iter->length());
+    if (ret < 0)
+      return ret;
+  }
+  return 0;
+}
+
+int RGWClientIO::write(bufferlist& bl)
+{
+  int ret = write_buffers(bl);
+  if (ret < 0)
+    return ret;
+
+  if (account)
+    bytes_sent += bl.length();
+
+  return 0;
+}
 
 int RGWClientIO::read(char *buf, int max, int *actual)
 {
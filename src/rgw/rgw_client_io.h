@@ -14,6 +14,7 @@ class RGWClientIO {
 protected:
   virtual int write_data(const char *buf, int len) = 0;
   virtual int read_data(char *buf, int max) = 0;
+  virtual int write_buffers(bufferlist& bl);
 
 public:
   virtual ~RGWClientIO() {}
@@ -21,6 +22,7 @@ public:
 
   int print(const char *format, ...);
   int write(const char *buf, int len);
+  int write(bufferlist& bl);
   virtual void flush() = 0;
   int read(char *buf, int max, int *actual);
 
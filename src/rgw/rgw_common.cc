@@ -38,10 +38,29 @@ int rgw_perf_start(CephContext *cct)
 
   plb.add_u64_counter(l_rgw_cache_hit, "cache_hit");
   plb.add_u64_counter(l_rgw_cache_miss, "cache_miss");
+  plb.add_u64_counter(l_rgw_cache_evict, "cache_evict");
+  plb.add_u64_counter(l_rgw_cache_bucket_hit, "cache_bucket_hit");
+  plb.add_u64_counter(l_rgw_cache_bucket_miss, "cache_bucket_miss");
+  plb.add_u64_counter(l_rgw_cache_bucket_evict, "cache_bucket_evict");
+  plb.add_u64_counter(l_rgw_cache_user_hit, "cache_user_hit");
+  plb.add_u64_counter(l_rgw_cache_user_miss, "cache_user_miss");
+  plb.add_u64_counter(l_rgw_cache_user_evict, "cache_user_evict");
 
   plb.add_u64_counter(l_rgw_keystone_token_cache_hit, "keystone_token_cache_hit");
   plb.add_u64_counter(l_rgw_keystone_token_cache_miss, "keystone_token_cache_miss");
 
+  plb.add_u64_counter(l_rgw_ops_log_entries, "ops_log_entries");
+  plb.add_u64_counter(l_rgw_ops_log_flush, "ops_log_flush");
+  plb.add_u64_counter(l_rgw_ops_log_drop, "ops_log_drop");
+  plb.add_u64(l_rgw_ops_log_pending, "ops_log_pending");
+  plb.add_u64_counter(l_rgw_usage_log_entries, "usage_log_entries");
+  plb.add_u64_counter(l_rgw_usage_log_flush, "usage_log_flush");
+
+  plb.add_u64_counter(l_rgw_gc_chain_removed, "gc_chain_removed");
+  plb.add_u64_counter(l_rgw_gc_obj_removed, "gc_obj_removed");
+  plb.add_u64_counter(l_rgw_gc_remove_failed, "gc_remove_failed");
+  plb.add_u64(l_rgw_gc_shards_active, "gc_shards_active");
+
   perfcounter = plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(perfcounter);
   return 0;
@@ -59,7 +59,6 @@ using ceph::crypto::MD5;
 #define RGW_BUCKETS_OBJ_PREFIX ".buckets"
 
 #define RGW_MAX_CHUNK_SIZE	(512*1024)
-#define RGW_MAX_PENDING_CHUNKS  16
 #define RGW_MAX_PUT_SIZE        (5ULL*1024*1024*1024)
 #define RGW_MIN_MULTIPART_SIZE (5ULL*1024*1024)
 
@@ -138,10 +137,29 @@ enum {
 
   l_rgw_cache_hit,
   l_rgw_cache_miss,
+  l_rgw_cache_evict,
+  l_rgw_cache_bucket_hit,
+  l_rgw_cache_bucket_miss,
+  l_rgw_cache_bucket_evict,
+  l_rgw_cache_user_hit,
+  l_rgw_cache_user_miss,
+  l_rgw_cache_user_evict,
 
   l_rgw_keystone_token_cache_hit,
   l_rgw_keystone_token_cache_miss,
 
+  l_rgw_ops_log_entries,
+  l_rgw_ops_log_flush,
+  l_rgw_ops_log_drop,
+  l_rgw_ops_log_pending,
+  l_rgw_usage_log_entries,
+  l_rgw_usage_log_flush,
+
+  l_rgw_gc_chain_removed,
+  l_rgw_gc_obj_removed,
+  l_rgw_gc_remove_failed,
+  l_rgw_gc_shards_active,
+
   l_rgw_last,
 };
 
@@ -461,33 +479,36 @@ struct rgw_bucket {
   std::string pool;
   std::string marker;
   std::string bucket_id;
+  uint32_t num_shards; ///< number of bucket index shards, 0 if unsharded
 
-  rgw_bucket() { }
-  rgw_bucket(const char *n) : name(n) {
+  rgw_bucket() : num_shards(0) { }
+  rgw_bucket(const char *n) : name(n), num_shards(0) {
     assert(*n == '.'); // only rgw private buckets should be initialized without pool
     pool = n;
     marker = "";
   }
   rgw_bucket(const char *n, const char *p, const char *m, const char *id) :
-    name(n), pool(p), marker(m), bucket_id(id) {}
+    name(n), pool(p), marker(m), bucket_id(id), num_shards(0) {}
 
   void clear() {
     name = "";
     pool = "";
     marker = "";
     bucket_id = "";
+    num_shards = 0;
   }
 
   void encode(bufferlist& bl) const {
-     ENCODE_START(4, 3, bl);
+     ENCODE_START(5, 3, bl);
     ::encode(name, bl);
     ::encode(pool, bl);
     ::encode(marker, bl);
     ::encode(bucket_id, bl);
+    ::encode(num_shards, bl);
     ENCODE_FINISH(bl);
   }
   void decode(bufferlist::iterator& bl) {
-    DECODE_START_LEGACY_COMPAT_LEN(4, 3, 3, bl);
+    DECODE_START_LEGACY_COMPAT_LEN(5, 3, 3, bl);
     ::decode(name, bl);
     ::decode(pool, bl);
     if (struct_v >= 2) {
@@ -502,6 +523,10 @@ struct rgw_bucket {
         ::decode(bucket_id, bl);
       }
     }
+    if (struct_v >= 5)
+      ::decode(num_shards, bl);
+    else
+      num_shards = 0;
     DECODE_FINISH(bl);
   }
   void dump(Formatter *f) const;
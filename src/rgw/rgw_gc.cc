@@ -17,6 +17,14 @@ using namespace librados;
 static string gc_oid_prefix = "gc";
 static string gc_index_lock_name = "gc_process";
 
+/* the gc listing marker is a time index key, see get_time_key() in cls_rgw */
+static void gc_time_marker(utime_t& ut, string *marker)
+{
+  char buf[32];
+  snprintf(buf, 32, "%011lld.%09d", (long long)ut.sec(), ut.nsec());
+  *marker = buf;
+}
+
 void RGWGC::initialize(CephContext *_cct, RGWRados *_store) {
   cct = _cct;
   store = _store;
@@ -99,6 +107,7 @@ int RGWGC::list(int *index, string& marker, uint32_t max, std::list<cls_rgw_gc_o
     std::list<cls_rgw_gc_obj_info>::iterator iter;
     for (iter = entries.begin(); iter != entries.end(); ++iter) {
       result.push_back(*iter);
+      gc_time_marker(iter->time, &marker);
     }
 
     if (*index == cct->_conf->rgw_gc_max_objs - 1) {
@@ -121,11 +130,169 @@ int RGWGC::list(int *index, string& marker, uint32_t max, std::list<cls_rgw_gc_o
   return 0;
 }
 
+/*
+ * The refcount puts for the chains of one gc shard, kept in flight up to
+ * rgw_gc_max_concurrent_io at a time.  A chain's tag is only removed from
+ * the shard once all of its objects are gone, and the removals are sent
+ * rgw_gc_max_trim_chunk tags at a time.
+ */
+class RGWGCIOManager {
+  CephContext *cct;
+  RGWGC *gc;
+  int index;
+
+public:
+  struct TagState {
+    string tag;
+    int pending;    /* puts in flight */
+    int objs;
+    bool scheduled; /* all puts sent */
+    bool failed;
+
+    TagState(const string& _tag) : tag(_tag), pending(0), objs(0), scheduled(false), failed(false) {}
+  };
+
+private:
+  struct IO {
+    AioCompletion *c;
+    list<TagState>::iterator tag;
+    cls_rgw_obj obj;
+  };
+
+  list<TagState> tags;
+  list<IO> ios;
+  map<string, IoCtx> ctxs;
+  std::list<string> remove_tags;
+  size_t max_aio;
+
+  void handle_next_completion();
+  void check_tag(list<TagState>::iterator t);
+  void flush_remove();
+
+public:
+  RGWGCIOManager(CephContext *_cct, RGWGC *_gc, int _index) : cct(_cct), gc(_gc), index(_index) {
+    max_aio = cct->_conf->rgw_gc_max_concurrent_io;
+    if (max_aio < 1)
+      max_aio = 1;
+  }
+  ~RGWGCIOManager() {
+    drain();
+  }
+
+  list<TagState>::iterator add_tag(const string& tag) {
+    tags.push_back(TagState(tag));
+    list<TagState>::iterator t = tags.end();
+    return --t;
+  }
+  int schedule_io(list<TagState>::iterator t, cls_rgw_obj& obj);
+  void tag_scheduled(list<TagState>::iterator t) {
+    t->scheduled = true;
+    check_tag(t);
+  }
+
+  /* wait for all puts, and remove the tags of the chains that are done */
+  void drain();
+};
+
+int RGWGCIOManager::schedule_io(list<TagState>::iterator t, cls_rgw_obj& obj)
+{
+  while (ios.size() >= max_aio)
+    handle_next_completion();
+
+  map<string, IoCtx>::iterator iter = ctxs.find(obj.pool);
+  if (iter == ctxs.end()) {
+    IoCtx ctx;
+    int ret = gc->open_pool_ctx(obj.pool, ctx);
+    if (ret < 0) {
+      dout(0) << "ERROR: failed to create ioctx pool=" << obj.pool << dendl;
+      t->failed = true;
+      gc->inc_removed(0, 0, 1);
+      return ret;
+    }
+    iter = ctxs.insert(make_pair(obj.pool, ctx)).first;
+  }
+  IoCtx& ctx = iter->second;
+
+  ctx.locator_set_key(obj.key);
+  dout(20) << "gc::process: removing " << obj.pool << ":" << obj.oid << dendl;
+  ObjectWriteOperation op;
+  cls_refcount_put(op, t->tag, true);
+
+  IO io;
+  io.c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+  io.tag = t;
+  io.obj = obj;
+  int ret = ctx.aio_operate(obj.oid, io.c, &op);
+  if (ret < 0) {
+    dout(0) << "failed to remove " << obj.pool << ":" << obj.oid << "@" << obj.key << " ret=" << ret << dendl;
+    io.c->release();
+    t->failed = true;
+    gc->inc_removed(0, 0, 1);
+    return ret;
+  }
+  t->pending++;
+  t->objs++;
+  ios.push_back(io);
+  return 0;
+}
+
+void RGWGCIOManager::handle_next_completion()
+{
+  IO& io = ios.front();
+  io.c->wait_for_complete();
+  int ret = io.c->get_return_value();
+  io.c->release();
+
+  if (ret == -ENOENT)
+    ret = 0;
+  list<TagState>::iterator t = io.tag;
+  if (ret < 0) {
+    dout(0) << "failed to remove " << io.obj.pool << ":" << io.obj.oid << "@" << io.obj.key << " ret=" << ret << dendl;
+    t->failed = true;
+    gc->inc_removed(0, 0, 1);
+  }
+  ios.pop_front();
+
+  t->pending--;
+  check_tag(t);
+}
+
+void RGWGCIOManager::check_tag(list<TagState>::iterator t)
+{
+  if (!t->scheduled || t->pending > 0)
+    return;
+
+  if (!t->failed) {
+    gc->inc_removed(1, t->objs, 0);
+    remove_tags.push_back(t->tag);
+    if ((int)remove_tags.size() >= cct->_conf->rgw_gc_max_trim_chunk)
+      flush_remove();
+  }
+  tags.erase(t);
+}
+
+void RGWGCIOManager::flush_remove()
+{
+  if (remove_tags.empty())
+    return;
+
+  int ret = gc->remove(index, remove_tags);
+  if (ret < 0)
+    dout(0) << "WARNING: failed to remove tags on gc shard index=" << index << " ret=" << ret << dendl;
+  remove_tags.clear();
+}
+
+void RGWGCIOManager::drain()
+{
+  while (!ios.empty())
+    handle_next_completion();
+  flush_remove();
+}
+
 int RGWGC::process(int index, int max_secs)
 {
   rados::cls::lock::Lock l(gc_index_lock_name);
   utime_t end = ceph_clock_now(g_ceph_context);
-  std::list<string> remove_tags;
 
   /* max_secs should be greater than zero. We don't want a zero max_secs
    * to be translated as no timeout, since we'd then need to break the
@@ -146,87 +313,86 @@ int RGWGC::process(int index, int max_secs)
   if (ret < 0)
     return ret;
 
+  if (perfcounter)
+    perfcounter->inc(l_rgw_gc_shards_active);
+
   string marker;
   bool truncated;
-  IoCtx *ctx = NULL;
-  do {
-    int max = 100;
-    std::list<cls_rgw_gc_obj_info> entries;
-    ret = cls_rgw_gc_list(store->gc_pool_ctx, obj_names[index], marker, max, entries, &truncated);
-    if (ret == -ENOENT) {
-      ret = 0;
-      goto done;
-    }
-    if (ret < 0)
-      goto done;
+  {
+    RGWGCIOManager io_manager(cct, this, index);
+    do {
+      int max = 100;
+      std::list<cls_rgw_gc_obj_info> entries;
+      ret = cls_rgw_gc_list(store->gc_pool_ctx, obj_names[index], marker, max, entries, &truncated);
+      if (ret == -ENOENT) {
+        ret = 0;
+        goto done;
+      }
+      if (ret < 0)
+        goto done;
 
-    string last_pool;
-    ctx = new IoCtx;
-    std::list<cls_rgw_gc_obj_info>::iterator iter;
-    for (iter = entries.begin(); iter != entries.end(); ++iter) {
-      bool remove_tag;
-      cls_rgw_gc_obj_info& info = *iter;
-      std::list<cls_rgw_obj>::iterator liter;
-      cls_rgw_obj_chain& chain = info.chain;
+      std::list<cls_rgw_gc_obj_info>::iterator iter;
+      for (iter = entries.begin(); iter != entries.end(); ++iter) {
+        cls_rgw_gc_obj_info& info = *iter;
+        std::list<cls_rgw_obj>::iterator liter;
+        cls_rgw_obj_chain& chain = info.chain;
 
-      utime_t now = ceph_clock_now(g_ceph_context);
-      if (now >= end)
-        goto done;
+        gc_time_marker(info.time, &marker);
 
-      remove_tag = true;
-      for (liter = chain.objs.begin(); liter != chain.objs.end(); ++liter) {
-        cls_rgw_obj& obj = *liter;
+        utime_t now = ceph_clock_now(g_ceph_context);
+        if (now >= end)
+          goto done;
 
-        if (obj.pool != last_pool) {
-          if (ctx) {
-            delete ctx;
-            ctx = new IoCtx;
+        std::list<RGWGCIOManager::TagState>::iterator t = io_manager.add_tag(info.tag);
+        for (liter = chain.objs.begin(); liter != chain.objs.end(); ++liter) {
+          if (going_down()) { // leave early, the tag stays for the next run
+            t->failed = true;
+            break;
           }
-	  ret = store->rados->ioctx_create(obj.pool.c_str(), *ctx);
-	  if (ret < 0) {
-	    dout(0) << "ERROR: failed to create ioctx pool=" << obj.pool << dendl;
-	    continue;
-	  }
-          last_pool = obj.pool;
-        }
-
-        ctx->locator_set_key(obj.key);
-	dout(0) << "gc::process: removing " << obj.pool << ":" << obj.oid << dendl;
-	ObjectWriteOperation op;
-	cls_refcount_put(op, info.tag, true);
-        ret = ctx->operate(obj.oid, &op);
-	if (ret == -ENOENT)
-	  ret = 0;
-        if (ret < 0) {
-          remove_tag = false;
-          dout(0) << "failed to remove " << obj.pool << ":" << obj.oid << "@" << obj.key << dendl;
+          io_manager.schedule_io(t, *liter);
         }
+        io_manager.tag_scheduled(t);
 
-        if (going_down()) // leave early, even if tag isn't removed, it's ok
+        if (going_down())
           goto done;
       }
-      if (remove_tag) {
-        remove_tags.push_back(info.tag);
-#define MAX_REMOVE_CHUNK 16
-        if (remove_tags.size() > MAX_REMOVE_CHUNK) {
-          remove(index, remove_tags);
-          remove_tags.clear();
-        }
-      }
-    }
-  } while (truncated);
+    } while (truncated);
 
 done:
-  if (remove_tags.size())
-    remove(index, remove_tags);
+    io_manager.drain();
+  }
+
+  if (perfcounter)
+    perfcounter->dec(l_rgw_gc_shards_active);
+
   l.unlock(&store->gc_pool_ctx, obj_names[index]);
-  delete ctx;
   return 0;
 }
 
+bool RGWGC::next_shard(int *index)
+{
+  Mutex::Locker l(shard_lock);
+  if (shards_taken >= max_objs || going_down())
+    return false;
+
+  *index = (shard_start + shards_taken) % max_objs;
+  shards_taken++;
+  return true;
+}
+
+void *RGWGC::GCShardWorker::entry()
+{
+  int index;
+  while (gc->next_shard(&index)) {
+    int r = gc->process(index, max_secs);
+    if (r < 0 && ret == 0)
+      ret = r;
+  }
+  return NULL;
+}
+
 int RGWGC::process()
 {
-  int max_objs = cct->_conf->rgw_gc_max_objs;
   int max_secs = cct->_conf->rgw_gc_processor_max_time;
 
   unsigned start;
@@ -234,12 +400,93 @@ int RGWGC::process()
   if (ret < 0)
     return ret;
 
-  for (int i = 0; i < max_objs; i++) {
-    int index = (i + start) % max_objs;
-    ret = process(index, max_secs);
+  shard_lock.Lock();
+  shard_start = start;
+  shards_taken = 0;
+  shard_lock.Unlock();
+
+  int num_workers = cct->_conf->rgw_gc_max_concurrent_shards;
+  if (num_workers > max_objs)
+    num_workers = max_objs;
+  if (num_workers < 1)
+    num_workers = 1;
+
+  vector<GCShardWorker *> workers;
+  for (int i = 0; i < num_workers; i++) {
+    GCShardWorker *w = new GCShardWorker(this, max_secs);
+    w->create();
+    workers.push_back(w);
+  }
+
+  ret = 0;
+  for (vector<GCShardWorker *>::iterator iter = workers.begin(); iter != workers.end(); ++iter) {
+    GCShardWorker *w = *iter;
+    w->join();
+    if (w->get_ret() < 0 && ret == 0)
+      ret = w->get_ret();
+    delete w;
+  }
+
+  return ret;
+}
+
+int RGWGC::open_pool_ctx(const string& pool, IoCtx& ctx)
+{
+  return store->rados->ioctx_create(pool.c_str(), ctx);
+}
+
+void RGWGC::inc_removed(uint64_t chains, uint64_t objs, uint64_t failed)
+{
+  if (chains)
+    chains_removed.add(chains);
+  if (objs)
+    objs_removed.add(objs);
+  if (failed)
+    remove_failed.add(failed);
+
+  if (perfcounter) {
+    if (chains)
+      perfcounter->inc(l_rgw_gc_chain_removed, chains);
+    if (objs)
+      perfcounter->inc(l_rgw_gc_obj_removed, objs);
+    if (failed)
+      perfcounter->inc(l_rgw_gc_remove_failed, failed);
+  }
+}
+
+void RGWGC::get_stats(RGWGCStats& stats)
+{
+  stats.chains_removed = chains_removed.read();
+  stats.objs_removed = objs_removed.read();
+  stats.remove_failed = remove_failed.read();
+}
+
+int RGWGC::shard_stats(int index, RGWGCShardStats& stats)
+{
+  stats = RGWGCShardStats();
+  stats.index = index;
+  stats.oid = obj_names[index];
+
+  string marker;
+  bool truncated;
+  do {
+    std::list<cls_rgw_gc_obj_info> entries;
+    int ret = cls_rgw_gc_list(store->gc_pool_ctx, obj_names[index], marker, 1000, entries, &truncated);
+    if (ret == -ENOENT)
+      return 0;
     if (ret < 0)
       return ret;
-  }
+
+    std::list<cls_rgw_gc_obj_info>::iterator iter;
+    for (iter = entries.begin(); iter != entries.end(); ++iter) {
+      cls_rgw_gc_obj_info& info = *iter;
+      if (stats.chains == 0 || info.time < stats.oldest)
+        stats.oldest = info.time;
+      stats.chains++;
+      stats.objs += info.chain.objs.size();
+      gc_time_marker(info.time, &marker);
+    }
+  } while (truncated);
 
   return 0;
 }
@@ -12,6 +12,28 @@
 #include "rgw_rados.h"
 #include "cls/rgw/cls_rgw_types.h"
 
+class RGWGCIOManager;
+
+/* totals of what gc processing removed since startup */
+struct RGWGCStats {
+  uint64_t chains_removed;
+  uint64_t objs_removed;
+  uint64_t remove_failed;
+
+  RGWGCStats() : chains_removed(0), objs_removed(0), remove_failed(0) {}
+};
+
+/* the expired chains waiting in one gc shard */
+struct RGWGCShardStats {
+  int index;
+  string oid;
+  uint64_t chains;
+  uint64_t objs;
+  utime_t oldest; /* expiration time of the oldest chain */
+
+  RGWGCShardStats() : index(0), chains(0), objs(0) {}
+};
+
 class RGWGC {
   CephContext *cct;
   RGWRados *store;
@@ -33,9 +55,40 @@ class RGWGC {
     void stop();
   };
 
+  /*
+   * Processes shards for a single process() run, taking them from
+   * next_shard() until none are left.
+   */
+  class GCShardWorker : public Thread {
+    RGWGC *gc;
+    int max_secs;
+    int ret;
+
+  public:
+    GCShardWorker(RGWGC *_gc, int _max_secs) : gc(_gc), max_secs(_max_secs), ret(0) {}
+    void *entry();
+    int get_ret() { return ret; }
+  };
+
   GCWorker *worker;
+
+  Mutex shard_lock;
+  unsigned shard_start;
+  int shards_taken;
+
+  bool next_shard(int *index);
+
+  atomic_t chains_removed;
+  atomic_t objs_removed;
+  atomic_t remove_failed;
+
+  friend class RGWGCIOManager;
+  int open_pool_ctx(const string& pool, librados::IoCtx& ctx);
+  void inc_removed(uint64_t chains, uint64_t objs, uint64_t failed);
+
 public:
-  RGWGC() : cct(NULL), store(NULL), max_objs(0), obj_names(NULL), worker(NULL) {}
+  RGWGC() : cct(NULL), store(NULL), max_objs(0), obj_names(NULL), worker(NULL),
+            shard_lock("RGWGC::shard_lock"), shard_start(0), shards_taken(0) {}
   ~RGWGC() {
     stop_processor();
     finalize();
@@ -54,6 +107,9 @@ public:
   int process(int index, int process_max_secs);
   int process();
 
+  int shard_stats(int index, RGWGCShardStats& stats);
+  void get_stats(RGWGCStats& stats);
+
   bool going_down();
   void start_processor();
   void stop_processor();
@@ -0,0 +1,887 @@
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "common/Clock.h"
+#include "common/config.h"
+#include "common/debug.h"
+#include "common/errno.h"
+#include "include/stringify.h"
+
+#include "rgw_http_frontend.h"
+
+#define dout_subsys ceph_subsys_rgw
+
+#define RGW_HTTP_BACKLOG 1024
+#define RGW_HTTP_READ_SIZE 16384
+#define RGW_HTTP_MAX_LINE 16384
+#define RGW_HTTP_MAX_HEADERS 100
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+static const char *http_reason(int status)
+{
+  switch (status) {
+  case 100: return "Continue";
+  case 200: return "OK";
+  case 201: return "Created";
+  case 202: return "Accepted";
+  case 204: return "No Content";
+  case 206: return "Partial Content";
+  case 301: return "Moved Permanently";
+  case 304: return "Not Modified";
+  case 400: return "Bad Request";
+  case 401: return "Unauthorized";
+  case 403: return "Forbidden";
+  case 404: return "Not Found";
+  case 405: return "Method Not Allowed";
+  case 408: return "Request Timeout";
+  case 409: return "Conflict";
+  case 411: return "Length Required";
+  case 412: return "Precondition Failed";
+  case 413: return "Request Entity Too Large";
+  case 416: return "Requested Range Not Satisfiable";
+  case 417: return "Expectation Failed";
+  case 500: return "Internal Server Error";
+  case 501: return "Not Implemented";
+  case 503: return "Service Unavailable";
+  }
+  return "Unknown";
+}
+
+static void trim(string& s)
+{
+  size_t start = s.find_first_not_of(" \t");
+  if (start == string::npos) {
+    s.clear();
+    return;
+  }
+  size_t end = s.find_last_not_of(" \t");
+  s = s.substr(start, end - start + 1);
+}
+
+/* find the blank line that ends a block of headers */
+static bool find_header_end(const string& s, size_t *body)
+{
+  size_t ofs = 0;
+  for (;;) {
+    size_t nl = s.find('\n', ofs);
+    if (nl == string::npos)
+      return false;
+    if (nl == ofs || (nl == ofs + 1 && s[ofs] == '\r')) {
+      *body = nl + 1;
+      return true;
+    }
+    ofs = nl + 1;
+  }
+}
+
+RGWHTTPConnection::RGWHTTPConnection(CephContext *_cct, int _fd, int _port,
+                                     const string& _remote_addr)
+  : cct(_cct), fd(_fd), port(_port), remote_addr(_remote_addr), in_ofs(0)
+{
+  last_active = ceph_clock_now(cct);
+}
+
+RGWHTTPConnection::~RGWHTTPConnection()
+{
+  ::close(fd);
+}
+
+int RGWHTTPConnection::read(char *buf, int max)
+{
+  if (in_ofs < in_buf.size()) {
+    int len = min((size_t)max, in_buf.size() - in_ofs);
+    memcpy(buf, in_buf.data() + in_ofs, len);
+    in_ofs += len;
+    if (in_ofs == in_buf.size()) {
+      in_buf.clear();
+      in_ofs = 0;
+    }
+    return len;
+  }
+
+  for (;;) {
+    ssize_t r = ::recv(fd, buf, max, 0);
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      return -errno;
+    }
+    return r;
+  }
+}
+
+/*
+ * Read up to the next LF, and return the line without its line end.
+ */
+int RGWHTTPConnection::read_line(string& line)
+{
+  for (;;) {
+    size_t nl = in_buf.find('\n', in_ofs);
+    if (nl != string::npos) {
+      size_t end = nl;
+      if (end > in_ofs && in_buf[end - 1] == '\r')
+        end--;
+      line = in_buf.substr(in_ofs, end - in_ofs);
+      in_ofs = nl + 1;
+      if (in_ofs == in_buf.size()) {
+        in_buf.clear();
+        in_ofs = 0;
+      }
+      return 0;
+    }
+
+    if (in_buf.size() - in_ofs > RGW_HTTP_MAX_LINE)
+      return -E2BIG;
+
+    if (in_ofs) {
+      in_buf.erase(0, in_ofs);
+      in_ofs = 0;
+    }
+
+    char buf[RGW_HTTP_READ_SIZE];
+    ssize_t r = ::recv(fd, buf, sizeof(buf), 0);
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      return -errno;
+    }
+    if (r == 0)
+      return -EPIPE;
+    in_buf.append(buf, r);
+  }
+}
+
+int RGWHTTPConnection::send(struct iovec *iov, int count)
+{
+  while (count) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = min(count, IOV_MAX);
+
+    ssize_t r = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      return -errno;
+    }
+
+    /* skip what was sent, which may end inside an iovec */
+    while (count && (size_t)r >= iov->iov_len) {
+      r -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count) {
+      iov->iov_base = (char *)iov->iov_base + r;
+      iov->iov_len -= r;
+    }
+  }
+  return 0;
+}
+
+int RGWHTTPConnection::send(const string& s)
+{
+  struct iovec iov;
+  iov.iov_base = (void *)s.data();
+  iov.iov_len = s.size();
+  return send(&iov, 1);
+}
+
+RGWHTTPClientIO::RGWHTTPClientIO(RGWHTTPConnection *_conn)
+  : conn(_conn), http11(false), keep_alive(false), head_request(false),
+    expect_continue(false), continue_sent(false), chunked_in(false),
+    in_left(0), in_done(true), header_sent(false), body_allowed(true),
+    chunked_out(false), length_known(false), out_left(0), error(false)
+{
+}
+
+int RGWHTTPClientIO::bad_request(int r)
+{
+  keep_alive = false;
+  error = true;
+  conn->send("HTTP/1.1 400 Bad Request\r\n"
+             "Content-Length: 0\r\n"
+             "Connection: close\r\n\r\n");
+  return r;
+}
+
+int RGWHTTPClientIO::read_request()
+{
+  string line;
+  int r;
+
+  /* tolerate empty lines before the request line (RFC 2616 4.1) */
+  do {
+    r = conn->read_line(line);
+    if (r < 0) {
+      keep_alive = false;
+      error = true;
+      return r;
+    }
+  } while (line.empty());
+
+  size_t sp1 = line.find(' ');
+  size_t sp2 = line.rfind(' ');
+  if (sp1 == string::npos || sp1 == sp2)
+    return bad_request(-EINVAL);
+
+  string method = line.substr(0, sp1);
+  string uri = line.substr(sp1 + 1, sp2 - sp1 - 1);
+  string protocol = line.substr(sp2 + 1);
+
+  if (protocol == "HTTP/1.1")
+    http11 = true;
+  else if (protocol != "HTTP/1.0")
+    return bad_request(-EINVAL);
+
+  keep_alive = http11;
+  head_request = (method == "HEAD");
+
+  for (int i = 0; ; i++) {
+    r = conn->read_line(line);
+    if (r < 0)
+      return bad_request(r);
+    if (line.empty())
+      break;
+    if (i == RGW_HTTP_MAX_HEADERS)
+      return bad_request(-E2BIG);
+
+    size_t colon = line.find(':');
+    if (colon == string::npos || colon == 0)
+      return bad_request(-EINVAL);
+
+    string name = line.substr(0, colon);
+    string val = line.substr(colon + 1);
+    trim(val);
+
+    string env_name;
+    if (strcasecmp(name.c_str(), "Content-Type") == 0) {
+      env_name = "CONTENT_TYPE";
+    } else if (strcasecmp(name.c_str(), "Content-Length") == 0) {
+      env_name = "CONTENT_LENGTH";
+    } else {
+      env_name = "HTTP_";
+      for (string::iterator iter = name.begin(); iter != name.end(); ++iter) {
+        char c = *iter;
+        env_name.append(1, (c == '-' ? '_' : toupper(c)));
+      }
+    }
+
+    map<string, string>::iterator iter = env_map.find(env_name);
+    if (iter == env_map.end()) {
+      env_map[env_name] = val;
+    } else {
+      iter->second.append(",");
+      iter->second.append(val);
+    }
+  }
+
+  const char *connection = NULL;
+  map<string, string>::iterator iter = env_map.find("HTTP_CONNECTION");
+  if (iter != env_map.end())
+    connection = iter->second.c_str();
+  if (connection) {
+    if (strcasestr(connection, "close"))
+      keep_alive = false;
+    else if (strcasestr(connection, "keep-alive"))
+      keep_alive = true;
+  }
+  if (!conn->get_cct()->_conf->rgw_http_keepalive)
+    keep_alive = false;
+
+  iter = env_map.find("HTTP_EXPECT");
+  if (iter != env_map.end())
+    expect_continue = (strcasecmp(iter->second.c_str(), "100-continue") == 0);
+
+  iter = env_map.find("HTTP_TRANSFER_ENCODING");
+  if (iter != env_map.end() && strcasecmp(iter->second.c_str(), "chunked") == 0) {
+    chunked_in = true;
+    in_done = false;
+    /* rgw looks at Content-Length before Transfer-Encoding */
+    env_map.erase("CONTENT_LENGTH");
+  } else {
+    iter = env_map.find("CONTENT_LENGTH");
+    if (iter != env_map.end()) {
+      char *end;
+      in_left = strtoull(iter->second.c_str(), &end, 10);
+      if (*end)
+        return bad_request(-EINVAL);
+      in_done = (in_left == 0);
+    }
+  }
+
+  string script_uri = uri;
+  string query;
+  size_t pos = uri.find('?');
+  if (pos != string::npos) {
+    script_uri = uri.substr(0, pos);
+    query = uri.substr(pos + 1);
+  }
+
+  env_map["REQUEST_METHOD"] = method;
+  env_map["REQUEST_URI"] = uri;
+  env_map["SCRIPT_URI"] = script_uri;
+  env_map["QUERY_STRING"] = query;
+  env_map["SERVER_PROTOCOL"] = protocol;
+  env_map["SERVER_PORT"] = stringify(conn->get_port());
+  env_map["REMOTE_ADDR"] = conn->get_remote_addr();
+
+  for (iter = env_map.begin(); iter != env_map.end(); ++iter)
+    env_strs.push_back(iter->first + "=" + iter->second);
+  for (vector<string>::iterator siter = env_strs.begin(); siter != env_strs.end(); ++siter)
+    env_ptrs.push_back(siter->c_str());
+  env_ptrs.push_back(NULL);
+
+  return 0;
+}
+
+const char **RGWHTTPClientIO::envp()
+{
+  return &env_ptrs[0];
+}
+
+void RGWHTTPClientIO::send_continue()
+{
+  continue_sent = true;
+  if (conn->send("HTTP/1.1 100 Continue\r\n\r\n") < 0)
+    error = true;
+}
+
+int RGWHTTPClientIO::read_chunk_header()
+{
+  string line;
+  int r = conn->read_line(line);
+  if (r < 0)
+    return r;
+
+  char *end;
+  in_left = strtoull(line.c_str(), &end, 16);
+  if (end == line.c_str() || (*end && *end != ';' && *end != ' '))
+    return -EINVAL;
+
+  if (in_left)
+    return 0;
+
+  /* last chunk; skip the trailer */
+  do {
+    r = conn->read_line(line);
+    if (r < 0)
+      return r;
+  } while (!line.empty());
+  in_done = true;
+  return 0;
+}
+
+int RGWHTTPClientIO::read_data(char *buf, int max)
+{
+  int total = 0;
+  int r;
+  string line;
+
+  if (in_done || error)
+    return 0;
+
+  /* the client may be waiting for this before it sends the body */
+  if (expect_continue && !continue_sent && !header_sent)
+    send_continue();
+
+  while (total < max && !in_done) {
+    if (chunked_in && !in_left) {
+      r = read_chunk_header();
+      if (r < 0)
+        goto err;
+      continue;
+    }
+
+    r = conn->read(buf + total, min((uint64_t)(max - total), in_left));
+    if (r <= 0) {
+      if (!r)
+        r = -EPIPE;
+      goto err;
+    }
+    total += r;
+    in_left -= r;
+
+    if (!in_left) {
+      if (chunked_in) {
+        r = conn->read_line(line); /* the CRLF after the chunk data */
+        if (r < 0)
+          goto err;
+      } else {
+        in_done = true;
+      }
+    }
+  }
+  return total;
+
+err:
+  ldout(conn->get_cct(), 10) << "http: failed to read request body: " << cpp_strerror(-r) << dendl;
+  keep_alive = false;
+  error = true;
+  return r;
+}
+
+/*
+ * Turn the CGI headers rgw wrote ("Status: 200\n", ...) into the
+ * HTTP response headers, kept in head until there's more to send.
+ */
+void RGWHTTPClientIO::build_head(const string& cgi_header)
+{
+  int status = 200;
+  string headers;
+  size_t ofs = 0;
+
+  while (ofs < cgi_header.size()) {
+    size_t nl = cgi_header.find('\n', ofs);
+    if (nl == string::npos)
+      nl = cgi_header.size();
+    size_t end = nl;
+    if (end > ofs && cgi_header[end - 1] == '\r')
+      end--;
+    string line = cgi_header.substr(ofs, end - ofs);
+    ofs = nl + 1;
+
+    if (line.empty())
+      continue;
+
+    if (strncasecmp(line.c_str(), "Status:", 7) == 0) {
+      status = atoi(line.c_str() + 7);
+      continue;
+    }
+    if (strncasecmp(line.c_str(), "Content-Length:", 15) == 0) {
+      length_known = true;
+      out_left = strtoull(line.c_str() + 15, NULL, 10);
+    }
+    headers.append(line);
+    headers.append("\r\n");
+  }
+
+  body_allowed = !(head_request || status == 204 || status == 304 ||
+                   (status >= 100 && status < 200));
+  if (!body_allowed) {
+    length_known = false;
+  } else if (!length_known) {
+    if (http11)
+      chunked_out = true;
+    else
+      keep_alive = false; /* the end of the body is the end of the connection */
+  }
+
+  char buf[64];
+  snprintf(buf, sizeof(buf), "HTTP/1.1 %d ", status);
+  head = buf;
+  head.append(http_reason(status));
+  head.append("\r\n");
+  head.append(headers);
+  if (chunked_out)
+    head.append("Transfer-Encoding: chunked\r\n");
+  head.append(keep_alive ? "Connection: Keep-Alive\r\n" : "Connection: close\r\n");
+  head.append("\r\n");
+
+  header_sent = true;
+}
+
+/*
+ * Send part of the body, after any pending headers and framed as a
+ * chunk if need be, in a single sendmsg().
+ */
+int RGWHTTPClientIO::send_body(vector<struct iovec>& iov, uint64_t len)
+{
+  if (error)
+    return -EIO;
+  if (!body_allowed || !len) {
+    if (head.empty())
+      return 0;
+    iov.clear();
+  }
+
+  char chunk_header[32];
+  struct iovec h;
+  size_t first = 0;
+  if (!head.empty()) {
+    h.iov_base = (void *)head.data();
+    h.iov_len = head.size();
+    iov.insert(iov.begin(), h);
+    first++;
+  }
+  if (chunked_out && !iov.empty() && len && body_allowed) {
+    h.iov_base = chunk_header;
+    h.iov_len = snprintf(chunk_header, sizeof(chunk_header), "%llx\r\n", (unsigned long long)len);
+    iov.insert(iov.begin() + first, h);
+    h.iov_base = (void *)"\r\n";
+    h.iov_len = 2;
+    iov.push_back(h);
+  }
+
+  if (length_known && body_allowed)
+    out_left -= min(out_left, len);
+
+  int r = conn->send(&iov[0], iov.size());
+  head.clear();
+  if (r < 0) {
+    ldout(conn->get_cct(), 10) << "http: failed to send response: " << cpp_strerror(-r) << dendl;
+    error = true;
+    keep_alive = false;
+    return r;
+  }
+  return 0;
+}
+
+int RGWHTTPClientIO::write_data(const char *buf, int len)
+{
+  vector<struct iovec> iov;
+
+  if (!header_sent) {
+    out_header.append(buf, len);
+    size_t body;
+    if (!find_header_end(out_header, &body))
+      return len;
+
+    build_head(out_header.substr(0, body));
+    if (body < out_header.size()) {
+      struct iovec v;
+      v.iov_base = (void *)(out_header.data() + body);
+      v.iov_len = out_header.size() - body;
+      iov.push_back(v);
+    }
+    int r = send_body(iov, out_header.size() - body);
+    out_header.clear();
+    return (r < 0 ? r : len);
+  }
+
+  if (!len)
+    return 0;
+
+  struct iovec v;
+  v.iov_base = (void *)buf;
+  v.iov_len = len;
+  iov.push_back(v);
+  int r = send_body(iov, len);
+  return (r < 0 ? r : len);
+}
+
+int RGWHTTPClientIO::write_buffers(bufferlist& bl)
+{
+  if (!header_sent)
+    return RGWClientIO::write_buffers(bl);
+
+  vector<struct iovec> iov;
+  for (std::list<bufferptr>::const_iterator iter = bl.buffers().begin();
+       iter != bl.buffers().end(); ++iter) {
+    if (!iter->length())
+      continue;
+    struct iovec v;
+    v.iov_base = (void *)iter->c_str();
+    v.iov_len = iter->length();
+    iov.push_back(v);
+  }
+  return send_body(iov, bl.length());
+}
+
+void RGWHTTPClientIO::flush()
+{
+  if (!header_sent) {
+    /* rgw prints a "Status: 100" and flushes, to let the body come */
+    if (out_header.compare(0, 11, "Status: 100") == 0) {
+      out_header.clear();
+      if (expect_continue && !continue_sent)
+        send_continue();
+    }
+    return;
+  }
+
+  if (!head.empty()) {
+    vector<struct iovec> iov;
+    send_body(iov, 0);
+  }
+}
+
+bool RGWHTTPClientIO::complete()
+{
+  if (!header_sent && !error) {
+    if (out_header.empty()) {
+      /* nothing was ever written, most likely the request was not read */
+      return false;
+    }
+    build_head(out_header);
+    out_header.clear();
+  }
+
+  if (!error) {
+    vector<struct iovec> iov;
+    if (chunked_out) {
+      struct iovec v;
+      v.iov_base = (void *)"0\r\n\r\n";
+      v.iov_len = 5;
+      iov.push_back(v);
+      /* not through send_body(), which would frame it as a chunk */
+      chunked_out = false;
+      if (!head.empty()) {
+        v.iov_base = (void *)head.data();
+        v.iov_len = head.size();
+        iov.insert(iov.begin(), v);
+      }
+      if (conn->send(&iov[0], iov.size()) < 0)
+        error = true;
+      head.clear();
+    } else if (!head.empty()) {
+      send_body(iov, 0);
+    }
+  }
+
+  /* the client can't tell where the body ends */
+  if (length_known && out_left)
+    keep_alive = false;
+  /* or where its next request starts */
+  if (!in_done)
+    keep_alive = false;
+
+  conn->set_last_active(ceph_clock_now(conn->get_cct()));
+
+  return keep_alive && !error;
+}
+
+RGWHTTPFrontend::RGWHTTPFrontend(CephContext *_cct)
+  : cct(_cct), port(0), listen_fd(-1), stopping(false),
+    lock("RGWHTTPFrontend::lock")
+{
+  wake_fds[0] = wake_fds[1] = -1;
+}
+
+RGWHTTPFrontend::~RGWHTTPFrontend()
+{
+  list<RGWHTTPConnection *>::iterator iter;
+  for (iter = returned.begin(); iter != returned.end(); ++iter)
+    delete *iter;
+  for (iter = idle.begin(); iter != idle.end(); ++iter)
+    delete *iter;
+  for (iter = ready.begin(); iter != ready.end(); ++iter)
+    delete *iter;
+
+  if (listen_fd >= 0)
+    ::close(listen_fd);
+  if (wake_fds[0] >= 0) {
+    ::close(wake_fds[0]);
+    ::close(wake_fds[1]);
+  }
+}
+
+int RGWHTTPFrontend::init(const string& addr, int _port)
+{
+  port = _port;
+
+  if (::pipe(wake_fds) < 0) {
+    int err = errno;
+    ldout(cct, 0) << "ERROR: pipe() failed: " << cpp_strerror(err) << dendl;
+    return -err;
+  }
+  ::fcntl(wake_fds[0], F_SETFL, O_NONBLOCK);
+  ::fcntl(wake_fds[1], F_SETFL, O_NONBLOCK);
+
+  struct addrinfo hints, *res;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  string port_str = stringify(port);
+  int r = getaddrinfo(addr.empty() ? NULL : addr.c_str(), port_str.c_str(), &hints, &res);
+  if (r != 0) {
+    ldout(cct, 0) << "ERROR: cannot resolve " << addr << ": " << gai_strerror(r) << dendl;
+    return -EINVAL;
+  }
+
+  int err = 0;
+  for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+    int fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) {
+      err = errno;
+      continue;
+    }
+    int on = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (::bind(fd, ai->ai_addr, ai->ai_addrlen) < 0 ||
+        ::listen(fd, RGW_HTTP_BACKLOG) < 0) {
+      err = errno;
+      ::close(fd);
+      continue;
+    }
+    ::fcntl(fd, F_SETFL, O_NONBLOCK);
+    listen_fd = fd;
+    break;
+  }
+  freeaddrinfo(res);
+
+  if (listen_fd < 0) {
+    ldout(cct, 0) << "ERROR: cannot listen on " << addr << ":" << port
+                  << ": " << cpp_strerror(err) << dendl;
+    return -err;
+  }
+
+  ldout(cct, 0) << "http frontend listening on " << addr << ":" << port << dendl;
+  return 0;
+}
+
+void RGWHTTPFrontend::accept_connections()
+{
+  for (;;) {
+    struct sockaddr_storage ss;
+    socklen_t len = sizeof(ss);
+    int fd = ::accept(listen_fd, (struct sockaddr *)&ss, &len);
+    if (fd < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        ldout(cct, 0) << "WARNING: accept() failed: " << cpp_strerror(errno) << dendl;
+      return;
+    }
+
+    int on = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    /* don't let a stalled client hold on to a thread forever */
+    struct timeval tv;
+    tv.tv_sec = cct->_conf->rgw_http_timeout;
+    tv.tv_usec = 0;
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    char host[NI_MAXHOST];
+    if (getnameinfo((struct sockaddr *)&ss, len, host, sizeof(host), NULL, 0, NI_NUMERICHOST) != 0)
+      host[0] = '\0';
+
+    ldout(cct, 20) << "http: accepted connection from " << host << " fd=" << fd << dendl;
+
+    /* wait for its request in the poll loop, not in a worker */
+    idle.push_back(new RGWHTTPConnection(cct, fd, port, host));
+  }
+}
+
+void RGWHTTPFrontend::expire_idle(utime_t now)
+{
+  int timeout = cct->_conf->rgw_http_timeout;
+  if (timeout <= 0)
+    return;
+
+  list<RGWHTTPConnection *>::iterator iter = idle.begin();
+  while (iter != idle.end()) {
+    RGWHTTPConnection *conn = *iter;
+    if (now - conn->get_last_active() < utime_t(timeout, 0)) {
+      ++iter;
+      continue;
+    }
+    ldout(cct, 20) << "http: closing idle connection fd=" << conn->get_fd() << dendl;
+    delete conn;
+    idle.erase(iter++);
+  }
+}
+
+RGWHTTPConnection *RGWHTTPFrontend::get_connection()
+{
+  for (;;) {
+    if (stopping)
+      return NULL;
+
+    if (!ready.empty()) {
+      RGWHTTPConnection *conn = ready.front();
+      ready.pop_front();
+      return conn;
+    }
+
+    lock.Lock();
+    while (!returned.empty()) {
+      RGWHTTPConnection *conn = returned.front();
+      returned.pop_front();
+      /* a pipelined request may already be waiting */
+      if (conn->has_buffered_data())
+        ready.push_back(conn);
+      else
+        idle.push_back(conn);
+    }
+    lock.Unlock();
+
+    if (!ready.empty())
+      continue;
+
+    vector<struct pollfd> fds(idle.size() + 2);
+    fds[0].fd = wake_fds[0];
+    fds[0].events = POLLIN;
+    fds[1].fd = listen_fd;
+    fds[1].events = POLLIN;
+    size_t i = 2;
+    list<RGWHTTPConnection *>::iterator iter;
+    for (iter = idle.begin(); iter != idle.end(); ++iter, ++i) {
+      fds[i].fd = (*iter)->get_fd();
+      fds[i].events = POLLIN;
+    }
+
+    int r = ::poll(&fds[0], fds.size(), 1000);
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      ldout(cct, 0) << "ERROR: poll() failed: " << cpp_strerror(errno) << dendl;
+      return NULL;
+    }
+
+    if (fds[0].revents) {
+      char buf[64];
+      while (::read(wake_fds[0], buf, sizeof(buf)) > 0)
+        ;
+    }
+
+    /* readable, or closed: either way a worker will find out which */
+    i = 2;
+    iter = idle.begin();
+    while (iter != idle.end()) {
+      if (fds[i++].revents) {
+        ready.push_back(*iter);
+        idle.erase(iter++);
+      } else {
+        ++iter;
+      }
+    }
+
+    if (fds[1].revents)
+      accept_connections();
+
+    expire_idle(ceph_clock_now(cct));
+  }
+}
+
+void RGWHTTPFrontend::put_connection(RGWHTTPConnection *conn, bool keep_alive)
+{
+  if (!keep_alive || stopping) {
+    delete conn;
+    return;
+  }
+
+  lock.Lock();
+  returned.push_back(conn);
+  lock.Unlock();
+
+  /* if the pipe is full, the poll loop is already going to wake up */
+  int r = ::write(wake_fds[1], "x", 1);
+  (void)r;
+}
+
+void RGWHTTPFrontend::shutdown()
+{
+  stopping = true;
+  int r = ::write(wake_fds[1], "x", 1);
+  (void)r;
+}
@@ -0,0 +1,158 @@
+#ifndef CEPH_RGW_HTTP_FRONTEND_H
+#define CEPH_RGW_HTTP_FRONTEND_H
+
+#include <sys/uio.h>
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common/Mutex.h"
+#include "include/buffer.h"
+#include "include/utime.h"
+
+#include "rgw_client_io.h"
+
+class CephContext;
+
+/*
+ * A client connection to the embedded HTTP frontend.  It outlives the
+ * requests on it (keep-alive), and keeps whatever was read past the end
+ * of one request for the next.
+ */
+class RGWHTTPConnection
+{
+  CephContext *cct;
+  int fd;
+  int port;
+  string remote_addr;
+  utime_t last_active;
+
+  string in_buf; /* read from the socket, not consumed yet */
+  size_t in_ofs;
+
+public:
+  RGWHTTPConnection(CephContext *_cct, int _fd, int _port, const string& _remote_addr);
+  ~RGWHTTPConnection();
+
+  int read(char *buf, int max);
+  int read_line(string& line);
+  int send(struct iovec *iov, int count);
+  int send(const string& s);
+
+  bool has_buffered_data() { return in_ofs < in_buf.size(); }
+
+  CephContext *get_cct() { return cct; }
+  int get_fd() { return fd; }
+  int get_port() { return port; }
+  const string& get_remote_addr() { return remote_addr; }
+  utime_t get_last_active() { return last_active; }
+  void set_last_active(utime_t t) { last_active = t; }
+};
+
+/*
+ * Client io for one request on an RGWHTTPConnection.  Turns the HTTP
+ * request into the CGI environment the rest of rgw expects, and the CGI
+ * response headers rgw writes back into an HTTP/1.1 response, framed
+ * with Content-Length when rgw sent one and chunked otherwise.
+ */
+class RGWHTTPClientIO : public RGWClientIO
+{
+  RGWHTTPConnection *conn;
+
+  map<string, string> env_map;
+  vector<string> env_strs;
+  vector<const char *> env_ptrs;
+
+  bool http11;
+  bool keep_alive;
+  bool head_request;
+  bool expect_continue;
+  bool continue_sent;
+
+  bool chunked_in;
+  uint64_t in_left;  /* body left to read, or left of the current chunk */
+  bool in_done;
+
+  string out_header; /* CGI headers written so far */
+  string head;       /* HTTP response headers not sent yet */
+  bool header_sent;
+  bool body_allowed;
+  bool chunked_out;
+  bool length_known;
+  uint64_t out_left;
+  bool error;
+
+  int bad_request(int r);
+  int read_chunk_header();
+  void send_continue();
+  void build_head(const string& cgi_header);
+  int send_body(vector<struct iovec>& iov, uint64_t len);
+
+protected:
+  int write_data(const char *buf, int len);
+  int write_buffers(bufferlist& bl);
+  int read_data(char *buf, int max);
+
+public:
+  RGWHTTPClientIO(RGWHTTPConnection *_conn);
+
+  /*
+   * Read the request line and headers.  Returns -EPIPE if the client
+   * closed the connection instead of sending another request.
+   */
+  int read_request();
+
+  /*
+   * Finish the response.  Returns true if the connection can carry
+   * another request.
+   */
+  bool complete();
+
+  void flush();
+  const char **envp();
+
+  RGWHTTPConnection *get_connection() { return conn; }
+};
+
+/*
+ * Listens for HTTP connections, and watches the idle keep-alive ones
+ * for their next request.  get_connection() is called from a single
+ * thread (the accept loop); put_connection() from any.
+ */
+class RGWHTTPFrontend
+{
+  CephContext *cct;
+  int port;
+  int listen_fd;
+  int wake_fds[2];
+  volatile bool stopping;
+
+  Mutex lock;
+  list<RGWHTTPConnection *> returned; /* put back, not seen by the poll loop yet */
+
+  list<RGWHTTPConnection *> idle;
+  list<RGWHTTPConnection *> ready;
+
+  void accept_connections();
+  void expire_idle(utime_t now);
+
+public:
+  RGWHTTPFrontend(CephContext *_cct);
+  ~RGWHTTPFrontend();
+
+  int init(const string& addr, int _port);
+
+  /*
+   * Wait for a connection with a request to read on it.  Returns NULL
+   * once shutdown() was called.
+   */
+  RGWHTTPConnection *get_connection();
+  void put_connection(RGWHTTPConnection *conn, bool keep_alive);
+
+  /* may be called from a signal handler */
+  void shutdown();
+};
+
+#endif
@@ -132,6 +132,7 @@ public:
     usage_map[ub].insert(round_timestamp, entry, &account);
     if (account)
       num_entries++;
+    perfcounter->inc(l_rgw_usage_log_entries);
     bool need_flush = (num_entries > cct->_conf->rgw_usage_log_flush_threshold);
     lock.Unlock();
     if (need_flush) {
@@ -147,6 +148,10 @@ public:
     num_entries = 0;
     lock.Unlock();
 
+    if (old_map.empty())
+      return;
+
+    perfcounter->inc(l_rgw_usage_log_flush);
     store->log_usage(old_map);
   }
 };
@@ -164,6 +169,116 @@ void rgw_log_usage_finalize()
   usage_logger = NULL;
 }
 
+/*
+ * ops logger: gathers the entries for each log object, and writes them
+ * with a single append every rgw_ops_log_flush_interval seconds, or once
+ * rgw_ops_log_flush_size bytes are pending.  At most
+ * rgw_ops_log_max_pending bytes are kept; entries beyond that are
+ * dropped (and counted), rather than holding up requests.
+ */
+class OpsLogger {
+  CephContext *cct;
+  RGWRados *store;
+  map<string, bufferlist> pending; /* log object -> encoded entries */
+  uint64_t pending_bytes;
+  Mutex lock;
+  Mutex timer_lock;
+  SafeTimer timer;
+
+  class C_OpsLogTimeout : public Context {
+    OpsLogger *logger;
+  public:
+    C_OpsLogTimeout(OpsLogger *_l) : logger(_l) {}
+    void finish(int r) {
+      logger->flush();
+      logger->set_timer();
+    }
+  };
+
+  void set_timer() {
+    timer.add_event_after(cct->_conf->rgw_ops_log_flush_interval, new C_OpsLogTimeout(this));
+  }
+
+  int append(string& oid, bufferlist& bl) {
+    rgw_obj obj(store->params.log_pool, oid);
+
+    int ret = store->append_async(obj, bl.length(), bl);
+    if (ret == -ENOENT) {
+      ret = store->create_pool(store->params.log_pool);
+      if (ret < 0)
+        return ret;
+      // retry
+      ret = store->append_async(obj, bl.length(), bl);
+    }
+    return ret;
+  }
+public:
+
+  OpsLogger(CephContext *_cct, RGWRados *_store) : cct(_cct), store(_store), pending_bytes(0), lock("OpsLogger"), timer_lock("OpsLogger::timer_lock"), timer(cct, timer_lock) {
+    timer.init();
+    Mutex::Locker l(timer_lock);
+    set_timer();
+  }
+
+  ~OpsLogger() {
+    Mutex::Locker l(timer_lock);
+    flush();
+    timer.cancel_all_events();
+    timer.shutdown();
+  }
+
+  void insert(const string& oid, bufferlist& bl) {
+    lock.Lock();
+    if (pending_bytes + bl.length() > (uint64_t)cct->_conf->rgw_ops_log_max_pending) {
+      lock.Unlock();
+      ldout(cct, 10) << "ops log backlog full, dropping entry for " << oid << dendl;
+      perfcounter->inc(l_rgw_ops_log_drop);
+      return;
+    }
+    pending[oid].append(bl);
+    pending_bytes += bl.length();
+    perfcounter->inc(l_rgw_ops_log_entries);
+    perfcounter->set(l_rgw_ops_log_pending, pending_bytes);
+    bool need_flush = (pending_bytes >= (uint64_t)cct->_conf->rgw_ops_log_flush_size);
+    lock.Unlock();
+    if (need_flush) {
+      Mutex::Locker l(timer_lock);
+      flush();
+    }
+  }
+
+  void flush() {
+    map<string, bufferlist> old_pending;
+    lock.Lock();
+    old_pending.swap(pending);
+    pending_bytes = 0;
+    perfcounter->set(l_rgw_ops_log_pending, 0);
+    lock.Unlock();
+
+    map<string, bufferlist>::iterator iter;
+    for (iter = old_pending.begin(); iter != old_pending.end(); ++iter) {
+      string oid = iter->first;
+      int ret = append(oid, iter->second);
+      if (ret < 0)
+        ldout(cct, 0) << "ERROR: failed to write ops log to " << oid << " ret=" << ret << dendl;
+      perfcounter->inc(l_rgw_ops_log_flush);
+    }
+  }
+};
+
+static OpsLogger *ops_logger = NULL;
+
+void rgw_log_ops_init(CephContext *cct, RGWRados *store)
+{
+  ops_logger = new OpsLogger(cct, store);
+}
+
+void rgw_log_ops_finalize()
+{
+  delete ops_logger;
+  ops_logger = NULL;
+}
+
 static void log_usage(struct req_state *s, const string& op_name)
 {
   if (!usage_logger)
@@ -339,15 +454,19 @@ int rgw_log_op(RGWRados *store, struct req_state *s, const string& op_name, OpsL
     string oid = render_log_object_name(s->cct->_conf->rgw_log_object_name, &bdt,
 				        s->bucket.bucket_id, entry.bucket.c_str());
 
-    rgw_obj obj(store->params.log_pool, oid);
+    if (ops_logger) {
+      ops_logger->insert(oid, bl);
+    } else {
+      rgw_obj obj(store->params.log_pool, oid);
 
-    ret = store->append_async(obj, bl.length(), bl);
-    if (ret == -ENOENT) {
-      ret = store->create_pool(store->params.log_pool);
-      if (ret < 0)
-        goto done;
-      // retry
       ret = store->append_async(obj, bl.length(), bl);
+      if (ret == -ENOENT) {
+        ret = store->create_pool(store->params.log_pool);
+        if (ret < 0)
+          goto done;
+        // retry
+        ret = store->append_async(obj, bl.length(), bl);
+      }
     }
   }
 
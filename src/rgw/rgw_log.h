@@ -137,6 +137,8 @@ int rgw_log_intent(RGWRados *store, rgw_obj& obj, RGWIntentEvent intent, const u
 int rgw_log_intent(RGWRados *store, struct req_state *s, rgw_obj& obj, RGWIntentEvent intent);
 void rgw_log_usage_init(CephContext *cct, RGWRados *store);
 void rgw_log_usage_finalize();
+void rgw_log_ops_init(CephContext *cct, RGWRados *store);
+void rgw_log_ops_finalize();
 void rgw_format_ops_log_entry(struct rgw_log_entry& entry, Formatter *formatter);
 
 #endif
@@ -18,6 +18,7 @@
 #endif
 
 #include "rgw_fcgi.h"
+#include "rgw_http_frontend.h"
 
 #include "common/ceph_argparse.h"
 #include "global/global_init.h"
@@ -41,6 +42,7 @@
 #include "rgw_swift_auth.h"
 #include "rgw_swift.h"
 #include "rgw_log.h"
+#include "rgw_put_hash.h"
 #include "rgw_tools.h"
 #include "rgw_resolve.h"
 
@@ -68,21 +70,39 @@ static RGWProcess *pprocess = NULL;
 
 #define SOCKET_BACKLOG 1024
 
-struct RGWRequest
+struct RGWRequest : public RGWResumeCB
 {
-  FCGX_Request fcgx;
   uint64_t id;
   struct req_state *s;
   string req_str;
   RGWOp *op;
   utime_t ts;
-
-  RGWRequest() : id(0), s(NULL), op(NULL) {
+  RGWEnv env;
+  RGWClientIO *client_io;
+  RGWHandler *handler;
+  RGWProcess *process;
+  bool started;
+
+  Mutex lock;
+  bool running; /* queued or being handled by a thread */
+  bool resumed; /* resume() was called while running */
+
+  RGWRequest(RGWProcess *p) : id(0), s(NULL), op(NULL), client_io(NULL),
+                              handler(NULL), process(p), started(false),
+                              lock("RGWRequest::lock"), running(true),
+                              resumed(false) {
   }
 
-  ~RGWRequest() {
+  virtual ~RGWRequest() {
     delete s;
   }
+
+  void resume();
+
+  /* read the request from the client, and set up env from it */
+  virtual int init_env(CephContext *cct) = 0;
+  /* the response is complete, let the client know */
+  virtual void finish() = 0;
  
   req_state *init_state(CephContext *cct, RGWEnv *env) { 
     s = new req_state(cct, env);
@@ -117,6 +137,46 @@ struct RGWRequest
   }
 };
 
+struct RGWFCGXRequest : public RGWRequest {
+  FCGX_Request fcgx;
+  RGWFCGX fcgx_io;
+
+  RGWFCGXRequest(RGWProcess *p) : RGWRequest(p), fcgx_io(&fcgx) {
+    client_io = &fcgx_io;
+  }
+
+  int init_env(CephContext *cct) {
+    env.init(cct, fcgx.envp);
+    return 0;
+  }
+
+  void finish() {
+    FCGX_Finish_r(&fcgx);
+  }
+};
+
+struct RGWHTTPRequest : public RGWRequest {
+  RGWHTTPFrontend *frontend;
+  RGWHTTPClientIO http_io;
+
+  RGWHTTPRequest(RGWProcess *p, RGWHTTPFrontend *f, RGWHTTPConnection *conn)
+    : RGWRequest(p), frontend(f), http_io(conn) {
+    client_io = &http_io;
+  }
+
+  int init_env(CephContext *cct) {
+    int r = http_io.read_request();
+    if (r < 0)
+      return r;
+    env.init(cct, (char **)http_io.envp());
+    return 0;
+  }
+
+  void finish() {
+    frontend->put_connection(http_io.get_connection(), http_io.complete());
+  }
+};
+
 class RGWProcess {
   RGWRados *store;
   OpsLogSocket *olog;
@@ -125,6 +185,7 @@ class RGWProcess {
   Throttle req_throttle;
   RGWREST *rest;
   int sock_fd;
+  RGWHTTPFrontend *http;
 
   struct RGWWQ : public ThreadPool::WorkQueue<RGWRequest> {
     RGWProcess *process;
@@ -156,8 +217,13 @@ class RGWProcess {
     }
     void _process(RGWRequest *req) {
       perfcounter->inc(l_rgw_qactive);
-      process->handle_request(req);
-      process->req_throttle.put(1);
+      bool done;
+      if (!req->started)
+        done = process->handle_request(req);
+      else
+        done = process->resume_request(req);
+      if (done)
+        process->req_throttle.put(1);
       perfcounter->inc(l_rgw_qactive, -1);
     }
     void _dump_queue() {
@@ -178,24 +244,49 @@ class RGWProcess {
 
   uint64_t max_req_id;
 
+  bool continue_request(RGWRequest *req);
+  void finish_request(RGWRequest *req);
+
+  void run_fcgi();
+  void run_http();
+
 public:
   RGWProcess(CephContext *cct, RGWRados *rgwstore, OpsLogSocket *_olog, int num_threads, RGWREST *_rest)
     : store(rgwstore), olog(_olog), m_tp(cct, "RGWProcess::m_tp", num_threads),
-      req_throttle(cct, "rgw_ops", num_threads * 2),
-      rest(_rest), sock_fd(-1),
+      req_throttle(cct, "rgw_ops", (g_conf->rgw_async_ops ?
+                                    g_conf->rgw_max_concurrent_requests :
+                                    num_threads * 2)),
+      rest(_rest), sock_fd(-1), http(NULL),
       req_wq(this, g_conf->rgw_op_thread_timeout,
 	     g_conf->rgw_op_thread_suicide_timeout, &m_tp),
       max_req_id(0) {}
   void run();
-  void handle_request(RGWRequest *req);
+  bool handle_request(RGWRequest *req);
+  bool resume_request(RGWRequest *req);
+  void queue_request(RGWRequest *req) {
+    req_wq.queue(req);
+  }
 
   void close_fd() {
-    if (sock_fd >= 0)
+    if (http)
+      http->shutdown();
+    else if (sock_fd >= 0)
       close(sock_fd);
   }
 };
 
 void RGWProcess::run()
+{
+  if (g_conf->rgw_frontend == "http") {
+    run_http();
+  } else if (g_conf->rgw_frontend == "fastcgi") {
+    run_fcgi();
+  } else {
+    dout(0) << "ERROR: unknown rgw_frontend " << g_conf->rgw_frontend << dendl;
+  }
+}
+
+void RGWProcess::run_fcgi()
 {
   sock_fd = 0;
   if (!g_conf->rgw_socket_path.empty()) {
@@ -228,7 +319,7 @@ void RGWProcess::run()
   m_tp.start();
 
   for (;;) {
-    RGWRequest *req = new RGWRequest;
+    RGWFCGXRequest *req = new RGWFCGXRequest(this);
     req->id = ++max_req_id;
     dout(10) << "allocated request req=" << hex << req << dec << dendl;
     FCGX_InitRequest(&req->fcgx, sock_fd, 0);
@@ -247,6 +338,39 @@ void RGWProcess::run()
   m_tp.stop();
 }
 
+void RGWProcess::run_http()
+{
+  http = new RGWHTTPFrontend(g_ceph_context);
+  int r = http->init(g_conf->rgw_http_addr, g_conf->rgw_http_port);
+  if (r < 0) {
+    delete http;
+    http = NULL;
+    return;
+  }
+
+  m_tp.start();
+
+  for (;;) {
+    req_throttle.get(1);
+    RGWHTTPConnection *conn = http->get_connection();
+    if (!conn) {
+      req_throttle.put(1);
+      break;
+    }
+
+    RGWRequest *req = new RGWHTTPRequest(this, http, conn);
+    req->id = ++max_req_id;
+    dout(10) << "allocated request req=" << hex << req << dec << dendl;
+    req_wq.queue(req);
+  }
+
+  m_tp.stop();
+
+  /* the workers handed their connections back by now */
+  delete http;
+  http = NULL;
+}
+
 static void godown_handler(int signum)
 {
   FCGX_ShutdownPending();
@@ -268,21 +392,46 @@ static int call_log_intent(RGWRados *store, void *ctx, rgw_obj& obj, RGWIntentEv
   return rgw_log_intent(store, s, obj, intent);
 }
 
-void RGWProcess::handle_request(RGWRequest *req)
+void RGWRequest::resume()
+{
+  lock.Lock();
+  if (running) {
+    /* the thread that has it will go on with it */
+    resumed = true;
+    lock.Unlock();
+    return;
+  }
+  running = true;
+  lock.Unlock();
+
+  process->queue_request(this);
+}
+
+/*
+ * Start handling a request.  Returns true if it is done, false if its op
+ * is waiting for rados, in which case it is queued again once it can go
+ * on, and resume_request() is called for it.
+ */
+bool RGWProcess::handle_request(RGWRequest *req)
 {
-  FCGX_Request *fcgx = &req->fcgx;
   int ret;
-  RGWEnv rgw_env;
-  RGWFCGX client_io(fcgx);
 
+  req->started = true;
   req->log_init();
 
+  ret = req->init_env(g_ceph_context);
+  if (ret < 0) {
+    /* e.g. the client closed an idle keep-alive connection */
+    dout(10) << "no request read req=" << hex << req << dec << " ret=" << ret << dendl;
+    req->finish();
+    delete req;
+    return true;
+  }
+
   dout(1) << "====== starting new request req=" << hex << req << dec << " =====" << dendl;
   perfcounter->inc(l_rgw_req);
 
-  rgw_env.init(g_ceph_context, fcgx->envp);
-
-  struct req_state *s = req->init_state(g_ceph_context, &rgw_env);
+  struct req_state *s = req->init_state(g_ceph_context, &req->env);
   s->obj_ctx = store->create_context(s);
   store->set_intent_cb(s->obj_ctx, call_log_intent);
 
@@ -290,7 +439,8 @@ void RGWProcess::handle_request(RGWRequest *req)
 
   RGWOp *op = NULL;
   int init_error = 0;
-  RGWHandler *handler = rest->get_handler(store, s, &client_io, &init_error);
+  RGWHandler *handler = rest->get_handler(store, s, req->client_io, &init_error);
+  req->handler = handler;
   if (init_error != 0) {
     abort_early(s, init_error);
     goto done;
@@ -341,10 +491,54 @@ void RGWProcess::handle_request(RGWRequest *req)
   if (s->expect_cont)
     dump_continue(s);
 
+  if (g_conf->rgw_async_ops)
+    op->set_resume_cb(req);
+
   req->log(s, "executing");
   op->execute();
-  op->complete();
+  return continue_request(req);
 done:
+  finish_request(req);
+  return true;
+}
+
+bool RGWProcess::resume_request(RGWRequest *req)
+{
+  req->log(req->s, "resuming");
+  req->op->execute_resume();
+  return continue_request(req);
+}
+
+bool RGWProcess::continue_request(RGWRequest *req)
+{
+  RGWOp *op = req->op;
+
+  while (op->is_pending()) {
+    req->lock.Lock();
+    if (!req->resumed) {
+      req->log(req->s, "waiting");
+      /* from here on the request belongs to whoever resumes it */
+      req->running = false;
+      req->lock.Unlock();
+      return false;
+    }
+    req->resumed = false;
+    req->lock.Unlock();
+
+    op->execute_resume();
+  }
+
+  op->complete();
+  finish_request(req);
+  return true;
+}
+
+void RGWProcess::finish_request(RGWRequest *req)
+{
+  struct req_state *s = req->s;
+  RGWOp *op = req->op;
+  RGWHandler *handler = req->handler;
+
   rgw_log_op(store, s, (op ? op->name() : "unknown"), olog);
 
   int http_ret = s->err.http_ret;
@@ -355,7 +549,7 @@ done:
     handler->put_op(op);
   rest->put_handler(handler);
   store->destroy_context(s->obj_ctx);
-  FCGX_Finish_r(fcgx);
+  req->finish();
 
   dout(1) << "====== req done req=" << hex << req << dec << " http_status=" << http_ret << " ======" << dendl;
   delete req;
@@ -397,7 +591,7 @@ int main(int argc, const char **argv)
 	      CINIT_FLAG_UNPRIVILEGED_DAEMON_DEFAULTS);
 
   if (g_conf->daemonize) {
-    if (g_conf->rgw_socket_path.empty()) {
+    if (g_conf->rgw_frontend == "fastcgi" && g_conf->rgw_socket_path.empty()) {
       cerr << "radosgw: must specify 'rgw socket path' to run as a daemon" << std::endl;
       exit(1);
     }
@@ -449,6 +643,8 @@ int main(int argc, const char **argv)
     return 1;
 
   rgw_log_usage_init(g_ceph_context, store);
+  rgw_log_ops_init(g_ceph_context, store);
+  rgw_put_hash_init(g_ceph_context);
 
   RGWREST rest;
 
@@ -497,6 +693,8 @@ int main(int argc, const char **argv)
     swift_finalize();
   }
 
+  rgw_put_hash_finalize();
+  rgw_log_ops_finalize();
   rgw_log_usage_finalize();
 
   delete olog;
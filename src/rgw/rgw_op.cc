@@ -8,6 +8,8 @@
 #include "common/armor.h"
 #include "common/mime.h"
 #include "common/utf8.h"
+#include "include/str_list.h"
+#include "auth/Crypto.h"
 
 #include "rgw_rados.h"
 #include "rgw_op.h"
@@ -20,6 +22,7 @@
 #include "rgw_multi_del.h"
 
 #include "rgw_client_io.h"
+#include "rgw_put_hash.h"
 
 #define dout_subsys ceph_subsys_rgw
 
@@ -342,7 +345,6 @@ int RGWGetObj::read_user_manifest_part(rgw_bucket& bucket, RGWObjEnt& ent, RGWAc
   void *handle = NULL;
   off_t cur_ofs = start_ofs;
   off_t cur_end = end_ofs;
-  utime_t start_time = s->time;
 
   rgw_obj part(bucket, ent.name);
 
@@ -378,21 +380,11 @@ int RGWGetObj::read_user_manifest_part(rgw_bucket& bucket, RGWObjEnt& ent, RGWAc
   }
 
   perfcounter->inc(l_rgw_get_b, cur_end - cur_ofs);
-  while (cur_ofs <= cur_end) {
-    bufferlist bl;
-    ret = store->get_obj(obj_ctx, &handle, part, bl, cur_ofs, cur_end);
+  if (cur_ofs <= cur_end) {
+    RGWGetObj_CB cb(this);
+    ret = store->get_obj_iterate(obj_ctx, &handle, part, cur_ofs, cur_end, &cb);
     if (ret < 0)
       goto done_err;
-
-    len = bl.length();
-    cur_ofs += len;
-    ofs += len;
-    ret = 0;
-    perfcounter->tinc(l_rgw_get_lat,
-                      (ceph_clock_now(s->cct) - start_time));
-    send_response_data(bl);
-
-    start_time = ceph_clock_now(s->cct);
   }
 
   store->destroy_context(obj_ctx);
@@ -403,6 +395,7 @@ int RGWGetObj::read_user_manifest_part(rgw_bucket& bucket, RGWObjEnt& ent, RGWAc
   return 0;
 
 done_err:
+  store->finish_get_obj(&handle);
   if (obj_ctx)
     store->destroy_context(obj_ctx);
   return ret;
@@ -524,12 +517,38 @@ int RGWGetObj::handle_user_manifest(const char *prefix)
   return 0;
 }
 
+int RGWGetObj::get_data_cb(bufferlist& bl)
+{
+  len = bl.length();
+  ofs += len;
+
+  perfcounter->tinc(l_rgw_get_lat,
+                   (ceph_clock_now(s->cct) - start_time));
+  int r = send_response_data(bl);
+  if (r < 0) {
+    dout(0) << "NOTICE: failed to send response to client" << dendl;
+    return r;
+  }
+
+  start_time = ceph_clock_now(s->cct);
+
+  if (ofs <= end && start_time > gc_invalidate_time) {
+    r = store->defer_gc(s->obj_ctx, obj);
+    if (r < 0) {
+      dout(0) << "WARNING: could not defer gc entry for obj" << dendl;
+    }
+    gc_invalidate_time = start_time;
+    gc_invalidate_time += (s->cct->_conf->rgw_gc_obj_min_wait / 2);
+  }
+  return 0;
+}
+
 void RGWGetObj::execute()
 {
-  void *handle = NULL;
-  utime_t start_time = s->time;
   bufferlist bl;
-  utime_t gc_invalidate_time = ceph_clock_now(s->cct);
+
+  start_time = s->time;
+  gc_invalidate_time = ceph_clock_now(s->cct);
   gc_invalidate_time += (s->cct->_conf->rgw_gc_obj_min_wait / 2);
 
   map<string, bufferlist>::iterator attr_iter;
@@ -572,49 +591,31 @@ void RGWGetObj::execute()
 
   perfcounter->inc(l_rgw_get_b, end - ofs);
 
-  while (ofs <= end) {
-    ret = store->get_obj(s->obj_ctx, &handle, obj, bl, ofs, end);
-    if (ret < 0) {
-      goto done;
-    }
-    len = ret;
-
-    if (!len) {
-      dout(0) << "WARNING: failed to read object, returned zero length" << dendl;
-      ret = -EIO;
-      goto done;
-    }
+  ret = store->get_obj_iterate(s->obj_ctx, &handle, obj, ofs, end, &cb, resume_cb);
+  finish_data();
+  return;
 
-    ofs += len;
-    ret = 0;
+done:
+  send_response_data(bl);
+  store->finish_get_obj(&handle);
+}
 
-    perfcounter->tinc(l_rgw_get_lat,
-                     (ceph_clock_now(s->cct) - start_time));
-    ret = send_response_data(bl);
-    bl.clear();
-    if (ret < 0) {
-      dout(0) << "NOTICE: failed to send response to client" << dendl;
-      goto done;
-    }
+void RGWGetObj::execute_resume()
+{
+  ret = store->get_obj_iterate(s->obj_ctx, &handle, obj, ofs, end, &cb, resume_cb);
+  finish_data();
+}
 
-    start_time = ceph_clock_now(s->cct);
+void RGWGetObj::finish_data()
+{
+  pending = (ret == -EINPROGRESS);
+  if (pending)
+    return;
 
-    if (ofs <= end) {
-      if (start_time > gc_invalidate_time) {
-	int r = store->defer_gc(s->obj_ctx, obj);
-	if (r < 0) {
-	  dout(0) << "WARNING: could not defer gc entry for obj" << dendl;
-	}
-	gc_invalidate_time = start_time;
-        gc_invalidate_time += (s->cct->_conf->rgw_gc_obj_min_wait / 2);
-      }
-    }
+  if (ret < 0) {
+    bufferlist bl;
+    send_response_data(bl);
   }
-
-  return;
-
-done:
-  send_response_data(bl);
   store->finish_get_obj(&handle);
 }
 
@@ -868,6 +869,7 @@ void RGWDeleteBucket::execute()
 
 struct put_obj_aio_info {
   void *handle;
+  uint64_t size;
 };
 
 int RGWPutObj::verify_permission()
@@ -953,38 +955,105 @@ int RGWPutObjProcessor_Plain::do_complete(string& etag, map<string, bufferlist>&
 class RGWPutObjProcessor_Aio : public RGWPutObjProcessor
 {
   list<struct put_obj_aio_info> pending;
-  size_t max_chunks;
+  uint64_t pending_size;
+  uint64_t window_size;
+  uint64_t max_req_size;
+
+  /* data not sent yet, to go at data_ofs in data_obj */
+  rgw_obj data_obj;
+  bufferlist data;
+  off_t data_ofs;
+
+  Mutex lock; /* protects waiting */
+  bool waiting;
 
   struct put_obj_aio_info pop_pending();
   int wait_pending_front();
   bool pending_has_completed();
-  int drain_pending();
+  int wait_pending(uint64_t max_size);
+  static void aio_cb(librados::completion_t c, void *arg);
 
 protected:
   uint64_t obj_len;
 
-  int handle_obj_data(rgw_obj& obj, bufferlist& bl, off_t ofs, off_t abs_ofs, void **phandle);
+  int prepare(RGWRados *store, struct req_state *s);
+  int handle_obj_data(rgw_obj& obj, bufferlist& bl, off_t ofs, off_t abs_ofs);
+  int flush_obj_data();
   int throttle_data(void *handle);
+  int drain_data();
+  int wait_all_pending();
+  int drain_pending();
+  void abort_pending();
 
-  RGWPutObjProcessor_Aio() : max_chunks(RGW_MAX_PENDING_CHUNKS), obj_len(0) {}
+  RGWPutObjProcessor_Aio() : pending_size(0), window_size(0), max_req_size(0),
+                             data_ofs(0), lock("RGWPutObjProcessor_Aio::lock"),
+                             waiting(false), obj_len(0) {}
   virtual ~RGWPutObjProcessor_Aio() {
-    drain_pending();
+    abort_pending();
   }
 };
 
-int RGWPutObjProcessor_Aio::handle_obj_data(rgw_obj& obj, bufferlist& bl, off_t ofs, off_t abs_ofs, void **phandle)
+int RGWPutObjProcessor_Aio::prepare(RGWRados *store, struct req_state *s)
+{
+  RGWPutObjProcessor::prepare(store, s);
+
+  window_size = s->cct->_conf->rgw_put_obj_window_size;
+  max_req_size = s->cct->_conf->rgw_put_obj_max_req_size;
+
+  return 0;
+}
+
+/*
+ * Queue data to be written at ofs in obj.  Contiguous data for the same
+ * object is gathered and sent as a single write once max_req_size bytes
+ * are available, or when data for another object comes in.
+ */
+int RGWPutObjProcessor_Aio::handle_obj_data(rgw_obj& obj, bufferlist& bl, off_t ofs, off_t abs_ofs)
 {
   if ((uint64_t)abs_ofs + bl.length() > obj_len)
     obj_len = abs_ofs + bl.length();
 
-  // For the first call pass -1 as the offset to
+  if (data.length() &&
+      (!(data_obj == obj) || data_ofs + (off_t)data.length() != ofs)) {
+    int r = flush_obj_data();
+    if (r < 0)
+      return r;
+  }
+
+  if (!data.length()) {
+    data_obj = obj;
+    data_ofs = ofs;
+  }
+  data.claim_append(bl);
+
+  if (data.length() >= max_req_size)
+    return flush_obj_data();
+
+  return 0;
+}
+
+int RGWPutObjProcessor_Aio::flush_obj_data()
+{
+  if (!data.length())
+    return 0;
+
+  struct put_obj_aio_info info;
+  info.size = data.length();
+
+  // For the first write to an object pass -1 as the offset to
   // do a write_full.
-  int r = store->aio_put_obj_data(NULL, obj,
-                                     bl,
-                                     ((ofs != 0) ? ofs : -1),
-                                     false, phandle);
+  int r = store->aio_put_obj_data(NULL, data_obj,
+                                  data,
+                                  ((data_ofs != 0) ? data_ofs : -1),
+                                  false, &info.handle, aio_cb, this);
+  data.clear();
+  if (r < 0)
+    return r;
 
-  return r;
+  pending.push_back(info);
+  pending_size += info.size;
+
+  return 0;
 }
 
 struct put_obj_aio_info RGWPutObjProcessor_Aio::pop_pending()
@@ -992,6 +1061,7 @@ struct put_obj_aio_info RGWPutObjProcessor_Aio::pop_pending()
   struct put_obj_aio_info info;
   info = pending.front();
   pending.pop_front();
+  pending_size -= info.size;
   return info;
 }
 
@@ -1011,7 +1081,7 @@ bool RGWPutObjProcessor_Aio::pending_has_completed()
   return store->aio_completed(info.handle);
 }
 
-int RGWPutObjProcessor_Aio::drain_pending()
+int RGWPutObjProcessor_Aio::wait_all_pending()
 {
   int ret = 0;
   while (!pending.empty()) {
@@ -1022,31 +1092,84 @@ int RGWPutObjProcessor_Aio::drain_pending()
   return ret;
 }
 
-int RGWPutObjProcessor_Aio::throttle_data(void *handle)
+/* send what is left and wait for all of it to be written */
+int RGWPutObjProcessor_Aio::drain_pending()
 {
-  if (handle) {
-    struct put_obj_aio_info info;
-    info.handle = handle;
-    pending.push_back(info);
+  int ret = flush_obj_data();
+  int r = wait_all_pending();
+  if (ret < 0)
+    return ret;
+  return r;
+}
+
+/*
+ * the upload failed or was cut short: drop what was not sent yet, and
+ * wait for the writes in flight, which still point at us
+ */
+void RGWPutObjProcessor_Aio::abort_pending()
+{
+  data.clear();
+  wait_all_pending();
+}
+
+void RGWPutObjProcessor_Aio::aio_cb(librados::completion_t c, void *arg)
+{
+  RGWPutObjProcessor_Aio *processor = (RGWPutObjProcessor_Aio *)arg;
+  RGWResumeCB *resume_cb = NULL;
+
+  processor->lock.Lock();
+  if (processor->waiting) {
+    processor->waiting = false;
+    resume_cb = processor->resume_cb;
   }
-  size_t orig_size = pending.size();
-  while (pending_has_completed()) {
+  processor->lock.Unlock();
+
+  if (resume_cb)
+    resume_cb->resume();
+}
+
+/*
+ * wait until at most max_size bytes are in flight, or, if we can be
+ * resumed, return -EINPROGRESS if that means waiting
+ */
+int RGWPutObjProcessor_Aio::wait_pending(uint64_t max_size)
+{
+  while (!pending.empty() && pending_size > max_size) {
+    if (resume_cb) {
+      /* the callback checks waiting after the write is marked complete,
+       * so it can't miss us */
+      Mutex::Locker l(lock);
+      if (!pending_has_completed()) {
+        waiting = true;
+        return -EINPROGRESS;
+      }
+    }
     int r = wait_pending_front();
     if (r < 0)
       return r;
   }
+  return 0;
+}
 
-  /* resize window in case messages are draining too fast */
-  if (orig_size - pending.size() >= max_chunks) {
-    max_chunks++;
-  }
-
-  if (pending.size() > max_chunks) {
+int RGWPutObjProcessor_Aio::throttle_data(void *handle)
+{
+  while (pending_has_completed()) {
     int r = wait_pending_front();
     if (r < 0)
       return r;
   }
-  return 0;
+
+  /* keep at most window_size bytes in flight */
+  return wait_pending(window_size);
+}
+
+int RGWPutObjProcessor_Aio::drain_data()
+{
+  int r = flush_obj_data();
+  if (r < 0)
+    return r;
+
+  return wait_pending(0);
 }
 
 class RGWPutObjProcessor_Atomic : public RGWPutObjProcessor_Aio
@@ -1076,25 +1199,49 @@ public:
                                 cur_part_ofs(0),
                                 next_part_ofs(_p),
                                 cur_part_id(0) {}
-  int handle_data(bufferlist& bl, off_t ofs, void **phandle) {
-    if (!ofs && !immutable_head()) {
-      first_chunk.claim(bl);
-      *phandle = NULL;
-      obj_len = (uint64_t)first_chunk.length();
-      prepare_next_part(first_chunk.length());
-      return 0;
-    }
+  int handle_data(bufferlist& bl, off_t ofs, void **phandle);
+};
+
+int RGWPutObjProcessor_Atomic::handle_data(bufferlist& bl, off_t ofs, void **phandle)
+{
+  *phandle = NULL;
+
+  if (!ofs && !immutable_head()) {
+    first_chunk.claim(bl);
+    obj_len = (uint64_t)first_chunk.length();
+    prepare_next_part(first_chunk.length());
+    return 0;
+  }
+
+  /* split the data at stripe boundaries, so that each tail object gets
+   * exactly part_size bytes */
+  while (bl.length()) {
     if (ofs >= next_part_ofs)
       prepare_next_part(ofs);
-    int r = RGWPutObjProcessor_Aio::handle_obj_data(cur_obj, bl, ofs - cur_part_ofs, ofs, phandle);
 
-    return r;
+    bufferlist part_bl;
+    uint64_t len = min((uint64_t)bl.length(), (uint64_t)(next_part_ofs - ofs));
+    if (len < bl.length()) {
+      part_bl.substr_of(bl, 0, len);
+      bufferlist rest;
+      rest.substr_of(bl, len, bl.length() - len);
+      bl.swap(rest);
+    } else {
+      part_bl.claim(bl);
+    }
+
+    int r = RGWPutObjProcessor_Aio::handle_obj_data(cur_obj, part_bl, ofs - cur_part_ofs, ofs);
+    if (r < 0)
+      return r;
+    ofs += len;
   }
-};
+
+  return 0;
+}
 
 int RGWPutObjProcessor_Atomic::prepare(RGWRados *store, struct req_state *s)
 {
-  RGWPutObjProcessor::prepare(store, s);
+  RGWPutObjProcessor_Aio::prepare(store, s);
 
   string oid = s->object_str;
   head_obj.init(s->bucket, s->object_str);
@@ -1149,11 +1296,16 @@ void RGWPutObjProcessor_Atomic::complete_parts()
 
 int RGWPutObjProcessor_Atomic::do_complete(string& etag, map<string, bufferlist>& attrs)
 {
+  /* the tail must be in place before the head points at it */
+  int r = drain_pending();
+  if (r < 0)
+    return r;
+
   complete_parts();
 
   store->set_atomic(s->obj_ctx, head_obj);
 
-  int r = store->put_obj_meta(s->obj_ctx, head_obj, obj_len, NULL, attrs,
+  r = store->put_obj_meta(s->obj_ctx, head_obj, obj_len, NULL, attrs,
                               RGW_OBJ_CATEGORY_MAIN, PUT_OBJ_CREATE, NULL, &first_chunk, &manifest, NULL, NULL);
 
   return r;
@@ -1175,7 +1327,7 @@ public:
 
 int RGWPutObjProcessor_Multipart::prepare(RGWRados *store, struct req_state *s)
 {
-  RGWPutObjProcessor::prepare(store, s);
+  RGWPutObjProcessor_Aio::prepare(store, s);
 
   string oid = s->object_str;
   string upload_id;
@@ -1199,9 +1351,13 @@ int RGWPutObjProcessor_Multipart::prepare(RGWRados *store, struct req_state *s)
 
 int RGWPutObjProcessor_Multipart::do_complete(string& etag, map<string, bufferlist>& attrs)
 {
+  int r = drain_pending();
+  if (r < 0)
+    return r;
+
   complete_parts();
 
-  int r = store->put_obj_meta(s->obj_ctx, head_obj, s->obj_size, NULL, attrs, RGW_OBJ_CATEGORY_MAIN, 0, NULL, NULL, NULL, NULL, NULL);
+  r = store->put_obj_meta(s->obj_ctx, head_obj, s->obj_size, NULL, attrs, RGW_OBJ_CATEGORY_MAIN, 0, NULL, NULL, NULL, NULL, NULL);
   if (r < 0)
     return r;
 
@@ -1227,6 +1383,21 @@ int RGWPutObjProcessor_Multipart::do_complete(string& etag, map<string, bufferli
 }
 
 
+/*
+ * Uploads by the users in rgw_put_obj_skip_md5_users are trusted to
+ * arrive intact, and are not hashed.
+ */
+static bool put_obj_skip_md5(struct req_state *s)
+{
+  const string& users = s->cct->_conf->rgw_put_obj_skip_md5_users;
+  if (users.empty())
+    return false;
+
+  list<string> l;
+  get_str_list(users, l);
+  return find(l.begin(), l.end(), s->user.user_id) != l.end();
+}
+
 RGWPutObjProcessor *RGWPutObj::select_processor()
 {
   RGWPutObjProcessor *processor;
@@ -1255,17 +1426,7 @@ void RGWPutObj::dispose_processor(RGWPutObjProcessor *processor)
 
 void RGWPutObj::execute()
 {
-  RGWPutObjProcessor *processor = NULL;
   char supplied_md5_bin[CEPH_CRYPTO_MD5_DIGESTSIZE + 1];
-  char supplied_md5[CEPH_CRYPTO_MD5_DIGESTSIZE * 2 + 1];
-  char calc_md5[CEPH_CRYPTO_MD5_DIGESTSIZE * 2 + 1];
-  unsigned char m[CEPH_CRYPTO_MD5_DIGESTSIZE];
-  MD5 hash;
-  bufferlist bl, aclbl;
-  map<string, bufferlist> attrs;
-  int len;
-  map<string, string>::iterator iter;
-
 
   perfcounter->inc(l_rgw_put);
   ret = -EINVAL;
@@ -1296,57 +1457,136 @@ void RGWPutObj::execute()
     supplied_md5[sizeof(supplied_md5) - 1] = '\0';
   }
 
+  if (!put_obj_skip_md5(s))
+    hasher = new RGWPutObjHasher(s->cct);
+
   processor = select_processor();
+  processor->set_resume_cb(resume_cb);
 
   ret = processor->prepare(store, s);
   if (ret < 0)
     goto done;
 
-  do {
+  ret = put_data();
+  if (ret == -EINPROGRESS) {
+    pending = true;
+    return;
+  }
+  if (ret < 0)
+    goto done;
+
+  finish_put();
+  return;
+
+done:
+  dispose_processor(processor);
+  processor = NULL;
+  perfcounter->tinc(l_rgw_put_lat,
+                   (ceph_clock_now(s->cct) - s->time));
+}
+
+void RGWPutObj::execute_resume()
+{
+  pending = false;
+
+  ret = put_data();
+  if (ret == -EINPROGRESS) {
+    pending = true;
+    return;
+  }
+  if (ret < 0) {
+    dispose_processor(processor);
+    processor = NULL;
+    perfcounter->tinc(l_rgw_put_lat,
+                     (ceph_clock_now(s->cct) - s->time));
+    return;
+  }
+
+  finish_put();
+}
+
+/*
+ * Read the data from the client and hand it to the processor.  Returns
+ * -EINPROGRESS if the processor is waiting for rados, in which case
+ * this is called again once it's resumed.
+ */
+int RGWPutObj::put_data()
+{
+  int r;
+
+  if (data_done)
+    return processor->drain_data();
+
+  /* we may have been waiting on the last chunk */
+  r = processor->throttle_data(NULL);
+  if (r < 0)
+    return r;
+
+  for (;;) {
     bufferlist data;
-    len = get_data(data);
-    if (len < 0) {
-      ret = len;
-      goto done;
-    }
+    int len = get_data(data);
+    if (len < 0)
+      return len;
     if (!len)
       break;
 
+    /* before the processor takes the data */
+    if (hasher)
+      hasher->update(data);
+
     void *handle;
-    const unsigned char *data_ptr = (const unsigned char *)data.c_str();
+    r = processor->handle_data(data, ofs, &handle);
+    if (r < 0)
+      return r;
 
-    ret = processor->handle_data(data, ofs, &handle);
-    if (ret < 0)
-      goto done;
+    ofs += len;
 
-    hash.Update(data_ptr, len);
+    r = processor->throttle_data(handle);
+    if (r < 0)
+      return r;
+  }
 
-    ret = processor->throttle_data(handle);
-    if (ret < 0)
-      goto done;
+  data_done = true;
 
-    ofs += len;
-  } while (len > 0);
+  if (!chunked_upload && (uint64_t)ofs != s->content_length)
+    return -ERR_REQUEST_TIMEOUT;
+
+  return processor->drain_data();
+}
+
+void RGWPutObj::finish_put()
+{
+  char calc_md5[CEPH_CRYPTO_MD5_DIGESTSIZE * 2 + 1];
+  unsigned char m[CEPH_CRYPTO_MD5_DIGESTSIZE];
+  bufferlist bl, aclbl;
+  map<string, bufferlist> attrs;
+  map<string, string>::iterator iter;
 
-  if (!chunked_upload && (uint64_t)ofs != s->content_length) {
-    ret = -ERR_REQUEST_TIMEOUT;
-    goto done;
-  }
   s->obj_size = ofs;
   perfcounter->inc(l_rgw_put_b, s->obj_size);
 
-  hash.Final(m);
+  if (hasher) {
+    hasher->final(m);
 
-  buf_to_hex(m, CEPH_CRYPTO_MD5_DIGESTSIZE, calc_md5);
+    buf_to_hex(m, CEPH_CRYPTO_MD5_DIGESTSIZE, calc_md5);
 
-  if (supplied_md5_b64 && strcmp(calc_md5, supplied_md5)) {
-     ret = -ERR_BAD_DIGEST;
-     goto done;
+    if (supplied_md5_b64 && strcmp(calc_md5, supplied_md5)) {
+       ret = -ERR_BAD_DIGEST;
+       goto done;
+    }
+    etag = calc_md5;
+  } else if (supplied_md5_b64 || supplied_etag) {
+    etag = supplied_md5;
+  } else {
+    /* not the md5, but still a different etag for every upload */
+    ret = get_random_bytes((char *)m, sizeof(m));
+    if (ret < 0)
+      goto done;
+    buf_to_hex(m, CEPH_CRYPTO_MD5_DIGESTSIZE, calc_md5);
+    etag = calc_md5;
   }
   policy.encode(aclbl);
 
-  etag = calc_md5;
-
   if (supplied_etag && etag.compare(supplied_etag) != 0) {
     ret = -ERR_UNPROCESSABLE_ENTITY;
     goto done;
@@ -1371,6 +1611,7 @@ void RGWPutObj::execute()
   ret = processor->complete(etag, attrs);
 done:
   dispose_processor(processor);
+  processor = NULL;
   perfcounter->tinc(l_rgw_put_lat,
                    (ceph_clock_now(s->cct) - s->time));
 }
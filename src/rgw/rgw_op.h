@@ -23,6 +23,7 @@ using namespace std;
 
 struct req_state;
 class RGWHandler;
+class RGWPutObjHasher;
 
 void rgw_get_request_metadata(struct req_state *s, map<string, bufferlist>& attrs);
 int rgw_build_policies(RGWRados *store, struct req_state *s, bool only_bucket, bool prefetch_data);
@@ -36,8 +37,10 @@ protected:
   struct req_state *s;
   RGWHandler *dialect_handler;
   RGWRados *store;
+  RGWResumeCB *resume_cb;
+  bool pending;
 public:
-  RGWOp() : s(NULL), dialect_handler(NULL), store(NULL) {}
+  RGWOp() : s(NULL), dialect_handler(NULL), store(NULL), resume_cb(NULL), pending(false) {}
   virtual ~RGWOp() {}
 
   virtual void init(RGWRados *store, struct req_state *s, RGWHandler *dialect_handler) {
@@ -49,11 +52,31 @@ public:
   virtual bool prefetch_data() { return false; }
   virtual int verify_permission() = 0;
   virtual void execute() = 0;
+  /**
+   * Ops that support it may then stop waiting for rados, leaving
+   * is_pending() set, and call resume_cb->resume() once they can go on;
+   * the caller then calls execute_resume(), until is_pending() is clear.
+   */
+  void set_resume_cb(RGWResumeCB *cb) { resume_cb = cb; }
+  bool is_pending() { return pending; }
+  virtual void execute_resume() {}
   virtual void send_response() {}
   virtual void complete() { send_response(); }
   virtual const char *name() = 0;
 };
 
+class RGWGetObj;
+
+class RGWGetObj_CB : public RGWGetDataCB
+{
+  RGWGetObj *op;
+public:
+  RGWGetObj_CB(RGWGetObj *_op) : op(_op) {}
+  virtual ~RGWGetObj_CB() {}
+
+  int handle_data(bufferlist& bl);
+};
+
 class RGWGetObj : public RGWOp {
 protected:
   const char *range_str;
@@ -76,10 +99,15 @@ protected:
   bool get_data;
   bool partial_content;
   rgw_obj obj;
+  utime_t start_time;
+  utime_t gc_invalidate_time;
+  void *handle;
+  RGWGetObj_CB cb;
 
   int init_common();
+  void finish_data();
 public:
-  RGWGetObj() {
+  RGWGetObj() : handle(NULL), cb(this) {
     range_str = NULL;
     if_mod = NULL;
     if_unmod = NULL;
@@ -99,6 +127,10 @@ public:
     partial_content = false;
     ret = 0;
  }
+  ~RGWGetObj() {
+    if (handle)
+      store->finish_get_obj(&handle);
+  }
 
   virtual bool prefetch_data() { return true; }
 
@@ -107,17 +139,25 @@ public:
   }
   int verify_permission();
   void execute();
+  void execute_resume();
   int read_user_manifest_part(rgw_bucket& bucket, RGWObjEnt& ent, RGWAccessControlPolicy *bucket_policy, off_t start_ofs, off_t end_ofs);
   int iterate_user_manifest_parts(rgw_bucket& bucket, string& obj_prefix, RGWAccessControlPolicy *bucket_policy,
                                   uint64_t *ptotal_len, bool read_data);
   int handle_user_manifest(const char *prefix);
 
+  int get_data_cb(bufferlist& bl);
+
   virtual int get_params() = 0;
   virtual int send_response_data(bufferlist& bl) = 0;
 
   virtual const char *name() { return "get_obj"; }
 };
 
+inline int RGWGetObj_CB::handle_data(bufferlist& bl)
+{
+  return op->get_data_cb(bl);
+}
+
 class RGWListBuckets : public RGWOp {
 protected:
   int ret;
@@ -255,6 +295,7 @@ protected:
   RGWRados *store;
   struct req_state *s;
   bool is_complete;
+  RGWResumeCB *resume_cb;
 
   virtual int do_complete(string& etag, map<string, bufferlist>& attrs) = 0;
 
@@ -264,15 +305,21 @@ protected:
     objs.push_back(obj);
   }
 public:
-  RGWPutObjProcessor() : store(NULL), s(NULL), is_complete(false) {}
+  RGWPutObjProcessor() : store(NULL), s(NULL), is_complete(false), resume_cb(NULL) {}
   virtual ~RGWPutObjProcessor();
   virtual int prepare(RGWRados *_store, struct req_state *_s) {
     store = _store;
     s = _s;
     return 0;
   };
+  /* if set, throttle_data() and drain_data() return -EINPROGRESS
+   * rather than wait for rados, and call cb->resume() when they can
+   * be called again */
+  void set_resume_cb(RGWResumeCB *cb) { resume_cb = cb; }
   virtual int handle_data(bufferlist& bl, off_t ofs, void **phandle) = 0;
   virtual int throttle_data(void *handle) = 0;
+  /* wait for all the data handed over so far to be written */
+  virtual int drain_data() { return 0; }
   virtual int complete(string& etag, map<string, bufferlist>& attrs);
 };
 
@@ -285,10 +332,17 @@ protected:
   off_t ofs;
   const char *supplied_md5_b64;
   const char *supplied_etag;
+  char supplied_md5[CEPH_CRYPTO_MD5_DIGESTSIZE * 2 + 1];
   string etag;
   bool chunked_upload;
   RGWAccessControlPolicy policy;
   const char *obj_manifest;
+  RGWPutObjProcessor *processor;
+  RGWPutObjHasher *hasher; /* NULL if the upload isn't hashed */
+  bool data_done;
+
+  int put_data();
+  void finish_put();
 
 public:
   RGWPutObj() {
@@ -298,6 +352,13 @@ public:
     supplied_etag = NULL;
     chunked_upload = false;
     obj_manifest = NULL;
+    processor = NULL;
+    hasher = NULL;
+    data_done = false;
+  }
+  ~RGWPutObj() {
+    dispose_processor(processor);
+    delete hasher;
   }
 
   virtual void init(RGWRados *store, struct req_state *s, RGWHandler *h) {
@@ -310,6 +371,7 @@ public:
 
   int verify_permission();
   void execute();
+  void execute_resume();
 
   virtual int get_params() = 0;
   virtual int get_data(bufferlist& bl) = 0;
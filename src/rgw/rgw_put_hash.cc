@@ -0,0 +1,153 @@
+#include <deque>
+
+#include "common/WorkQueue.h"
+
+#include "rgw_put_hash.h"
+
+#define dout_subsys ceph_subsys_rgw
+
+/*
+ * The threads hashing uploads.  What gets queued is the hasher of an
+ * upload, which a thread then drains of all the data handed over so far,
+ * so that the data of one upload is hashed by one thread at a time, in
+ * order.
+ */
+class RGWPutHashPool {
+  ThreadPool tp;
+  deque<RGWPutObjHasher *> hashers;
+
+  struct HashWQ : public ThreadPool::WorkQueue<RGWPutObjHasher> {
+    RGWPutHashPool *pool;
+    HashWQ(RGWPutHashPool *p, time_t timeout, time_t suicide_timeout, ThreadPool *tp)
+      : ThreadPool::WorkQueue<RGWPutObjHasher>("RGWPutHashWQ", timeout, suicide_timeout, tp), pool(p) {}
+
+    bool _enqueue(RGWPutObjHasher *hasher) {
+      pool->hashers.push_back(hasher);
+      return true;
+    }
+    void _dequeue(RGWPutObjHasher *hasher) {
+      assert(0);
+    }
+    bool _empty() {
+      return pool->hashers.empty();
+    }
+    RGWPutObjHasher *_dequeue() {
+      if (pool->hashers.empty())
+        return NULL;
+      RGWPutObjHasher *hasher = pool->hashers.front();
+      pool->hashers.pop_front();
+      return hasher;
+    }
+    void _process(RGWPutObjHasher *hasher) {
+      hasher->process();
+    }
+    void _clear() {
+      assert(pool->hashers.empty());
+    }
+  } wq;
+
+public:
+  RGWPutHashPool(CephContext *cct, int num_threads)
+    : tp(cct, "RGWPutHashPool::tp", num_threads),
+      wq(this, cct->_conf->rgw_op_thread_timeout,
+         cct->_conf->rgw_op_thread_suicide_timeout, &tp) {
+    tp.start();
+  }
+  ~RGWPutHashPool() {
+    tp.drain(&wq);
+    tp.stop();
+  }
+
+  void queue(RGWPutObjHasher *hasher) {
+    wq.queue(hasher);
+  }
+};
+
+static RGWPutHashPool *hash_pool = NULL;
+
+RGWPutObjHasher::RGWPutObjHasher(CephContext *_cct)
+  : cct(_cct), lock("RGWPutObjHasher::lock"), pending_bytes(0), queued(false)
+{
+}
+
+RGWPutObjHasher::~RGWPutObjHasher()
+{
+  /* a hash thread may still be on it if the upload was cut short */
+  Mutex::Locker l(lock);
+  pending.clear();
+  while (queued)
+    cond.Wait(lock);
+}
+
+void RGWPutObjHasher::hash_data(bufferlist& bl)
+{
+  const list<bufferptr>& buffers = bl.buffers();
+  for (list<bufferptr>::const_iterator iter = buffers.begin(); iter != buffers.end(); ++iter) {
+    hash.Update((const unsigned char *)iter->c_str(), iter->length());
+  }
+}
+
+void RGWPutObjHasher::update(bufferlist& bl)
+{
+  if (!hash_pool) {
+    hash_data(bl);
+    return;
+  }
+
+  Mutex::Locker l(lock);
+  pending.push_back(bl);
+  pending_bytes += bl.length();
+  if (!queued) {
+    queued = true;
+    hash_pool->queue(this);
+  }
+
+  uint64_t window = cct->_conf->rgw_put_obj_hash_window;
+  while (pending_bytes > window) {
+    ldout(cct, 20) << "RGWPutObjHasher::update: waiting, pending_bytes=" << pending_bytes << dendl;
+    cond.Wait(lock);
+  }
+}
+
+void RGWPutObjHasher::process()
+{
+  lock.Lock();
+  while (!pending.empty()) {
+    bufferlist bl;
+    bl.swap(pending.front());
+    pending.pop_front();
+    lock.Unlock();
+
+    hash_data(bl);
+
+    lock.Lock();
+    pending_bytes -= bl.length();
+    cond.Signal();
+  }
+  queued = false;
+  cond.Signal();
+  lock.Unlock();
+}
+
+void RGWPutObjHasher::final(unsigned char *digest)
+{
+  lock.Lock();
+  while (queued)
+    cond.Wait(lock);
+  lock.Unlock();
+
+  hash.Final(digest);
+}
+
+void rgw_put_hash_init(CephContext *cct)
+{
+  int num_threads = cct->_conf->rgw_put_obj_hash_threads;
+  if (num_threads > 0)
+    hash_pool = new RGWPutHashPool(cct, num_threads);
+}
+
+void rgw_put_hash_finalize()
+{
+  delete hash_pool;
+  hash_pool = NULL;
+}
@@ -0,0 +1,54 @@
+#ifndef CEPH_RGW_PUT_HASH_H
+#define CEPH_RGW_PUT_HASH_H
+
+#include <list>
+
+#include "common/Mutex.h"
+#include "common/Cond.h"
+#include "include/buffer.h"
+
+#include "rgw_common.h"
+
+class CephContext;
+
+/*
+ * The MD5 of a single upload.  The data handed to update() is hashed by
+ * the shared hash threads, in order, while the request thread goes on
+ * reading from the client and writing to rados.  Without hash threads
+ * (radosgw-admin, or rgw_put_obj_hash_threads = 0, the default) it is
+ * hashed right away.
+ */
+class RGWPutObjHasher {
+  CephContext *cct;
+  MD5 hash;
+
+  Mutex lock;
+  Cond cond;
+  list<bufferlist> pending;
+  uint64_t pending_bytes;
+  bool queued; /* waiting for a hash thread, or being hashed */
+
+  void hash_data(bufferlist& bl);
+
+public:
+  RGWPutObjHasher(CephContext *_cct);
+  ~RGWPutObjHasher();
+
+  /*
+   * Hand over data to hash.  The buffers are shared, not copied, so bl
+   * may be claimed by someone else afterwards, but not modified.  Waits
+   * if more than rgw_put_obj_hash_window bytes are not hashed yet.
+   */
+  void update(bufferlist& bl);
+
+  /* wait for all the data to be hashed, and get the digest */
+  void final(unsigned char *digest);
+
+  /* called by the hash threads */
+  void process();
+};
+
+extern void rgw_put_hash_init(CephContext *cct);
+extern void rgw_put_hash_finalize();
+
+#endif
@@ -694,13 +694,31 @@ int RGWRados::list_objects(rgw_bucket& bucket, int max, string& prefix, string&
   }
   result.clear();
 
+  /* the bucket index can fold the entries under each common prefix itself,
+   * and skip past them, as long as its raw keys split at the delimiter the
+   * same way the object names do */
+  string index_delim;
+  if (!delim.empty() && ns.empty() && !filter &&
+      (prefix.empty() || prefix[0] != '_') && delim.find('_') == string::npos)
+    index_delim = delim;
+
   do {
     std::map<string, RGWObjEnt> ent_map;
+    set<string> index_prefixes;
     int r = cls_bucket_list(bucket, cur_marker, prefix, max - count, ent_map,
-                            &truncated, &cur_marker);
+                            &truncated, &cur_marker, NULL, index_delim, &index_prefixes);
     if (r < 0)
       return r;
 
+    set<string>::iterator piter;
+    for (piter = index_prefixes.begin(); piter != index_prefixes.end(); ++piter) {
+      string obj = *piter;
+      if (!rgw_obj::translate_raw_obj_to_obj_in_ns(obj, ns))
+        continue;
+      if (common_prefixes.insert(make_pair(obj, true)).second)
+        count++;
+    }
+
     std::map<string, RGWObjEnt>::iterator eiter;
     for (eiter = ent_map.begin(); eiter != ent_map.end(); ++eiter) {
       string obj = eiter->first;
@@ -719,7 +737,8 @@ int RGWRados::list_objects(rgw_bucket& bucket, int max, string& prefix, string&
         int delim_pos = obj.find(delim, prefix.size());
 
         if (delim_pos >= 0) {
-          common_prefixes[obj.substr(0, delim_pos + 1)] = true;
+          if (common_prefixes.insert(make_pair(obj.substr(0, delim_pos + delim.size()), true)).second)
+            count++;
           continue;
         }
       }
@@ -791,15 +810,20 @@ int RGWRados::create_bucket(string& owner, rgw_bucket& bucket,
   snprintf(buf, sizeof(buf), "%llu.%llu", (long long)iid, (long long)bid); 
   bucket.marker = buf;
   bucket.bucket_id = bucket.marker;
+  bucket.num_shards = max(cct->_conf->rgw_bucket_index_shards, 0);
 
   string dir_oid =  dir_oid_prefix;
   dir_oid.append(bucket.marker);
 
-  librados::ObjectWriteOperation op;
-  op.create(true);
-  r = cls_rgw_init_index(io_ctx, op, dir_oid);
-  if (r < 0 && r != -EEXIST)
-    return r;
+  vector<string> index_oids;
+  cls_rgw_bucket_shard_oids(dir_oid, bucket.num_shards, index_oids);
+  for (vector<string>::iterator iter = index_oids.begin(); iter != index_oids.end(); ++iter) {
+    librados::ObjectWriteOperation op;
+    op.create(true);
+    r = cls_rgw_init_index(io_ctx, op, *iter);
+    if (r < 0 && r != -EEXIST)
+      return r;
+  }
 
   RGWBucketInfo info;
   info.bucket = bucket;
@@ -1164,7 +1188,8 @@ int RGWRados::put_obj_data(void *ctx, rgw_obj& obj,
 
 int RGWRados::aio_put_obj_data(void *ctx, rgw_obj& obj, bufferlist& bl,
 			       off_t ofs, bool exclusive,
-                               void **handle)
+                               void **handle,
+                               librados::callback_t cb, void *cb_arg)
 {
   rgw_bucket bucket;
   std::string oid, key;
@@ -1177,7 +1202,7 @@ int RGWRados::aio_put_obj_data(void *ctx, rgw_obj& obj, bufferlist& bl,
 
   io_ctx.locator_set_key(key);
 
-  AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+  AioCompletion *c = librados::Rados::aio_create_completion(cb_arg, cb, NULL);
   *handle = c;
   
   ObjectWriteOperation op;
@@ -1200,7 +1225,8 @@ int RGWRados::aio_put_obj_data(void *ctx, rgw_obj& obj, bufferlist& bl,
 int RGWRados::aio_wait(void *handle)
 {
   AioCompletion *c = (AioCompletion *)handle;
-  c->wait_for_complete();
+  /* the callback may still need whatever it was passed */
+  c->wait_for_complete_and_cb();
   int ret = c->get_return_value();
   c->release();
   return ret;
@@ -1482,15 +1508,19 @@ int RGWRados::delete_bucket(rgw_bucket& bucket)
   if (r < 0)
     return r;
 
-  ObjectWriteOperation op;
-  op.remove();
   string oid = dir_oid_prefix;
   oid.append(bucket.marker);
-  librados::AioCompletion *completion = rados->aio_create_completion(NULL, NULL, NULL);
-  r = list_ctx.aio_operate(oid, completion, &op);
-  completion->release();
-  if (r < 0)
-    return r;
+  vector<string> index_oids;
+  cls_rgw_bucket_shard_oids(oid, bucket.num_shards, index_oids);
+  for (vector<string>::iterator iter = index_oids.begin(); iter != index_oids.end(); ++iter) {
+    ObjectWriteOperation op;
+    op.remove();
+    librados::AioCompletion *completion = rados->aio_create_completion(NULL, NULL, NULL);
+    r = list_ctx.aio_operate(*iter, completion, &op);
+    completion->release();
+    if (r < 0)
+      return r;
+  }
 
   return 0;
 }
@@ -1587,6 +1617,32 @@ int RGWRados::open_bucket(rgw_bucket& bucket, librados::IoCtx& io_ctx, string& b
   return 0;
 }
 
+int RGWRados::open_bucket_index(rgw_bucket& bucket, librados::IoCtx& io_ctx, vector<string>& oids)
+{
+  string bucket_oid;
+  int r = open_bucket(bucket, io_ctx, bucket_oid);
+  if (r < 0)
+    return r;
+
+  cls_rgw_bucket_shard_oids(bucket_oid, bucket.num_shards, oids);
+  return 0;
+}
+
+/*
+ * the index entry of an object lives in the shard picked by hashing its key
+ */
+int RGWRados::open_bucket_index_shard(rgw_bucket& bucket, librados::IoCtx& io_ctx, const string& obj_key,
+                                      string& oid)
+{
+  string bucket_oid;
+  int r = open_bucket(bucket, io_ctx, bucket_oid);
+  if (r < 0)
+    return r;
+
+  cls_rgw_bucket_shard_oid(bucket_oid, bucket.num_shards, obj_key, oid);
+  return 0;
+}
+
 static void translate_raw_stats(rgw_bucket_dir_header& header, map<RGWObjCategory, RGWBucketStats>& stats)
 {
   map<uint8_t, struct rgw_bucket_category_stats>::iterator iter = header.stats.begin();
@@ -1606,18 +1662,24 @@ int RGWRados::bucket_check_index(rgw_bucket& bucket,
 				 map<RGWObjCategory, RGWBucketStats> *calculated_stats)
 {
   librados::IoCtx io_ctx;
-  string oid;
+  vector<string> oids;
 
-  int ret = open_bucket(bucket, io_ctx, oid);
+  int ret = open_bucket_index(bucket, io_ctx, oids);
   if (ret < 0)
     return ret;
 
   rgw_bucket_dir_header existing_header;
   rgw_bucket_dir_header calculated_header;
 
-  ret = cls_rgw_bucket_check_index_op(io_ctx, oid, &existing_header, &calculated_header);
-  if (ret < 0)
-    return ret;
+  for (vector<string>::iterator iter = oids.begin(); iter != oids.end(); ++iter) {
+    rgw_bucket_dir_header shard_existing;
+    rgw_bucket_dir_header shard_calculated;
+    ret = cls_rgw_bucket_check_index_op(io_ctx, *iter, &shard_existing, &shard_calculated);
+    if (ret < 0)
+      return ret;
+    existing_header.aggregate(shard_existing);
+    calculated_header.aggregate(shard_calculated);
+  }
 
   translate_raw_stats(existing_header, *existing_stats);
   translate_raw_stats(calculated_header, *calculated_stats);
@@ -1628,13 +1690,18 @@ int RGWRados::bucket_check_index(rgw_bucket& bucket,
 int RGWRados::bucket_rebuild_index(rgw_bucket& bucket)
 {
   librados::IoCtx io_ctx;
-  string oid;
+  vector<string> oids;
 
-  int ret = open_bucket(bucket, io_ctx, oid);
+  int ret = open_bucket_index(bucket, io_ctx, oids);
   if (ret < 0)
     return ret;
 
-  return cls_rgw_bucket_rebuild_index_op(io_ctx, oid);
+  for (vector<string>::iterator iter = oids.begin(); iter != oids.end(); ++iter) {
+    ret = cls_rgw_bucket_rebuild_index_op(io_ctx, *iter);
+    if (ret < 0)
+      return ret;
+  }
+  return 0;
 }
 
 
@@ -2667,6 +2734,183 @@ void RGWRados::finish_get_obj(void **handle)
   }
 }
 
+struct get_obj_io {
+  uint64_t read_ofs;
+  uint64_t len;
+  bufferlist bl;
+  librados::AioCompletion *c;
+
+  get_obj_io() : read_ofs(0), len(0), c(NULL) {}
+};
+
+RGWRados::GetObjState::~GetObjState()
+{
+  /* the reads still going write into buffers we're about to free */
+  while (!ios.empty()) {
+    get_obj_io *io = ios.front();
+    ios.pop_front();
+    io->c->wait_for_complete_and_cb();
+    io->c->release();
+    delete io;
+  }
+  delete new_ctx;
+}
+
+void RGWRados::get_obj_io_cb(librados::completion_t c, void *arg)
+{
+  GetObjState *state = (GetObjState *)arg;
+  RGWResumeCB *resume_cb = NULL;
+
+  state->lock.Lock();
+  if (state->waiting) {
+    state->waiting = false;
+    resume_cb = state->resume_cb;
+  }
+  state->lock.Unlock();
+
+  /* the state may be gone once the op is resumed */
+  if (resume_cb)
+    resume_cb->resume();
+}
+
+int RGWRados::get_obj_iterate(void *ctx, void **handle, rgw_obj& obj,
+                              off_t ofs, off_t end, RGWGetDataCB *cb,
+                              RGWResumeCB *resume_cb)
+{
+  RGWRadosCtx *rctx = (RGWRadosCtx *)ctx;
+  GetObjState *state = *(GetObjState **)handle;
+  uint64_t window = max(cct->_conf->rgw_get_obj_window_size, 1);
+  uint64_t max_req = max(cct->_conf->rgw_get_obj_max_req_size, 1);
+  int r;
+
+  if (!rctx) {
+    if (!state->new_ctx)
+      state->new_ctx = new RGWRadosCtx(this);
+    rctx = state->new_ctx;
+  }
+  state->resume_cb = resume_cb;
+
+  if (!state->started) {
+    state->started = true;
+    state->ofs = ofs;
+    state->end = end;
+
+    r = get_obj_state(rctx, obj, &state->astate);
+    if (r < 0)
+      return r;
+
+    /* the beginning of the head may have been read with its state */
+    RGWObjState *astate = state->astate;
+    if (ofs <= end && ofs < (off_t)astate->data.length()) {
+      uint64_t len = min((off_t)astate->data.length(), end + 1) - ofs;
+      bufferlist bl;
+      bl.substr_of(astate->data, ofs, len);
+      r = cb->handle_data(bl);
+      if (r < 0)
+        return r;
+      state->ofs += len;
+    }
+  }
+
+  list<get_obj_io *>& ios = state->ios;
+
+  while (state->ofs <= state->end || !ios.empty()) {
+    /* keep the window full, but always have at least one read going */
+    while (state->ofs <= state->end && (ios.empty() || state->in_flight < window)) {
+      rgw_obj read_obj = obj;
+      uint64_t read_ofs = state->ofs;
+      uint64_t len = state->end - state->ofs + 1;
+
+      if (state->astate->has_manifest) {
+        RGWObjManifest& manifest = state->astate->manifest;
+        map<uint64_t, RGWObjManifestPart>::iterator iter = manifest.objs.upper_bound(state->ofs);
+        if (iter != manifest.objs.begin())
+          --iter;
+        RGWObjManifestPart& part = iter->second;
+        read_obj = part.loc;
+        len = min(len, part.size - (state->ofs - iter->first));
+        read_ofs = part.loc_ofs + (state->ofs - iter->first);
+      }
+      len = min(len, max_req);
+
+      rgw_bucket bucket;
+      string oid, key;
+      get_obj_bucket_and_oid_key(read_obj, bucket, oid, key);
+
+      ObjectReadOperation op;
+      if (read_obj == obj) {
+        /* only when reading from the head object do we need to do the atomic test */
+        r = append_atomic_test(rctx, read_obj, op, &state->astate);
+        if (r < 0)
+          return r;
+      }
+
+      get_obj_io *io = new get_obj_io;
+      io->read_ofs = read_ofs;
+      io->len = len;
+      op.read(read_ofs, len, &io->bl, NULL);
+
+      ldout(cct, 20) << "get_obj_iterate: aio read oid=" << oid << " ofs=" << read_ofs << " len=" << len << dendl;
+      state->io_ctx.locator_set_key(key);
+      io->c = librados::Rados::aio_create_completion(state, get_obj_io_cb, NULL);
+      r = state->io_ctx.aio_operate(oid, io->c, &op, NULL);
+      if (r < 0) {
+        io->c->release();
+        delete io;
+        return r;
+      }
+      ios.push_back(io);
+      state->in_flight += len;
+      state->ofs += len;
+    }
+
+    get_obj_io *io = ios.front();
+
+    if (resume_cb) {
+      /* the callback checks waiting after the read is marked complete,
+       * so it can't miss us */
+      state->lock.Lock();
+      if (!io->c->is_complete()) {
+        state->waiting = true;
+        state->lock.Unlock();
+        return -EINPROGRESS;
+      }
+      state->lock.Unlock();
+    }
+
+    ios.pop_front();
+    state->in_flight -= io->len;
+    io->c->wait_for_complete_and_cb();
+    r = io->c->get_return_value();
+    io->c->release();
+
+    if (r == -ECANCELED) {
+      /* a race! object was replaced, we need to read the original from the shadow obj */
+      ldout(cct, 0) << "NOTICE: RGWRados::get_obj_iterate: raced with another process, going to the shadow obj instead" << dendl;
+      string loc = obj.loc();
+      rgw_obj shadow(obj.bucket, state->astate->shadow_obj, loc, shadow_ns);
+      rgw_bucket bucket;
+      string oid, key;
+      get_obj_bucket_and_oid_key(shadow, bucket, oid, key);
+      state->io_ctx.locator_set_key(key);
+      io->bl.clear();
+      r = state->io_ctx.read(oid, io->bl, io->len, io->read_ofs);
+    }
+    if (r >= 0 && io->bl.length() != io->len) {
+      ldout(cct, 0) << "ERROR: get_obj_iterate: short read, got " << io->bl.length()
+                    << " bytes, expected " << io->len << dendl;
+      r = -EIO;
+    }
+    if (r >= 0)
+      r = cb->handle_data(io->bl);
+    delete io;
+    if (r < 0)
+      return r;
+  }
+
+  return 0;
+}
+
 /* a simple object read */
 int RGWRados::read(void *ctx, rgw_obj& obj, off_t ofs, size_t size, bufferlist& bl)
 {
@@ -2756,6 +3000,21 @@ int RGWRados::get_bucket_stats(rgw_bucket& bucket, map<RGWObjCategory, RGWBucket
   return 0;
 }
 
+int RGWRados::get_bucket_shard_stats(rgw_bucket& bucket, vector<map<RGWObjCategory, RGWBucketStats> >& stats)
+{
+  vector<rgw_bucket_dir_header> headers;
+  int r = cls_bucket_head(bucket, headers);
+  if (r < 0)
+    return r;
+
+  stats.clear();
+  stats.resize(headers.size());
+  for (size_t i = 0; i < headers.size(); i++)
+    translate_raw_stats(headers[i], stats[i]);
+
+  return 0;
+}
+
 int RGWRados::get_bucket_info(void *ctx, string& bucket_name, RGWBucketInfo& info, map<string, bufferlist> *pattrs)
 {
   bufferlist bl;
@@ -3006,6 +3265,23 @@ int RGWRados::process_gc()
   return gc->process();
 }
 
+void RGWRados::get_gc_stats(RGWGCStats& stats)
+{
+  gc->get_stats(stats);
+}
+
+int RGWRados::get_gc_shard_stats(std::list<RGWGCShardStats>& stats)
+{
+  for (int i = 0; i < cct->_conf->rgw_gc_max_objs; i++) {
+    RGWGCShardStats s;
+    int ret = gc->shard_stats(i, s);
+    if (ret < 0)
+      return ret;
+    stats.push_back(s);
+  }
+  return 0;
+}
+
 int RGWRados::cls_rgw_init_index(librados::IoCtx& io_ctx, librados::ObjectWriteOperation& op, string& oid)
 {
   bufferlist in;
@@ -3020,7 +3296,7 @@ int RGWRados::cls_obj_prepare_op(rgw_bucket& bucket, uint8_t op, string& tag,
   librados::IoCtx io_ctx;
   string oid;
 
-  int r = open_bucket(bucket, io_ctx, oid);
+  int r = open_bucket_index_shard(bucket, io_ctx, name, oid);
   if (r < 0)
     return r;
 
@@ -3036,10 +3312,28 @@ int RGWRados::cls_obj_complete_op(rgw_bucket& bucket, uint8_t op, string& tag, u
   librados::IoCtx io_ctx;
   string oid;
 
-  int r = open_bucket(bucket, io_ctx, oid);
+  int r = open_bucket_index_shard(bucket, io_ctx, ent.name, oid);
   if (r < 0)
     return r;
 
+  /* entries to remove that live in other shards can't go with this op */
+  list<string> shard_remove_objs;
+  if (remove_objs && bucket.num_shards) {
+    int shard = cls_rgw_bucket_shard_id(ent.name, bucket.num_shards);
+    for (list<string>::iterator iter = remove_objs->begin(); iter != remove_objs->end(); ++iter) {
+      if (cls_rgw_bucket_shard_id(*iter, bucket.num_shards) == shard) {
+        shard_remove_objs.push_back(*iter);
+        continue;
+      }
+      string tag;
+      r = cls_obj_complete_del(bucket, tag, 0, *iter);
+      if (r < 0) {
+        ldout(cct, 0) << "WARNING: failed to remove index entry " << *iter << " r=" << r << dendl;
+      }
+    }
+    remove_objs = &shard_remove_objs;
+  }
+
   ObjectWriteOperation o;
   rgw_bucket_dir_entry_meta dir_meta;
   dir_meta.size = ent.size;
@@ -3079,40 +3373,46 @@ int RGWRados::cls_obj_complete_cancel(rgw_bucket& bucket, string& tag, string& n
 int RGWRados::cls_obj_set_bucket_tag_timeout(rgw_bucket& bucket, uint64_t timeout)
 {
   librados::IoCtx io_ctx;
-  string oid;
+  vector<string> oids;
 
-  int r = open_bucket(bucket, io_ctx, oid);
+  int r = open_bucket_index(bucket, io_ctx, oids);
   if (r < 0)
     return r;
 
-  ObjectWriteOperation o;
-  cls_rgw_bucket_set_tag_timeout(o, timeout);
+  for (vector<string>::iterator iter = oids.begin(); iter != oids.end(); ++iter) {
+    ObjectWriteOperation o;
+    cls_rgw_bucket_set_tag_timeout(o, timeout);
 
-  r = io_ctx.operate(oid, &o);
+    r = io_ctx.operate(*iter, &o);
+    if (r < 0)
+      return r;
+  }
 
-  return r;
+  return 0;
 }
 
 int RGWRados::cls_bucket_list(rgw_bucket& bucket, string start, string prefix,
 		              uint32_t num, map<string, RGWObjEnt>& m,
 			      bool *is_truncated, string *last_entry,
-			      bool (*force_check_filter)(const string&  name))
+			      bool (*force_check_filter)(const string&  name),
+                              const string& delim, set<string> *common_prefixes)
 {
   ldout(cct, 10) << "cls_bucket_list " << bucket << " start " << start << " num " << num << dendl;
 
   librados::IoCtx io_ctx;
-  string oid;
-  int r = open_bucket(bucket, io_ctx, oid);
+  vector<string> oids;
+  int r = open_bucket_index(bucket, io_ctx, oids);
   if (r < 0)
     return r;
 
   struct rgw_bucket_dir dir;
-  r = cls_rgw_list_op(io_ctx, oid, start, prefix, num, &dir, is_truncated);
+  r = cls_rgw_list_op(io_ctx, oids, start, prefix, num, &dir, is_truncated,
+                      delim, common_prefixes);
   if (r < 0)
     return r;
 
   map<string, struct rgw_bucket_dir_entry>::iterator miter;
-  bufferlist updates;
+  map<int, bufferlist> updates; // shard -> suggested changes
   for (miter = dir.m.begin(); miter != dir.m.end(); ++miter) {
     RGWObjEnt e;
     rgw_bucket_dir_entry& dirent = miter->second;
@@ -3139,7 +3439,8 @@ int RGWRados::cls_bucket_list(rgw_bucket& bucket, string start, string prefix,
        * and if the tags are old we need to do cleanup as well. */
       librados::IoCtx sub_ctx;
       sub_ctx.dup(io_ctx);
-      r = check_disk_state(sub_ctx, bucket, dirent, e, updates);
+      int shard = cls_rgw_bucket_shard_id(dirent.name, bucket.num_shards);
+      r = check_disk_state(sub_ctx, bucket, dirent, e, updates[shard]);
       if (r < 0) {
         if (r == -ENOENT)
           continue;
@@ -3154,13 +3455,20 @@ int RGWRados::cls_bucket_list(rgw_bucket& bucket, string start, string prefix,
   if (dir.m.size()) {
     *last_entry = dir.m.rbegin()->first;
   }
+  if (common_prefixes && !common_prefixes->empty() &&
+      common_prefixes->rbegin()->compare(*last_entry) > 0) {
+    *last_entry = *common_prefixes->rbegin();
+  }
 
-  if (updates.length()) {
+  map<int, bufferlist>::iterator uiter;
+  for (uiter = updates.begin(); uiter != updates.end(); ++uiter) {
+    if (!uiter->second.length())
+      continue;
     ObjectWriteOperation o;
-    cls_rgw_suggest_changes(o, updates);
+    cls_rgw_suggest_changes(o, uiter->second);
     // we don't care if we lose suggested updates, send them off blindly
     AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
-    r = io_ctx.aio_operate(oid, c, &o);
+    r = io_ctx.aio_operate(oids[uiter->first], c, &o);
     c->release();
   }
   return m.size();
@@ -3327,14 +3635,28 @@ int RGWRados::check_disk_state(librados::IoCtx io_ctx,
 }
 
 int RGWRados::cls_bucket_head(rgw_bucket& bucket, struct rgw_bucket_dir_header& header)
+{
+  vector<rgw_bucket_dir_header> headers;
+  int r = cls_bucket_head(bucket, headers);
+  if (r < 0)
+    return r;
+
+  header = rgw_bucket_dir_header();
+  for (vector<rgw_bucket_dir_header>::iterator iter = headers.begin(); iter != headers.end(); ++iter)
+    header.aggregate(*iter);
+
+  return 0;
+}
+
+int RGWRados::cls_bucket_head(rgw_bucket& bucket, vector<rgw_bucket_dir_header>& headers)
 {
   librados::IoCtx io_ctx;
-  string oid;
-  int r = open_bucket(bucket, io_ctx, oid);
+  vector<string> oids;
+  int r = open_bucket_index(bucket, io_ctx, oids);
   if (r < 0)
     return r;
 
-  r = cls_rgw_get_dir_header(io_ctx, oid, &header);
+  r = cls_rgw_get_dir_headers(io_ctx, oids, &headers);
   if (r < 0)
     return r;
 
@@ -3497,16 +3819,20 @@ int RGWRados::process_intent_log(rgw_bucket& bucket, string& oid,
         int r = open_bucket_ctx(entry.obj.bucket, io_ctx);
         if (r < 0)
           return r;
-        ObjectWriteOperation op;
-        op.remove();
         string oid = dir_oid_prefix;
         oid.append(entry.obj.bucket.marker);
-        librados::AioCompletion *completion = rados->aio_create_completion(NULL, NULL, NULL);
-        r = io_ctx.aio_operate(oid, completion, &op);
-        completion->release();
-        if (r < 0 && r != -ENOENT) {
-          cerr << "failed to remove pool: " << entry.obj.bucket.pool << std::endl;
-          complete = false;
+        vector<string> index_oids;
+        cls_rgw_bucket_shard_oids(oid, entry.obj.bucket.num_shards, index_oids);
+        for (vector<string>::iterator iter = index_oids.begin(); iter != index_oids.end(); ++iter) {
+          ObjectWriteOperation op;
+          op.remove();
+          librados::AioCompletion *completion = rados->aio_create_completion(NULL, NULL, NULL);
+          r = io_ctx.aio_operate(*iter, completion, &op);
+          completion->release();
+          if (r < 0 && r != -ENOENT) {
+            cerr << "failed to remove pool: " << entry.obj.bucket.pool << std::endl;
+            complete = false;
+          }
         }
       }
       break;
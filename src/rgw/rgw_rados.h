@@ -11,6 +11,8 @@ class RGWWatcher;
 class SafeTimer;
 class ACLOwner;
 class RGWGC;
+struct RGWGCStats;
+struct RGWGCShardStats;
 
 /* flags for put_obj_meta() */
 #define PUT_OBJ_CREATE      0x01
@@ -61,6 +63,25 @@ public:
   virtual bool filter(string& name, string& key) = 0;
 };
 
+/* receives the data of an object, in order, from get_obj_iterate() */
+class RGWGetDataCB {
+public:
+  virtual ~RGWGetDataCB() {}
+  virtual int handle_data(bufferlist& bl) = 0;
+};
+
+/*
+ * Called, from a librados thread, once an op that returned -EINPROGRESS
+ * rather than wait for rados can go on.
+ */
+class RGWResumeCB {
+public:
+  virtual ~RGWResumeCB() {}
+  virtual void resume() = 0;
+};
+
+struct get_obj_io;
+
 struct RGWCloneRangeInfo {
   rgw_obj src;
   off_t src_ofs;
@@ -290,13 +311,35 @@ class RGWRados
 
   int open_bucket_ctx(rgw_bucket& bucket, librados::IoCtx&  io_ctx);
   int open_bucket(rgw_bucket& bucket, librados::IoCtx&  io_ctx, string& bucket_oid);
+  int open_bucket_index(rgw_bucket& bucket, librados::IoCtx& io_ctx, vector<string>& oids);
+  int open_bucket_index_shard(rgw_bucket& bucket, librados::IoCtx& io_ctx, const string& obj_key,
+                              string& oid);
 
   struct GetObjState {
     librados::IoCtx io_ctx;
     bool sent_data;
 
-    GetObjState() : sent_data(false) {}
+    /* where get_obj_iterate() got to, for when it's called again after
+     * returning -EINPROGRESS */
+    bool started;
+    off_t ofs;
+    off_t end;
+    RGWRadosCtx *new_ctx;
+    RGWObjState *astate;
+    list<get_obj_io *> ios; /* in the order the data goes out */
+    uint64_t in_flight;
+
+    Mutex lock; /* protects waiting */
+    bool waiting;
+    RGWResumeCB *resume_cb;
+
+    GetObjState() : sent_data(false), started(false), ofs(0), end(-1),
+                    new_ctx(NULL), astate(NULL), in_flight(0),
+                    lock("RGWRados::GetObjState::lock"), waiting(false),
+                    resume_cb(NULL) {}
+    ~GetObjState();
   };
+  static void get_obj_io_cb(librados::completion_t c, void *arg);
 
   Mutex lock;
   SafeTimer *timer;
@@ -469,7 +512,8 @@ public:
   virtual int put_obj_data(void *ctx, rgw_obj& obj, const char *data,
               off_t ofs, size_t len, bool exclusive);
   virtual int aio_put_obj_data(void *ctx, rgw_obj& obj, bufferlist& bl,
-                               off_t ofs, bool exclusive, void **handle);
+                               off_t ofs, bool exclusive, void **handle,
+                               librados::callback_t cb = NULL, void *cb_arg = NULL);
   /* note that put_obj doesn't set category on an object, only use it for none user objects */
   int put_obj(void *ctx, rgw_obj& obj, const char *data, size_t len, bool exclusive,
               time_t *mtime, map<std::string, bufferlist>& attrs) {
@@ -625,6 +669,19 @@ public:
 
   virtual void finish_get_obj(void **handle);
 
+  /**
+   * Read [ofs, end] of an object prepared with prepare_get_obj(), and
+   * hand it to cb in order, keeping up to rgw_get_obj_window_size bytes
+   * of reads in flight.
+   *
+   * If resume_cb is given, this returns -EINPROGRESS instead of waiting
+   * for a read, and calls resume_cb->resume() once the read completes;
+   * then call it again with the same handle to go on.
+   */
+  int get_obj_iterate(void *ctx, void **handle, rgw_obj& obj,
+                      off_t ofs, off_t end, RGWGetDataCB *cb,
+                      RGWResumeCB *resume_cb = NULL);
+
  /**
    * a simple object read without keeping state
    */
@@ -672,6 +729,7 @@ public:
 
   int decode_policy(bufferlist& bl, ACLOwner *owner);
   int get_bucket_stats(rgw_bucket& bucket, map<RGWObjCategory, RGWBucketStats>& stats);
+  int get_bucket_shard_stats(rgw_bucket& bucket, vector<map<RGWObjCategory, RGWBucketStats> >& stats);
   virtual int get_bucket_info(void *ctx, string& bucket_name, RGWBucketInfo& info, map<string, bufferlist> *pattrs = NULL);
   virtual int put_bucket_info(string& bucket_name, RGWBucketInfo& info, bool exclusive, map<string, bufferlist> *pattrs);
 
@@ -686,8 +744,10 @@ public:
   int cls_obj_set_bucket_tag_timeout(rgw_bucket& bucket, uint64_t timeout);
   int cls_bucket_list(rgw_bucket& bucket, string start, string prefix, uint32_t num,
                       map<string, RGWObjEnt>& m, bool *is_truncated,
-                      string *last_entry, bool (*force_check_filter)(const string&  name) = NULL);
+                      string *last_entry, bool (*force_check_filter)(const string&  name) = NULL,
+                      const string& delim = "", set<string> *common_prefixes = NULL);
   int cls_bucket_head(rgw_bucket& bucket, struct rgw_bucket_dir_header& header);
+  int cls_bucket_head(rgw_bucket& bucket, vector<rgw_bucket_dir_header>& headers);
   int prepare_update_index(RGWObjState *state, rgw_bucket& bucket,
                            rgw_obj& oid, string& tag);
   int complete_update_index(rgw_bucket& bucket, string& oid, string& tag, uint64_t epoch, uint64_t size,
@@ -714,6 +774,8 @@ public:
 
   int list_gc_objs(int *index, string& marker, uint32_t max, std::list<cls_rgw_gc_obj_info>& result, bool *truncated);
   int process_gc();
+  void get_gc_stats(RGWGCStats& stats);
+  int get_gc_shard_stats(std::list<RGWGCShardStats>& stats);
   int defer_gc(void *ctx, rgw_obj& obj);
 
   int bucket_check_index(rgw_bucket& bucket,
@@ -176,7 +176,7 @@ done:
 
 send_data:
   if (get_data && !orig_ret) {
-    int r = s->cio->write(bl.c_str(), len);
+    int r = s->cio->write(bl);
     if (r < 0)
       return r;
   }
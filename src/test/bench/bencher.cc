@@ -168,10 +168,13 @@ void Bencher::run_bench()
 	while (bl.length() < length) {
 	  bl.append(rand());
 	}
+	// io sizes may vary, so only use as much as this op needs
+	bufferlist write_bl;
+	write_bl.substr_of(bl, 0, length);
 	backend->write(
 	  obj_name,
 	  offset,
-	  bl,
+	  write_bl,
 	  new OnWriteApplied(
 	    this, seq, on_delete),
 	  new OnWriteCommit(
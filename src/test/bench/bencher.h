@@ -116,7 +116,7 @@ class SequentialLoad :
   boost::tuple<string, uint64_t, uint64_t, Bencher::OpType> > {
   set<string> objects;
   uint64_t size;
-  uint64_t length;
+  boost::scoped_ptr<Distribution<uint64_t> > length;
   set<string>::iterator object_pos;
   uint64_t cur_pos;
   boost::scoped_ptr<Distribution<Bencher::OpType> > op_dist;
@@ -126,21 +126,29 @@ public:
     const set<string> &_objects, uint64_t size,
     uint64_t length,
     Distribution<Bencher::OpType> *op_dist)
+    : objects(_objects), size(size), length(new Uniform(length)),
+      object_pos(objects.begin()), cur_pos(0),
+      op_dist(op_dist) {}
+  SequentialLoad(
+    const set<string> &_objects, uint64_t size,
+    Distribution<uint64_t> *length,
+    Distribution<Bencher::OpType> *op_dist)
     : objects(_objects), size(size), length(length),
       object_pos(objects.begin()), cur_pos(0),
       op_dist(op_dist) {}
 
   boost::tuple<string, uint64_t, uint64_t, Bencher::OpType>
   operator()() {
-    boost::tuple<string, uint64_t, uint64_t, Bencher::OpType> ret =
-      boost::make_tuple(*object_pos, cur_pos, length, (*op_dist)());
-    cur_pos += length;
-    if (cur_pos > size) {
+    uint64_t len = (*length)();
+    if (cur_pos + len > size) {
       cur_pos = 0;
       object_pos++;
+      if (object_pos == objects.end())
+	object_pos = objects.begin();
     }
-    if (object_pos == objects.end())
-      object_pos = objects.begin();
+    boost::tuple<string, uint64_t, uint64_t, Bencher::OpType> ret =
+      boost::make_tuple(*object_pos, cur_pos, len, (*op_dist)());
+    cur_pos += len;
     return ret;
   }
 };
@@ -1,6 +1,7 @@
 // -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
 
 #include "detailed_stat_collector.h"
+#include <math.h>
 #include <sys/time.h>
 #include <utility>
 #include <boost/tuple/tuple.hpp>
@@ -29,6 +30,49 @@ static utime_t cur_time()
   return utime_t(&tv);
 }
 
+// buckets per doubling of latency; the bucket bounds are ~4% apart
+static const int BUCKETS_PER_OCTAVE = 16;
+
+void DetailedStatCollector::LatencyHistogram::add(double latency)
+{
+  double usec = latency * 1000000;
+  unsigned i = 0;
+  if (usec >= 1)
+    i = (unsigned)(log2(usec) * BUCKETS_PER_OCTAVE) + 1;
+  if (i >= buckets.size())
+    buckets.resize(i + 1);
+  ++buckets[i];
+  ++count;
+}
+
+double DetailedStatCollector::LatencyHistogram::percentile(double p) const
+{
+  uint64_t target = (uint64_t)ceil(count * p / 100);
+  uint64_t seen = 0;
+  for (unsigned i = 0; i < buckets.size(); ++i) {
+    seen += buckets[i];
+    if (seen >= target && seen) {
+      // report the upper bound of the bucket, in seconds
+      return pow(2, (double)i / BUCKETS_PER_OCTAVE) / 1000000;
+    }
+  }
+  return 0;
+}
+
+void DetailedStatCollector::LatencyHistogram::clear()
+{
+  buckets.clear();
+  count = 0;
+}
+
+void DetailedStatCollector::LatencyHistogram::dump(Formatter *f) const
+{
+  f->dump_float("p50", percentile(50));
+  f->dump_float("p90", percentile(90));
+  f->dump_float("p99", percentile(99));
+  f->dump_float("p999", percentile(99.9));
+}
+
 DetailedStatCollector::Aggregator::Aggregator()
   : recent_size(0), total_size(0), recent_latency(0),
     total_latency(0), recent_ops(0), total_ops(0), started(false)
@@ -46,6 +90,8 @@ void DetailedStatCollector::Aggregator::add(const Op &op)
   total_size += op.size;
   recent_latency += op.latency;
   total_latency += op.latency;
+  recent_hist.add(op.latency);
+  total_hist.add(op.latency);
 }
 
 void DetailedStatCollector::Aggregator::dump(Formatter *f)
@@ -54,6 +100,12 @@ void DetailedStatCollector::Aggregator::dump(Formatter *f)
   f->dump_stream("time") << now;
   f->dump_float("avg_recent_latency", recent_latency / recent_ops);
   f->dump_float("avg_total_latency", total_latency / total_ops);
+  f->open_object_section("recent_latency");
+  recent_hist.dump(f);
+  f->close_section();
+  f->open_object_section("total_latency");
+  total_hist.dump(f);
+  f->close_section();
   f->dump_float("avg_recent_iops", recent_ops / (now - last));
   f->dump_float("avg_total_iops", total_ops / (now - first));
   f->dump_float("avg_recent_throughput", recent_size / (now - last));
@@ -67,6 +119,7 @@ void DetailedStatCollector::Aggregator::dump(Formatter *f)
   recent_latency = 0;
   recent_size = 0;
   recent_ops = 0;
+  recent_hist.clear();
 }
 
 DetailedStatCollector::DetailedStatCollector(
@@ -81,30 +134,42 @@ DetailedStatCollector::DetailedStatCollector(
   last_dump = cur_time();
 }
 
-uint64_t DetailedStatCollector::next_seq()
+void DetailedStatCollector::_dump_summary()
 {
-  Mutex::Locker l(lock);
-  if (summary_out && ((cur_time() - last_dump) > bin_size)) {
-    f->open_object_section("stats");
-    for (map<string, Aggregator>::iterator i = aggregators.begin();
-	 i != aggregators.end();
-	 ++i) {
-      f->open_object_section(i->first.c_str());
-      i->second.dump(f.get());
-      f->close_section();
-    }
+  assert(lock.is_locked());
+  f->open_object_section("stats");
+  for (map<string, Aggregator>::iterator i = aggregators.begin();
+       i != aggregators.end();
+       ++i) {
+    f->open_object_section(i->first.c_str());
+    i->second.dump(f.get());
     f->close_section();
-    f->flush(*summary_out);
+  }
+  f->close_section();
+  f->flush(*summary_out);
+  *summary_out << std::endl;
+  if (details) {
+    (*details)(summary_out);
     *summary_out << std::endl;
-    if (details) {
-      (*details)(summary_out);
-      *summary_out << std::endl;
-    }
-    last_dump = cur_time();
   }
+  last_dump = cur_time();
+}
+
+uint64_t DetailedStatCollector::next_seq()
+{
+  Mutex::Locker l(lock);
+  if (summary_out && ((cur_time() - last_dump) > bin_size))
+    _dump_summary();
   return cur_seq++;
 }
 
+void DetailedStatCollector::dump_summary()
+{
+  Mutex::Locker l(lock);
+  if (summary_out)
+    _dump_summary();
+}
+
 void DetailedStatCollector::start_write(uint64_t seq, uint64_t length)
 {
   Mutex::Locker l(lock);
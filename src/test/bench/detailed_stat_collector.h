@@ -11,6 +11,7 @@
 #include "include/utime.h"
 #include <list>
 #include <map>
+#include <vector>
 #include <boost/tuple/tuple.hpp>
 #include <ostream>
 
@@ -38,7 +39,20 @@ private:
 	size(size), seq(seq) {}
     void dump(ostream *out, Formatter *f);
   };
+  /// log-scale latency histogram, so percentiles don't need every sample
+  class LatencyHistogram {
+    vector<uint64_t> buckets;
+    uint64_t count;
+  public:
+    LatencyHistogram() : count(0) {}
+    void add(double latency);
+    double percentile(double p) const;
+    void clear();
+    void dump(Formatter *f) const;
+  };
   class Aggregator {
+    LatencyHistogram recent_hist;
+    LatencyHistogram total_hist;
     uint64_t recent_size;
     uint64_t total_size;
     double recent_latency;
@@ -75,6 +89,7 @@ private:
   void dump(
     const string &type,
     boost::tuple<utime_t, utime_t, uint64_t, uint64_t> stuff);
+  void _dump_summary();
 public:
   DetailedStatCollector(
     double bin_size,
@@ -85,6 +100,8 @@ public:
     );
 
   uint64_t next_seq();
+  /// dump the stats since the last dump, and the totals, right away
+  void dump_summary();
   void start_write(uint64_t seq, uint64_t size);
   void start_read(uint64_t seq, uint64_t size);
   void write_applied(uint64_t seq);
@@ -20,6 +20,7 @@
     bucket stats               returns bucket statistics
     bucket rm                  remove bucket
     bucket check               check bucket index
+    bucket shards              show the size of each bucket index shard
     object rm                  remove object
     cluster info               show cluster params info
     pool add                   add an existing pool for data placement
@@ -20,6 +20,12 @@
                                                 (dest defaults
                                                  as the filename part of file)
                                                 "-" for stdin
+    export-diff <image-name> [--from-snap <snap-name>] <path>
+                                                export an incremental diff to
+                                                path, or "-" for stdout
+    import-diff <path> <image-name>             apply an incremental diff to
+                                                image-name
+                                                "-" for stdin
     (cp | copy) <src> <dest>                    copy src image to dest
     (mv | rename) <src> <dest>                  rename src image to dest
     snap ls <image-name>                        dump list of image snapshots
@@ -40,6 +46,11 @@
     lock add <image-name> <id> [--shared <tag>] take a lock called id on an image
     lock remove <image-name> <id> <locker>      release a lock on an image
     bench-write <image-name> --io-size <bytes> --io-threads <num> --io-total <bytes>
+    bench-read <image-name> --io-size <bytes> --io-threads <num> --io-total <bytes>
+    bench <image-name> --io-type <read | write | rw> [--io-pattern <seq | rand>]
+          [--rw-mix-read <percent>] --io-size <bytes> [--io-size-max <bytes>]
+          --io-threads <num> [--io-total <bytes>] [--duration <seconds>]
+                                                simple io benchmark
   
   <image-name>, <snap-name> are [pool/]name[@snap], or you may specify
   individual pieces of names with -p/--pool, --image, and/or --snap.
@@ -51,12 +62,14 @@
     --snap <snap-name>           snapshot name
     --dest-pool <name>           destination pool name
     --path <path-name>           path name for import/export
+    --from-snap <snap-name>      starting snapshot for export-diff
     --size <size in MB>          size of image for create and resize
     --order <bits>               the object size in bits; object size will be
                                  (1 << order) bytes. Default is 22 (4 MB).
     --format <format-number>     format to use when creating an image
                                  format 1 is the original format (default)
                                  format 2 supports cloning
+    --object-map                 track which objects exist (format 2 only)
     --id <username>              rados user (without 'client.' prefix) to authenticate as
     --keyfile <path>             file containing secret key for use with cephx
     --shared <tag>               take a shared (rather than exclusive) lock
@@ -48,6 +48,9 @@ using ::librbd::cls_client::set_protection_status;
 using ::librbd::cls_client::get_stripe_unit_count;
 using ::librbd::cls_client::set_stripe_unit_count;
 using ::librbd::cls_client::old_snapshot_add;
+using ::librbd::cls_client::object_map_load;
+using ::librbd::cls_client::object_map_resize;
+using ::librbd::cls_client::object_map_update;
 
 static char *random_buf(size_t len)
 {
@@ -909,3 +912,53 @@ TEST(cls_rbd, stripingv2)
   ioctx.close();
   ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
 }
+
+TEST(cls_rbd, object_map)
+{
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+
+  ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+
+  string oid = "rbd_object_map.foo";
+  vector<bool> object_map;
+  ASSERT_EQ(-ENOENT, object_map_load(&ioctx, oid, &object_map));
+  ASSERT_EQ(-ENOENT, object_map_update(&ioctx, oid, 0, 1, true));
+
+  ASSERT_EQ(0, object_map_resize(&ioctx, oid, 20));
+  ASSERT_EQ(0, object_map_load(&ioctx, oid, &object_map));
+  ASSERT_EQ(20u, object_map.size());
+  for (size_t i = 0; i < object_map.size(); ++i)
+    ASSERT_FALSE(object_map[i]);
+
+  // ranges that straddle byte boundaries and run off the end
+  ASSERT_EQ(0, object_map_update(&ioctx, oid, 3, 11, true));
+  ASSERT_EQ(0, object_map_update(&ioctx, oid, 18, 100, true));
+  ASSERT_EQ(0, object_map_update(&ioctx, oid, 5, 7, false));
+  ASSERT_EQ(0, object_map_update(&ioctx, oid, 30, 40, true));
+  ASSERT_EQ(0, object_map_load(&ioctx, oid, &object_map));
+  ASSERT_EQ(20u, object_map.size());
+  for (size_t i = 0; i < object_map.size(); ++i) {
+    bool expected = (i >= 3 && i < 5) || (i >= 7 && i < 11) || i >= 18;
+    ASSERT_EQ(expected, object_map[i]) << "object " << i;
+  }
+
+  // shrinking drops bits, growing again adds nonexistent objects
+  ASSERT_EQ(0, object_map_resize(&ioctx, oid, 9));
+  ASSERT_EQ(0, object_map_resize(&ioctx, oid, 24));
+  ASSERT_EQ(0, object_map_load(&ioctx, oid, &object_map));
+  ASSERT_EQ(24u, object_map.size());
+  for (size_t i = 0; i < object_map.size(); ++i) {
+    bool expected = (i >= 3 && i < 5) || (i >= 7 && i < 9);
+    ASSERT_EQ(expected, object_map[i]) << "object " << i;
+  }
+
+  ASSERT_EQ(0, object_map_resize(&ioctx, oid, 0));
+  ASSERT_EQ(0, object_map_load(&ioctx, oid, &object_map));
+  ASSERT_EQ(0u, object_map.size());
+
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
+}
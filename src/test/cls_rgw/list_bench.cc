@@ -0,0 +1,242 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Measure listing a bucket index with a delimiter.  Fills an index
+ * object with --keys entries spread over --prefixes "directories", then
+ * lists it a page of --page items at a time, the way a delimited S3
+ * listing does: once letting the class fold each common prefix and seek
+ * past it, and once the way the gateway does it when the class cannot,
+ * reading every key and folding them itself.  Reports the class calls,
+ * the omap reads the class did, the keys it returned, and the time for
+ * each page.
+ */
+
+#include <errno.h>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "include/types.h"
+#include "include/rados/librados.hpp"
+#include "cls/rgw/cls_rgw_client.h"
+#include "cls/rgw/cls_rgw_ops.h"
+#include "common/ceph_argparse.h"
+#include "common/Clock.h"
+#include "common/errno.h"
+#include "test/librados/test.h"
+
+using namespace librados;
+
+static const string oid = "list-bench";
+
+struct page_stats {
+  uint64_t pages;
+  uint64_t calls;
+  uint64_t omap_reads;
+  uint64_t keys;
+  utime_t time;
+
+  page_stats() : pages(0), calls(0), omap_reads(0), keys(0) {}
+};
+
+static string key_name(long long dir, long long obj)
+{
+  char buf[64];
+  snprintf(buf, sizeof(buf), "dir-%08lld/obj-%08lld", dir, obj);
+  return buf;
+}
+
+static int fill(IoCtx& ioctx, long long num_keys, long long num_prefixes)
+{
+  ObjectWriteOperation init;
+  cls_rgw_bucket_init(init);
+  int r = ioctx.operate(oid, &init);
+  if (r < 0)
+    return r;
+
+  /* the listing only looks at the entries, so skip prepare/complete and
+   * write them straight into the omap */
+  map<string, bufferlist> batch;
+  for (long long i = 0; i < num_keys; i++) {
+    rgw_bucket_dir_entry entry;
+    entry.name = key_name(i % num_prefixes, i / num_prefixes);
+    entry.exists = true;
+    entry.meta.size = 1;
+    ::encode(entry, batch[entry.name]);
+    if (batch.size() == 1000 || i == num_keys - 1) {
+      r = ioctx.omap_set(oid, batch);
+      if (r < 0)
+        return r;
+      batch.clear();
+    }
+  }
+  return 0;
+}
+
+static int list_index(IoCtx& ioctx, const string& marker, uint32_t num_entries,
+                      const string& delimiter, rgw_cls_list_ret *ret)
+{
+  rgw_cls_list_op call;
+  call.start_obj = marker;
+  call.num_entries = num_entries;
+  call.delimiter = delimiter;
+  bufferlist in, out;
+  ::encode(call, in);
+  int r = ioctx.exec(oid, "rgw", "bucket_list", in, out);
+  if (r < 0)
+    return r;
+
+  try {
+    bufferlist::iterator iter = out.begin();
+    ::decode(*ret, iter);
+  } catch (buffer::error& err) {
+    return -EIO;
+  }
+  return 0;
+}
+
+/* list one page, as RGWRados::list_objects does, with the class folding
+ * the common prefixes or with the gateway folding them */
+static int list_page(IoCtx& ioctx, string& marker, uint32_t page, bool index_delim,
+                     page_stats *stats, bool *truncated)
+{
+  uint32_t count = 0;
+  set<string> common_prefixes;
+
+  do {
+    rgw_cls_list_ret ret;
+    int r = list_index(ioctx, marker, page - count, (index_delim ? "/" : ""), &ret);
+    if (r < 0)
+      return r;
+    stats->calls++;
+    stats->omap_reads += ret.omap_reads;
+    stats->keys += ret.dir.m.size() + ret.common_prefixes.size();
+    *truncated = ret.is_truncated;
+
+    for (set<string>::iterator piter = ret.common_prefixes.begin();
+         piter != ret.common_prefixes.end(); ++piter) {
+      if (common_prefixes.insert(*piter).second)
+        count++;
+      marker = max(marker, *piter);
+    }
+
+    map<string, rgw_bucket_dir_entry>::iterator eiter;
+    for (eiter = ret.dir.m.begin(); eiter != ret.dir.m.end(); ++eiter) {
+      const string& name = eiter->first;
+      size_t pos = name.find('/');
+      if (pos == string::npos || common_prefixes.insert(name.substr(0, pos + 1)).second)
+        count++;
+      marker = max(marker, name);
+    }
+  } while (*truncated && count < page);
+
+  stats->pages++;
+  return 0;
+}
+
+static int run(IoCtx& ioctx, bool index_delim, uint32_t page, long long max_pages)
+{
+  page_stats stats;
+  string marker;
+  bool truncated = true;
+
+  utime_t start = ceph_clock_now(NULL);
+  while (truncated && (max_pages <= 0 || (long long)stats.pages < max_pages)) {
+    int r = list_page(ioctx, marker, page, index_delim, &stats, &truncated);
+    if (r < 0)
+      return r;
+  }
+  stats.time = ceph_clock_now(NULL) - start;
+
+  double pages = stats.pages;
+  std::cout << std::setw(10) << (index_delim ? "class" : "gateway")
+	    << std::setw(7) << stats.pages
+	    << std::setprecision(1) << std::fixed
+	    << std::setw(12) << stats.calls / pages
+	    << std::setw(12) << stats.omap_reads / pages
+	    << std::setw(12) << stats.keys / pages
+	    << std::setprecision(3)
+	    << std::setw(12) << (double)stats.time * 1000 / pages
+	    << std::endl;
+  return 0;
+}
+
+int main(int argc, const char **argv)
+{
+  std::vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+
+  long long num_keys = 100000;
+  long long num_prefixes = 100;
+  long long page = 1000;
+  long long max_pages = 0;
+  std::ostringstream err;
+  std::vector<const char*>::iterator i;
+  for (i = args.begin(); i != args.end();) {
+    if (ceph_argparse_withlonglong(args, i, &num_keys, &err, "--keys", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_withlonglong(args, i, &num_prefixes, &err, "--prefixes", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_withlonglong(args, i, &page, &err, "--page", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_withlonglong(args, i, &max_pages, &err, "--pages", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else {
+      cerr << "unknown option " << *i << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if (num_keys <= 0 || num_prefixes <= 0 || page <= 0 || page > (uint32_t)-1) {
+    cerr << argv[0] << ": invalid sizes" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  Rados rados;
+  IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+  string ret = create_one_pool_pp(pool_name, rados);
+  if (!ret.empty()) {
+    cerr << argv[0] << ": " << ret << std::endl;
+    return EXIT_FAILURE;
+  }
+  int r = rados.ioctx_create(pool_name.c_str(), ioctx);
+  if (r == 0)
+    r = fill(ioctx, num_keys, num_prefixes);
+  if (r < 0) {
+    cerr << argv[0] << ": filling the index failed: " << cpp_strerror(r) << std::endl;
+    destroy_one_pool_pp(pool_name, rados);
+    return EXIT_FAILURE;
+  }
+
+  std::cout << num_keys << " keys in " << num_prefixes << " prefixes, "
+	    << page << " items a page" << std::endl;
+  std::cout << "      fold  pages  calls/page  reads/page   keys/page     ms/page"
+	    << std::endl;
+  r = run(ioctx, true, page, max_pages);
+  if (r == 0)
+    r = run(ioctx, false, page, max_pages);
+  if (r < 0)
+    cerr << argv[0] << ": listing failed: " << cpp_strerror(r) << std::endl;
+
+  ioctx.close();
+  destroy_one_pool_pp(pool_name, rados);
+  return (r < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -8,6 +8,7 @@
 #include "test/librados/test.h"
 
 #include <errno.h>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -355,6 +356,185 @@ TEST(cls_rgw, index_suggest)
   test_stats(ioctx, bucket_oid, 0, num_objs / 2, total_size);
 }
 
+TEST(cls_rgw, index_sharded)
+{
+  string base_oid = str_int("bucket", 4);
+  uint32_t num_shards = 4;
+
+  vector<string> shard_oids;
+  cls_rgw_bucket_shard_oids(base_oid, num_shards, shard_oids);
+  ASSERT_EQ(num_shards, shard_oids.size());
+
+  OpMgr mgr;
+
+  for (vector<string>::iterator iter = shard_oids.begin(); iter != shard_oids.end(); ++iter) {
+    ObjectWriteOperation *op = mgr.write_op();
+    cls_rgw_bucket_init(*op);
+    ASSERT_EQ(0, ioctx.operate(*iter, op));
+  }
+
+  int num_objs = 100;
+  uint64_t obj_size = 1024;
+  set<string> objs;
+
+  for (int i = 0; i < num_objs; i++) {
+    string obj = str_int("obj", i);
+    string tag = str_int("tag", i);
+    string loc = str_int("loc", i);
+
+    string oid;
+    cls_rgw_bucket_shard_oid(base_oid, num_shards, obj, oid);
+    ASSERT_EQ(shard_oids[cls_rgw_bucket_shard_id(obj, num_shards)], oid);
+
+    index_prepare(mgr, ioctx, oid, CLS_RGW_OP_ADD, tag, obj, loc);
+
+    rgw_bucket_dir_entry_meta meta;
+    meta.category = 0;
+    meta.size = obj_size;
+    index_complete(mgr, ioctx, oid, CLS_RGW_OP_ADD, tag, 1, obj, meta);
+
+    objs.insert(obj);
+  }
+
+  /* every shard got some of the objects, and the headers add up */
+  vector<rgw_bucket_dir_header> headers;
+  ASSERT_EQ(0, cls_rgw_get_dir_headers(ioctx, shard_oids, &headers));
+  ASSERT_EQ(num_shards, headers.size());
+  rgw_bucket_dir_header total;
+  for (vector<rgw_bucket_dir_header>::iterator iter = headers.begin(); iter != headers.end(); ++iter) {
+    ASSERT_LT(0u, iter->stats[0].num_entries);
+    total.aggregate(*iter);
+  }
+  ASSERT_EQ((uint64_t)num_objs, total.stats[0].num_entries);
+  ASSERT_EQ(obj_size * num_objs, total.stats[0].total_size);
+
+  /* list in pages, the result should be one sorted listing of all of them */
+  string marker;
+  string prefix;
+  set<string>::iterator expected = objs.begin();
+  bool truncated = true;
+  int pages = 0;
+  while (truncated) {
+    rgw_bucket_dir dir;
+    ASSERT_EQ(0, cls_rgw_list_op(ioctx, shard_oids, marker, prefix, 7, &dir, &truncated));
+    ASSERT_GE(7u, dir.m.size());
+    ASSERT_EQ(total.stats[0].num_entries, dir.header.stats[0].num_entries);
+    for (map<string, rgw_bucket_dir_entry>::iterator iter = dir.m.begin(); iter != dir.m.end(); ++iter) {
+      ASSERT_TRUE(expected != objs.end());
+      ASSERT_EQ(*expected, iter->first);
+      ++expected;
+      marker = iter->first;
+    }
+    pages++;
+  }
+  ASSERT_TRUE(expected == objs.end());
+  ASSERT_EQ((num_objs + 6) / 7, pages);
+
+  /* a prefix only matching a few objects */
+  rgw_bucket_dir dir;
+  marker.clear();
+  prefix = "obj-1";
+  ASSERT_EQ(0, cls_rgw_list_op(ioctx, shard_oids, marker, prefix, 1000, &dir, &truncated));
+  ASSERT_FALSE(truncated);
+  ASSERT_EQ(11u, dir.m.size()); // obj-1, obj-10 .. obj-19
+}
+
+/* list the whole bucket in pages, returns the entries and common prefixes in order */
+static void list_delimited(vector<string>& oids, string prefix, string delimiter,
+                           uint32_t page, vector<string>& listed, int *pages)
+{
+  string marker;
+  bool truncated = true;
+  *pages = 0;
+  while (truncated) {
+    rgw_bucket_dir dir;
+    set<string> common_prefixes;
+    ASSERT_EQ(0, cls_rgw_list_op(ioctx, oids, marker, prefix, page, &dir, &truncated,
+                                 delimiter, &common_prefixes));
+    ASSERT_GE(page, dir.m.size() + common_prefixes.size());
+
+    set<string> page_items(common_prefixes);
+    for (map<string, rgw_bucket_dir_entry>::iterator iter = dir.m.begin(); iter != dir.m.end(); ++iter)
+      page_items.insert(iter->first);
+    listed.insert(listed.end(), page_items.begin(), page_items.end());
+    if (!page_items.empty())
+      marker = *page_items.rbegin();
+    (*pages)++;
+  }
+}
+
+TEST(cls_rgw, index_list_delimiter)
+{
+  for (uint32_t num_shards = 0; num_shards <= 4; num_shards += 4) {
+    string base_oid = str_int("bucket-delim", num_shards);
+
+    vector<string> oids;
+    cls_rgw_bucket_shard_oids(base_oid, num_shards, oids);
+
+    OpMgr mgr;
+
+    for (vector<string>::iterator iter = oids.begin(); iter != oids.end(); ++iter) {
+      ObjectWriteOperation *op = mgr.write_op();
+      cls_rgw_bucket_init(*op);
+      ASSERT_EQ(0, ioctx.operate(*iter, op));
+    }
+
+    /* 5 directories of 20 objects each, and 5 objects at the top */
+    vector<string> objs;
+    for (int i = 0; i < 5; i++) {
+      for (int j = 0; j < 20; j++)
+        objs.push_back(str_int("dir", i) + str_int("/obj", j));
+      objs.push_back(str_int("obj", i));
+    }
+
+    for (vector<string>::iterator iter = objs.begin(); iter != objs.end(); ++iter) {
+      string& obj = *iter;
+      string tag = "tag";
+      string loc;
+
+      string oid;
+      cls_rgw_bucket_shard_oid(base_oid, num_shards, obj, oid);
+
+      index_prepare(mgr, ioctx, oid, CLS_RGW_OP_ADD, tag, obj, loc);
+
+      rgw_bucket_dir_entry_meta meta;
+      meta.category = 0;
+      meta.size = 1;
+      index_complete(mgr, ioctx, oid, CLS_RGW_OP_ADD, tag, 1, obj, meta);
+    }
+
+    /* the directories come back as one common prefix each */
+    vector<string> listed;
+    int pages;
+    list_delimited(oids, "", "/", 3, listed, &pages);
+    ASSERT_EQ(10u, listed.size());
+    for (int i = 0; i < 5; i++) {
+      ASSERT_EQ(str_int("dir", i) + "/", listed[i]);
+      ASSERT_EQ(str_int("obj", i), listed[5 + i]);
+    }
+    ASSERT_EQ(4, pages);
+
+    /* within a directory there is nothing to fold */
+    listed.clear();
+    list_delimited(oids, "dir-2/", "/", 7, listed, &pages);
+    ASSERT_EQ(20u, listed.size());
+    ASSERT_EQ(3, pages);
+
+    /* a marker within a common prefix continues after it */
+    rgw_bucket_dir dir;
+    set<string> common_prefixes;
+    bool truncated;
+    string marker = "dir-3/obj-7";
+    string prefix;
+    ASSERT_EQ(0, cls_rgw_list_op(ioctx, oids, marker, prefix, 1, &dir, &truncated,
+                                 "/", &common_prefixes));
+    ASSERT_EQ(0u, dir.m.size());
+    ASSERT_EQ(1u, common_prefixes.size());
+    ASSERT_EQ("dir-4/", *common_prefixes.begin());
+    ASSERT_TRUE(truncated);
+  }
+}
+
 /* test garbage collection */
 static void create_obj(cls_rgw_obj& obj, int i, int j)
 {
@@ -525,6 +705,62 @@ TEST(cls_rgw, gc_defer)
   ASSERT_EQ(0, destroy_one_pool_pp(gc_pool_name, rados));
 }
 
+TEST(cls_rgw, gc_remove_batch)
+{
+  /* add chains */
+  string oid = "gc_batch";
+  for (int i = 0; i < 20; i++) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "chain-%d", i);
+    librados::ObjectWriteOperation op;
+    cls_rgw_gc_obj_info info;
+
+    cls_rgw_obj obj;
+    create_obj(obj, i, 1);
+    info.chain.objs.push_back(obj);
+
+    op.create(false); // create object
+
+    info.tag = buf;
+    cls_rgw_gc_set_entry(op, 0, info);
+
+    ASSERT_EQ(0, ioctx.operate(oid, &op));
+  }
+
+  /* remove most of them in a single op, along with a tag that isn't there */
+  list<string> tags;
+  for (int i = 0; i < 15; i++) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "chain-%d", i);
+    tags.push_back(buf);
+  }
+  tags.push_back("nonexistent");
+
+  librados::ObjectWriteOperation op;
+  cls_rgw_gc_remove(op, tags);
+  ASSERT_EQ(0, ioctx.operate(oid, &op));
+
+  bool truncated;
+  list<cls_rgw_gc_obj_info> entries;
+  string marker;
+
+  /* verify only the chains that weren't removed are left */
+  ASSERT_EQ(0, cls_rgw_gc_list(ioctx, oid, marker, 100, entries, &truncated));
+  ASSERT_EQ(5, (int)entries.size());
+  ASSERT_EQ(0, truncated);
+
+  set<string> left;
+  list<cls_rgw_gc_obj_info>::iterator iter;
+  for (iter = entries.begin(); iter != entries.end(); ++iter)
+    left.insert(iter->tag);
+
+  for (int i = 15; i < 20; i++) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "chain-%d", i);
+    ASSERT_EQ(1, (int)left.count(buf));
+  }
+}
+
 
 /* must be last test! */
 
@@ -55,8 +55,13 @@ TYPE(pg_create_t)
 TYPE(watch_info_t)
 TYPE(object_info_t)
 TYPE(SnapSet)
+TYPE(clone_info)
+TYPE(obj_list_snap_response_t)
 TYPE(ObjectRecoveryInfo)
 TYPE(ObjectRecoveryProgress)
+TYPE(PushOp)
+TYPE(PushReplyOp)
+TYPE(PullOp)
 TYPE(ScrubMap::object)
 TYPE(ScrubMap)
 TYPE(osd_peer_stat_t)
@@ -307,6 +312,12 @@ MESSAGE(MOSDPGMissing)
 MESSAGE(MOSDPGNotify)
 #include "messages/MOSDPGQuery.h"
 MESSAGE(MOSDPGQuery)
+#include "messages/MOSDPGPull.h"
+MESSAGE(MOSDPGPull)
+#include "messages/MOSDPGPush.h"
+MESSAGE(MOSDPGPush)
+#include "messages/MOSDPGPushReply.h"
+MESSAGE(MOSDPGPushReply)
 #include "messages/MOSDPGRemove.h"
 MESSAGE(MOSDPGRemove)
 #include "messages/MOSDPGScan.h"
@@ -0,0 +1,169 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Time copy, flatten, rollback, resize and remove of an image for a
+ * range of rbd_concurrent_management_ops settings.
+ *
+ * usage: bench_rbd_management <pool> [num_objects [order]]
+ */
+
+#include "include/rados/librados.hpp"
+#include "include/rbd/librbd.hpp"
+#include "include/stringify.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+static double now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static int fail(const char *what, int r)
+{
+  cerr << "bench_rbd_management: " << what << " failed: "
+       << strerror(-r) << std::endl;
+  return 1;
+}
+
+int main(int argc, const char **argv)
+{
+  if (argc < 2) {
+    cerr << "usage: " << argv[0] << " <pool> [num_objects [order]]"
+	 << std::endl;
+    return 1;
+  }
+  const char *pool_name = argv[1];
+  uint64_t num_objects = argc > 2 ? strtoull(argv[2], NULL, 10) : 64;
+  int order = argc > 3 ? atoi(argv[3]) : 16;
+  uint64_t object_size = 1ull << order;
+  uint64_t size = num_objects * object_size;
+
+  librados::Rados rados;
+  int r = rados.init(NULL);
+  if (r < 0)
+    return fail("init", r);
+  r = rados.conf_read_file(NULL);
+  if (r < 0)
+    return fail("reading config", r);
+  r = rados.connect();
+  if (r < 0)
+    return fail("connect", r);
+
+  librados::IoCtx ioctx;
+  r = rados.ioctx_create(pool_name, ioctx);
+  if (r < 0)
+    return fail("opening pool", r);
+
+  librbd::RBD rbd;
+  bufferlist data;
+  data.append(string(object_size, 'x'));
+  bufferlist zero;
+  zero.append_zero(object_size);
+
+  cout << "window   copy      flatten   rollback  resize    remove"
+       << "  (seconds)" << std::endl;
+  for (int window = 1; window <= 64; window *= 2) {
+    rados.conf_set("rbd_concurrent_management_ops",
+		   stringify(window).c_str());
+    double copy_time, flatten_time, rollback_time, resize_time, remove_time;
+
+    r = rbd.create2(ioctx, "bench_parent", size, RBD_FEATURE_LAYERING,
+		    &order);
+    if (r < 0)
+      return fail("create", r);
+    {
+      librbd::Image parent;
+      r = rbd.open(ioctx, parent, "bench_parent", NULL);
+      if (r < 0)
+	return fail("open", r);
+      for (uint64_t i = 0; i < num_objects; ++i)
+	parent.write(i * object_size, object_size, data);
+      r = parent.snap_create("snap");
+      if (r == 0)
+	r = parent.snap_protect("snap");
+      if (r < 0)
+	return fail("snapshot", r);
+
+      double start = now();
+      r = parent.copy(ioctx, "bench_copy");
+      if (r < 0)
+	return fail("copy", r);
+      copy_time = now() - start;
+
+      for (uint64_t i = 0; i < num_objects; ++i)
+	parent.write(i * object_size, object_size, zero);
+      start = now();
+      r = parent.snap_rollback("snap");
+      if (r < 0)
+	return fail("rollback", r);
+      rollback_time = now() - start;
+    }
+
+    r = rbd.clone(ioctx, "bench_parent", "snap", ioctx, "bench_child",
+		  RBD_FEATURE_LAYERING, &order);
+    if (r < 0)
+      return fail("clone", r);
+    {
+      librbd::Image child;
+      r = rbd.open(ioctx, child, "bench_child", NULL);
+      if (r < 0)
+	return fail("open", r);
+      double start = now();
+      r = child.flatten();
+      if (r < 0)
+	return fail("flatten", r);
+      flatten_time = now() - start;
+    }
+
+    {
+      librbd::Image copy;
+      r = rbd.open(ioctx, copy, "bench_copy", NULL);
+      if (r < 0)
+	return fail("open", r);
+      double start = now();
+      r = copy.resize(object_size);
+      if (r < 0)
+	return fail("resize", r);
+      resize_time = now() - start;
+    }
+
+    double start = now();
+    r = rbd.remove(ioctx, "bench_child");
+    if (r < 0)
+      return fail("remove", r);
+    remove_time = now() - start;
+
+    rbd.remove(ioctx, "bench_copy");
+    {
+      librbd::Image parent;
+      r = rbd.open(ioctx, parent, "bench_parent", NULL);
+      if (r < 0)
+	return fail("open", r);
+      parent.snap_unprotect("snap");
+      parent.snap_remove("snap");
+    }
+    rbd.remove(ioctx, "bench_parent");
+
+    cout << std::fixed << std::setprecision(4)
+	 << std::setw(6) << window << "   "
+	 << std::setw(8) << copy_time << "  "
+	 << std::setw(8) << flatten_time << "  "
+	 << std::setw(8) << rollback_time << "  "
+	 << std::setw(8) << resize_time << "  "
+	 << std::setw(8) << remove_time << std::endl;
+  }
+
+  ioctx.close();
+  rados.shutdown();
+  return 0;
+}
@@ -16,17 +16,25 @@
 #include "include/rbd_types.h"
 #include "include/rbd/librbd.h"
 #include "include/rbd/librbd.hpp"
+#include "include/rbd/features.h"
 
 #include "gtest/gtest.h"
 
+#include <dirent.h>
 #include <errno.h>
 #include <inttypes.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
 #include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
+#include <iomanip>
 #include <iostream>
 #include <algorithm>
 #include <sstream>
@@ -34,6 +42,7 @@
 #include "test/librados/test.h"
 #include "common/errno.h"
 #include "include/stringify.h"
+#include "include/interval_set.h"
 
 using namespace std;
 
@@ -772,6 +781,83 @@ TEST(LibRBD, TestEmptyDiscard)
 }
 
 
+TEST(LibRBD, TestIOV)
+{
+  rados_t cluster;
+  rados_ioctx_t ioctx;
+  string pool_name = get_temp_pool_name();
+  ASSERT_EQ("", create_one_pool(pool_name, &cluster));
+  rados_ioctx_create(cluster, pool_name.c_str(), &ioctx);
+
+  rbd_image_t image;
+  int order = 16;
+  const char *name = "testimg";
+  uint64_t size = 2 << 20;
+
+  ASSERT_EQ(0, create_image(ioctx, name, size, &order));
+  ASSERT_EQ(0, rbd_open(ioctx, name, &image, NULL));
+
+  // cross an object boundary with unevenly sized buffers
+  uint64_t off = (1 << order) - 5000;
+  size_t len = 12000;
+  char *data = (char *)malloc(len);
+  for (size_t i = 0; i < len; ++i)
+    data[i] = (char) (rand() % (126 - 33) + 33);
+
+  struct iovec wiov[3];
+  wiov[0].iov_base = data;
+  wiov[0].iov_len = 1000;
+  wiov[1].iov_base = data + 1000;
+  wiov[1].iov_len = 6000;
+  wiov[2].iov_base = data + 7000;
+  wiov[2].iov_len = len - 7000;
+
+  rbd_completion_t comp;
+  rbd_aio_create_completion(NULL, (rbd_callback_t) simple_write_cb, &comp);
+  ASSERT_EQ(0, rbd_aio_writev(image, wiov, 3, off, comp));
+  ASSERT_EQ(0, rbd_aio_wait_for_complete(comp));
+  ASSERT_EQ(0, rbd_aio_get_return_value(comp));
+  rbd_aio_release(comp);
+
+  read_test_data(image, data, off, len);
+
+  // read it back split differently, along with some zeros on either
+  // side and in an object that was never written
+  size_t rlen = len + 2000 + (1 << order);
+  char *result = (char *)malloc(rlen);
+  memset(result, 'x', rlen);
+  struct iovec riov[4];
+  riov[0].iov_base = result;
+  riov[0].iov_len = 3000;
+  riov[1].iov_base = result + 3000;
+  riov[1].iov_len = 0;
+  riov[2].iov_base = result + 3000;
+  riov[2].iov_len = 5000;
+  riov[3].iov_base = result + 8000;
+  riov[3].iov_len = rlen - 8000;
+
+  rbd_aio_create_completion(NULL, (rbd_callback_t) simple_read_cb, &comp);
+  ASSERT_EQ(0, rbd_aio_readv(image, riov, 4, off - 1000, comp));
+  ASSERT_EQ(0, rbd_aio_wait_for_complete(comp));
+  ASSERT_EQ((ssize_t)rlen, rbd_aio_get_return_value(comp));
+  rbd_aio_release(comp);
+
+  char *zeros = (char *)calloc(1, rlen);
+  ASSERT_EQ(0, memcmp(result, zeros, 1000));
+  ASSERT_EQ(0, memcmp(result + 1000, data, len));
+  ASSERT_EQ(0, memcmp(result + 1000 + len, zeros, rlen - 1000 - len));
+
+  free(zeros);
+  free(result);
+  free(data);
+
+  ASSERT_EQ(0, rbd_close(image));
+
+  rados_ioctx_destroy(ioctx);
+  ASSERT_EQ(0, destroy_one_pool(pool_name, &cluster));
+}
+
+
 void simple_write_cb_pp(librbd::completion_t cb, void *arg)
 {
   cout << "write completion cb called!" << endl;
@@ -1391,3 +1477,797 @@ TEST(LibRBD, LockingPP)
   ioctx.close();
   ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
 }
+
+TEST(LibRBD, ObjectMapPP)
+{
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+
+  ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+
+  librbd::RBD rbd;
+  const char *name = "testimg";
+  int order = 16;
+  uint64_t object_size = 1ull << order;
+  uint64_t size = 12 * object_size;
+  string map_oid, data_prefix;
+
+  ASSERT_EQ(0, rbd.create2(ioctx, name, size,
+			   RBD_FEATURE_LAYERING | RBD_FEATURE_OBJECT_MAP,
+			   &order));
+  {
+    librbd::Image image;
+    ASSERT_EQ(0, rbd.open(ioctx, image, name, NULL));
+    ASSERT_EQ(0, image.lock_exclusive("test"));
+
+    librbd::image_info_t info;
+    ASSERT_EQ(0, image.stat(info, sizeof(info)));
+    data_prefix = info.block_name_prefix;
+    map_oid = string(RBD_OBJECT_MAP_PREFIX) +
+      data_prefix.substr(strlen(RBD_DATA_PREFIX));
+
+    // another opener without the lock doesn't trust its copy of the
+    // map, so it sees objects written after it loaded the map
+    librbd::Image other;
+    ASSERT_EQ(0, rbd.open(ioctx, other, name, NULL));
+
+    // a new image has an empty map
+    bufferlist bl;
+    ASSERT_EQ(8 + 2, ioctx.read(map_oid, bl, 0, 0));
+    ASSERT_EQ(0, bl[8]);
+    ASSERT_EQ(0, bl[9]);
+
+    // writes mark the objects they touch
+    bufferlist data;
+    data.append(string(object_size, 'x'));
+    ASSERT_EQ((ssize_t)object_size, image.write(object_size / 2,
+						object_size, data));
+    ASSERT_EQ((ssize_t)object_size, image.write(9 * object_size,
+						object_size, data));
+    bl.clear();
+    ASSERT_EQ(8 + 2, ioctx.read(map_oid, bl, 0, 0));
+    ASSERT_EQ((1 << 0) | (1 << 1), bl[8]);
+    ASSERT_EQ(1 << 1, bl[9]);
+
+    // unwritten objects read back as zeros
+    bufferlist read_bl;
+    ASSERT_EQ((ssize_t)object_size, image.read(4 * object_size, object_size,
+					       read_bl));
+    ASSERT_TRUE(read_bl.is_zero());
+    read_bl.clear();
+    ASSERT_EQ((ssize_t)object_size, image.read(9 * object_size, object_size,
+					       read_bl));
+    ASSERT_TRUE(read_bl.contents_equal(data));
+    read_bl.clear();
+    ASSERT_EQ((ssize_t)object_size, other.read(9 * object_size, object_size,
+					       read_bl));
+    ASSERT_TRUE(read_bl.contents_equal(data));
+
+    // shrinking drops the bits of removed objects
+    ASSERT_EQ(0, image.resize(6 * object_size));
+    bl.clear();
+    ASSERT_EQ(8 + 1, ioctx.read(map_oid, bl, 0, 0));
+    ASSERT_EQ((1 << 0) | (1 << 1), bl[8]);
+    ASSERT_EQ(0, image.unlock("test"));
+  }
+
+  // a bit left set by a client that died before writing the object is
+  // harmless
+  bufferlist bits;
+  bits.append((char)((1 << 0) | (1 << 1) | (1 << 3)));
+  ASSERT_EQ(0, ioctx.write(map_oid, bits, bits.length(), 8));
+  {
+    librbd::Image image;
+    ASSERT_EQ(0, rbd.open(ioctx, image, name, NULL));
+    ASSERT_EQ(0, image.lock_exclusive("test"));
+    bufferlist read_bl;
+    ASSERT_EQ((ssize_t)object_size, image.read(3 * object_size, object_size,
+					       read_bl));
+    ASSERT_TRUE(read_bl.is_zero());
+    ASSERT_EQ(0, image.unlock("test"));
+  }
+
+  ASSERT_EQ(0, rbd.remove(ioctx, name));
+  uint64_t psize;
+  time_t pmtime;
+  ASSERT_EQ(-ENOENT, ioctx.stat(map_oid, &psize, &pmtime));
+
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
+}
+
+TEST(LibRBD, ObjectMapClonePP)
+{
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+
+  ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+
+  librbd::RBD rbd;
+  int order = 16;
+  uint64_t object_size = 1ull << order;
+  uint64_t size = 4 * object_size;
+  string expected(size, 'p');
+
+  ASSERT_EQ(0, rbd.create2(ioctx, "parent", size,
+			   RBD_FEATURE_LAYERING | RBD_FEATURE_OBJECT_MAP,
+			   &order));
+  {
+    librbd::Image parent;
+    ASSERT_EQ(0, rbd.open(ioctx, parent, "parent", NULL));
+    bufferlist bl;
+    bl.append(expected);
+    ASSERT_EQ((ssize_t)size, parent.write(0, size, bl));
+    ASSERT_EQ(0, parent.snap_create("snap"));
+    ASSERT_EQ(0, parent.snap_protect("snap"));
+  }
+
+  ASSERT_EQ(0, rbd.clone(ioctx, "parent", "snap", ioctx, "child",
+			 RBD_FEATURE_LAYERING | RBD_FEATURE_OBJECT_MAP,
+			 &order));
+  string map_oid;
+  {
+    librbd::Image child;
+    ASSERT_EQ(0, rbd.open(ioctx, child, "child", NULL));
+    ASSERT_EQ(0, child.lock_exclusive("test"));
+    librbd::image_info_t info;
+    ASSERT_EQ(0, child.stat(info, sizeof(info)));
+    string data_prefix = info.block_name_prefix;
+    map_oid = string(RBD_OBJECT_MAP_PREFIX) +
+      data_prefix.substr(strlen(RBD_DATA_PREFIX));
+
+    // zeroing inside object 0 and truncating object 1 copy them up
+    // from the parent first
+    ASSERT_EQ(3000, child.discard(1000, 3000));
+    expected.replace(1000, 3000, 3000, '\0');
+    ASSERT_EQ((int)(object_size - 2000),
+	      child.discard(object_size + 2000, object_size - 2000));
+    expected.replace(object_size + 2000, object_size - 2000,
+		     object_size - 2000, '\0');
+
+    bufferlist bl;
+    ASSERT_EQ(8 + 1, ioctx.read(map_oid, bl, 0, 0));
+    ASSERT_EQ((1 << 0) | (1 << 1), bl[8]);
+
+    // the discarded ranges read back as zeros, not as parent data
+    bufferlist read_bl;
+    ASSERT_EQ((ssize_t)size, child.read(0, size, read_bl));
+    ASSERT_TRUE(expected == string(read_bl.c_str(), read_bl.length()));
+    ASSERT_EQ(0, child.unlock("test"));
+  }
+
+  // a stale or invalidated map has bits set for objects the child
+  // doesn't have
+  bufferlist bits;
+  bits.append((char)0xf);
+  ASSERT_EQ(0, ioctx.write(map_oid, bits, bits.length(), 8));
+  {
+    librbd::Image child;
+    ASSERT_EQ(0, rbd.open(ioctx, child, "child", NULL));
+    ASSERT_EQ(0, child.lock_exclusive("test"));
+
+    // flattening copies up every object regardless
+    ASSERT_EQ(0, child.flatten());
+    bufferlist read_bl;
+    ASSERT_EQ((ssize_t)size, child.read(0, size, read_bl));
+    ASSERT_TRUE(expected == string(read_bl.c_str(), read_bl.length()));
+    ASSERT_EQ(0, child.unlock("test"));
+  }
+
+  ASSERT_EQ(0, rbd.remove(ioctx, "child"));
+  {
+    librbd::Image parent;
+    ASSERT_EQ(0, rbd.open(ioctx, parent, "parent", NULL));
+    ASSERT_EQ(0, parent.snap_unprotect("snap"));
+    ASSERT_EQ(0, parent.snap_remove("snap"));
+  }
+  ASSERT_EQ(0, rbd.remove(ioctx, "parent"));
+
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
+}
+
+// read a counter of an open image from the perf dump on an admin socket
+static int get_image_perf_counter(const string &asok, const string &image,
+				  const string &counter, uint64_t *val)
+{
+  int fd = socket(PF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -errno;
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, asok.c_str(), sizeof(addr.sun_path) - 1);
+  const char request[] = "perf dump";
+  uint32_t len;
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      write(fd, request, sizeof(request)) != sizeof(request) ||
+      read(fd, &len, sizeof(len)) != sizeof(len)) {
+    int r = -errno;
+    close(fd);
+    return r;
+  }
+  string dump(ntohl(len), '\0');
+  size_t got = 0;
+  while (got < dump.size()) {
+    ssize_t r = read(fd, &dump[got], dump.size() - got);
+    if (r <= 0) {
+      close(fd);
+      return r < 0 ? -errno : -EIO;
+    }
+    got += r;
+  }
+  close(fd);
+
+  // an image's counters are under "librbd-<id>-<pool>/<image>"
+  size_t pos = dump.find("/" + image + "\":{");
+  if (pos == string::npos)
+    return -ENOENT;
+  pos = dump.find("\"" + counter + "\":", pos);
+  if (pos == string::npos)
+    return -ENOENT;
+  *val = strtoull(dump.c_str() + pos + counter.length() + 3, NULL, 10);
+  return 0;
+}
+
+TEST(LibRBD, CopyOnReadPP)
+{
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+
+  ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+
+  // the child is opened through a client with copy-on-read enabled and
+  // an admin socket to read its perf counters from
+  string asok = "/tmp/test_librbd_cor." + stringify(getpid()) + ".asok";
+  librados::Rados cor_rados;
+  librados::IoCtx cor_ioctx;
+  ASSERT_EQ(0, cor_rados.init(getenv("CEPH_CLIENT_ID")));
+  ASSERT_EQ(0, cor_rados.conf_read_file(NULL));
+  cor_rados.conf_parse_env(NULL);
+  ASSERT_EQ(0, cor_rados.conf_set("admin_socket", asok.c_str()));
+  ASSERT_EQ(0, cor_rados.conf_set("rbd_clone_copy_on_read", "true"));
+  ASSERT_EQ(0, cor_rados.connect());
+  ASSERT_EQ(0, cor_rados.ioctx_create(pool_name.c_str(), cor_ioctx));
+
+  librbd::RBD rbd;
+  int order = 16;
+  uint64_t object_size = 1ull << order;
+  uint64_t size = 4 * object_size;
+  bufferlist data;
+  data.append(string(object_size, 'x'));
+
+  // object 3 of the parent is left empty
+  ASSERT_EQ(0, rbd.create2(ioctx, "parent", size, RBD_FEATURE_LAYERING,
+			   &order));
+  {
+    librbd::Image parent;
+    ASSERT_EQ(0, rbd.open(ioctx, parent, "parent", NULL));
+    for (uint64_t i = 0; i < 3; ++i)
+      ASSERT_EQ((ssize_t)object_size,
+		parent.write(i * object_size, object_size, data));
+    ASSERT_EQ(0, parent.snap_create("snap"));
+    ASSERT_EQ(0, parent.snap_protect("snap"));
+  }
+
+  ASSERT_EQ(0, rbd.clone(ioctx, "parent", "snap", ioctx, "child",
+			 RBD_FEATURE_LAYERING, &order));
+  string data_prefix;
+  {
+    librbd::Image child;
+    ASSERT_EQ(0, rbd.open(cor_ioctx, child, "child", NULL));
+    librbd::image_info_t info;
+    ASSERT_EQ(0, child.stat(info, sizeof(info)));
+    data_prefix = info.block_name_prefix;
+
+    // a partial read of object 1 copies up all of it.  resizing waits
+    // for copy-ups in flight.
+    bufferlist read_bl;
+    ASSERT_EQ(4096, child.read(object_size + 100, 4096, read_bl));
+    ASSERT_EQ(string(4096, 'x'), string(read_bl.c_str(), read_bl.length()));
+    ASSERT_EQ(0, child.resize(size));
+    uint64_t copied_up;
+    ASSERT_EQ(0, get_image_perf_counter(asok, "child", "copy_on_read",
+					&copied_up));
+    ASSERT_EQ(1u, copied_up);
+
+    // the next read is served by the child's own object
+    read_bl.clear();
+    ASSERT_EQ(4096, child.read(object_size + 100, 4096, read_bl));
+    ASSERT_EQ(0, child.resize(size));
+    ASSERT_EQ(0, get_image_perf_counter(asok, "child", "copy_on_read",
+					&copied_up));
+    ASSERT_EQ(1u, copied_up);
+
+    // there's nothing to copy up for object 3, so only the first read
+    // of it tries to: after that, only the read itself goes to the
+    // parent
+    uint64_t parent_reads, last_parent_reads;
+    ASSERT_EQ(0, get_image_perf_counter(asok, "parent@snap", "aio_rd",
+					&last_parent_reads));
+    for (int i = 0; i < 2; ++i) {
+      read_bl.clear();
+      ASSERT_EQ(4096, child.read(3 * object_size, 4096, read_bl));
+      ASSERT_TRUE(read_bl.is_zero());
+      ASSERT_EQ(0, child.resize(size));
+      ASSERT_EQ(0, get_image_perf_counter(asok, "parent@snap", "aio_rd",
+					  &parent_reads));
+      ASSERT_EQ(i == 0 ? 2u : 1u, parent_reads - last_parent_reads);
+      last_parent_reads = parent_reads;
+    }
+    ASSERT_EQ(0, get_image_perf_counter(asok, "child", "copy_on_read",
+					&copied_up));
+    ASSERT_EQ(1u, copied_up);
+  } // closing waits for the copy-up
+
+  char oid[RBD_MAX_BLOCK_NAME_SIZE + 32];
+  snprintf(oid, sizeof(oid), "%s.%016llx", data_prefix.c_str(), 1ull);
+  bufferlist obj_bl;
+  ASSERT_EQ((int)object_size, ioctx.read(oid, obj_bl, 0, 0));
+  ASSERT_TRUE(obj_bl.contents_equal(data));
+
+  // objects that weren't read, or had only zeros, stay in the parent
+  uint64_t psize;
+  time_t pmtime;
+  snprintf(oid, sizeof(oid), "%s.%016llx", data_prefix.c_str(), 2ull);
+  ASSERT_EQ(-ENOENT, ioctx.stat(oid, &psize, &pmtime));
+  snprintf(oid, sizeof(oid), "%s.%016llx", data_prefix.c_str(), 3ull);
+  ASSERT_EQ(-ENOENT, ioctx.stat(oid, &psize, &pmtime));
+
+  cor_ioctx.close();
+  cor_rados.shutdown();
+
+  ASSERT_EQ(0, rbd.remove(ioctx, "child"));
+  {
+    librbd::Image parent;
+    ASSERT_EQ(0, rbd.open(ioctx, parent, "parent", NULL));
+    ASSERT_EQ(0, parent.snap_unprotect("snap"));
+    ASSERT_EQ(0, parent.snap_remove("snap"));
+  }
+  ASSERT_EQ(0, rbd.remove(ioctx, "parent"));
+
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
+}
+
+static void aio_discard_pp(librbd::Image& image, uint64_t off, uint64_t len,
+			   librbd::RBD::AioCompletion **comp)
+{
+  *comp = new librbd::RBD::AioCompletion(NULL, (librbd::callback_t) simple_write_cb_pp);
+  ASSERT_EQ(0, image.aio_discard(off, len, *comp));
+}
+
+TEST(LibRBD, DiscardPP)
+{
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+
+  ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+
+  librbd::RBD rbd;
+  int order = 16;
+  uint64_t object_size = 1ull << order;
+  // the last object is cut short by the end of the image
+  uint64_t size = 3 * object_size + object_size / 2;
+  ASSERT_EQ(0, rbd.create2(ioctx, "testimg", size,
+			   RBD_FEATURE_LAYERING | RBD_FEATURE_OBJECT_MAP,
+			   &order));
+
+  {
+    librbd::Image image;
+    ASSERT_EQ(0, rbd.open(ioctx, image, "testimg", NULL));
+    ASSERT_EQ(0, image.lock_exclusive("test"));
+    librbd::image_info_t info;
+    ASSERT_EQ(0, image.stat(info, sizeof(info)));
+    string data_prefix = info.block_name_prefix;
+
+    string expected(size, 'x');
+    bufferlist bl;
+    bl.append(expected);
+    ASSERT_EQ((ssize_t)size, image.write(0, size, bl));
+
+    // partial, then overlapping up to the end of object 0
+    ASSERT_EQ(3000, image.discard(1000, 3000));
+    expected.replace(1000, 3000, 3000, '\0');
+    ASSERT_EQ((int)(object_size - 2000), image.discard(2000, object_size - 2000));
+    expected.replace(2000, object_size - 2000, object_size - 2000, '\0');
+
+    // all of object 1 and the start of object 2, overlapping with two
+    // more discards in flight at the same time
+    librbd::RBD::AioCompletion *comps[3];
+    aio_discard_pp(image, object_size, object_size + 500, &comps[0]);
+    aio_discard_pp(image, 2 * object_size + 200, 4800, &comps[1]);
+    aio_discard_pp(image, 2 * object_size + 3000, 5000, &comps[2]);
+    for (int i = 0; i < 3; ++i) {
+      comps[i]->wait_for_complete();
+      ASSERT_EQ(0, comps[i]->get_return_value());
+      comps[i]->release();
+    }
+    expected.replace(object_size, object_size + 8000, object_size + 8000, '\0');
+
+    // everything left in the last object
+    ASSERT_EQ((int)(object_size / 2),
+	    image.discard(3 * object_size, object_size / 2));
+    expected.replace(3 * object_size, object_size / 2, object_size / 2, '\0');
+
+    bufferlist read_bl;
+    ASSERT_EQ((ssize_t)size, image.read(0, size, read_bl));
+    ASSERT_TRUE(expected == string(read_bl.c_str(), read_bl.length()));
+
+    // object 0 was truncated, and whole objects were removed
+    char oid[RBD_MAX_BLOCK_NAME_SIZE + 32];
+    uint64_t psize;
+    time_t pmtime;
+    snprintf(oid, sizeof(oid), "%s.%016llx", data_prefix.c_str(), 0ull);
+    ASSERT_EQ(0, ioctx.stat(oid, &psize, &pmtime));
+    ASSERT_EQ(2000u, psize);
+    snprintf(oid, sizeof(oid), "%s.%016llx", data_prefix.c_str(), 1ull);
+    ASSERT_EQ(-ENOENT, ioctx.stat(oid, &psize, &pmtime));
+    snprintf(oid, sizeof(oid), "%s.%016llx", data_prefix.c_str(), 3ull);
+    ASSERT_EQ(-ENOENT, ioctx.stat(oid, &psize, &pmtime));
+
+    // discarding what was never written doesn't create anything
+    ASSERT_EQ(0, image.resize(size + 2 * object_size));
+    ASSERT_EQ(1000, image.discard(4 * object_size + 100, 1000));
+    ASSERT_EQ(500, image.discard(5 * object_size, 500));
+    snprintf(oid, sizeof(oid), "%s.%016llx", data_prefix.c_str(), 4ull);
+    ASSERT_EQ(-ENOENT, ioctx.stat(oid, &psize, &pmtime));
+    snprintf(oid, sizeof(oid), "%s.%016llx", data_prefix.c_str(), 5ull);
+    ASSERT_EQ(-ENOENT, ioctx.stat(oid, &psize, &pmtime));
+
+    // a window of zero could never send a remove
+    ASSERT_EQ(0, rados.conf_set("rbd_concurrent_discard_ops", "0"));
+    ASSERT_EQ(-EINVAL, image.discard(0, object_size));
+    ASSERT_EQ(0, rados.conf_set("rbd_concurrent_discard_ops", "16"));
+    ASSERT_EQ(0, image.unlock("test"));
+  }
+
+  ASSERT_EQ(0, rbd.remove(ioctx, "testimg"));
+
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
+}
+
+static int iterate_cb(uint64_t off, size_t len, int exists, void *arg)
+{
+  interval_set<uint64_t> *diff = static_cast<interval_set<uint64_t> *>(arg);
+  interval_set<uint64_t> w;
+  w.insert(off, len);
+  diff->union_of(w);
+  return 0;
+}
+
+static int iterate_removed_cb(uint64_t off, size_t len, int exists, void *arg)
+{
+  interval_set<uint64_t> *removed = static_cast<interval_set<uint64_t> *>(arg);
+  if (!exists) {
+    interval_set<uint64_t> w;
+    w.insert(off, len);
+    removed->union_of(w);
+  }
+  return 0;
+}
+
+TEST(LibRBD, DiffIterate)
+{
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+
+  ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+
+  librbd::RBD rbd;
+  int order = 16;
+  const char *name = "testimg";
+  uint64_t object_size = 1ull << order;
+  uint64_t size = 8 * object_size;
+
+  ASSERT_EQ(0, create_image_pp(rbd, ioctx, name, size, &order));
+  {
+    librbd::Image image;
+    ASSERT_EQ(0, rbd.open(ioctx, image, name, NULL));
+
+    bufferlist data;
+    data.append(string(object_size / 4, 'a'));
+
+    // nothing has been written yet
+    interval_set<uint64_t> diff;
+    ASSERT_EQ(0, image.diff_iterate(NULL, 0, size, iterate_cb, (void *)&diff));
+    ASSERT_TRUE(diff.empty());
+
+    ASSERT_EQ((ssize_t)data.length(), image.write(0, data.length(), data));
+    ASSERT_EQ((ssize_t)data.length(),
+	      image.write(3 * object_size + 10, data.length(), data));
+    ASSERT_EQ(0, image.snap_create("snap1"));
+
+    // everything written so far, and only within the objects touched
+    ASSERT_EQ(0, image.diff_iterate(NULL, 0, size, iterate_cb, (void *)&diff));
+    ASSERT_TRUE(diff.contains(0, data.length()));
+    ASSERT_TRUE(diff.contains(3 * object_size + 10, data.length()));
+    ASSERT_FALSE(diff.intersects(object_size, 2 * object_size));
+    ASSERT_FALSE(diff.intersects(4 * object_size, 4 * object_size));
+
+    ASSERT_EQ((ssize_t)data.length(),
+	      image.write(5 * object_size + 100, data.length(), data));
+    ASSERT_EQ((int)data.length(), image.discard(0, data.length()));
+    ASSERT_EQ(0, image.snap_create("snap2"));
+
+    // only what changed since snap1
+    diff.clear();
+    ASSERT_EQ(0, image.diff_iterate("snap1", 0, size, iterate_cb,
+				    (void *)&diff));
+    ASSERT_TRUE(diff.contains(5 * object_size + 100, data.length()));
+    ASSERT_TRUE(diff.contains(0, data.length()));
+    ASSERT_FALSE(diff.intersects(3 * object_size, object_size));
+
+    // the same diff, read from the snapshot
+    ASSERT_EQ(0, image.snap_set("snap2"));
+    interval_set<uint64_t> snap_diff;
+    ASSERT_EQ(0, image.diff_iterate("snap1", 0, size, iterate_cb,
+				    (void *)&snap_diff));
+    ASSERT_EQ(diff, snap_diff);
+
+    // the start snapshot must come before the end
+    ASSERT_EQ(-EINVAL, image.diff_iterate("snap2", 0, size, iterate_cb,
+					  (void *)&snap_diff));
+
+    ASSERT_EQ(-ENOENT, image.diff_iterate("nosuchsnap", 0, size, iterate_cb,
+					  (void *)&snap_diff));
+
+    // an object removed since snap2 is reported as gone
+    ASSERT_EQ(0, image.snap_set(NULL));
+    ASSERT_EQ((int)object_size, image.discard(3 * object_size, object_size));
+    interval_set<uint64_t> removed;
+    ASSERT_EQ(0, image.diff_iterate("snap2", 0, size, iterate_removed_cb,
+				    (void *)&removed));
+    ASSERT_TRUE(removed.contains(3 * object_size + 10, data.length()));
+    ASSERT_FALSE(removed.intersects(5 * object_size, object_size));
+  }
+
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
+}
+
+TEST(LibRBD, ConcurrentManagementOpsPP)
+{
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+
+  ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+
+  librbd::RBD rbd;
+  int order = 16;
+  uint64_t object_size = 1ull << order;
+  uint64_t num_objects = 16;
+  uint64_t size = num_objects * object_size;
+
+  // every object gets different contents, so that an op handled out of
+  // order or skipped shows up
+  string expected;
+  for (uint64_t i = 0; i < num_objects; ++i)
+    expected.append(object_size, 'a' + i);
+  bufferlist data;
+  data.append(expected);
+
+  // (see bench_rbd_management for timings)
+  const char *windows[] = { "1", "3", "64" };
+  for (size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); ++w) {
+    ASSERT_EQ(0, rados.conf_set("rbd_concurrent_management_ops",
+				windows[w]));
+
+    ASSERT_EQ(0, rbd.create2(ioctx, "parent", size, RBD_FEATURE_LAYERING,
+			     &order));
+    {
+      librbd::Image parent;
+      ASSERT_EQ(0, rbd.open(ioctx, parent, "parent", NULL));
+      ASSERT_EQ((ssize_t)size, parent.write(0, size, data));
+      ASSERT_EQ(0, parent.snap_create("snap"));
+      ASSERT_EQ(0, parent.snap_protect("snap"));
+      ASSERT_EQ(0, parent.copy(ioctx, "copy"));
+
+      bufferlist zero;
+      zero.append_zero(size);
+      ASSERT_EQ((ssize_t)size, parent.write(0, size, zero));
+      ASSERT_EQ(0, parent.snap_rollback("snap"));
+
+      bufferlist read_bl;
+      ASSERT_EQ((ssize_t)size, parent.read(0, size, read_bl));
+      ASSERT_TRUE(read_bl.contents_equal(data));
+    }
+
+    ASSERT_EQ(0, rbd.clone(ioctx, "parent", "snap", ioctx, "child",
+			   RBD_FEATURE_LAYERING, &order));
+    {
+      librbd::Image child;
+      ASSERT_EQ(0, rbd.open(ioctx, child, "child", NULL));
+      ASSERT_EQ(0, child.flatten());
+      bufferlist read_bl;
+      ASSERT_EQ((ssize_t)size, child.read(0, size, read_bl));
+      ASSERT_TRUE(read_bl.contents_equal(data));
+    }
+
+    {
+      librbd::Image copy;
+      ASSERT_EQ(0, rbd.open(ioctx, copy, "copy", NULL));
+      bufferlist read_bl;
+      ASSERT_EQ((ssize_t)size, copy.read(0, size, read_bl));
+      ASSERT_TRUE(read_bl.contents_equal(data));
+
+      // shrinking to a bit over three objects and growing back leaves
+      // zeros past the cut
+      uint64_t cut = 3 * object_size + 100;
+      ASSERT_EQ(0, copy.resize(cut));
+      ASSERT_EQ(0, copy.resize(size));
+      read_bl.clear();
+      ASSERT_EQ((ssize_t)size, copy.read(0, size, read_bl));
+      string shrunk = expected.substr(0, cut) + string(size - cut, '\0');
+      ASSERT_TRUE(shrunk == string(read_bl.c_str(), read_bl.length()));
+    }
+
+    ASSERT_EQ(0, rbd.remove(ioctx, "child"));
+    ASSERT_EQ(0, rbd.remove(ioctx, "copy"));
+    {
+      librbd::Image parent;
+      ASSERT_EQ(0, rbd.open(ioctx, parent, "parent", NULL));
+      ASSERT_EQ(0, parent.snap_unprotect("snap"));
+      ASSERT_EQ(0, parent.snap_remove("snap"));
+    }
+    ASSERT_EQ(0, rbd.remove(ioctx, "parent"));
+
+    // nothing of the removed images is left behind
+    int leftover = 0;
+    for (librados::ObjectIterator it = ioctx.objects_begin();
+	 it != ioctx.objects_end(); ++it) {
+      if (it->first.find(RBD_DATA_PREFIX) == 0)
+	++leftover;
+    }
+    ASSERT_EQ(0, leftover);
+  }
+
+  // a window of zero can't make progress
+  ASSERT_EQ(0, rados.conf_set("rbd_concurrent_management_ops", "0"));
+  ASSERT_EQ(0, rbd.create2(ioctx, "parent", size, RBD_FEATURE_LAYERING,
+			   &order));
+  {
+    librbd::Image parent;
+    ASSERT_EQ(0, rbd.open(ioctx, parent, "parent", NULL));
+    ASSERT_EQ(-EINVAL, parent.copy(ioctx, "copy"));
+    ASSERT_EQ(-EINVAL, parent.resize(object_size));
+  }
+  ASSERT_EQ(-EINVAL, rbd.remove(ioctx, "parent"));
+  ASSERT_EQ(0, rados.conf_set("rbd_concurrent_management_ops", "10"));
+  ASSERT_EQ(0, rbd.remove(ioctx, "parent"));
+
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
+}
+
+static int set_persistent_cache(librados::Rados &rados, const char *dir)
+{
+  int r = rados.conf_set("rbd_persistent_cache", "true");
+  if (r == 0)
+    r = rados.conf_set("rbd_persistent_cache_path", dir);
+  if (r == 0)
+    r = rados.conf_set("rbd_persistent_cache_size", "67108864");
+  return r;
+}
+
+static void remove_dir(const char *dir)
+{
+  DIR *d = opendir(dir);
+  if (d) {
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+      if (strcmp(de->d_name, ".") && strcmp(de->d_name, ".."))
+	unlink((string(dir) + "/" + de->d_name).c_str());
+    }
+    closedir(d);
+  }
+  rmdir(dir);
+}
+
+TEST(LibRBD, PersistentCacheReplayPP)
+{
+  char dir[] = "/tmp/test_librbd_pcache.XXXXXX";
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  string pool_name = get_temp_pool_name();
+
+  librbd::RBD rbd;
+  int order = 16;
+  uint64_t object_size = 1ull << order;
+  uint64_t num_objects = 8;
+  uint64_t size = num_objects * object_size;
+  string expected;
+  for (uint64_t i = 0; i < num_objects; ++i)
+    expected.append(object_size, 'a' + i);
+  bufferlist data;
+  data.append(expected);
+
+  // no client may be running when forking
+  {
+    librados::Rados rados;
+    librados::IoCtx ioctx;
+    ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+    ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+    ASSERT_EQ(0, rbd.create2(ioctx, "testimg", size, RBD_FEATURE_LAYERING,
+			     &order));
+    ioctx.close();
+  }
+
+  // the child logs the writes and dies without closing the image, so
+  // some of them may only be in the log
+  pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    librados::Rados rados;
+    librados::IoCtx ioctx;
+    librbd::Image image;
+    if (connect_cluster_pp(rados) != "" ||
+	set_persistent_cache(rados, dir) < 0 ||
+	rados.ioctx_create(pool_name.c_str(), ioctx) < 0 ||
+	rbd.open(ioctx, image, "testimg", NULL) < 0 ||
+	image.write(0, size, data) != (ssize_t)size ||
+	image.flush() < 0)
+      _exit(1);
+    _exit(0);
+  }
+  int status;
+  ASSERT_EQ(pid, waitpid(pid, &status, 0));
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(0, WEXITSTATUS(status));
+
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  ASSERT_EQ("", connect_cluster_pp(rados));
+  ASSERT_EQ(0, set_persistent_cache(rados, dir));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+  {
+    librbd::Image image;
+    ASSERT_EQ(0, rbd.open(ioctx, image, "testimg", NULL));
+    bufferlist read_bl;
+    ASSERT_EQ((ssize_t)size, image.read(0, size, read_bl));
+    ASSERT_TRUE(read_bl.contents_equal(data));
+
+    // the log is in use until the image is closed
+    librbd::Image other;
+    ASSERT_EQ(-EBUSY, rbd.open(ioctx, other, "testimg", NULL));
+
+    // a snapshot gets everything logged before it
+    bufferlist zero;
+    zero.append_zero(object_size);
+    ASSERT_EQ((ssize_t)object_size, image.write(0, object_size, zero));
+    ASSERT_EQ(0, image.snap_create("snap"));
+    librbd::Image snap;
+    ASSERT_EQ(0, rbd.open(ioctx, snap, "testimg", "snap"));
+    read_bl.clear();
+    ASSERT_EQ((ssize_t)object_size, snap.read(0, object_size, read_bl));
+    ASSERT_TRUE(read_bl.is_zero());
+  } // closing writes the log back
+  expected.replace(0, object_size, object_size, '\0');
+
+  ASSERT_EQ(0, rados.conf_set("rbd_persistent_cache", "false"));
+  {
+    librbd::Image image;
+    ASSERT_EQ(0, rbd.open(ioctx, image, "testimg", NULL));
+    bufferlist read_bl;
+    ASSERT_EQ((ssize_t)size, image.read(0, size, read_bl));
+    ASSERT_TRUE(expected == string(read_bl.c_str(), read_bl.length()));
+    ASSERT_EQ(0, image.snap_remove("snap"));
+  }
+  ASSERT_EQ(0, rbd.remove(ioctx, "testimg"));
+  remove_dir(dir);
+
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
+}
@@ -0,0 +1,47 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "msg/Message.h"
+
+#include "FakeMessenger.h"
+
+FakeMessenger::FakeMessenger(CephContext *cct, entity_name_t name)
+  : Messenger(cct, name), m_sent(0)
+{
+}
+
+FakeMessenger::~FakeMessenger()
+{
+}
+
+int FakeMessenger::send_message(Message *m, const entity_inst_t& dest)
+{
+  ++m_sent;
+  m->put();
+  return 0;
+}
+
+int FakeMessenger::send_message(Message *m, Connection *con)
+{
+  ++m_sent;
+  m->put();
+  return 0;
+}
+
+int FakeMessenger::lazy_send_message(Message *m, const entity_inst_t& dest)
+{
+  return send_message(m, dest);
+}
+
+int FakeMessenger::lazy_send_message(Message *m, Connection *con)
+{
+  return send_message(m, con);
+}
+
+Connection *FakeMessenger::get_connection(const entity_inst_t& dest)
+{
+  Connection *con = new Connection;
+  con->set_peer_type(dest.name.type());
+  con->set_peer_addr(dest.addr);
+  return con;
+}
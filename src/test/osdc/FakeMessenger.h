@@ -0,0 +1,49 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#ifndef CEPH_TEST_OSDC_FAKEMESSENGER_H
+#define CEPH_TEST_OSDC_FAKEMESSENGER_H
+
+#include "msg/Messenger.h"
+
+/**
+ * A Messenger that never touches the network: connections are
+ * handed out on demand and every message sent is dropped.  Useful for
+ * driving the Objecter without a cluster.
+ */
+class FakeMessenger : public Messenger {
+public:
+  FakeMessenger(CephContext *cct, entity_name_t name);
+  virtual ~FakeMessenger();
+
+  uint64_t get_num_sent() const { return m_sent; }
+
+  virtual void set_addr_unknowns(entity_addr_t &addr) {}
+  virtual int get_dispatch_queue_len() { return 0; }
+  virtual void set_cluster_protocol(int p) {}
+  virtual void set_default_policy(Policy p) {}
+  virtual void set_policy(int type, Policy p) {}
+  virtual Policy get_policy(int t) { return Policy(); }
+  virtual Policy get_default_policy() { return Policy(); }
+  virtual void set_policy_throttler(int type, Throttle *t) {}
+  virtual int bind(const entity_addr_t& bind_addr) { return 0; }
+  virtual void wait() {}
+
+  virtual int send_message(Message *m, const entity_inst_t& dest);
+  virtual int send_message(Message *m, Connection *con);
+  virtual int lazy_send_message(Message *m, const entity_inst_t& dest);
+  virtual int lazy_send_message(Message *m, Connection *con);
+  virtual Connection *get_connection(const entity_inst_t& dest);
+  virtual int send_keepalive(const entity_inst_t& dest) { return 0; }
+  virtual int send_keepalive(Connection *con) { return 0; }
+
+  virtual void mark_down(const entity_addr_t& a) {}
+  virtual void mark_down(Connection *con) {}
+  virtual void mark_down_on_empty(Connection *con) {}
+  virtual void mark_disposable(Connection *con) {}
+  virtual void mark_down_all() {}
+
+private:
+  uint64_t m_sent;
+};
+
+#endif
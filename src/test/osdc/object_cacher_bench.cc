@@ -0,0 +1,248 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Measure how an ObjectCacher behaves with several threads doing I/O
+ * through it at once, the way a guest with several queues uses an rbd
+ * image.  All threads share one cache and its lock; writeback goes to a
+ * FakeWriteback, so only the cache itself is measured.  Reports the
+ * throughput and how long threads waited for the cache lock.
+ */
+
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "common/ceph_argparse.h"
+#include "common/config.h"
+#include "common/Clock.h"
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "common/Thread.h"
+#include "common/snap_types.h"
+#include "global/global_init.h"
+#include "include/buffer.h"
+#include "include/Context.h"
+#include "include/stringify.h"
+#include "osdc/ObjectCacher.h"
+
+#include "FakeWriteback.h"
+
+struct bench_config {
+  long long ops_per_thread;
+  long long num_objs;
+  long long obj_bytes;
+  long long op_bytes;
+  float percent_reads;
+};
+
+class BenchThread : public Thread {
+public:
+  BenchThread(ObjectCacher *obc, ObjectCacher::ObjectSet *oset, Mutex *lock,
+	      const bench_config &conf, unsigned seed)
+    : m_obc(obc), m_oset(oset), m_lock(lock), m_conf(conf), m_seed(seed),
+      m_ops(0), m_max_wait(0) {}
+
+  void *entry() {
+    bufferptr bp(m_conf.op_bytes);
+    bp.zero();
+    bufferlist data;
+    data.append(bp);
+    ::SnapContext snapc;
+
+    for (long long i = 0; i < m_conf.ops_per_thread; ++i) {
+      uint64_t off = (rand_r(&m_seed) % (m_conf.obj_bytes / m_conf.op_bytes)) *
+	m_conf.op_bytes;
+      std::string oid = "bench" + stringify(rand_r(&m_seed) % m_conf.num_objs);
+      bool is_read = rand_r(&m_seed) < m_conf.percent_reads * RAND_MAX;
+      ObjectExtent extent(oid, 0, off, m_conf.op_bytes);
+      extent.oloc.pool = 0;
+      extent.buffer_extents.push_back(make_pair(0, m_conf.op_bytes));
+
+      if (is_read) {
+	bufferlist bl;
+	ObjectCacher::OSDRead *rd = m_obc->prepare_read(CEPH_NOSNAP, &bl, 0);
+	rd->extents.push_back(extent);
+	Mutex wait_lock("BenchThread::wait_lock");
+	Cond cond;
+	bool done = false;
+	int r = 0;
+	Context *onfinish = new C_SafeCond(&wait_lock, &cond, &done, &r);
+	lock();
+	r = m_obc->readx(rd, m_oset, onfinish);
+	m_lock->Unlock();
+	if (r == 0) {
+	  wait_lock.Lock();
+	  while (!done)
+	    cond.Wait(wait_lock);
+	  wait_lock.Unlock();
+	} else {
+	  delete onfinish;
+	}
+      } else {
+	ObjectCacher::OSDWrite *wr = m_obc->prepare_write(snapc, data,
+							  utime_t(), 0);
+	wr->extents.push_back(extent);
+	lock();
+	m_obc->writex(wr, m_oset, *m_lock);
+	m_lock->Unlock();
+      }
+      m_ops++;
+    }
+    return 0;
+  }
+
+  uint64_t get_ops() const { return m_ops; }
+  utime_t get_wait() const { return m_wait; }
+  utime_t get_max_wait() const { return m_max_wait; }
+
+private:
+  void lock() {
+    utime_t start = ceph_clock_now(g_ceph_context);
+    m_lock->Lock();
+    utime_t waited = ceph_clock_now(g_ceph_context) - start;
+    m_wait += waited;
+    if (waited > m_max_wait)
+      m_max_wait = waited;
+  }
+
+  ObjectCacher *m_obc;
+  ObjectCacher::ObjectSet *m_oset;
+  Mutex *m_lock;
+  bench_config m_conf;
+  unsigned m_seed;
+  uint64_t m_ops;
+  utime_t m_wait, m_max_wait;
+};
+
+static void run(int num_threads, const bench_config &conf, uint64_t delay_ns)
+{
+  Mutex lock("object_cacher_bench::object_cacher");
+  FakeWriteback writeback(g_ceph_context, &lock, delay_ns);
+  ObjectCacher obc(g_ceph_context, "bench", writeback, lock, NULL, NULL,
+		   g_conf->client_oc_size,
+		   g_conf->client_oc_max_objects,
+		   g_conf->client_oc_max_dirty,
+		   g_conf->client_oc_target_dirty,
+		   g_conf->client_oc_max_dirty_age);
+  obc.start();
+  ObjectCacher::ObjectSet oset(NULL, 0, 0);
+
+  std::vector<BenchThread*> threads;
+  for (int i = 0; i < num_threads; ++i)
+    threads.push_back(new BenchThread(&obc, &oset, &lock, conf, i + 1));
+
+  utime_t start = ceph_clock_now(g_ceph_context);
+  for (int i = 0; i < num_threads; ++i)
+    threads[i]->create();
+  uint64_t ops = 0;
+  utime_t wait, max_wait;
+  for (int i = 0; i < num_threads; ++i) {
+    threads[i]->join();
+    ops += threads[i]->get_ops();
+    wait += threads[i]->get_wait();
+    if (threads[i]->get_max_wait() > max_wait)
+      max_wait = threads[i]->get_max_wait();
+    delete threads[i];
+  }
+  utime_t dur = ceph_clock_now(g_ceph_context) - start;
+
+  // write everything back before tearing down
+  Mutex flush_lock("object_cacher_bench::flush_lock");
+  Cond cond;
+  bool done = false;
+  int r = 0;
+  Context *onfinish = new C_SafeCond(&flush_lock, &cond, &done, &r);
+  lock.Lock();
+  bool already_flushed = obc.commit_set(&oset, onfinish);
+  lock.Unlock();
+  if (!already_flushed) {
+    flush_lock.Lock();
+    while (!done)
+      cond.Wait(flush_lock);
+    flush_lock.Unlock();
+  }
+  lock.Lock();
+  obc.release_set(&oset);
+  lock.Unlock();
+  obc.stop();
+
+  std::cout << std::setw(7) << num_threads
+	    << std::setw(12) << (uint64_t)(ops / (double)dur)
+	    << std::setw(14) << std::setprecision(3) << std::fixed
+	    << (double)wait * 1000000.0 / ops
+	    << std::setw(14) << (double)max_wait * 1000.0
+	    << std::endl;
+}
+
+int main(int argc, const char **argv)
+{
+  std::vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+
+  bench_config conf;
+  conf.ops_per_thread = 100000;
+  conf.num_objs = 64;
+  conf.obj_bytes = 4 << 20;
+  conf.op_bytes = 4096;
+  conf.percent_reads = 0.7;
+  int max_threads = 8;
+  long long delay_ns = 0;
+  std::ostringstream err;
+  std::vector<const char*>::iterator i;
+  for (i = args.begin(); i != args.end();) {
+    if (ceph_argparse_withlonglong(args, i, &conf.ops_per_thread, &err, "--ops", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_withlonglong(args, i, &conf.num_objs, &err, "--objects", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_withlonglong(args, i, &conf.obj_bytes, &err, "--obj-size", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_withlonglong(args, i, &conf.op_bytes, &err, "--op-size", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_withfloat(args, i, &conf.percent_reads, &err, "--percent-read", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_withint(args, i, &max_threads, &err, "--threads", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_withlonglong(args, i, &delay_ns, &err, "--delay-ns", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else {
+      cerr << "unknown option " << *i << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if (conf.op_bytes <= 0 || conf.obj_bytes < conf.op_bytes ||
+      conf.num_objs <= 0 || max_threads <= 0) {
+    cerr << argv[0] << ": invalid sizes" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "threads     ops/sec  avg wait(us)  max wait(ms)" << std::endl;
+  for (int threads = 1; threads <= max_threads; threads *= 2)
+    run(threads, conf, delay_ns);
+  return EXIT_SUCCESS;
+}
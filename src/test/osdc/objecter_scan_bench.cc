@@ -0,0 +1,184 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Measure how long the Objecter holds its lock handling a new osdmap
+ * while many ops are in flight.  Ops are submitted against a synthetic
+ * cluster through a FakeMessenger, so nothing is ever acked, and then a
+ * few kinds of map change are fed through handle_osd_map().
+ */
+
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "common/ceph_argparse.h"
+#include "common/config.h"
+#include "common/Clock.h"
+#include "common/Mutex.h"
+#include "common/Timer.h"
+#include "global/global_init.h"
+#include "include/stringify.h"
+#include "messages/MOSDMap.h"
+#include "mon/MonClient.h"
+#include "osd/OSDMap.h"
+#include "osdc/Objecter.h"
+
+#include "FakeMessenger.h"
+
+static entity_addr_t fake_osd_addr(int osd)
+{
+  entity_addr_t a;
+  a.set_family(AF_INET);
+  a.set_port(6800 + osd);
+  a.nonce = osd;
+  return a;
+}
+
+static void feed_map(Objecter &objecter, OSDMap &osdmap,
+		     OSDMap::Incremental &inc, const char *what)
+{
+  inc.fsid = osdmap.get_fsid();
+  MOSDMap *m = new MOSDMap(osdmap.get_fsid());
+  inc.encode(m->incremental_maps[inc.epoch]);
+  m->oldest_map = 1;
+  m->newest_map = inc.epoch;
+
+  utime_t start = ceph_clock_now(g_ceph_context);
+  objecter.handle_osd_map(m);
+  utime_t dur = ceph_clock_now(g_ceph_context) - start;
+
+  std::cout << std::setw(24) << what << "  epoch " << osdmap.get_epoch()
+	    << "  " << dur << " sec" << std::endl;
+}
+
+int main(int argc, const char **argv)
+{
+  std::vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+
+  long long num_ops = 100000;
+  int num_osds = 32;
+  int pg_bits = 6;
+  std::ostringstream err;
+  std::vector<const char*>::iterator i;
+  for (i = args.begin(); i != args.end();) {
+    if (ceph_argparse_withlonglong(args, i, &num_ops, &err, "--ops", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_withint(args, i, &num_osds, &err, "--osds", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_withint(args, i, &pg_bits, &err, "--pg-bits", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else {
+      cerr << "unknown option " << *i << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // a cluster with every osd up and in
+  OSDMap osdmap;
+  uuid_d fsid;
+  fsid.generate_random();
+  osdmap.build_simple(g_ceph_context, 0, fsid, num_osds, pg_bits, pg_bits);
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.fsid = fsid;
+    for (int o = 0; o < num_osds; ++o) {
+      inc.new_up_client[o] = fake_osd_addr(o);
+      inc.new_weight[o] = CEPH_OSD_IN;
+    }
+    osdmap.apply_incremental(inc);
+  }
+
+  FakeMessenger messenger(g_ceph_context, entity_name_t::CLIENT(-1));
+  MonClient monc(g_ceph_context);
+  monc.monmap.fsid = fsid;
+  Mutex lock("objecter_scan_bench::lock");
+  SafeTimer timer(g_ceph_context, lock);
+  timer.init();
+
+  Objecter objecter(g_ceph_context, &messenger, &monc, &osdmap, lock, timer);
+  objecter.set_client_incarnation(0);
+  objecter.init_unlocked();
+
+  lock.Lock();
+  // pretend we already asked for the next map so that the objecter
+  // does not go looking for a monitor
+  monc.sub_want("osdmap", osdmap.get_epoch() + 1, CEPH_SUBSCRIBE_ONETIME);
+  objecter.init_locked();
+
+  std::cout << "submitting " << num_ops << " ops to " << num_osds
+	    << " osds, " << (num_osds << pg_bits) << " pgs" << std::endl;
+  object_locator_t oloc(osdmap.lookup_pg_pool_name("data"));
+  SnapContext snapc;
+  bufferlist bl;
+  bl.append("x");
+  utime_t start = ceph_clock_now(g_ceph_context);
+  for (long long n = 0; n < num_ops; ++n)
+    objecter.write(object_t("obj" + stringify(n)), oloc, 0, bl.length(), snapc,
+		   bl, start, 0, NULL, NULL);
+  std::cout << "submitted in " << ceph_clock_now(g_ceph_context) - start
+	    << " sec, " << messenger.get_num_sent() << " sent" << std::endl;
+
+  // an epoch that moves nothing
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_up_thru[0] = osdmap.get_epoch();
+    feed_map(objecter, osdmap, inc, "up_thru only");
+  }
+
+  // an epoch that may move things but moves nothing we have in flight
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_pool_max = osdmap.get_pool_max() + 1;
+    pg_pool_t &pool = inc.new_pools[inc.new_pool_max];
+    pool.type = pg_pool_t::TYPE_REP;
+    pool.size = g_conf->osd_pool_default_size;
+    pool.crush_ruleset = CEPH_DATA_RULE;
+    pool.object_hash = CEPH_STR_HASH_RJENKINS;
+    pool.set_pg_num(1 << pg_bits);
+    pool.set_pgp_num(1 << pg_bits);
+    inc.new_pool_names[inc.new_pool_max] = "bench";
+    feed_map(objecter, osdmap, inc, "new pool");
+  }
+
+  // one osd goes down, then comes back
+  uint64_t sent = messenger.get_num_sent();
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_state[0] = CEPH_OSD_UP;
+    feed_map(objecter, osdmap, inc, "osd.0 down");
+  }
+  std::cout << std::setw(24) << "" << "  resent "
+	    << messenger.get_num_sent() - sent << " ops" << std::endl;
+  sent = messenger.get_num_sent();
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_up_client[0] = fake_osd_addr(0);
+    feed_map(objecter, osdmap, inc, "osd.0 up");
+  }
+  std::cout << std::setw(24) << "" << "  resent "
+	    << messenger.get_num_sent() - sent << " ops" << std::endl;
+
+  objecter.shutdown_locked();
+  lock.Unlock();
+  objecter.shutdown_unlocked();
+
+  lock.Lock();
+  timer.shutdown();
+  lock.Unlock();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,175 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Measure the rgw metadata cache (ObjectCache) with many request
+ * threads looking objects up at once, the way RGWProcess workers look
+ * up bucket and user info.  Each lookup that misses fills the cache,
+ * with a negative entry for objects that do not exist.  Runs with an
+ * increasing number of cache shards and reports the throughput and the
+ * hit rate.
+ */
+
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "common/ceph_argparse.h"
+#include "common/config.h"
+#include "common/Clock.h"
+#include "common/Thread.h"
+#include "global/global_init.h"
+#include "include/stringify.h"
+#include "rgw/rgw_cache.h"
+
+struct bench_config {
+  long long ops_per_thread;
+  long long num_objs;
+  long long obj_bytes;
+  float percent_missing;
+};
+
+class BenchThread : public Thread {
+public:
+  BenchThread(ObjectCache *cache, const bench_config &conf, unsigned seed)
+    : m_cache(cache), m_conf(conf), m_seed(seed), m_ops(0) {}
+
+  void *entry() {
+    bufferptr bp(m_conf.obj_bytes);
+    bp.zero();
+
+    for (long long i = 0; i < m_conf.ops_per_thread; ++i) {
+      long long n = rand_r(&m_seed) % m_conf.num_objs;
+      // the first percent_missing of the objects do not exist
+      bool missing = n < m_conf.percent_missing * m_conf.num_objs;
+      std::string name = ".rgw+bucket" + stringify(n);
+      int obj_class = (n % 2 ? RGW_CACHE_CLASS_BUCKET : RGW_CACHE_CLASS_USER);
+
+      ObjectCacheInfo info;
+      if (m_cache->get(name, info, CACHE_FLAG_XATTRS | CACHE_FLAG_DATA, obj_class) < 0) {
+	if (missing) {
+	  info.status = -ENOENT;
+	} else {
+	  info.status = 0;
+	  info.flags = CACHE_FLAG_XATTRS | CACHE_FLAG_DATA;
+	  info.data.append(bp);
+	}
+	m_cache->put(name, info, obj_class);
+      }
+      m_ops++;
+    }
+    return 0;
+  }
+
+  uint64_t get_ops() const { return m_ops; }
+
+private:
+  ObjectCache *m_cache;
+  bench_config m_conf;
+  unsigned m_seed;
+  uint64_t m_ops;
+};
+
+static void run(int num_shards, int num_threads, const bench_config &conf)
+{
+  g_ceph_context->_conf->set_val("rgw_cache_shards", stringify(num_shards).c_str());
+  ObjectCache cache;
+  cache.set_ctx(g_ceph_context);
+
+  uint64_t hits = perfcounter->get(l_rgw_cache_hit);
+  uint64_t misses = perfcounter->get(l_rgw_cache_miss);
+
+  std::vector<BenchThread*> threads;
+  for (int i = 0; i < num_threads; ++i)
+    threads.push_back(new BenchThread(&cache, conf, i + 1));
+
+  utime_t start = ceph_clock_now(g_ceph_context);
+  for (int i = 0; i < num_threads; ++i)
+    threads[i]->create();
+  uint64_t ops = 0;
+  for (int i = 0; i < num_threads; ++i) {
+    threads[i]->join();
+    ops += threads[i]->get_ops();
+    delete threads[i];
+  }
+  utime_t dur = ceph_clock_now(g_ceph_context) - start;
+
+  hits = perfcounter->get(l_rgw_cache_hit) - hits;
+  misses = perfcounter->get(l_rgw_cache_miss) - misses;
+
+  std::cout << std::setw(6) << num_shards
+	    << std::setw(12) << (uint64_t)(ops / (double)dur)
+	    << std::setw(11) << std::setprecision(1) << std::fixed
+	    << (hits + misses ? 100.0 * hits / (hits + misses) : 0.0)
+	    << std::endl;
+}
+
+int main(int argc, const char **argv)
+{
+  std::vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+
+  bench_config conf;
+  conf.ops_per_thread = 100000;
+  conf.num_objs = 5000;
+  conf.obj_bytes = 512;
+  conf.percent_missing = 0.1;
+  int num_threads = 64;
+  int max_shards = 64;
+  std::ostringstream err;
+  std::vector<const char*>::iterator i;
+  for (i = args.begin(); i != args.end();) {
+    if (ceph_argparse_withlonglong(args, i, &conf.ops_per_thread, &err, "--ops", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_withlonglong(args, i, &conf.num_objs, &err, "--objects", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_withlonglong(args, i, &conf.obj_bytes, &err, "--obj-size", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_withfloat(args, i, &conf.percent_missing, &err, "--percent-missing", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_withint(args, i, &num_threads, &err, "--threads", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_withint(args, i, &max_shards, &err, "--shards", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else {
+      cerr << "unknown option " << *i << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if (conf.num_objs <= 0 || conf.obj_bytes < 0 ||
+      num_threads <= 0 || max_shards <= 0) {
+    cerr << argv[0] << ": invalid sizes" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  rgw_perf_start(g_ceph_context);
+
+  std::cout << "shards     ops/sec  hit rate%" << std::endl;
+  for (int shards = 1; shards <= max_shards; shards *= 2)
+    run(shards, num_threads, conf);
+
+  rgw_perf_stop(g_ceph_context);
+  return EXIT_SUCCESS;
+}
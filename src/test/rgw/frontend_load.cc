@@ -0,0 +1,596 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Load a radosgw through its FastCGI socket (standing in for the web
+ * server in front of it), through its embedded HTTP frontend, or both
+ * one after the other, to compare them.  Each of --concurrency threads
+ * keeps one request going at a time for --duration seconds: a new
+ * connection per request for FastCGI, a keep-alive connection for HTTP
+ * (unless --no-keepalive).  Reports requests/sec, throughput, latency
+ * percentiles and the HTTP statuses seen, per frontend.
+ *
+ * The requests are anonymous, so use a public-read object for GETs and
+ * a public-read-write bucket for PUTs (or expect 403s, which still
+ * exercise everything up to authorization).
+ */
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "common/ceph_argparse.h"
+#include "common/config.h"
+#include "common/Clock.h"
+#include "common/Thread.h"
+#include "common/errno.h"
+#include "global/global_context.h"
+#include "global/global_init.h"
+#include "include/stringify.h"
+
+#define FCGI_VERSION_1 1
+#define FCGI_BEGIN_REQUEST 1
+#define FCGI_END_REQUEST 3
+#define FCGI_PARAMS 4
+#define FCGI_STDIN 5
+#define FCGI_STDOUT 6
+#define FCGI_RESPONDER 1
+#define FCGI_MAX_CONTENT 65535
+
+struct load_config {
+  std::string socket_path;
+  std::string http_host;
+  std::string http_port;
+  bool keepalive;
+  std::string method;
+  std::string uri;
+  std::string host;
+  std::string body;
+  utime_t end;
+};
+
+static int write_full(int fd, const char *p, size_t left)
+{
+  while (left) {
+    ssize_t w = ::send(fd, p, left, MSG_NOSIGNAL);
+    if (w < 0) {
+      if (errno == EINTR)
+	continue;
+      return -errno;
+    }
+    p += w;
+    left -= w;
+  }
+  return 0;
+}
+
+static int read_full(int fd, char *buf, size_t len)
+{
+  while (len) {
+    ssize_t r = ::read(fd, buf, len);
+    if (r < 0) {
+      if (errno == EINTR)
+	continue;
+      return -errno;
+    }
+    if (r == 0)
+      return -EPIPE;
+    buf += r;
+    len -= r;
+  }
+  return 0;
+}
+
+static void add_record(std::string &out, int type, const std::string &content)
+{
+  char h[8];
+  h[0] = FCGI_VERSION_1;
+  h[1] = type;
+  h[2] = 0;  // request id 1
+  h[3] = 1;
+  h[4] = (content.size() >> 8) & 0xff;
+  h[5] = content.size() & 0xff;
+  h[6] = 0;  // padding
+  h[7] = 0;
+  out.append(h, sizeof(h));
+  out.append(content);
+}
+
+static void add_length(std::string &out, size_t len)
+{
+  if (len < 128) {
+    out.push_back((char)len);
+  } else {
+    out.push_back((char)(((len >> 24) & 0x7f) | 0x80));
+    out.push_back((char)((len >> 16) & 0xff));
+    out.push_back((char)((len >> 8) & 0xff));
+    out.push_back((char)(len & 0xff));
+  }
+}
+
+static void add_param(std::string &params, const std::string &name,
+		      const std::string &val)
+{
+  add_length(params, name.size());
+  add_length(params, val.size());
+  params.append(name);
+  params.append(val);
+}
+
+static std::string build_fcgi_request(const load_config &conf)
+{
+  std::string out;
+
+  std::string begin(8, '\0');
+  begin[1] = FCGI_RESPONDER;
+  add_record(out, FCGI_BEGIN_REQUEST, begin);
+
+  std::string path = conf.uri, query;
+  size_t pos = path.find('?');
+  if (pos != std::string::npos) {
+    query = path.substr(pos + 1);
+    path = path.substr(0, pos);
+  }
+
+  std::string params;
+  add_param(params, "REQUEST_METHOD", conf.method);
+  add_param(params, "REQUEST_URI", conf.uri);
+  add_param(params, "SCRIPT_URI", path);
+  add_param(params, "QUERY_STRING", query);
+  add_param(params, "HTTP_HOST", conf.host);
+  add_param(params, "SERVER_PORT", "80");
+  if (!conf.body.empty())
+    add_param(params, "CONTENT_LENGTH", stringify(conf.body.size()));
+  add_record(out, FCGI_PARAMS, params);
+  add_record(out, FCGI_PARAMS, "");
+  for (size_t ofs = 0; ofs < conf.body.size(); ofs += FCGI_MAX_CONTENT)
+    add_record(out, FCGI_STDIN, conf.body.substr(ofs, FCGI_MAX_CONTENT));
+  add_record(out, FCGI_STDIN, "");
+  return out;
+}
+
+static std::string build_http_request(const load_config &conf)
+{
+  std::string out = conf.method + " " + conf.uri + " HTTP/1.1\r\n";
+  out += "Host: " + conf.host + "\r\n";
+  if (!conf.body.empty() || conf.method == "PUT" || conf.method == "POST")
+    out += "Content-Length: " + stringify(conf.body.size()) + "\r\n";
+  if (!conf.keepalive)
+    out += "Connection: close\r\n";
+  out += "\r\n";
+  out += conf.body;
+  return out;
+}
+
+/// one FastCGI request; returns the http status, or a negative error code
+static int do_fcgi_request(const load_config &conf, const std::string &req,
+			   uint64_t *bytes)
+{
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -errno;
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, conf.socket_path.c_str(), sizeof(addr.sun_path) - 1);
+  if (::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    int r = -errno;
+    ::close(fd);
+    return r;
+  }
+
+  int r = write_full(fd, req.data(), req.size());
+
+  std::string head;  // the start of stdout, to find the status in
+  int status = 200;
+  *bytes = 0;
+  while (r == 0) {
+    unsigned char h[8];
+    r = read_full(fd, (char *)h, sizeof(h));
+    if (r < 0)
+      break;
+    size_t len = (h[4] << 8) | h[5];
+    std::vector<char> content(len + h[6]);
+    if (!content.empty()) {
+      r = read_full(fd, &content[0], content.size());
+      if (r < 0)
+	break;
+    }
+    if (h[1] == FCGI_STDOUT) {
+      *bytes += len;
+      if (head.size() < 4096)
+	head.append(&content[0], len);
+    } else if (h[1] == FCGI_END_REQUEST) {
+      break;
+    }
+  }
+  ::close(fd);
+  if (r < 0)
+    return r;
+
+  size_t pos = head.find("Status: ");
+  if (pos != std::string::npos)
+    status = atoi(head.c_str() + pos + 8);
+  return status;
+}
+
+/// an http client connection, with what was read past the last response
+struct http_conn {
+  int fd;
+  std::string buf;
+
+  http_conn() : fd(-1) {}
+  ~http_conn() { close(); }
+
+  void close() {
+    if (fd >= 0)
+      ::close(fd);
+    fd = -1;
+    buf.clear();
+  }
+
+  int connect(const load_config &conf) {
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(conf.http_host.c_str(), conf.http_port.c_str(), &hints, &res) != 0)
+      return -EINVAL;
+    fd = ::socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd < 0) {
+      freeaddrinfo(res);
+      return -errno;
+    }
+    int r = 0;
+    if (::connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+      r = -errno;
+      close();
+    }
+    freeaddrinfo(res);
+    if (r == 0) {
+      int on = 1;
+      ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    return r;
+  }
+
+  int fill() {
+    char b[65536];
+    for (;;) {
+      ssize_t r = ::read(fd, b, sizeof(b));
+      if (r < 0) {
+	if (errno == EINTR)
+	  continue;
+	return -errno;
+      }
+      if (r == 0)
+	return -EPIPE;
+      buf.append(b, r);
+      return 0;
+    }
+  }
+
+  int read_line(std::string *line) {
+    for (;;) {
+      size_t nl = buf.find("\r\n");
+      if (nl != std::string::npos) {
+	*line = buf.substr(0, nl);
+	buf.erase(0, nl + 2);
+	return 0;
+      }
+      int r = fill();
+      if (r < 0)
+	return r;
+    }
+  }
+
+  int skip(uint64_t len) {
+    while (len) {
+      if (buf.empty()) {
+	int r = fill();
+	if (r < 0)
+	  return r;
+      }
+      size_t n = std::min((uint64_t)buf.size(), len);
+      buf.erase(0, n);
+      len -= n;
+    }
+    return 0;
+  }
+
+  int read_until_close(uint64_t *bytes) {
+    *bytes += buf.size();
+    buf.clear();
+    for (;;) {
+      int r = fill();
+      if (r == -EPIPE)
+	return 0;
+      if (r < 0)
+	return r;
+      *bytes += buf.size();
+      buf.clear();
+    }
+  }
+};
+
+/// one request on an http connection; returns the http status, or a negative error code
+static int do_http_request(const load_config &conf, http_conn &conn,
+			   const std::string &req, bool head_request, uint64_t *bytes)
+{
+  int r;
+  *bytes = 0;
+
+  if (conn.fd < 0) {
+    r = conn.connect(conf);
+    if (r < 0)
+      return r;
+  }
+
+  r = write_full(conn.fd, req.data(), req.size());
+  if (r < 0)
+    goto fail;
+
+  {
+    std::string line;
+    r = conn.read_line(&line);
+    if (r < 0)
+      goto fail;
+    int status = 0;
+    size_t sp = line.find(' ');
+    if (sp != std::string::npos)
+      status = atoi(line.c_str() + sp + 1);
+
+    bool has_length = false, chunked = false, close = !conf.keepalive;
+    uint64_t length = 0;
+    for (;;) {
+      r = conn.read_line(&line);
+      if (r < 0)
+	goto fail;
+      if (line.empty())
+	break;
+      if (strncasecmp(line.c_str(), "Content-Length:", 15) == 0) {
+	has_length = true;
+	length = strtoull(line.c_str() + 15, NULL, 10);
+      } else if (strncasecmp(line.c_str(), "Transfer-Encoding:", 18) == 0) {
+	chunked = (strcasestr(line.c_str() + 18, "chunked") != NULL);
+      } else if (strncasecmp(line.c_str(), "Connection:", 11) == 0) {
+	if (strcasestr(line.c_str() + 11, "close"))
+	  close = true;
+      }
+    }
+
+    if (head_request || status == 204 || status == 304) {
+      // no body
+    } else if (chunked) {
+      for (;;) {
+	r = conn.read_line(&line);
+	if (r < 0)
+	  goto fail;
+	uint64_t len = strtoull(line.c_str(), NULL, 16);
+	if (!len)
+	  break;
+	r = conn.skip(len + 2);
+	if (r < 0)
+	  goto fail;
+	*bytes += len;
+      }
+      do {
+	r = conn.read_line(&line);
+	if (r < 0)
+	  goto fail;
+      } while (!line.empty());
+    } else if (has_length) {
+      r = conn.skip(length);
+      if (r < 0)
+	goto fail;
+      *bytes += length;
+    } else {
+      r = conn.read_until_close(bytes);
+      if (r < 0)
+	goto fail;
+      close = true;
+    }
+
+    if (close)
+      conn.close();
+    return status;
+  }
+
+fail:
+  conn.close();
+  return r;
+}
+
+class LoadThread : public Thread {
+public:
+  LoadThread(const load_config &conf, bool http)
+    : m_conf(conf), m_http(http), m_bytes(0) {}
+
+  void *entry() {
+    std::string req = (m_http ? build_http_request(m_conf) : build_fcgi_request(m_conf));
+    bool head_request = (m_conf.method == "HEAD");
+    http_conn conn;
+    while (ceph_clock_now(g_ceph_context) < m_conf.end) {
+      utime_t start = ceph_clock_now(g_ceph_context);
+      uint64_t bytes;
+      int r;
+      if (m_http)
+	r = do_http_request(m_conf, conn, req, head_request, &bytes);
+      else
+	r = do_fcgi_request(m_conf, req, &bytes);
+      m_latencies.push_back(ceph_clock_now(g_ceph_context) - start);
+      m_statuses[r]++;
+      m_bytes += bytes;
+    }
+    return 0;
+  }
+
+  const load_config &m_conf;
+  bool m_http;
+  std::vector<double> m_latencies;
+  std::map<int, uint64_t> m_statuses;
+  uint64_t m_bytes;
+};
+
+static double percentile(const std::vector<double> &sorted, double p)
+{
+  if (sorted.empty())
+    return 0;
+  size_t i = (size_t)(p * (sorted.size() - 1));
+  return sorted[i];
+}
+
+static void run(load_config &conf, bool http, int concurrency, int duration)
+{
+  utime_t start = ceph_clock_now(g_ceph_context);
+  conf.end = start;
+  conf.end += duration;
+
+  std::vector<LoadThread*> threads;
+  for (int n = 0; n < concurrency; ++n) {
+    LoadThread *t = new LoadThread(conf, http);
+    // small stacks, so that thousands of threads fit
+    int r = t->try_create(64 << 10);
+    if (r != 0) {
+      cerr << "could only start " << n << " threads: " << cpp_strerror(r) << std::endl;
+      delete t;
+      break;
+    }
+    threads.push_back(t);
+  }
+
+  std::vector<double> latencies;
+  std::map<int, uint64_t> statuses;
+  uint64_t bytes = 0;
+  for (std::vector<LoadThread*>::iterator t = threads.begin(); t != threads.end(); ++t) {
+    (*t)->join();
+    latencies.insert(latencies.end(), (*t)->m_latencies.begin(), (*t)->m_latencies.end());
+    for (std::map<int, uint64_t>::iterator s = (*t)->m_statuses.begin();
+	 s != (*t)->m_statuses.end(); ++s)
+      statuses[s->first] += s->second;
+    bytes += (*t)->m_bytes;
+    delete *t;
+  }
+  double dur = ceph_clock_now(g_ceph_context) - start;
+  std::sort(latencies.begin(), latencies.end());
+
+  double total = 0;
+  for (std::vector<double>::iterator l = latencies.begin(); l != latencies.end(); ++l)
+    total += *l;
+
+  const char *name = (http ? "http" : "fastcgi");
+  std::cout << std::setprecision(3) << std::fixed;
+  std::cout << name << ": " << conf.method << " " << conf.uri
+	    << ", concurrency " << threads.size() << ", " << latencies.size()
+	    << " requests in " << dur << " s" << std::endl;
+  std::cout << name << ": requests/sec " << latencies.size() / dur
+	    << ", MB/sec " << bytes / dur / (1 << 20) << std::endl;
+  if (!latencies.empty()) {
+    std::cout << name << ": latency ms: avg " << total / latencies.size() * 1000
+	      << " p50 " << percentile(latencies, 0.5) * 1000
+	      << " p90 " << percentile(latencies, 0.9) * 1000
+	      << " p99 " << percentile(latencies, 0.99) * 1000
+	      << " max " << latencies.back() * 1000 << std::endl;
+  }
+  for (std::map<int, uint64_t>::iterator s = statuses.begin(); s != statuses.end(); ++s) {
+    if (s->first < 0)
+      std::cout << name << ": error " << cpp_strerror(s->first) << ": " << s->second << std::endl;
+    else
+      std::cout << name << ": status " << s->first << ": " << s->second << std::endl;
+  }
+}
+
+int main(int argc, const char **argv)
+{
+  std::vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+
+  load_config conf;
+  conf.keepalive = true;
+  conf.method = "GET";
+  conf.host = "localhost";
+  std::string http;
+  int concurrency = 256;
+  int duration = 10;
+  int size = 4096;
+  std::string val;
+  std::ostringstream err;
+  std::vector<const char*>::iterator i;
+  for (i = args.begin(); i != args.end();) {
+    if (ceph_argparse_witharg(args, i, &val, "--socket", (char*)NULL)) {
+      conf.socket_path = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--http", (char*)NULL)) {
+      http = val;
+    } else if (ceph_argparse_flag(args, i, "--no-keepalive", (char*)NULL)) {
+      conf.keepalive = false;
+    } else if (ceph_argparse_witharg(args, i, &val, "--method", (char*)NULL)) {
+      conf.method = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--uri", (char*)NULL)) {
+      conf.uri = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--host", (char*)NULL)) {
+      conf.host = val;
+    } else if (ceph_argparse_withint(args, i, &size, &err, "--size", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_withint(args, i, &concurrency, &err, "--concurrency", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_withint(args, i, &duration, &err, "--duration", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else {
+      cerr << "unknown option " << *i << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if (!http.empty()) {
+    size_t pos = http.rfind(':');
+    if (pos == std::string::npos) {
+      conf.http_host = http;
+      conf.http_port = "7480";
+    } else {
+      conf.http_host = http.substr(0, pos);
+      conf.http_port = http.substr(pos + 1);
+    }
+  }
+  if ((conf.socket_path.empty() && http.empty()) || conf.uri.empty() ||
+      concurrency <= 0 || duration <= 0 || size < 0) {
+    cerr << "usage: " << argv[0] << " [--socket <rgw socket path>] [--http <host>[:7480]]"
+	 << " --uri /<bucket>/<object>"
+	 << " [--method GET] [--size 4096 (PUT)] [--host localhost] [--no-keepalive]"
+	 << " [--concurrency 256] [--duration 10]" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (conf.method == "PUT" || conf.method == "POST")
+    conf.body.assign(size, 'x');
+
+  if (!conf.socket_path.empty())
+    run(conf, false, concurrency, duration);
+  if (!http.empty())
+    run(conf, true, concurrency, duration);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,173 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Measure the MD5 of uploads (RGWPutObjHasher) with and without hash
+ * threads.  Each stream plays a PUT: it hands --chunk bytes at a time
+ * to its hasher, then spends --io-us on what the request thread does
+ * with a chunk besides hashing it (reading it from the client, writing
+ * it to rados).  Runs with no hash threads, then with 1, 2, 4, ... up to
+ * --threads, and reports the throughput, the time of one upload and the
+ * cpu time the whole process took per GB hashed.
+ */
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "common/ceph_argparse.h"
+#include "common/config.h"
+#include "common/Clock.h"
+#include "common/Thread.h"
+#include "global/global_init.h"
+#include "include/stringify.h"
+#include "rgw/rgw_put_hash.h"
+
+struct bench_config {
+  long long obj_bytes;
+  long long chunk_bytes;
+  long long objs_per_stream;
+  int io_us;
+};
+
+class StreamThread : public Thread {
+public:
+  StreamThread(bufferptr& data, const bench_config &conf)
+    : m_data(data), m_conf(conf) {}
+
+  void *entry() {
+    for (long long i = 0; i < m_conf.objs_per_stream; ++i) {
+      RGWPutObjHasher hasher(g_ceph_context);
+      for (long long ofs = 0; ofs < m_conf.obj_bytes; ofs += m_conf.chunk_bytes) {
+	bufferlist bl;
+	bl.append(m_data, 0, MIN(m_conf.chunk_bytes, m_conf.obj_bytes - ofs));
+	hasher.update(bl);
+	if (m_conf.io_us)
+	  usleep(m_conf.io_us);
+      }
+      unsigned char digest[CEPH_CRYPTO_MD5_DIGESTSIZE];
+      hasher.final(digest);
+    }
+    return 0;
+  }
+
+private:
+  bufferptr m_data;
+  bench_config m_conf;
+};
+
+static double cpu_secs()
+{
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+    (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000000.0;
+}
+
+static void run(int hash_threads, int num_streams, const bench_config &conf)
+{
+  g_ceph_context->_conf->set_val("rgw_put_obj_hash_threads", stringify(hash_threads).c_str());
+  g_ceph_context->_conf->apply_changes(NULL);
+  rgw_put_hash_init(g_ceph_context);
+
+  bufferptr data(conf.chunk_bytes);
+  for (unsigned i = 0; i < data.length(); ++i)
+    data[i] = (char)i;
+
+  std::vector<StreamThread*> threads;
+  for (int i = 0; i < num_streams; ++i)
+    threads.push_back(new StreamThread(data, conf));
+
+  double cpu = cpu_secs();
+  utime_t start = ceph_clock_now(g_ceph_context);
+  for (int i = 0; i < num_streams; ++i)
+    threads[i]->create();
+  for (int i = 0; i < num_streams; ++i) {
+    threads[i]->join();
+    delete threads[i];
+  }
+  utime_t dur = ceph_clock_now(g_ceph_context) - start;
+  cpu = cpu_secs() - cpu;
+
+  rgw_put_hash_finalize();
+
+  double gb = (double)conf.obj_bytes * conf.objs_per_stream * num_streams / (1 << 30);
+  std::cout << std::setw(7) << hash_threads
+	    << std::setprecision(1) << std::fixed
+	    << std::setw(10) << gb * 1024 / (double)dur
+	    << std::setprecision(3)
+	    << std::setw(13) << (double)dur * 1000 / conf.objs_per_stream
+	    << std::setw(10) << cpu / gb
+	    << std::endl;
+}
+
+int main(int argc, const char **argv)
+{
+  std::vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+
+  bench_config conf;
+  conf.obj_bytes = 64 << 20;
+  conf.chunk_bytes = 512 << 10;
+  conf.objs_per_stream = 4;
+  conf.io_us = 0;
+  int num_streams = 1;
+  int max_threads = 4;
+  std::ostringstream err;
+  std::vector<const char*>::iterator i;
+  for (i = args.begin(); i != args.end();) {
+    if (ceph_argparse_withlonglong(args, i, &conf.obj_bytes, &err, "--obj-size", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_withlonglong(args, i, &conf.chunk_bytes, &err, "--chunk", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_withlonglong(args, i, &conf.objs_per_stream, &err, "--objects", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_withint(args, i, &conf.io_us, &err, "--io-us", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_withint(args, i, &num_streams, &err, "--streams", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_withint(args, i, &max_threads, &err, "--threads", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else {
+      cerr << "unknown option " << *i << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if (conf.obj_bytes <= 0 || conf.chunk_bytes <= 0 || conf.objs_per_stream <= 0 ||
+      conf.io_us < 0 || num_streams <= 0 || max_threads < 0) {
+    cerr << argv[0] << ": invalid sizes" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "threads      MB/s    ms/upload  cpu s/GB" << std::endl;
+  run(0, num_streams, conf);
+  for (int threads = 1; threads <= max_threads; threads *= 2)
+    run(threads, num_streams, conf);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,120 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "common/config.h"
+#include "rgw/rgw_cache.h"
+#include "test/unit.h"
+
+static void set_ttls(const char *ttl, const char *negative_ttl)
+{
+  g_ceph_context->_conf->set_val("rgw_cache_ttl", ttl);
+  g_ceph_context->_conf->set_val("rgw_cache_negative_ttl", negative_ttl);
+  g_ceph_context->_conf->apply_changes(NULL);
+}
+
+static void put_positive(ObjectCache& cache, string name, const char *data)
+{
+  ObjectCacheInfo info;
+  info.status = 0;
+  info.flags = CACHE_FLAG_DATA;
+  info.data.append(data);
+  cache.put(name, info);
+}
+
+static void put_negative(ObjectCache& cache, string name)
+{
+  ObjectCacheInfo info;
+  info.status = -ENOENT;
+  cache.put(name, info);
+}
+
+TEST(ObjectCache, NegativeHit)
+{
+  set_ttls("0", "0");
+  ObjectCache cache;
+  cache.set_ctx(g_ceph_context);
+
+  string name = "bucket+missing";
+  ObjectCacheInfo info;
+  ASSERT_EQ(-ENOENT, cache.get(name, info, CACHE_FLAG_DATA));
+
+  put_negative(cache, name);
+  // a negative entry is a hit, whatever is asked for
+  ASSERT_EQ(0, cache.get(name, info, CACHE_FLAG_DATA | CACHE_FLAG_XATTRS));
+  ASSERT_EQ(-ENOENT, info.status);
+
+  // and is replaced once the object is written
+  put_positive(cache, name, "foo");
+  ASSERT_EQ(0, cache.get(name, info, CACHE_FLAG_DATA));
+  ASSERT_EQ(0, info.status);
+  ASSERT_EQ(3u, info.data.length());
+
+  cache.remove(name);
+  ASSERT_EQ(-ENOENT, cache.get(name, info, CACHE_FLAG_DATA));
+}
+
+TEST(ObjectCache, NegativeDoesNotReplaceValid)
+{
+  set_ttls("0", "0");
+  ObjectCache cache;
+  cache.set_ctx(g_ceph_context);
+
+  string name = "bucket+obj";
+  put_positive(cache, name, "foo");
+  // a lookup that started before the write came back with ENOENT
+  put_negative(cache, name);
+
+  ObjectCacheInfo info;
+  ASSERT_EQ(0, cache.get(name, info, CACHE_FLAG_DATA));
+  ASSERT_EQ(0, info.status);
+  ASSERT_EQ(3u, info.data.length());
+}
+
+TEST(ObjectCache, TTLExpiry)
+{
+  set_ttls("1", "1");
+  ObjectCache cache;
+  cache.set_ctx(g_ceph_context);
+
+  string pos = "bucket+obj";
+  string neg = "bucket+missing";
+  put_positive(cache, pos, "foo");
+  put_negative(cache, neg);
+
+  ObjectCacheInfo info;
+  ASSERT_EQ(0, cache.get(pos, info, CACHE_FLAG_DATA));
+  ASSERT_EQ(0, cache.get(neg, info, CACHE_FLAG_DATA));
+  ASSERT_EQ(-ENOENT, info.status);
+
+  sleep(2);
+  ASSERT_EQ(-ENOENT, cache.get(pos, info, CACHE_FLAG_DATA));
+  ASSERT_EQ(-ENOENT, cache.get(neg, info, CACHE_FLAG_DATA));
+
+  // a stale positive entry can be replaced by a negative one
+  put_positive(cache, pos, "foo");
+  sleep(2);
+  put_negative(cache, pos);
+  ASSERT_EQ(0, cache.get(pos, info, CACHE_FLAG_DATA));
+  ASSERT_EQ(-ENOENT, info.status);
+}
+
+TEST(ObjectCache, NegativeTTL)
+{
+  // negative entries expire on their own ttl
+  set_ttls("0", "1");
+  ObjectCache cache;
+  cache.set_ctx(g_ceph_context);
+
+  string pos = "bucket+obj";
+  string neg = "bucket+missing";
+  put_positive(cache, pos, "foo");
+  put_negative(cache, neg);
+
+  sleep(2);
+  ObjectCacheInfo info;
+  ASSERT_EQ(0, cache.get(pos, info, CACHE_FLAG_DATA));
+  ASSERT_EQ(-ENOENT, cache.get(neg, info, CACHE_FLAG_DATA));
+}
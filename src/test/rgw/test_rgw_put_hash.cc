@@ -0,0 +1,142 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/config.h"
+#include "rgw/rgw_put_hash.h"
+#include "test/unit.h"
+
+static void start_hash_threads(const char *threads, const char *window)
+{
+  rgw_put_hash_finalize();
+  g_ceph_context->_conf->set_val("rgw_put_obj_hash_threads", threads);
+  g_ceph_context->_conf->set_val("rgw_put_obj_hash_window", window);
+  g_ceph_context->_conf->apply_changes(NULL);
+  rgw_put_hash_init(g_ceph_context);
+}
+
+static void fill(bufferptr& bp, unsigned seed)
+{
+  for (unsigned i = 0; i < bp.length(); ++i)
+    bp[i] = (char)rand_r(&seed);
+}
+
+/* the digest of data, handed to a hasher chunk_size bytes at a time */
+static string chunked_digest(bufferptr& data, unsigned chunk_size)
+{
+  RGWPutObjHasher hasher(g_ceph_context);
+  for (unsigned ofs = 0; ofs < data.length(); ofs += chunk_size) {
+    bufferlist bl;
+    bl.append(data, ofs, MIN(chunk_size, data.length() - ofs));
+    hasher.update(bl);
+  }
+  unsigned char digest[CEPH_CRYPTO_MD5_DIGESTSIZE];
+  hasher.final(digest);
+  return string((char *)digest, sizeof(digest));
+}
+
+static string inline_digest(bufferptr& data)
+{
+  MD5 hash;
+  hash.Update((const unsigned char *)data.c_str(), data.length());
+  unsigned char digest[CEPH_CRYPTO_MD5_DIGESTSIZE];
+  hash.Final(digest);
+  return string((char *)digest, sizeof(digest));
+}
+
+static const unsigned chunk_sizes[] = {
+  1, 7, 512, 4095, 4096, 65537, 1 << 20, 3 << 20, 8 << 20
+};
+
+TEST(RGWPutObjHasher, Inline)
+{
+  rgw_put_hash_finalize();
+  bufferptr data(4 << 20);
+  fill(data, 1);
+  string expected = inline_digest(data);
+  for (unsigned i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); ++i)
+    ASSERT_EQ(expected, chunked_digest(data, chunk_sizes[i]));
+}
+
+TEST(RGWPutObjHasher, Threaded)
+{
+  // the data of one upload must be hashed in order, whatever thread
+  // picks it up
+  start_hash_threads("4", "8388608");
+  bufferptr data(4 << 20);
+  fill(data, 2);
+  string expected = inline_digest(data);
+  for (unsigned i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); ++i) {
+    if (chunk_sizes[i] < 512)
+      continue; // a few million tiny updates would only be slow
+    ASSERT_EQ(expected, chunked_digest(data, chunk_sizes[i]));
+  }
+
+  // and a mix of sizes
+  RGWPutObjHasher hasher(g_ceph_context);
+  unsigned seed = 3;
+  for (unsigned ofs = 0; ofs < data.length(); ) {
+    unsigned len = MIN(1 + rand_r(&seed) % (256 << 10), data.length() - ofs);
+    bufferlist bl;
+    bl.append(data, ofs, len);
+    hasher.update(bl);
+    ofs += len;
+  }
+  unsigned char digest[CEPH_CRYPTO_MD5_DIGESTSIZE];
+  hasher.final(digest);
+  ASSERT_EQ(expected, string((char *)digest, sizeof(digest)));
+  rgw_put_hash_finalize();
+}
+
+TEST(RGWPutObjHasher, Window)
+{
+  // updates wait for the hash threads once the window is full; with a
+  // window smaller than a chunk every update waits
+  start_hash_threads("1", "1");
+  bufferptr data(4 << 20);
+  fill(data, 4);
+  string expected = inline_digest(data);
+  ASSERT_EQ(expected, chunked_digest(data, 4096));
+  ASSERT_EQ(expected, chunked_digest(data, 1 << 20));
+
+  start_hash_threads("2", "65536");
+  ASSERT_EQ(expected, chunked_digest(data, 4096));
+  ASSERT_EQ(expected, chunked_digest(data, 100000));
+  rgw_put_hash_finalize();
+}
+
+TEST(RGWPutObjHasher, DestroyPending)
+{
+  // uploads cut short go away without final(), while their data is
+  // still queued for, or being hashed by, a hash thread
+  start_hash_threads("1", "67108864");
+  bufferptr data(16 << 20);
+  fill(data, 5);
+  for (int i = 0; i < 20; ++i) {
+    RGWPutObjHasher *busy = new RGWPutObjHasher(g_ceph_context);
+    RGWPutObjHasher *queued = new RGWPutObjHasher(g_ceph_context);
+    for (int j = 0; j < 4; ++j) {
+      bufferlist bl;
+      bl.append(data, j << 22, 4 << 20);
+      busy->update(bl);
+      bufferlist bl2;
+      bl2.append(data, j << 22, 4 << 20);
+      queued->update(bl2);
+    }
+    if (i % 2) {
+      delete queued;
+      delete busy;
+    } else {
+      delete busy;
+      delete queued;
+    }
+  }
+
+  // the threads are still good for another upload
+  bufferptr small(1 << 20);
+  fill(small, 6);
+  ASSERT_EQ(inline_digest(small), chunked_digest(small, 4096));
+  rgw_put_hash_finalize();
+}
@@ -0,0 +1,111 @@
+#include "gtest/gtest.h"
+
+#include "osdc/Readahead.h"
+
+static const uint64_t NO_LIMIT = 1ull << 40;
+
+#define ASSERT_READAHEAD(off, len, extent) do {	\
+    Readahead::extent_t e = (extent);		\
+    ASSERT_EQ((uint64_t)(off), e.first);	\
+    ASSERT_EQ((uint64_t)(len), e.second);	\
+  } while (0)
+
+#define ASSERT_NO_READAHEAD(extent) do {	\
+    Readahead::extent_t e = (extent);		\
+    ASSERT_EQ(0u, e.second);			\
+  } while (0)
+
+TEST(Readahead, Trigger)
+{
+  Readahead r;
+  r.set_trigger_requests(4);
+  r.set_min_readahead_size(4096);
+  r.set_max_readahead_size(65536);
+
+  ASSERT_NO_READAHEAD(r.update(0, 4096, NO_LIMIT));
+  ASSERT_NO_READAHEAD(r.update(4096, 4096, NO_LIMIT));
+  ASSERT_NO_READAHEAD(r.update(8192, 4096, NO_LIMIT));
+  ASSERT_READAHEAD(16384, 16384, r.update(12288, 4096, NO_LIMIT));
+}
+
+TEST(Readahead, Grow)
+{
+  Readahead r;
+  r.set_trigger_requests(1);
+  r.set_min_readahead_size(4096);
+  r.set_max_readahead_size(65536);
+
+  ASSERT_READAHEAD(4096, 4096, r.update(0, 4096, NO_LIMIT));
+  // halfway into the window: the next one starts where it ended
+  ASSERT_READAHEAD(8192, 8192, r.update(4096, 2048, NO_LIMIT));
+  ASSERT_NO_READAHEAD(r.update(6144, 2048, NO_LIMIT));
+  ASSERT_READAHEAD(16384, 16384, r.update(8192, 4096, NO_LIMIT));
+  ASSERT_NO_READAHEAD(r.update(12288, 4096, NO_LIMIT));
+  ASSERT_READAHEAD(32768, 32768, r.update(16384, 8192, NO_LIMIT));
+  // capped at the maximum
+  ASSERT_READAHEAD(65536, 65536, r.update(24576, 24576, NO_LIMIT));
+  // the reader went past the window: start after the read
+  ASSERT_READAHEAD(131072, 65536, r.update(49152, 65536, NO_LIMIT));
+  ASSERT_READAHEAD(200000, 65536, r.update(114688, 85312, NO_LIMIT));
+}
+
+TEST(Readahead, Reset)
+{
+  Readahead r;
+  r.set_trigger_requests(2);
+  r.set_min_readahead_size(4096);
+  r.set_max_readahead_size(65536);
+
+  ASSERT_NO_READAHEAD(r.update(0, 4096, NO_LIMIT));
+  ASSERT_READAHEAD(8192, 8192, r.update(4096, 4096, NO_LIMIT));
+  // a random read starts over
+  ASSERT_NO_READAHEAD(r.update(1 << 20, 4096, NO_LIMIT));
+  ASSERT_NO_READAHEAD(r.update((1 << 20) + 4096, 4096, NO_LIMIT));
+  ASSERT_READAHEAD((1 << 20) + 12288, 12288,
+	    r.update((1 << 20) + 8192, 4096, NO_LIMIT));
+}
+
+TEST(Readahead, Disabled)
+{
+  Readahead r;
+  r.set_trigger_requests(1);
+  r.set_min_readahead_size(4096);
+  r.set_max_readahead_size(0);
+
+  ASSERT_NO_READAHEAD(r.update(0, 4096, NO_LIMIT));
+  ASSERT_NO_READAHEAD(r.update(4096, 4096, NO_LIMIT));
+}
+
+TEST(Readahead, Align)
+{
+  Readahead r;
+  r.set_trigger_requests(1);
+  r.set_min_readahead_size(4096);
+  r.set_max_readahead_size(1 << 20);
+  vector<uint64_t> alignments;
+  alignments.push_back(65536);
+  alignments.push_back(4096);
+  r.set_alignments(alignments);
+
+  // too short to reach the next object: fall back to the smaller alignment
+  ASSERT_READAHEAD(10000, 6384, r.update(0, 10000, NO_LIMIT));
+
+  Readahead r2;
+  r2.set_trigger_requests(1);
+  r2.set_min_readahead_size(4096);
+  r2.set_max_readahead_size(1 << 20);
+  r2.set_alignments(alignments);
+  ASSERT_READAHEAD(40000, 25536, r2.update(0, 40000, NO_LIMIT));
+}
+
+TEST(Readahead, Limit)
+{
+  Readahead r;
+  r.set_trigger_requests(1);
+  r.set_min_readahead_size(4096);
+  r.set_max_readahead_size(65536);
+
+  ASSERT_READAHEAD(4096, 1000, r.update(0, 4096, 5096));
+  // nothing left to read ahead
+  ASSERT_NO_READAHEAD(r.update(4096, 1000, 5096));
+}
@@ -0,0 +1,67 @@
+#!/bin/bash -x
+
+#
+# Measure recovery throughput for a pool full of small objects, with
+# and without batched (packed) pushes.
+#
+
+# Includes
+source "`dirname $0`/test_common.sh"
+
+# Functions
+setup() {
+        export CEPH_NUM_OSD=$1
+        vstart_config=$2
+
+        # Start ceph
+        ./stop.sh
+
+        ./vstart.sh -d -n -o "$vstart_config" || die "vstart failed"
+}
+
+recover_small_objects_impl() {
+        label=$1
+
+        # Take down osd1 so that everything we write is missing there
+        stop_osd 1
+
+        # Write lots of small objects
+        ./rados -c ./ceph.conf -p data bench 60 write -b 4096 -t 16 \
+                --no-cleanup || die "rados bench failed"
+
+        # Bring up osd1 and let it peer without recovering
+        restart_osd 1
+        sleep 15
+
+        poll_cmd "./ceph pg debug degraded_pgs_exist" TRUE 3 120
+        [ $? -eq 1 ] || die "Failed to see degraded PGs."
+
+        num_objs=`./rados -c ./ceph.conf -p data ls | wc -l`
+
+        start=`date +%s`
+        start_recovery 2
+        poll_cmd "./ceph pg debug degraded_pgs_exist" FALSE 1 3600
+        [ $? -eq 1 ] || die "Recovery never finished."
+        end=`date +%s`
+
+        elapsed=$(($end - $start))
+        [ $elapsed -gt 0 ] || elapsed=1
+        echo "$label: recovered $num_objs objects in $elapsed seconds" \
+             "($(($num_objs / $elapsed)) objects/sec)"
+}
+
+recover_small_objects() {
+        setup 2 'osd recovery delay start = 10000
+osd recovery batch ops = false'
+        recover_small_objects_impl "unbatched"
+
+        setup 2 'osd recovery delay start = 10000
+osd recovery batch ops = true'
+        recover_small_objects_impl "batched"
+}
+
+run() {
+        recover_small_objects || die "test failed"
+}
+
+$@